@@ -22,6 +22,7 @@ $(OUT_PATH)/$(SRC_PATH)/eeprom.o \
 $(OUT_PATH)/$(SRC_PATH)/zigbee.o \
 $(OUT_PATH)/$(SRC_PATH)/comms.o \
 $(OUT_PATH)/$(SRC_PATH)/drawing.o \
+$(OUT_PATH)/$(SRC_PATH)/compression.o \
 $(OUT_PATH)/$(SRC_PATH)/syncedproto.o \
 $(OUT_PATH)/$(SRC_PATH)/wdt.o \
 $(OUT_PATH)/$(SRC_PATH)/powermgt.o \
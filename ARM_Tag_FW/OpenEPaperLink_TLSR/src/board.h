@@ -28,4 +28,7 @@
 //hw types
 #define HW_TYPE					        0x60
 
+//reported to the AP, which only sends compressed images from the version set in the tag type
+#define FW_VERSION				        0x0027
+
 #endif
@@ -0,0 +1,439 @@
+#include "compression.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include "tl_common.h"
+#include "eeprom.h"
+#include "proto.h"
+#include "screen.h"
+
+// a line has at most SCREEN_WIDTH color changes, plus the terminators
+#define MAX_IMAGE_FLIPS (SCREEN_WIDTH + 8)
+#include "Group5.h"
+#include "g5dec.inl"
+
+#define LINE_BYTES (SCREEN_WIDTH / 8)
+#define IMAGE_HEADER_SIZE 6
+
+// the AP compresses with a 4k dictionary, and says so in the zlib header
+#define INFLATE_WINDOW_SIZE 4096
+#define INFLATE_INPUT_SIZE 256
+
+// worst case size of one G5 line, same as the encoder on the AP allows for
+#define G5_LINE_MAX (SCREEN_WIDTH * 2 + 64)
+#define G5_BUFFER_SIZE (G5_LINE_MAX * 2)
+
+#define BLOCK_NONE 0
+#define BLOCK_STORED 1
+#define BLOCK_HUFFMAN 2
+
+struct huffTable
+{
+    uint16_t counts[16];
+    uint16_t symbols[288];
+};
+
+struct inflateState
+{
+    uint8_t window[INFLATE_WINDOW_SIZE];
+    uint8_t input[INFLATE_INPUT_SIZE];
+    uint16_t inputPos;
+    uint16_t inputLen;
+    uint32_t bitBuf;
+    uint8_t bitCount;
+    uint32_t outCount;
+    uint16_t copyLeft;
+    uint16_t copyDist;
+    uint16_t storedLeft;
+    uint8_t blockType;
+    bool lastBlock;
+    struct huffTable lit;
+    struct huffTable dist;
+};
+
+struct g5State
+{
+    G5DECIMAGE dec;
+    uint8_t input[G5_BUFFER_SIZE + 4]; // TIFFMOTOLONG reads 4 bytes ahead
+    uint16_t inputLen;
+};
+
+// only one of them is in use at a time. Aligned, as the G5 decoder walks its flips with plain pointers
+static union
+{
+    struct inflateState inf;
+    struct g5State g5;
+} state __attribute__((aligned(4)));
+
+static uint32_t readAddr;
+static uint32_t readEnd;
+static uint8_t openType;
+static bool failed;
+
+static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t codeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// reads up to len bytes of image data, the rest is zero-filled
+static uint32_t readData(uint8_t *dst, uint32_t len)
+{
+    uint32_t avail = (readAddr < readEnd) ? readEnd - readAddr : 0;
+    if (len > avail)
+    {
+        memset(dst + avail, 0, len - avail);
+        len = avail;
+    }
+    if (len)
+        eepromRead(readAddr, dst, len);
+    readAddr += len;
+    return len;
+}
+
+static uint8_t inflateInputByte(void)
+{
+    struct inflateState *s = &state.inf;
+    if (s->inputPos == s->inputLen)
+    {
+        s->inputLen = readData(s->input, INFLATE_INPUT_SIZE);
+        s->inputPos = 0;
+        if (s->inputLen == 0)
+        {
+            failed = true;
+            return 0;
+        }
+    }
+    return s->input[s->inputPos++];
+}
+
+static uint16_t inflateBits(uint8_t count)
+{
+    struct inflateState *s = &state.inf;
+    while (s->bitCount < count)
+    {
+        s->bitBuf |= (uint32_t)inflateInputByte() << s->bitCount;
+        s->bitCount += 8;
+    }
+    uint16_t val = s->bitBuf & ((1UL << count) - 1);
+    s->bitBuf >>= count;
+    s->bitCount -= count;
+    return val;
+}
+
+static bool buildTable(struct huffTable *table, const uint8_t *lengths, uint16_t num)
+{
+    uint16_t offs[16];
+    memset(table->counts, 0, sizeof(table->counts));
+    for (uint16_t i = 0; i < num; i++)
+        table->counts[lengths[i]]++;
+    table->counts[0] = 0;
+
+    // reject oversubscribed codes, incomplete ones are allowed (a single distance code is)
+    int32_t left = 1;
+    for (uint8_t len = 1; len < 16; len++)
+    {
+        left <<= 1;
+        left -= table->counts[len];
+        if (left < 0)
+            return false;
+    }
+
+    offs[1] = 0;
+    for (uint8_t len = 1; len < 15; len++)
+        offs[len + 1] = offs[len] + table->counts[len];
+    for (uint16_t i = 0; i < num; i++)
+    {
+        if (lengths[i])
+            table->symbols[offs[lengths[i]]++] = i;
+    }
+    return true;
+}
+
+// canonical decoding, one bit at a time
+static int16_t decodeSymbol(const struct huffTable *table)
+{
+    int32_t code = 0, first = 0, index = 0;
+    for (uint8_t len = 1; len < 16; len++)
+    {
+        code |= inflateBits(1);
+        int32_t count = table->counts[len];
+        if (code - first < count)
+            return table->symbols[index + code - first];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    failed = true;
+    return -1;
+}
+
+static bool inflateFixedTables(void)
+{
+    uint8_t lengths[288];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    if (!buildTable(&state.inf.lit, lengths, 288))
+        return false;
+    memset(lengths, 5, 30);
+    return buildTable(&state.inf.dist, lengths, 30);
+}
+
+static bool inflateDynamicTables(void)
+{
+    uint8_t lengths[288 + 32];
+    uint16_t hlit = inflateBits(5) + 257;
+    uint16_t hdist = inflateBits(5) + 1;
+    uint8_t hclen = inflateBits(4) + 4;
+    if (hlit > 286 || hdist > 30)
+        return false;
+
+    // the code length code goes in the distance table until the real one is read
+    memset(lengths, 0, 19);
+    for (uint8_t i = 0; i < hclen; i++)
+        lengths[codeLengthOrder[i]] = inflateBits(3);
+    if (!buildTable(&state.inf.dist, lengths, 19))
+        return false;
+
+    uint16_t num = 0;
+    while (num < hlit + hdist)
+    {
+        int16_t sym = decodeSymbol(&state.inf.dist);
+        uint8_t len = 0;
+        uint8_t repeat;
+        if (sym < 0)
+            return false;
+        if (sym < 16)
+        {
+            lengths[num++] = sym;
+            continue;
+        }
+        if (sym == 16)
+        {
+            if (num == 0)
+                return false;
+            len = lengths[num - 1];
+            repeat = 3 + inflateBits(2);
+        }
+        else if (sym == 17)
+        {
+            repeat = 3 + inflateBits(3);
+        }
+        else
+        {
+            repeat = 11 + inflateBits(7);
+        }
+        if (num + repeat > hlit + hdist)
+            return false;
+        memset(lengths + num, len, repeat);
+        num += repeat;
+    }
+    if (lengths[256] == 0)
+        return false;
+    return buildTable(&state.inf.lit, lengths, hlit) && buildTable(&state.inf.dist, lengths + hlit, hdist);
+}
+
+static bool inflateBlockStart(void)
+{
+    struct inflateState *s = &state.inf;
+    s->lastBlock = inflateBits(1);
+    switch (inflateBits(2))
+    {
+    case 0:
+    {
+        // skip to the byte boundary, the bit buffer never holds a full byte here
+        s->bitBuf = 0;
+        s->bitCount = 0;
+        uint16_t len = inflateInputByte();
+        len |= inflateInputByte() << 8;
+        uint16_t nlen = inflateInputByte();
+        nlen |= inflateInputByte() << 8;
+        if (len != (uint16_t)~nlen)
+            return false;
+        s->storedLeft = len;
+        s->blockType = BLOCK_STORED;
+        return true;
+    }
+    case 1:
+        s->blockType = BLOCK_HUFFMAN;
+        return inflateFixedTables();
+    case 2:
+        s->blockType = BLOCK_HUFFMAN;
+        return inflateDynamicTables();
+    default:
+        return false;
+    }
+}
+
+static inline uint8_t inflateOutput(uint8_t b)
+{
+    struct inflateState *s = &state.inf;
+    s->window[s->outCount % INFLATE_WINDOW_SIZE] = b;
+    s->outCount++;
+    return b;
+}
+
+// pulls the next decompressed byte, a block or a match at a time
+static bool inflateByte(uint8_t *out)
+{
+    struct inflateState *s = &state.inf;
+    while (!failed)
+    {
+        if (s->copyLeft)
+        {
+            s->copyLeft--;
+            *out = inflateOutput(s->window[(s->outCount - s->copyDist) % INFLATE_WINDOW_SIZE]);
+            return true;
+        }
+        if (s->blockType == BLOCK_STORED)
+        {
+            if (s->storedLeft)
+            {
+                s->storedLeft--;
+                *out = inflateOutput(inflateInputByte());
+                return !failed;
+            }
+            s->blockType = BLOCK_NONE;
+        }
+        if (s->blockType == BLOCK_HUFFMAN)
+        {
+            int16_t sym = decodeSymbol(&s->lit);
+            if (sym < 0)
+                break;
+            if (sym < 256)
+            {
+                *out = inflateOutput(sym);
+                return true;
+            }
+            if (sym == 256)
+            {
+                s->blockType = BLOCK_NONE;
+                continue;
+            }
+            sym -= 257;
+            if (sym >= 29)
+                break;
+            s->copyLeft = lengthBase[sym] + inflateBits(lengthExtra[sym]);
+            sym = decodeSymbol(&s->dist);
+            if (sym < 0 || sym >= 30)
+                break;
+            s->copyDist = distBase[sym] + inflateBits(distExtra[sym]);
+            if (s->copyDist > INFLATE_WINDOW_SIZE || s->copyDist > s->outCount)
+                break;
+            continue;
+        }
+        if (s->lastBlock || !inflateBlockStart())
+            break;
+    }
+    failed = true;
+    return false;
+}
+
+static uint8_t inflateOpen(void)
+{
+    uint8_t header[IMAGE_HEADER_SIZE];
+    uint8_t cmf, flg;
+    struct inflateState *s = &state.inf;
+    memset(s, 0, sizeof(struct inflateState));
+
+    // skip the uncompressed size, the screen size tells us how much to read
+    readAddr += 4;
+    cmf = inflateInputByte();
+    flg = inflateInputByte();
+    if ((cmf & 0x0F) != 8 || (1UL << ((cmf >> 4) + 8)) > INFLATE_WINDOW_SIZE || (flg & 0x20) || ((cmf << 8) | flg) % 31)
+    {
+        printf("zlib header %02X %02X not supported\r\n", cmf, flg);
+        return 0;
+    }
+    for (uint8_t c = 0; c < IMAGE_HEADER_SIZE; c++)
+    {
+        if (!inflateByte(&header[c]))
+            return 0;
+    }
+    // skip anything that was added to the header since
+    for (uint8_t c = IMAGE_HEADER_SIZE; c < header[0]; c++)
+    {
+        if (!inflateByte(&cmf))
+            return 0;
+    }
+    if ((uint32_t)(header[1] | header[2] << 8) * (header[3] | header[4] << 8) != (uint32_t)SCREEN_WIDTH * SCREEN_HEIGHT)
+        return 0;
+    return header[5] & 0x0F;
+}
+
+static void g5Refill(void)
+{
+    struct g5State *s = &state.g5;
+    // the decoder sets pBuf when it starts on the first line
+    if (s->dec.y == 0)
+        return;
+    uint16_t used = s->dec.pBuf - s->input;
+    if (used < G5_LINE_MAX || used >= s->inputLen)
+        return;
+    s->inputLen -= used;
+    memmove(s->input, s->input + used, s->inputLen);
+    s->inputLen += readData(s->input + s->inputLen, G5_BUFFER_SIZE - s->inputLen);
+    s->dec.pBuf = s->input;
+    s->dec.iVLCSize = s->inputLen;
+}
+
+static uint8_t g5Open(void)
+{
+    uint8_t header[IMAGE_HEADER_SIZE];
+    struct g5State *s = &state.g5;
+    readData(header, IMAGE_HEADER_SIZE);
+    if ((uint32_t)(header[1] | header[2] << 8) * (header[3] | header[4] << 8) != (uint32_t)SCREEN_WIDTH * SCREEN_HEIGHT)
+        return 0;
+    uint8_t planes = header[5] & 0x0F;
+    if (planes != 1 && planes != 2)
+        return 0;
+
+    memset(s->input + G5_BUFFER_SIZE, 0, 4);
+    s->inputLen = readData(s->input, G5_BUFFER_SIZE);
+    // two planes are sent as one image of double height
+    if (g5_decode_init(&s->dec, SCREEN_WIDTH, SCREEN_HEIGHT * planes, s->input, s->inputLen) != G5_SUCCESS)
+        return 0;
+    return planes;
+}
+
+uint8_t compressedImageOpen(uint32_t addr, uint32_t size, uint8_t dataType)
+{
+    uint8_t planes = 0;
+    readAddr = addr;
+    readEnd = addr + size;
+    openType = dataType;
+    failed = false;
+    if (dataType == DATATYPE_IMG_ZLIB)
+        planes = inflateOpen();
+    else if (dataType == DATATYPE_IMG_G5)
+        planes = g5Open();
+    if (failed || planes < 1 || planes > 2)
+    {
+        printf("can't decode image type 0x%02X\r\n", dataType);
+        failed = true;
+        return 0;
+    }
+    return planes;
+}
+
+bool compressedImageReadLine(uint8_t *line)
+{
+    if (failed)
+        return false;
+    if (openType == DATATYPE_IMG_G5)
+    {
+        g5Refill();
+        int rc = g5_decode_line(&state.g5.dec, line);
+        failed = (rc != G5_SUCCESS && rc != G5_DECODE_COMPLETE);
+    }
+    else
+    {
+        for (uint8_t c = 0; c < LINE_BYTES && !failed; c++)
+            inflateByte(&line[c]);
+    }
+    if (failed)
+        printf("image data is corrupt\r\n");
+    return !failed;
+}
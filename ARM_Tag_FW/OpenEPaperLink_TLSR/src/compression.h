@@ -0,0 +1,16 @@
+#ifndef _COMPRESSION_H_
+#define _COMPRESSION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Decodes DATATYPE_IMG_ZLIB and DATATYPE_IMG_G5 images straight from the eeprom, one line at a time.
+// Only one image can be open at a time, the decoder state is shared between both formats.
+
+// opens the image data at addr (just after the EepromImageHeader), returns the number of planes or 0 if it can't be drawn
+uint8_t compressedImageOpen(uint32_t addr, uint32_t size, uint8_t dataType);
+
+// decodes the next SCREEN_WIDTH / 8 bytes, planes follow each other
+bool compressedImageReadLine(uint8_t *line);
+
+#endif
@@ -7,6 +7,7 @@
 #include "proto.h"
 #include "screen.h"
 #include "epd.h"
+#include "compression.h"
 
 #define LINE_BYTE_COUNTER ((SCREEN_WIDTH/8)*5)// Draw 5 lines
 
@@ -18,6 +19,40 @@ void drawOnOffline(uint8_t state)
 }
 
 static uint8_t mClutMap[256];
+
+static void drawCompressed(uint32_t addr, uint32_t size, uint8_t dataType)
+{
+    uint8_t planes = compressedImageOpen(addr, size, dataType);
+    if (planes == 0)
+        return;
+    EPD_Display_start(1);
+    for (uint16_t y = 0; y < SCREEN_HEIGHT; y++)
+    {
+        // on failure, the rest is drawn white rather than leaving the display half-sent
+        if (!compressedImageReadLine(mClutMap))
+            memset(mClutMap, 0xFF, SCREEN_WIDTH / 8);
+        for (uint8_t c = 0; c < (SCREEN_WIDTH / 8); c++)
+        {
+            if (byteCounter < LINE_BYTE_COUNTER && onlineState == 0)
+                EPD_Display_byte(0x55);
+            else
+                EPD_Display_byte(mClutMap[c]);
+            byteCounter++;
+        }
+    }
+    EPD_Display_color_change();
+    for (uint16_t y = 0; y < SCREEN_HEIGHT; y++)
+    {
+        if (planes == 1 || !compressedImageReadLine(mClutMap))
+            memset(mClutMap, 0x00, SCREEN_WIDTH / 8);
+        for (uint8_t c = 0; c < (SCREEN_WIDTH / 8); c++)
+        {
+            EPD_Display_byte(mClutMap[c]);
+        }
+    }
+    EPD_Display_end();
+}
+
 void drawImageAtAddress(uint32_t addr, uint8_t lut)
 {
     byteCounter = 0;
@@ -73,6 +108,11 @@ void drawImageAtAddress(uint32_t addr, uint8_t lut)
         }
         EPD_Display_end();
         break;
+    case DATATYPE_IMG_ZLIB:
+    case DATATYPE_IMG_G5:
+        printf("Doing compressed type 0x%02X\r\n", eih->dataType);
+        drawCompressed(addr + sizeof(struct EepromImageHeader), eih->size, eih->dataType);
+        break;
     case DATATYPE_IMG_BMP:;
         printf("sending BMP to EPD - ");
 
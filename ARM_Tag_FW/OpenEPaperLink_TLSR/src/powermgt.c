@@ -28,7 +28,7 @@ bool lowBattery = false;
 uint16_t longDataReqCounter = 0;
 uint16_t voltageCheckCounter = 0;
 
-uint8_t capabilities = 0;
+uint8_t capabilities = CAPABILITY_SUPPORTS_COMPRESSION;
 
 RAM uint64_t time_ms = 0;
 RAM uint32_t time_overflow = 0;
@@ -208,6 +208,7 @@ static void sendAvailDataReq()
     availreq->temperature = temperature;
     availreq->batteryMv = batteryVoltage;
     availreq->capabilities = capabilities;
+    availreq->tagSoftwareVersion = FW_VERSION;
     addCRC(availreq, sizeof(struct AvailDataReq));
     commsTxNoCpy(outBuffer);
 }
@@ -812,6 +813,8 @@ bool processAvailDataInfo(struct AvailDataInfo *avail)
         break;
     case DATATYPE_IMG_RAW_1BPP:
     case DATATYPE_IMG_RAW_2BPP:
+    case DATATYPE_IMG_ZLIB:
+    case DATATYPE_IMG_G5:
         printf("RAW_BPP\r\n");
         // check if this download is currently displayed or active
         if (curDataInfo.dataSize == 0 && !memcmp((const void *)&avail->dataVer, (const void *)&curDataInfo.dataVer, 8))
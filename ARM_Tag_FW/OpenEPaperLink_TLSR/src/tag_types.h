@@ -21,6 +21,8 @@
 #define DATATYPE_IMG_DIFF 0x10             // always 1BPP
 #define DATATYPE_IMG_RAW_1BPP 0x20         // 2888 bytes for 1.54"  / 4736 2.9" / 15000 4.2"
 #define DATATYPE_IMG_RAW_2BPP 0x21         // 5776 bytes for 1.54"  / 9472 2.9" / 30000 4.2"
+#define DATATYPE_IMG_ZLIB 0x30             // [uint32_t uncompressed size][2 byte zlib header][zlib compressed image]
+#define DATATYPE_IMG_G5 0x31               // [6 byte image header][G5 compressed planes]
 #define DATATYPE_IMG_RAW_1BPP_DIRECT 0x3F  // only for 1.54", don't write to EEPROM, but straightaway to the EPD
 #define DATATYPE_UK_SEGMENTED 0x51         // Segmented data for the UK Segmented display type (contained in availableData Reply)
 #define DATATYPE_EU_SEGMENTED 0x52         // Segmented data for the EU/DE Segmented display type (contained in availableData Reply)
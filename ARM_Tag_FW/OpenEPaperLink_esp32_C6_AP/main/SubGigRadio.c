@@ -215,6 +215,7 @@ void SubGig_CC1101_SetConfig(const RfSetting *pConfig);
 static void IRAM_ATTR gpio_isr_handler(void *arg)
 {
    gSubGigData.RxAvailable = true;
+   radioWakeFromISR();
 }
 
 // return SUBGIG_ERR_NONE aka ESP_OK aka 0 if CC1101 is detected and all is good
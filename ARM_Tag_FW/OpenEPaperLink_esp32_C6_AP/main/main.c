@@ -11,6 +11,7 @@
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "led.h"
 #include "proto.h"
@@ -63,36 +64,134 @@ const struct {
 #define DATATYPE_NOUPDATE 0
 #define HW_TYPE           0xC6
 
-#define MAX_PENDING_MACS      250
+#define MAX_PENDING_MACS      CONFIG_OEPL_PENDING_SLOTS
 #define HOUSEKEEPING_INTERVAL 60UL
 
 struct pendingData pendingDataArr[MAX_PENDING_MACS];
 
+// pending data is found by mac through an open-addressed index, and times out through a timer wheel
+#define PENDING_INDEX_SIZE (MAX_PENDING_MACS * 2 + 1)  // at most half full, so probe runs stay short
+#define PENDING_WHEEL_SIZE 64                          // housekeeping ticks per turn of the wheel
+#define NO_PENDING_SLOT    0xFFFF
+
+struct pendingTimer {
+    uint16_t next;     // next slot in the same wheel bucket
+    uint16_t prev;     // previous slot in the same wheel bucket
+    uint32_t expires;  // housekeeping tick the slot times out at
+    uint32_t added;    // housekeeping tick the slot was filled at, nextCheckIn counts down from here
+};
+
+uint16_t            pendingIndex[PENDING_INDEX_SIZE];  // slot per mac hash, NO_PENDING_SLOT if empty
+struct pendingTimer pendingTimers[MAX_PENDING_MACS];
+uint16_t            pendingWheel[PENDING_WHEEL_SIZE];  // first slot per bucket
+uint16_t            pendingFree[MAX_PENDING_MACS];     // stack of unused slots
+uint16_t            pendingFreeCount = 0;
+uint32_t            pendingTick      = 0;  // housekeeping passes so far
+
 // VERSION GOES HERE!
-uint16_t version = 0x001f;
+uint16_t version = 0x0020;
 
 #define RAW_PKT_PADDING 2
 
-uint8_t radiotxbuffer[128];
-uint8_t radiorxbuffer[128];
+uint8_t  radiotxbuffer[128];
+uint8_t *radiorxbuffer;  // packet being processed, in the radio driver's rx buffer
 
 static uint32_t housekeepingTimer;
 
-struct blockRequest requestedData = {0};                  // holds which data was requested by the tag
+// the radio task handles the tags, the serial task handles the ESP32. They take turns on the shared state through protoMutex
+#define RADIO_TASK_PRIORITY  11  // below the uart event task, so the serial link is read while parts are sent
+#define SERIAL_TASK_PRIORITY 10
+#define RADIO_IDLE_WAIT      100  // ms the radio task sleeps at most, also picks up sub-GHz packets whose interrupt got lost
+#define SERIAL_CHUNK         256  // characters processed before the radio task gets a chance
+
+TaskHandle_t       radioTaskHandle;
+TaskHandle_t       serialTaskHandle;
+SemaphoreHandle_t  protoMutex;
+esp_timer_handle_t radioTimer;  // wakes the radio task when the next block part or timeout is due
+
+// time between receiving a packet and handing the response to the radio, per packet type
+#define LATENCY_BUCKETS 10  // the first bucket holds everything below 250us, each next one twice as much, the last one the rest
+
+struct latencyStats {
+    uint8_t     pktType;
+    const char *name;
+    uint32_t    count;
+    uint64_t    totalUs;
+    uint32_t    maxUs;
+    uint32_t    buckets[LATENCY_BUCKETS];
+};
 
-uint8_t  dstMac[8];                                       // target for the block transfer
-uint16_t dstPan;                                          //
+struct latencyStats latencyStats[] = {
+    {PKT_AVAIL_DATA_REQ, "ADR"},
+    {PKT_AVAIL_DATA_SHORTREQ, "ADR_SHORT"},
+    {PKT_BLOCK_REQUEST, "BLOCK_REQ"},
+    {PKT_BLOCK_PARTIAL_REQUEST, "BLOCK_PARTIAL_REQ"},
+    {PKT_XFER_COMPLETE, "XFER_COMPLETE"},
+    {PKT_PING, "PING"},
+    {PKT_TAG_RETURN_DATA, "TAG_RETURN_DATA"},
+};
+#define LATENCY_TYPES (sizeof(latencyStats) / sizeof(latencyStats[0]))
+
+// block transfers are handled in slots, so the AP can serve multiple tags at the same time
+#define MAX_BLOCK_SLOTS          CONFIG_OEPL_BLOCK_SLOTS
+#define NO_BLOCK_SLOT            -1
+#define CONCURRENT_REQUEST_DELAY 1200UL  // a slot can be taken over if its tag hasn't requested anything for this long
+#define HOST_BLOCK_TIMEOUT       2000UL  // give up waiting for block data from the ESP32 after this long
+#define HOST_BLOCK_HOLDOFF       1000UL  // after a timeout, no new block request for this long so a late answer can't be taken for it
+
+struct blockSlot {
+    bool                inUse;
+    bool                dataValid;       // blockbuffer holds the block described in requestedData
+    bool                waitingForHost;  // queued for a block request to the ESP32
+    bool                sending;         // currently sending parts to the tag
+    uint8_t             mac[8];          // target for the block transfer
+    uint16_t            pan;             //
+    uint32_t            lastRequest;     // last time the tag sent a block request
+    uint32_t            hostQueued;      // reference that holds when the slot was queued for the ESP32
+    uint32_t            hostRequested;   // reference that holds when the block was requested from the ESP32
+    uint32_t            sendAt;          // reference that holds when the AP sends the next block, 0 if nothing is scheduled
+    uint8_t             partCursor;      // next part to look at while sending
+    uint8_t             partsLeft;       // parts left to send in this burst
+    struct blockRequest requestedData;   // holds which data was requested by the tag
+    uint8_t             blockbuffer[BLOCK_XFER_BUFFER_SIZE + 5];  // block transfer buffer
+};
+
+struct blockSlot blockSlots[MAX_BLOCK_SLOTS];
+int8_t           hostSlot = NO_BLOCK_SLOT;  // slot currently receiving block data from the ESP32
+// text mode block data doesn't say which request it answers. Block data announced while no request
+// is out is refused, so after a timeout the next request waits until a late answer can't be on its way
+uint32_t hostBlockTimedOut  = 0;
+bool     hostBlockStreaming = false;  // text mode block data is coming in
+
+// blocks pushed by the ESP32 before a tag asks for them
+#define BLOCK_CACHE_ENTRIES CONFIG_OEPL_BLOCK_CACHE_ENTRIES
+
+struct blockCacheEntry {
+    bool     valid;
+    uint64_t ver;
+    uint8_t  blockId;
+    uint8_t  data[BLOCK_XFER_BUFFER_SIZE + 5];
+};
 
-static uint32_t blockStartTimer  = 0;                     // reference that holds when the AP sends the next block
-uint32_t        nextBlockAttempt = 0;                     // reference time for when the AP can request a new block from the ESP32
-uint8_t         seq              = 0;                     // holds current sequence number for transmission
-uint8_t         blockbuffer[BLOCK_XFER_BUFFER_SIZE + 5];  // block transfer buffer
-uint8_t         lastAckMac[8] = {0};
+struct blockCacheEntry blockCache[BLOCK_CACHE_ENTRIES];
+uint8_t                blockCacheNext = 0;  // entries are replaced in the order they were filled, the ESP32 keeps the same accounting
+uint8_t                pushEntry      = 0;  // entry currently receiving pushed block data
 
-// these variables hold the current mac were talking to
-#define CONCURRENT_REQUEST_DELAY 1200UL
-uint32_t lastBlockRequest = 0;
-uint8_t  lastBlockMac[8];
+// the pending data and the block buffers are static, they have to leave the IDF, the radio and the task stacks enough SRAM
+#ifdef CONFIG_IDF_TARGET_ESP32H2
+#define OEPL_STATIC_RAM_BUDGET (200 * 1024)  // of 320kB
+#else
+#define OEPL_STATIC_RAM_BUDGET (320 * 1024)  // of 512kB
+#endif
+_Static_assert(sizeof(pendingDataArr) + sizeof(pendingIndex) + sizeof(pendingTimers) + sizeof(pendingFree) + sizeof(blockSlots) +
+                       sizeof(blockCache) <=
+                   OEPL_STATIC_RAM_BUDGET,
+               "OEPL_PENDING_SLOTS, OEPL_BLOCK_SLOTS and OEPL_BLOCK_CACHE_ENTRIES take too much RAM together");
+
+uint16_t dstPan;                                          // pan of the last block request
+uint32_t nextBlockAttempt = 0;                            // reference time for when the AP requested the last block from the ESP32
+uint8_t  seq              = 0;                            // holds current sequence number for transmission
+uint8_t  lastAckMac[8]    = {0};
 uint8_t  lastTagReturn[8];
 
 #define NO_SUBGHZ_CHANNEL  255
@@ -100,14 +199,18 @@ uint8_t curSubGhzChannel;
 uint8_t curChannel = 25;
 uint8_t curPower   = 10;
 
-uint8_t curPendingData = 0;
-uint8_t curNoUpdate    = 0;
+uint16_t curPendingData = 0;
+uint16_t curNoUpdate    = 0;
 
 bool highspeedSerial = false;
 
 void sendXferCompleteAck(uint8_t *dst);
 void sendCancelXfer(uint8_t *dst);
 void espNotifyAPInfo();
+void espNotifyLatency();
+void espNotifyTxStats();
+void espNotifyTimeOut(const uint8_t *src);
+void blockDataReceived();
 
 // tools
 void addCRC(void *p, uint8_t len) {
@@ -138,10 +241,27 @@ uint8_t getPacketType(void *buffer) {
     }
     return 0;
 }
-uint8_t getBlockDataLength() {
+void recordLatency(uint8_t pktType, uint32_t us) {
+    for (uint8_t c = 0; c < LATENCY_TYPES; c++) {
+        struct latencyStats *ls = &latencyStats[c];
+        if (ls->pktType != pktType) continue;
+        uint8_t  bucket = 0;
+        uint32_t limit  = 250;
+        while ((bucket < LATENCY_BUCKETS - 1) && (us >= limit)) {
+            bucket++;
+            limit <<= 1;
+        }
+        ls->buckets[bucket]++;
+        ls->count++;
+        ls->totalUs += us;
+        if (us > ls->maxUs) ls->maxUs = us;
+        return;
+    }
+}
+uint8_t getBlockDataLength(const struct blockSlot *bs) {
     uint8_t partNo = 0;
     for (uint8_t c = 0; c < BLOCK_MAX_PARTS; c++) {
-        if (requestedData.requestedParts[c / 8] & (1 << (c % 8))) {
+        if (bs->requestedData.requestedParts[c / 8] & (1 << (c % 8))) {
             partNo++;
         }
     }
@@ -149,67 +269,225 @@ uint8_t getBlockDataLength() {
 }
 
 // pendingdata slot stuff
+uint32_t pendingHash(const uint8_t *mac) {
+    uint64_t key;
+    memcpy(&key, mac, 8);
+    key *= 0x9E3779B97F4A7C15ULL;
+    return (uint32_t) (key >> 32) % PENDING_INDEX_SIZE;
+}
+void initPendingSlots() {
+    memset(pendingDataArr, 0, sizeof(pendingDataArr));
+    memset(pendingIndex, 0xFF, sizeof(pendingIndex));
+    memset(pendingWheel, 0xFF, sizeof(pendingWheel));
+    for (uint16_t c = 0; c < MAX_PENDING_MACS; c++) pendingFree[c] = MAX_PENDING_MACS - 1 - c;
+    pendingFreeCount = MAX_PENDING_MACS;
+    curPendingData   = 0;
+    curNoUpdate      = 0;
+}
 int32_t findSlotForMac(const uint8_t *mac) {
-    for (uint8_t c = 0; c < MAX_PENDING_MACS; c++) {
-        if (memcmp(mac, ((uint8_t *) &(pendingDataArr[c].targetMac)), 8) == 0) {
-            if (pendingDataArr[c].attemptsLeft != 0) {
-                return c;
-            }
+    for (uint32_t i = pendingHash(mac);; i = (i + 1) % PENDING_INDEX_SIZE) {
+        uint16_t slot = pendingIndex[i];
+        if (slot == NO_PENDING_SLOT) return -1;
+        if (memcmp(mac, pendingDataArr[slot].targetMac, 8) == 0) return slot;
+    }
+}
+void unindexPendingSlot(uint16_t slot) {
+    uint32_t hole = pendingHash(pendingDataArr[slot].targetMac);
+    while (pendingIndex[hole] != slot) hole = (hole + 1) % PENDING_INDEX_SIZE;
+    // move later entries of the probe run back into the hole, unless that would put them before their home
+    for (uint32_t i = (hole + 1) % PENDING_INDEX_SIZE; pendingIndex[i] != NO_PENDING_SLOT; i = (i + 1) % PENDING_INDEX_SIZE) {
+        uint32_t home     = pendingHash(pendingDataArr[pendingIndex[i]].targetMac);
+        bool     homeHere = (hole <= i) ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!homeHere) {
+            pendingIndex[hole] = pendingIndex[i];
+            hole               = i;
         }
     }
-    return -1;
+    pendingIndex[hole] = NO_PENDING_SLOT;
 }
-int32_t findFreeSlot() {
-    for (uint8_t c = 0; c < MAX_PENDING_MACS; c++) {
-        if (pendingDataArr[c].attemptsLeft == 0) {
-            return c;
+void releasePendingSlot(uint16_t slot) {
+    struct pendingTimer *pt = &pendingTimers[slot];
+    if (pt->prev != NO_PENDING_SLOT) {
+        pendingTimers[pt->prev].next = pt->next;
+    } else {
+        pendingWheel[pt->expires % PENDING_WHEEL_SIZE] = pt->next;
+    }
+    if (pt->next != NO_PENDING_SLOT) pendingTimers[pt->next].prev = pt->prev;
+    unindexPendingSlot(slot);
+    if (pendingDataArr[slot].availdatainfo.dataType != DATATYPE_NOUPDATE) {
+        curPendingData--;
+    } else {
+        curNoUpdate--;
+    }
+    pendingDataArr[slot].attemptsLeft = 0;
+    pendingFree[pendingFreeCount++]   = slot;
+}
+bool storePendingData(const struct pendingData *pd) {
+    int32_t slot = findSlotForMac(pd->targetMac);
+    if (slot != -1) releasePendingSlot(slot);
+    // nothing left to try, which clears what was pending for the mac
+    if (pd->attemptsLeft == 0) return true;
+    if (pendingFreeCount == 0) return false;
+
+    slot = pendingFree[--pendingFreeCount];
+    memcpy(&(pendingDataArr[slot]), pd, sizeof(struct pendingData));
+    uint32_t i = pendingHash(pd->targetMac);
+    while (pendingIndex[i] != NO_PENDING_SLOT) i = (i + 1) % PENDING_INDEX_SIZE;
+    pendingIndex[i] = slot;
+
+    // times out at the attemptsLeft'th housekeeping pass from now
+    struct pendingTimer *pt = &pendingTimers[slot];
+    uint16_t            *bucket;
+    pt->added   = pendingTick;
+    pt->expires = pendingTick + pd->attemptsLeft;
+    bucket      = &pendingWheel[pt->expires % PENDING_WHEEL_SIZE];
+    pt->prev    = NO_PENDING_SLOT;
+    pt->next    = *bucket;
+    if (*bucket != NO_PENDING_SLOT) pendingTimers[*bucket].prev = slot;
+    *bucket = slot;
+
+    if (pd->availdatainfo.dataType != DATATYPE_NOUPDATE) {
+        curPendingData++;
+    } else {
+        curNoUpdate++;
+    }
+    return true;
+}
+uint16_t pendingNextCheckIn(uint16_t slot) {
+    uint16_t nextCheckIn = pendingDataArr[slot].availdatainfo.nextCheckIn;
+    uint32_t elapsed     = pendingTick - pendingTimers[slot].added;
+    return (nextCheckIn > elapsed) ? nextCheckIn - elapsed : 0;
+}
+void expirePendingSlots() {
+    // only the bucket for this tick, slots that are a turn of the wheel or more away stay
+    pendingTick++;
+    uint16_t slot = pendingWheel[pendingTick % PENDING_WHEEL_SIZE];
+    while (slot != NO_PENDING_SLOT) {
+        uint16_t next = pendingTimers[slot].next;
+        if (pendingTimers[slot].expires == pendingTick) {
+            if (pendingDataArr[slot].availdatainfo.dataType != DATATYPE_NOUPDATE) {
+                espNotifyTimeOut(pendingDataArr[slot].targetMac);
+            }
+            releasePendingSlot(slot);
         }
+        slot = next;
     }
-    return -1;
 }
-int32_t findSlotForVer(const uint8_t *ver) {
-    for (uint8_t c = 0; c < MAX_PENDING_MACS; c++) {
-        if (memcmp(ver, ((uint8_t *) &(pendingDataArr[c].availdatainfo.dataVer)), 8) == 0) {
-            if (pendingDataArr[c].attemptsLeft != 0) return c;
+void deleteAllPendingDataForMac(const uint8_t *mac) {
+    // the index holds one slot per mac
+    int32_t slot = findSlotForMac(mac);
+    if (slot != -1) releasePendingSlot(slot);
+}
+
+// block transfer slot stuff
+int8_t findBlockSlot(const uint8_t *mac) {
+    for (uint8_t c = 0; c < MAX_BLOCK_SLOTS; c++) {
+        if (blockSlots[c].inUse && memcmp(mac, blockSlots[c].mac, 8) == 0) return c;
+    }
+    return NO_BLOCK_SLOT;
+}
+int8_t claimBlockSlot(const uint8_t *mac) {
+    // use a free slot, or take over the slot that has been abandoned the longest
+    int8_t   slot    = NO_BLOCK_SLOT;
+    uint32_t maxIdle = CONCURRENT_REQUEST_DELAY;
+    for (uint8_t c = 0; c < MAX_BLOCK_SLOTS; c++) {
+        // block data for this slot is still coming in over the serial port
+        if (c == hostSlot) continue;
+        if (!blockSlots[c].inUse) {
+            slot = c;
+            break;
+        }
+        uint32_t idle = getMillis() - blockSlots[c].lastRequest;
+        if (idle > maxIdle) {
+            maxIdle = idle;
+            slot    = c;
         }
     }
-    return -1;
+    if (slot == NO_BLOCK_SLOT) return NO_BLOCK_SLOT;
+
+    struct blockSlot *bs = &blockSlots[slot];
+    if (bs->inUse) ESP_LOGI(TAG, "Taking over block slot %d", slot);
+    bs->inUse                 = true;
+    bs->dataValid             = false;
+    bs->waitingForHost        = false;
+    bs->sending               = false;
+    bs->sendAt                = 0;
+    bs->requestedData.blockId = 0xFF;
+    memcpy(bs->mac, mac, 8);
+    return slot;
 }
-void deleteAllPendingDataForVer(const uint8_t *ver) {
-    int32_t slot = -1;
-    do {
-        slot = findSlotForVer(ver);
-        if (slot != -1) pendingDataArr[slot].attemptsLeft = 0;
-    } while (slot != -1);
+void releaseBlockSlotForMac(const uint8_t *mac) {
+    int8_t slot = findBlockSlot(mac);
+    if (slot != NO_BLOCK_SLOT) blockSlots[slot].inUse = false;
 }
-void deleteAllPendingDataForMac(const uint8_t *mac) {
-    int32_t slot = -1;
-    do {
-        slot = findSlotForMac(mac);
-        if (slot != -1) pendingDataArr[slot].attemptsLeft = 0;
-    } while (slot != -1);
-}
-
-void countSlots() {
-    curPendingData = 0;
-    curNoUpdate    = 0;
-    for (uint8_t c = 0; c < MAX_PENDING_MACS; c++) {
-        if (pendingDataArr[c].attemptsLeft != 0) {
-            if (pendingDataArr[c].availdatainfo.dataType != 0) {
-                curPendingData++;
-            } else {
-                curNoUpdate++;
-            }
+uint8_t countHostQueue() {
+    uint8_t queued = (hostSlot != NO_BLOCK_SLOT) ? 1 : 0;
+    for (uint8_t c = 0; c < MAX_BLOCK_SLOTS; c++) {
+        if (blockSlots[c].inUse && blockSlots[c].waitingForHost) queued++;
+    }
+    return queued;
+}
+bool loadBlockFromCache(struct blockSlot *bs) {
+    for (uint8_t c = 0; c < BLOCK_CACHE_ENTRIES; c++) {
+        struct blockCacheEntry *bce = &blockCache[c];
+        if (bce->valid && (bce->ver == bs->requestedData.ver) && (bce->blockId == bs->requestedData.blockId)) {
+            memcpy(bs->blockbuffer, bce->data, sizeof(bce->data));
+            ESP_LOGI(TAG, "Block %d served from cache", bce->blockId);
+            return true;
+        }
+    }
+    return false;
+}
+
+// channel and power as set by the ESP32, false if the channel isn't one we use
+bool setChannelPower(const struct espSetChannelPower *scp) {
+#ifdef CONFIG_OEPL_SUBGIG_SUPPORT
+    if (curSubGhzChannel != scp->subghzchannel && curSubGhzChannel != NO_SUBGHZ_CHANNEL) {
+        curSubGhzChannel = scp->subghzchannel;
+        ESP_LOGI(TAG, "Set SubGhz channel: %d", curSubGhzChannel);
+        SubGig_radioSetChannel(scp->subghzchannel);
+        if (scp->channel == 0) {
+            // Not setting 802.15.4 channel
+            return true;
         }
     }
+#endif
+    bool found = false;
+    for (uint8_t c = 0; c < sizeof(channelList); c++) {
+        if (channelList[c] == scp->channel) found = true;
+    }
+    if (!found) return false;
+    if (curChannel != scp->channel) {
+        radioSetChannel(scp->channel);
+        curChannel = scp->channel;
+    }
+    curPower = scp->power;
+    radioSetTxPower(scp->power);
+    ESP_LOGI(TAG, "Set channel: %d power: %d", curChannel, curPower);
+    return true;
+}
+void cancelPendingData(const struct pendingData *pd) {
+    deleteAllPendingDataForMac((uint8_t *) &pd->targetMac);
+    releaseBlockSlotForMac((uint8_t *) &pd->targetMac);
+}
+// claims the next block cache entry for a pushed block, its data follows
+struct blockCacheEntry *startBlockPush(const struct espBlockPush *bp) {
+    struct blockCacheEntry *bce = &blockCache[blockCacheNext];
+    pushEntry                   = blockCacheNext;
+    blockCacheNext              = (blockCacheNext + 1) % BLOCK_CACHE_ENTRIES;
+    bce->valid                  = false;
+    bce->ver                    = bp->ver;
+    bce->blockId                = bp->blockId;
+    return bce;
 }
 
-// processing serial data
 #define ZBS_RX_WAIT_HEADER 0
 #define ZBS_RX_WAIT_SDA    1  // send data avail
 #define ZBS_RX_WAIT_CANCEL 2  // cancel traffic for mac
 #define ZBS_RX_WAIT_SCP    3  // set channel power
 #define ZBS_RX_WAIT_BLOCKDATA 4
+#define ZBS_RX_WAIT_BKP    5  // block push header
+#define ZBS_RX_WAIT_PUSHDATA 6
 
 bool isSame(uint8_t *in1, char *in2, int len) {
     bool flag = 1;
@@ -219,6 +497,10 @@ bool isSame(uint8_t *in1, char *in2, int len) {
     return flag;
 }
 
+bool framedSerial = false;  // switched on by FRM!, see espFrameHeader
+void processFrameByte(uint8_t c);
+void startFraming();
+
 int      blockPosition  = 0;
 void     processSerial(uint8_t lastchar) {
     static uint8_t  cmdbuffer[4];
@@ -228,8 +510,14 @@ void     processSerial(uint8_t lastchar) {
     static uint8_t  bytesRemain = 0;
     static uint32_t lastSerial  = 0;
     static uint32_t blockStartTime = 0;
+    static int      pushPosition   = 0;
+    if (framedSerial) {
+        processFrameByte(lastchar);
+        return;
+    }
     if ((RXState != ZBS_RX_WAIT_HEADER) && ((getMillis() - lastSerial) > 1000)) {
-        RXState = ZBS_RX_WAIT_HEADER;
+        RXState            = ZBS_RX_WAIT_HEADER;
+        hostBlockStreaming = false;
         ESP_LOGI(TAG, "UART Timeout");
     }
     lastSerial = getMillis();
@@ -242,11 +530,18 @@ void     processSerial(uint8_t lastchar) {
             cmdbuffer[3] = lastchar;
 
             if (isSame(cmdbuffer + 1, ">D>", 3)) {
-                pr("ACK>");
-                blockStartTime = getMillis();
-                ESP_LOGI(TAG, "Starting BlkData, %lu ms after request", blockStartTime - nextBlockAttempt );
-                blockPosition = 0;
-                RXState       = ZBS_RX_WAIT_BLOCKDATA;
+                if (hostSlot == NO_BLOCK_SLOT) {
+                    // an answer to a request that timed out, the ESP32 won't send the data
+                    ESP_LOGI(TAG, "Refused BlkData, no block request out");
+                    pr("NOK>");
+                } else {
+                    pr("ACK>");
+                    blockStartTime = getMillis();
+                    ESP_LOGI(TAG, "Starting BlkData for slot %d, %lu ms after request", hostSlot, blockStartTime - nextBlockAttempt);
+                    blockPosition      = 0;
+                    hostBlockStreaming = true;
+                    RXState            = ZBS_RX_WAIT_BLOCKDATA;
+                }
             }
 
             if (isSame(cmdbuffer, "SDA>", 4)) {
@@ -263,6 +558,13 @@ void     processSerial(uint8_t lastchar) {
                 serialbufferp = serialbuffer;
                 break;
             }
+            if (isSame(cmdbuffer, "BKP>", 4)) {
+                ESP_LOGI(TAG, "BKP In");
+                RXState       = ZBS_RX_WAIT_BKP;
+                bytesRemain   = sizeof(struct espBlockPush);
+                serialbufferp = serialbuffer;
+                break;
+            }
             if (isSame(cmdbuffer, "SCP>", 4)) {
                 ESP_LOGI(TAG, "SCP In");
                 RXState       = ZBS_RX_WAIT_SCP;
@@ -288,6 +590,37 @@ void     processSerial(uint8_t lastchar) {
                 // TODO RESET US HERE
                 RXState = ZBS_RX_WAIT_HEADER;
             }
+            if (isSame(cmdbuffer, "LAT?", 4)) {
+                espNotifyLatency();
+                RXState = ZBS_RX_WAIT_HEADER;
+            }
+            if (isSame(cmdbuffer, "LAT!", 4)) {
+                pr("ACK>");
+                for (uint8_t c = 0; c < LATENCY_TYPES; c++) {
+                    latencyStats[c].count   = 0;
+                    latencyStats[c].totalUs = 0;
+                    latencyStats[c].maxUs   = 0;
+                    memset(latencyStats[c].buckets, 0, sizeof(latencyStats[c].buckets));
+                }
+                radioRxDropped = 0;
+                radioRxPeak    = 0;
+                RXState        = ZBS_RX_WAIT_HEADER;
+            }
+            if (isSame(cmdbuffer, "TXS?", 4)) {
+                espNotifyTxStats();
+                RXState = ZBS_RX_WAIT_HEADER;
+            }
+            if (isSame(cmdbuffer, "TXS!", 4)) {
+                pr("ACK>");
+                memset(&radioTxStats, 0, sizeof(radioTxStats));
+                RXState = ZBS_RX_WAIT_HEADER;
+            }
+            if (isSame(cmdbuffer, "FRM!", 4)) {
+                pr("ACK>");
+                ESP_LOGI(TAG, "FRM! In, switching to framed serial");
+                startFraming();
+                RXState = ZBS_RX_WAIT_HEADER;
+            }
             if (isSame(cmdbuffer, "HSPD", 4)) {
                 pr("ACK>");
                 ESP_LOGI(TAG, "HSPD In, switching to 2000000");
@@ -300,24 +633,50 @@ void     processSerial(uint8_t lastchar) {
             }
             break;
         case ZBS_RX_WAIT_BLOCKDATA:
-            blockbuffer[blockPosition++] = 0xAA ^ lastchar;
+            // if the request timed out in the meantime, the data is read but discarded
+            if (hostSlot != NO_BLOCK_SLOT) blockSlots[hostSlot].blockbuffer[blockPosition] = 0xAA ^ lastchar;
+            blockPosition++;
             if (blockPosition >= 4100) {
                 ESP_LOGI(TAG, "Blockdata fully received in %lu ms, %lu ms after the request", getMillis() - blockStartTime, getMillis() - nextBlockAttempt);
+                hostBlockStreaming = false;
+                blockDataReceived();
                 RXState = ZBS_RX_WAIT_HEADER;
             }
             break;
 
+        case ZBS_RX_WAIT_BKP:
+            *serialbufferp = lastchar;
+            serialbufferp++;
+            bytesRemain--;
+            if (bytesRemain == 0) {
+                if (checkCRC(serialbuffer, sizeof(struct espBlockPush))) {
+                    startBlockPush((struct espBlockPush *) serialbuffer);
+                    pushPosition = 0;
+                    pr("ACK>");
+                    RXState = ZBS_RX_WAIT_PUSHDATA;
+                } else {
+                    pr("NOK>");
+                    RXState = ZBS_RX_WAIT_HEADER;
+                }
+            }
+            break;
+        case ZBS_RX_WAIT_PUSHDATA:
+            blockCache[pushEntry].data[pushPosition++] = 0xAA ^ lastchar;
+            if (pushPosition >= 4100) {
+                ESP_LOGI(TAG, "Pushed block %d received", blockCache[pushEntry].blockId);
+                blockCache[pushEntry].valid = true;
+                RXState                     = ZBS_RX_WAIT_HEADER;
+            }
+            break;
+
         case ZBS_RX_WAIT_SDA:
             *serialbufferp = lastchar;
             serialbufferp++;
             bytesRemain--;
             if (bytesRemain == 0) {
                 if (checkCRC(serialbuffer, sizeof(struct pendingData))) {
-                    struct pendingData *pd   = (struct pendingData *) serialbuffer;
-                    int32_t              slot = findSlotForMac(pd->targetMac);
-                    if (slot == -1) slot = findFreeSlot();
-                    if (slot != -1) {
-                        memcpy(&(pendingDataArr[slot]), serialbuffer, sizeof(struct pendingData));
+                    struct pendingData *pd = (struct pendingData *) serialbuffer;
+                    if (storePendingData(pd)) {
                         pr("ACK>");
                     } else {
                         pr("NOQ>");
@@ -335,8 +694,7 @@ void     processSerial(uint8_t lastchar) {
             bytesRemain--;
             if (bytesRemain == 0) {
                 if (checkCRC(serialbuffer, sizeof(struct pendingData))) {
-                    struct pendingData *pd = (struct pendingData *) serialbuffer;
-                    deleteAllPendingDataForMac((uint8_t *) &pd->targetMac);
+                    cancelPendingData((struct pendingData *) serialbuffer);
                     pr("ACK>");
                 } else {
                     pr("NOK>");
@@ -350,36 +708,9 @@ void     processSerial(uint8_t lastchar) {
             serialbufferp++;
             bytesRemain--;
             if (bytesRemain == 0) {
-                if (checkCRC(serialbuffer, sizeof(struct espSetChannelPower))) {
-                   struct espSetChannelPower *scp = (struct espSetChannelPower *) serialbuffer;
-#ifdef CONFIG_OEPL_SUBGIG_SUPPORT
-                    if(curSubGhzChannel != scp->subghzchannel
-                       && curSubGhzChannel != NO_SUBGHZ_CHANNEL)
-                    {
-                        curSubGhzChannel = scp->subghzchannel;
-                        ESP_LOGI(TAG,"Set SubGhz channel: %d",curSubGhzChannel);
-                        SubGig_radioSetChannel(scp->subghzchannel);
-                        if(scp->channel == 0) {
-                        // Not setting 802.15.4 channel
-                           goto SCPchannelFound;
-                        }
-                    }
-#endif
-                    for (uint8_t c = 0; c < sizeof(channelList); c++) {
-                        if (channelList[c] == scp->channel) goto SCPchannelFound;
-                    }
-                    goto SCPfailed;
-                SCPchannelFound:
+                if (checkCRC(serialbuffer, sizeof(struct espSetChannelPower)) && setChannelPower((struct espSetChannelPower *) serialbuffer)) {
                     pr("ACK>");
-                    if (curChannel != scp->channel) {
-                        radioSetChannel(scp->channel);
-                        curChannel = scp->channel;
-                    }
-                    curPower   = scp->power;
-                    radioSetTxPower(scp->power);
-                    ESP_LOGI(TAG, "Set channel: %d power: %d", curChannel, curPower);
                 } else {
-                SCPfailed:
                     pr("NOK>");
                 }
                 RXState = ZBS_RX_WAIT_HEADER;
@@ -388,58 +719,308 @@ void     processSerial(uint8_t lastchar) {
     }
 }
 
+// framed serial protocol
+#define FRAME_HOLD_SIZE (sizeof(struct espFrameHeader) + FRAME_MAX_BATCH * sizeof(struct pendingData))
+#define FRAME_TX_SIZE   (sizeof(struct espFrameHeader) + sizeof(struct espTagReturnData) + 2)
+#define FRAME_NAK_DELAY 20  // ms between two requests for the same missing command
+
+struct frameResult {
+    bool    valid;
+    uint8_t seq;
+    uint8_t count;
+    uint8_t status[FRAME_MAX_BATCH];
+};
+// small commands that arrived before the one they follow, larger ones are sent again by the ESP32
+struct frameHeld {
+    bool     valid;
+    uint16_t len;
+    uint8_t  data[FRAME_HOLD_SIZE];
+};
+
+uint8_t            frameRx[FRAME_MAX_ENCODED];
+uint32_t           frameRxLen    = 0;
+uint8_t            frameExpected = 0;  // sequence number of the next command to carry out
+uint8_t            frameTxSeq    = 0;
+uint8_t            lastNakSeq    = 0;
+uint32_t           lastNak       = 0;
+struct frameResult frameResults[FRAME_WINDOW];  // so a result that got lost can be sent again
+struct frameHeld   frameHeld[FRAME_WINDOW];
+
+void startFraming() {
+    framedSerial  = true;
+    frameRxLen    = 0;
+    frameExpected = 0;
+    frameTxSeq    = 0;
+    memset(frameResults, 0, sizeof(frameResults));
+    memset(frameHeld, 0, sizeof(frameHeld));
+}
+
+void espSendFrame(uint8_t type, const void *data, uint16_t len) {
+    static uint8_t raw[FRAME_TX_SIZE];
+    static uint8_t encoded[FRAME_TX_SIZE + FRAME_TX_SIZE / 254 + 3];
+    if (len > FRAME_TX_SIZE - sizeof(struct espFrameHeader) - 2) return;
+    struct espFrameHeader *fh = (struct espFrameHeader *) raw;
+    fh->type                  = type;
+    fh->seq                   = frameTxSeq;
+    fh->base                  = frameTxSeq;
+    frameTxSeq++;
+    memcpy(raw + sizeof(struct espFrameHeader), data, len);
+    len += sizeof(struct espFrameHeader);
+    uint16_t crc = crc16(0xFFFF, raw, len);
+    raw[len++]   = crc & 0xFF;
+    raw[len++]   = crc >> 8;
+    encoded[0]   = 0x00;
+    uint32_t encodedLen    = cobsEncode(raw, len, encoded + 1) + 1;
+    encoded[encodedLen++] = 0x00;
+    uart_write_bytes(1, (const char *) encoded, encodedLen);
+}
+void espSendFrameResult(const struct frameResult *fr) {
+    uint8_t buffer[sizeof(struct espFrameResult) + FRAME_MAX_BATCH];
+    buffer[0] = fr->seq;
+    memcpy(buffer + 1, fr->status, fr->count);
+    espSendFrame(FRAME_RESULT, buffer, fr->count + 1);
+}
+void espSendFrameNak() {
+    if (lastNakSeq == frameExpected && (getMillis() - lastNak) < FRAME_NAK_DELAY) return;
+    lastNakSeq = frameExpected;
+    lastNak    = getMillis();
+    espSendFrame(FRAME_NAK, &frameExpected, 1);
+}
+
+// carries out a command, and answers it
+void processFrame(const uint8_t *frame, uint16_t len) {
+    const struct espFrameHeader *fh      = (const struct espFrameHeader *) frame;
+    const uint8_t               *payload = frame + sizeof(struct espFrameHeader);
+    struct frameResult          *fr      = &frameResults[fh->seq % FRAME_WINDOW];
+    len -= sizeof(struct espFrameHeader);
+    fr->valid     = true;
+    fr->seq       = fh->seq;
+    fr->count     = 1;
+    fr->status[0] = FRAME_STATUS_ACK;
+    switch (fh->type) {
+        case FRAME_SDA:
+        case FRAME_CXD:
+            if ((len % sizeof(struct pendingData)) || (len == 0) || (len > FRAME_MAX_BATCH * sizeof(struct pendingData))) {
+                fr->status[0] = FRAME_STATUS_NOK;
+                break;
+            }
+            fr->count = len / sizeof(struct pendingData);
+            for (uint8_t c = 0; c < fr->count; c++) {
+                const struct pendingData *pd = ((const struct pendingData *) payload) + c;
+                if (fh->type == FRAME_CXD) {
+                    cancelPendingData(pd);
+                    fr->status[c] = FRAME_STATUS_ACK;
+                } else {
+                    fr->status[c] = storePendingData(pd) ? FRAME_STATUS_ACK : FRAME_STATUS_NOQ;
+                }
+            }
+            ESP_LOGI(TAG, "%s frame with %d entries", (fh->type == FRAME_SDA) ? "SDA" : "CXD", fr->count);
+            break;
+        case FRAME_SCP:
+            if ((len != sizeof(struct espSetChannelPower)) || !setChannelPower((const struct espSetChannelPower *) payload)) fr->status[0] = FRAME_STATUS_NOK;
+            break;
+        case FRAME_BLOCK:
+            if ((len < sizeof(struct espBlockPush)) || (len > sizeof(struct espBlockPush) + BLOCK_XFER_BUFFER_SIZE)) {
+                fr->status[0] = FRAME_STATUS_NOK;
+                break;
+            } else {
+                const struct espBlockPush *bh = (const struct espBlockPush *) payload;
+                // an answer to a request that timed out is discarded, the slot may be waiting for another block by now
+                if ((hostSlot == NO_BLOCK_SLOT) || (bh->ver != blockSlots[hostSlot].requestedData.ver) || (bh->blockId != blockSlots[hostSlot].requestedData.blockId)) {
+                    ESP_LOGI(TAG, "Stale blockdata frame for block %d dropped", bh->blockId);
+                    break;
+                }
+                len -= sizeof(struct espBlockPush);
+                memcpy(blockSlots[hostSlot].blockbuffer, payload + sizeof(struct espBlockPush), len);
+                memset(blockSlots[hostSlot].blockbuffer + len, 0xFF, BLOCK_XFER_BUFFER_SIZE - len);
+            }
+            ESP_LOGI(TAG, "Blockdata frame received, %lu ms after the request", getMillis() - nextBlockAttempt);
+            blockDataReceived();
+            break;
+        case FRAME_BKP:
+            if ((len < sizeof(struct espBlockPush)) || (len > sizeof(struct espBlockPush) + BLOCK_XFER_BUFFER_SIZE)) {
+                fr->status[0] = FRAME_STATUS_NOK;
+                break;
+            } else {
+                struct blockCacheEntry *bce = startBlockPush((const struct espBlockPush *) payload);
+                len -= sizeof(struct espBlockPush);
+                memcpy(bce->data, payload + sizeof(struct espBlockPush), len);
+                memset(bce->data + len, 0xFF, BLOCK_XFER_BUFFER_SIZE - len);
+                bce->valid = true;
+                ESP_LOGI(TAG, "Pushed block %d received", bce->blockId);
+            }
+            break;
+        case FRAME_PING:
+            break;
+        default:
+            fr->status[0] = FRAME_STATUS_NOK;
+            break;
+    }
+    espSendFrameResult(fr);
+}
+
+void frameReceived() {
+    int32_t len = -1;
+    if (frameRxLen <= sizeof(frameRx)) len = cobsDecode(frameRx, frameRxLen);
+    if (len < (int32_t) (sizeof(struct espFrameHeader) + 2)) return;
+    len -= 2;
+    if (crc16(0xFFFF, frameRx, len) != (frameRx[len] | (frameRx[len + 1] << 8))) {
+        ESP_LOGI(TAG, "Frame CRC error");
+        // whatever it was, it wasn't a command before the one we wait for
+        espSendFrameNak();
+        return;
+    }
+    const struct espFrameHeader *fh = (const struct espFrameHeader *) frameRx;
+    // the ESP32 gave up on commands before base, don't wait for them
+    while ((int8_t) (fh->base - frameExpected) > 0) {
+        frameHeld[frameExpected % FRAME_WINDOW].valid = false;
+        frameExpected++;
+    }
+    int8_t ahead = fh->seq - frameExpected;
+    if (ahead < 0) {
+        // done before, the result must have been lost
+        const struct frameResult *fr = &frameResults[fh->seq % FRAME_WINDOW];
+        if ((ahead >= -FRAME_WINDOW) && fr->valid && (fr->seq == fh->seq)) espSendFrameResult(fr);
+        return;
+    }
+    if (ahead >= FRAME_WINDOW) return;
+    if (ahead > 0) {
+        struct frameHeld *held = &frameHeld[fh->seq % FRAME_WINDOW];
+        if ((uint32_t) len <= sizeof(held->data)) {
+            memcpy(held->data, frameRx, len);
+            held->len   = len;
+            held->valid = true;
+        }
+        espSendFrameNak();
+        return;
+    }
+    processFrame(frameRx, len);
+    frameExpected++;
+    struct frameHeld *held = &frameHeld[frameExpected % FRAME_WINDOW];
+    while (held->valid && (((struct espFrameHeader *) held->data)->seq == frameExpected)) {
+        held->valid = false;
+        processFrame(held->data, held->len);
+        frameExpected++;
+        held = &frameHeld[frameExpected % FRAME_WINDOW];
+    }
+}
+
+void processFrameByte(uint8_t c) {
+    static uint32_t lastSerial = 0;
+    if ((getMillis() - lastSerial) > 1000) frameRxLen = 0;
+    lastSerial = getMillis();
+    if (c == 0x00) {
+        if (frameRxLen) frameReceived();
+        frameRxLen = 0;
+        return;
+    }
+    if (frameRxLen < sizeof(frameRx)) frameRx[frameRxLen] = c;
+    if (frameRxLen < sizeof(frameRx) + 1) frameRxLen++;
+    // frame types aren't printable, so a text command at the start of a frame means the ESP32 restarted
+    if ((frameRxLen == 4) && (isSame(frameRx, "RDY?", 4) || isSame(frameRx, "NFO?", 4) || isSame(frameRx, "FRM!", 4))) {
+        ESP_LOGI(TAG, "Text command in framed mode, back to text");
+        framedSerial = false;
+        for (uint8_t i = 0; i < 4; i++) processSerial(frameRx[i]);
+    }
+    if ((frameRxLen == 4) && (isSame(frameRx, "LAT?", 4) || isSame(frameRx, "TXS?", 4))) {
+        if (frameRx[0] == 'L') {
+            espNotifyLatency();
+        } else {
+            espNotifyTxStats();
+        }
+        frameRxLen = sizeof(frameRx) + 1;  // not a frame, drop the rest
+    }
+}
+
 // sending data to the ESP
+void espNotify(const char *cmd, uint8_t frameType, const void *data, uint16_t len) {
+    if (framedSerial) {
+        espSendFrame(frameType, data, len);
+        return;
+    }
+    for (uint8_t c = 0; c < 4; c++) {
+        uartTx(cmd[c]);
+    }
+    for (uint16_t c = 0; c < len; c++) {
+        uartTx(((const uint8_t *) data)[c]);
+    }
+}
 void espBlockRequest(const struct blockRequest *br, uint8_t *src) {
-    struct espBlockRequest *ebr = (struct espBlockRequest *) blockbuffer;
-    uartTx('R');
-    uartTx('Q');
-    uartTx('B');
-    uartTx('>');
-    memcpy(&(ebr->ver), &(br->ver), 8);
-    memcpy(&(ebr->src), src, 8);
-    ebr->blockId = br->blockId;
-    addCRC(ebr, sizeof(struct espBlockRequest));
-    for (uint8_t c = 0; c < sizeof(struct espBlockRequest); c++) {
-        uartTx(((uint8_t *) ebr)[c]);
+    struct espBlockRequest ebr = {0};
+    memcpy(&(ebr.ver), &(br->ver), 8);
+    memcpy(&(ebr.src), src, 8);
+    ebr.blockId = br->blockId;
+    addCRC(&ebr, sizeof(struct espBlockRequest));
+    espNotify("RQB>", FRAME_RQB, &ebr, sizeof(struct espBlockRequest));
+}
+// only one block is requested from the ESP32 at a time; the block data doesn't say who it's for, and the serial link is the bottleneck anyway
+void requestNextBlockFromHost() {
+    if (hostSlot != NO_BLOCK_SLOT) {
+        if ((getMillis() - nextBlockAttempt) < HOST_BLOCK_TIMEOUT) return;
+        ESP_LOGI(TAG, "Block request for slot %d timed out", hostSlot);
+        hostSlot = NO_BLOCK_SLOT;
+        // frames name the block they carry, text mode has to wait for a late answer to be refused
+        if (!framedSerial) hostBlockTimedOut = getMillis();
     }
+    if (hostBlockStreaming) return;
+    if (hostBlockTimedOut) {
+        if ((getMillis() - hostBlockTimedOut) < HOST_BLOCK_HOLDOFF) return;
+        hostBlockTimedOut = 0;
+    }
+
+    // serve the slot that has been waiting the longest, the block may have been pushed in the meantime
+    int8_t next;
+    do {
+        next = NO_BLOCK_SLOT;
+        for (uint8_t c = 0; c < MAX_BLOCK_SLOTS; c++) {
+            if (!blockSlots[c].inUse || !blockSlots[c].waitingForHost) continue;
+            if ((next == NO_BLOCK_SLOT) || ((int32_t) (blockSlots[c].hostQueued - blockSlots[next].hostQueued) < 0)) next = c;
+        }
+        if (next == NO_BLOCK_SLOT) return;
+        if (loadBlockFromCache(&blockSlots[next])) {
+            blockSlots[next].waitingForHost = false;
+            blockSlots[next].dataValid      = true;
+            next                            = NO_BLOCK_SLOT;
+        }
+    } while (next == NO_BLOCK_SLOT);
+
+    struct blockSlot *bs = &blockSlots[next];
+    bs->waitingForHost   = false;
+    bs->dataValid        = false;
+    bs->hostRequested    = getMillis();
+    hostSlot             = next;
+    blockPosition        = 0;
+    espBlockRequest(&bs->requestedData, bs->mac);
+    nextBlockAttempt = getMillis();
+}
+void blockDataReceived() {
+    // without a slot, this was the rest of an answer to a request that timed out
+    if (hostSlot != NO_BLOCK_SLOT) {
+        struct blockSlot *bs = &blockSlots[hostSlot];
+        // if the tag asked for another block in the meantime, this data is stale
+        if (bs->inUse && !bs->waitingForHost) bs->dataValid = true;
+        hostSlot = NO_BLOCK_SLOT;
+    }
+    requestNextBlockFromHost();
 }
 void espNotifyAvailDataReq(const struct AvailDataReq *adr, const uint8_t *src) {
-    uartTx('A');
-    uartTx('D');
-    uartTx('R');
-    uartTx('>');
-
     struct espAvailDataReq eadr = {0};
     memcpy((void *) eadr.src, (void *) src, 8);
     memcpy((void *) &eadr.adr, (void *) adr, sizeof(struct AvailDataReq));
     addCRC(&eadr, sizeof(struct espAvailDataReq));
-    for (uint8_t c = 0; c < sizeof(struct espAvailDataReq); c++) {
-        uartTx(((uint8_t *) &eadr)[c]);
-    }
+    espNotify("ADR>", FRAME_ADR, &eadr, sizeof(struct espAvailDataReq));
 }
 void espNotifyXferComplete(const uint8_t *src) {
     struct espXferComplete exfc;
     memcpy(&exfc.src, src, 8);
-    uartTx('X');
-    uartTx('F');
-    uartTx('C');
-    uartTx('>');
     addCRC(&exfc, sizeof(exfc));
-    for (uint8_t c = 0; c < sizeof(exfc); c++) {
-        uartTx(((uint8_t *) &exfc)[c]);
-    }
+    espNotify("XFC>", FRAME_XFC, &exfc, sizeof(exfc));
 }
 void espNotifyTimeOut(const uint8_t *src) {
     struct espXferComplete exfc;
     memcpy(&exfc.src, src, 8);
-    uartTx('X');
-    uartTx('T');
-    uartTx('O');
-    uartTx('>');
     addCRC(&exfc, sizeof(exfc));
-    for (uint8_t c = 0; c < sizeof(exfc); c++) {
-        uartTx(((uint8_t *) &exfc)[c]);
-    }
+    espNotify("XTO>", FRAME_XTO, &exfc, sizeof(exfc));
 }
 void espNotifyAPInfo() {
     pr("TYP>%02X", HW_TYPE);
@@ -453,9 +1034,36 @@ void espNotifyAPInfo() {
     pr("SCH>%03d",curSubGhzChannel);
 #endif
     pr("ZPW>%02X", curPower);
-    countSlots();
-    pr("PEN>%02X", curPendingData);
-    pr("NOP>%02X", curNoUpdate);
+    pr("PEN>%02X", (curPendingData > 0xFF) ? 0xFF : curPendingData);
+    pr("NOP>%02X", (curNoUpdate > 0xFF) ? 0xFF : curNoUpdate);
+    pr("BKC>%02X", BLOCK_CACHE_ENTRIES);
+    pr("FRM>%02X", FRAME_PROTOCOL_VERSION);
+}
+void espNotifyLatency() {
+    pr("LAT>rx ring peak %d, dropped %lu\n\r", radioRxPeak, radioRxDropped);
+    for (uint8_t c = 0; c < LATENCY_TYPES; c++) {
+        const struct latencyStats *ls = &latencyStats[c];
+        pr("LAT>%s n=%lu avg=%luus max=%luus", ls->name, ls->count, ls->count ? (uint32_t) (ls->totalUs / ls->count) : 0, ls->maxUs);
+        uint32_t limit = 250;
+        for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+            if (b < LATENCY_BUCKETS - 1) {
+                pr(" <%lu:%lu", limit, ls->buckets[b]);
+            } else {
+                pr(" >=%lu:%lu", limit >> 1, ls->buckets[b]);
+            }
+            limit <<= 1;
+        }
+        pr("\n\r");
+    }
+}
+void espNotifyTxStats() {
+    static const char *errorNames[RADIO_TX_ERRORS] = {"none", "cca_busy", "abort", "no_ack", "invalid_ack", "coexist", "security", "other"};
+    const struct radioTxStats *ts = &radioTxStats;
+    pr("TXS>queued %lu, refused %lu, peak %d, sent %lu (%lu parts), failed %lu\n\r", ts->queued, ts->queueFull, ts->queuePeak, ts->sent, ts->bulkSent, ts->failed);
+    pr("TXS>%lu bytes in %lu ms airtime, %lu B/s", ts->bytes, (uint32_t) (ts->airtimeUs / 1000), ts->airtimeUs ? (uint32_t) (ts->bytes * 1000000ULL / ts->airtimeUs) : 0);
+    pr(", retries %lu, timeouts %lu, errors", ts->retries, ts->timeouts);
+    for (uint8_t c = 1; c < RADIO_TX_ERRORS; c++) pr(" %s:%lu", errorNames[c], ts->errors[c]);
+    pr("\n\r");
 }
 
 void espNotifyTagReturnData(uint8_t *src, uint8_t len) {
@@ -472,14 +1080,7 @@ void espNotifyTagReturnData(uint8_t *src, uint8_t len) {
     etrd->len = len;
     memcpy(&etrd->returnData, trd, len);
     addCRC(etrd, len + 10);
-
-    uartTx('T');
-    uartTx('R');
-    uartTx('D');
-    uartTx('>');
-    for (uint8_t c = 0; c < len + 10; c++) {
-        uartTx(((uint8_t *)etrd)[c]);
-    }
+    espNotify("TRD>", FRAME_TRD, etrd, len + 10);
 }
 
 // process data from tag
@@ -487,39 +1088,42 @@ void processBlockRequest(const uint8_t *buffer, uint8_t forceBlockDownload) {
     struct MacFrameNormal *rxHeader = (struct MacFrameNormal *) buffer;
     struct blockRequest   *blockReq = (struct blockRequest *) (buffer + sizeof(struct MacFrameNormal) + 1);
     if (!checkCRC(blockReq, sizeof(struct blockRequest))) return;
-
-    // check if we're already talking to this mac
-    if (memcmp(rxHeader->src, lastBlockMac, 8) == 0) {
-        lastBlockRequest = getMillis();
-    } else {
-        // we weren't talking to this mac, see if there was a transfer in progress from another mac, recently
-        if ((getMillis() - lastBlockRequest) > CONCURRENT_REQUEST_DELAY) {
-            // mark this mac as the new current mac we're talking to
-            memcpy((void *) lastBlockMac, (void *) rxHeader->src, 8);
-            lastBlockRequest = getMillis();
-        } else {
-            // we're talking to another mac, let this mac know we can't accomodate another request right now
-            pr("BUSY!\n\r");
-            sendCancelXfer(rxHeader->src);
-            return;
-        }
-    }
+    dstPan = rxHeader->pan;
 
     // check if we have data for this mac
     if (findSlotForMac(rxHeader->src) == -1) {
         // no data for this mac, politely tell it to fuck off
+        releaseBlockSlotForMac(rxHeader->src);
         sendCancelXfer(rxHeader->src);
         return;
     }
 
+    // check if we're already talking to this mac
+    int8_t slot = findBlockSlot(rxHeader->src);
+    if (slot == NO_BLOCK_SLOT) {
+        slot = claimBlockSlot(rxHeader->src);
+        if (slot == NO_BLOCK_SLOT) {
+            // all slots are in use by other macs, let this mac know we can't accomodate another request right now
+            pr("BUSY!\n\r");
+            sendCancelXfer(rxHeader->src);
+            return;
+        }
+    }
+    struct blockSlot *bs = &blockSlots[slot];
+    bs->lastRequest      = getMillis();
+    bs->pan              = rxHeader->pan;
+
     bool requestDataDownload = false;
-    if ((blockReq->blockId != requestedData.blockId) || (blockReq->ver != requestedData.ver)) {
+    if ((blockReq->blockId != bs->requestedData.blockId) || (blockReq->ver != bs->requestedData.ver)) {
         // requested block isn't already in the buffer
         requestDataDownload = true;
+    } else if (!bs->dataValid && !bs->waitingForHost && (slot != hostSlot)) {
+        // an earlier download for this block failed
+        requestDataDownload = true;
     } else {
-        // requested block is already in the buffer
+        // requested block is already in the buffer, or on its way
         if (forceBlockDownload) {
-            if ((getMillis() - nextBlockAttempt) > 380) {
+            if (!bs->waitingForHost && ((getMillis() - bs->hostRequested) > 380)) {
                 requestDataDownload = true;
                 pr("FORCED\n\r");
             } else {
@@ -529,20 +1133,28 @@ void processBlockRequest(const uint8_t *buffer, uint8_t forceBlockDownload) {
     }
 
     // copy blockrequest into requested data
-    memcpy(&requestedData, blockReq, sizeof(struct blockRequest));
+    memcpy(&bs->requestedData, blockReq, sizeof(struct blockRequest));
+
+    // the ESP32 may have pushed this block already, unless a download is still being written into this slot
+    if (requestDataDownload && (slot != hostSlot) && loadBlockFromCache(bs)) {
+        requestDataDownload = false;
+        bs->waitingForHost  = false;
+        bs->dataValid       = true;
+    }
 
     struct MacFrameNormal  *txHeader                 = (struct MacFrameNormal *) (radiotxbuffer + 1);
     struct blockRequestAck *blockRequestAck          = (struct blockRequestAck *) (radiotxbuffer + sizeof(struct MacFrameNormal) + 2);
     radiotxbuffer[0]                                 = sizeof(struct MacFrameNormal) + 1 + sizeof(struct blockRequestAck) + RAW_PKT_PADDING;
     radiotxbuffer[sizeof(struct MacFrameNormal) + 1] = PKT_BLOCK_REQUEST_ACK;
 
-    if (blockStartTimer == 0) {
+    uint16_t blockFetchMs = (highspeedSerial == true) ? 140 : 550;
+    if (bs->sendAt == 0) {
         if (requestDataDownload) {
-            if (highspeedSerial == true) {
-                blockRequestAck->pleaseWaitMs = 140;
-            } else {
-                blockRequestAck->pleaseWaitMs = 550;
-            }
+            // every block queued for the ESP32 ahead of this one has to cross the serial link first
+            blockRequestAck->pleaseWaitMs = blockFetchMs * (1 + countHostQueue() - (bs->waitingForHost ? 1 : 0));
+        } else if (!bs->dataValid) {
+            // block is still on its way
+            blockRequestAck->pleaseWaitMs = blockFetchMs;
         } else {
             // block is already in buffer
             blockRequestAck->pleaseWaitMs = 30;
@@ -550,7 +1162,8 @@ void processBlockRequest(const uint8_t *buffer, uint8_t forceBlockDownload) {
     } else {
         blockRequestAck->pleaseWaitMs = 30;
     }
-    blockStartTimer = getMillis() + blockRequestAck->pleaseWaitMs;
+    bs->sendAt  = getMillis() + blockRequestAck->pleaseWaitMs;
+    bs->sending = false;
 
     memcpy(txHeader->src, mSelfMac, 8);
     memcpy(txHeader->dst, rxHeader->src, 8);
@@ -566,14 +1179,12 @@ void processBlockRequest(const uint8_t *buffer, uint8_t forceBlockDownload) {
 
     radioTx(radiotxbuffer);
 
-    // save the target for the blockdata
-    memcpy(dstMac, rxHeader->src, 8);
-    dstPan = rxHeader->pan;
-
     if (requestDataDownload) {
-        blockPosition = 0;
-        espBlockRequest(&requestedData, rxHeader->src);
-        nextBlockAttempt = getMillis();
+        // queue the slot for the ESP32, a download that's already running for this slot will be discarded
+        bs->dataValid      = false;
+        bs->waitingForHost = true;
+        bs->hostQueued     = getMillis();
+        requestNextBlockFromHost();
     }
 }
 
@@ -591,15 +1202,12 @@ void processAvailDataReq(uint8_t *buffer) {
     radiotxbuffer[sizeof(struct MacFrameNormal) + 1] = PKT_AVAIL_DATA_INFO;
 
     // check to see if we have data available for this mac
-    bool haveData = false;
-    for (uint8_t c = 0; c < MAX_PENDING_MACS; c++) {
-        if (pendingDataArr[c].attemptsLeft) {
-            if (memcmp(pendingDataArr[c].targetMac, rxHeader->src, 8) == 0) {
-                haveData = true;
-                memcpy((void *) availDataInfo, &(pendingDataArr[c].availdatainfo), sizeof(struct AvailDataInfo));
-                break;
-            }
-        }
+    bool    haveData = false;
+    int32_t slot     = findSlotForMac(rxHeader->src);
+    if (slot != -1) {
+        haveData = true;
+        memcpy((void *) availDataInfo, &(pendingDataArr[slot].availdatainfo), sizeof(struct AvailDataInfo));
+        availDataInfo->nextCheckIn = pendingNextCheckIn(slot);
     }
 
     // couldn't find data for this mac
@@ -625,7 +1233,8 @@ void processXferComplete(uint8_t *buffer) {
         memcpy((void *) lastAckMac, (void *) rxHeader->src, 8);
         espNotifyXferComplete(rxHeader->src);
         int32_t slot = findSlotForMac(rxHeader->src);
-        if (slot != -1) pendingDataArr[slot].attemptsLeft = 0;
+        if (slot != -1) releasePendingSlot(slot);
+        releaseBlockSlotForMac(rxHeader->src);
     }
 }
 
@@ -650,36 +1259,36 @@ void processTagReturnData(uint8_t *buffer, uint8_t len) {
 }
 
 // send block data to the tag
-void sendPart(uint8_t partNo) {
+void sendPart(const struct blockSlot *bs, uint8_t partNo) {
     struct MacFrameNormal *frameHeader = (struct MacFrameNormal *) (radiotxbuffer + 1);
     struct blockPart      *blockPart   = (struct blockPart *) (radiotxbuffer + sizeof(struct MacFrameNormal) + 2);
     memset(radiotxbuffer + 1, 0, sizeof(struct blockPart) + sizeof(struct MacFrameNormal));
     radiotxbuffer[sizeof(struct MacFrameNormal) + 1] = PKT_BLOCK_PART;
     radiotxbuffer[0]                                 = sizeof(struct MacFrameNormal) + sizeof(struct blockPart) + BLOCK_PART_DATA_SIZE + 1 + RAW_PKT_PADDING;
     memcpy(frameHeader->src, mSelfMac, 8);
-    memcpy(frameHeader->dst, dstMac, 8);
-    blockPart->blockId   = requestedData.blockId;
+    memcpy(frameHeader->dst, bs->mac, 8);
+    blockPart->blockId   = bs->requestedData.blockId;
     blockPart->blockPart = partNo;
-    memcpy(&(blockPart->data), blockbuffer + (partNo * BLOCK_PART_DATA_SIZE), BLOCK_PART_DATA_SIZE);
+    memcpy(&(blockPart->data), bs->blockbuffer + (partNo * BLOCK_PART_DATA_SIZE), BLOCK_PART_DATA_SIZE);
     addCRC(blockPart, sizeof(struct blockPart) + BLOCK_PART_DATA_SIZE);
     frameHeader->fcs.frameType       = 1;
     frameHeader->fcs.panIdCompressed = 1;
     frameHeader->fcs.destAddrType    = 3;
     frameHeader->fcs.srcAddrType     = 3;
     frameHeader->seq                 = seq++;
-    frameHeader->pan                 = dstPan;
-    radioTx(radiotxbuffer);
+    frameHeader->pan                 = bs->pan;
+    radioTxBulk(radiotxbuffer);
 }
-void sendBlockData() {
-    if (getBlockDataLength() == 0) {
+void startBlockData(struct blockSlot *bs) {
+    if (getBlockDataLength(bs) == 0) {
         pr("Invalid block request received, 0 parts..\n\r");
-        requestedData.requestedParts[0] |= 0x01;
+        bs->requestedData.requestedParts[0] |= 0x01;
     }
 
     pr("Sending parts:");
     for (uint8_t c = 0; (c < BLOCK_MAX_PARTS); c++) {
         if (c % 10 == 0) pr(" ");
-        if (requestedData.requestedParts[c / 8] & (1 << (c % 8))) {
+        if (bs->requestedData.requestedParts[c / 8] & (1 << (c % 8))) {
             pr("X");
         } else {
             pr(".");
@@ -687,18 +1296,38 @@ void sendBlockData() {
     }
     pr("\n\r");
 
-    uint8_t partNo = 0;
-    while (partNo < BLOCK_MAX_PARTS) {
-        for (uint8_t c = 0; (c < BLOCK_MAX_PARTS) && (partNo < BLOCK_MAX_PARTS); c++) {
-            if (requestedData.requestedParts[c / 8] & (1 << (c % 8))) {
-                sendPart(c);
-                partNo++;
-            }
-        }
-        if(dstPan == PROTO_PAN_ID_SUBGHZ) {
-        // Don't send BLOCK_MAX_PARTS for subgig, it requests what it 
+    bs->sending    = true;
+    bs->partCursor = 0;
+    if (bs->pan == PROTO_PAN_ID_SUBGHZ) {
+        // Don't send BLOCK_MAX_PARTS for subgig, it requests what it
         // can handle with its limited RAM
-           break;
+        bs->partsLeft = getBlockDataLength(bs);
+    } else {
+        // repeat the requested parts until BLOCK_MAX_PARTS parts are sent
+        bs->partsLeft = BLOCK_MAX_PARTS;
+    }
+}
+// sends one part to every tag that is ready to receive, so transfers to multiple tags are interleaved
+void sendBlockData() {
+    for (uint8_t c = 0; c < MAX_BLOCK_SLOTS; c++) {
+        struct blockSlot *bs = &blockSlots[c];
+        if (!bs->inUse || (bs->sendAt == 0) || (getMillis() < bs->sendAt)) continue;
+        if (!bs->dataValid) {
+            // wait for the block data, unless we'll never get it
+            if (!bs->waitingForHost && (c != hostSlot)) bs->sendAt = 0;
+            continue;
+        }
+        if (!bs->sending) startBlockData(bs);
+
+        while (!(bs->requestedData.requestedParts[bs->partCursor / 8] & (1 << (bs->partCursor % 8)))) {
+            bs->partCursor = (bs->partCursor + 1) % BLOCK_MAX_PARTS;
+        }
+        sendPart(bs, bs->partCursor);
+        bs->partCursor = (bs->partCursor + 1) % BLOCK_MAX_PARTS;
+
+        if (--bs->partsLeft == 0) {
+            bs->sending = false;
+            bs->sendAt  = 0;
         }
     }
 }
@@ -753,6 +1382,153 @@ void sendPong(void *buf) {
     radioTx(radiotxbuffer);
 }
 
+// handles one packet from a tag
+void processRadioPacket(int32_t ret, uint32_t rxTime) {
+    led_flash(0);
+
+    uint32_t txFrames = radioTxFrames;
+    uint8_t PktType = getPacketType(radiorxbuffer);
+#if CONFIG_OEPL_VERBOSE_DEBUG
+    LOGV_RAW("Received %d byte ",ret);
+    for(uint8_t i = 0; gPktTypeLookupTbl[i].Name != NULL; i++) {
+       if(gPktTypeLookupTbl[i].Type == PktType) {
+          LOGV_RAW("%s",gPktTypeLookupTbl[i].Name);
+          break;
+       }
+       if(gPktTypeLookupTbl[i].Name == NULL) {
+          LOGV_RAW("undefined (0x%02x)",PktType);
+       }
+    }
+    LOGV_RAW(" packet:\n");
+    LOGV_HEX(radiorxbuffer,ret);
+#endif
+    // received a packet, lets see what it is
+    switch (PktType) {
+        case PKT_AVAIL_DATA_REQ:
+            if (ret == 28) {
+                // old version of the AvailDataReq struct, set all the new fields to zero, so it will pass the CRC
+                memset(radiorxbuffer + 1 + sizeof(struct MacFrameBcast) + sizeof(struct oldAvailDataReq), 0,
+                       sizeof(struct AvailDataReq) - sizeof(struct oldAvailDataReq) + 2);
+                processAvailDataReq(radiorxbuffer);
+            } else if (ret == 40) {
+                // new version of the AvailDataReq struct
+                processAvailDataReq(radiorxbuffer);
+            }
+            break;
+        case PKT_BLOCK_REQUEST:
+            processBlockRequest(radiorxbuffer, 1);
+            break;
+        case PKT_BLOCK_PARTIAL_REQUEST:
+            processBlockRequest(radiorxbuffer, 0);
+            break;
+        case PKT_XFER_COMPLETE:
+            processXferComplete(radiorxbuffer);
+            break;
+        case PKT_PING:
+            sendPong(radiorxbuffer);
+            break;
+        case PKT_AVAIL_DATA_SHORTREQ:
+            // a short AvailDataReq is basically a very short (1 byte payload) packet that requires little preparation on the tx side, for optimal
+            // battery use bytes of the struct are set 0, so it passes the checksum test, and the ESP32 can detect that no interesting payload is
+            // sent
+            if (ret == 18) {
+                memset(radiorxbuffer + 1 + sizeof(struct MacFrameBcast), 0, sizeof(struct AvailDataReq) + 2);
+                processAvailDataReq(radiorxbuffer);
+            }
+            break;
+        case PKT_TAG_RETURN_DATA:
+            processTagReturnData(radiorxbuffer, ret);
+            break;
+        default:
+            ESP_LOGI(TAG, "t=%02X" , getPacketType(radiorxbuffer));
+            break;
+    }
+    // the first frame sent since is the response
+    if (radioTxFrames != txFrames) recordLatency(PktType, radioLastTx - rxTime);
+}
+
+void radioTimerExpired(void *arg) {
+    xTaskNotifyGive(radioTaskHandle);
+}
+// keeps *wait at most the ms left until due
+void waitUntil(uint32_t due, uint32_t *wait) {
+    int32_t left = (int32_t) (due - getMillis());
+    if (left < 0) left = 0;
+    if ((uint32_t) left < *wait) *wait = left;
+}
+// ms until sendBlockData, requestNextBlockFromHost or the housekeeping have something to do.
+// Block data arriving from the ESP32 wakes the radio task through the serial task
+uint32_t nextRadioWork() {
+    uint32_t wait = RADIO_IDLE_WAIT;
+    waitUntil(housekeepingTimer + (1000 * HOUSEKEEPING_INTERVAL) - 100, &wait);
+    if (hostSlot != NO_BLOCK_SLOT) waitUntil(nextBlockAttempt + HOST_BLOCK_TIMEOUT, &wait);
+    if (hostBlockTimedOut) waitUntil(hostBlockTimedOut + HOST_BLOCK_HOLDOFF, &wait);
+    for (uint8_t c = 0; c < MAX_BLOCK_SLOTS; c++) {
+        struct blockSlot *bs = &blockSlots[c];
+        if (!bs->inUse || (bs->sendAt == 0)) continue;
+        // a slot still waiting for its block data can't send yet
+        if (!bs->dataValid && (bs->waitingForHost || (c == hostSlot))) continue;
+        waitUntil(bs->sendAt, &wait);
+    }
+    return wait;
+}
+
+void radioTask(void *arg) {
+    housekeepingTimer = getMillis();
+    while (1) {
+        xSemaphoreTake(protoMutex, portMAX_DELAY);
+        radioTxService();
+        uint32_t rxTime;
+        int32_t  ret;
+        while ((ret = commsRxUnencrypted(&radiorxbuffer, &rxTime)) > 0) {
+            if (ret > 1) processRadioPacket(ret, rxTime);
+            commsRxRelease();
+        }
+
+        requestNextBlockFromHost();
+        // sendBlockData queues up to one part per slot
+        if (radioTxBulkRoom() >= MAX_BLOCK_SLOTS) sendBlockData();
+
+        if ((getMillis() - housekeepingTimer) >= ((1000 * HOUSEKEEPING_INTERVAL) - 100)) {
+            memset(&lastTagReturn, 0, 8);
+            expirePendingSlots();
+            housekeepingTimer = getMillis();
+        }
+        uint32_t wait = nextRadioWork();
+        xSemaphoreGive(protoMutex);
+
+        if (wait == 0) {
+            // a part is due, transmit_done wakes us when there's room for it
+            if (radioTxBulkRoom() < MAX_BLOCK_SLOTS) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RADIO_IDLE_WAIT));
+            continue;
+        }
+        esp_timer_stop(radioTimer);
+        esp_timer_start_once(radioTimer, wait * 1000ULL);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+void serialTask(void *arg) {
+    while (1) {
+        uint8_t curr_char;
+        bool    more = true;
+        while (more) {
+            xSemaphoreTake(protoMutex, portMAX_DELAY);
+            for (uint16_t c = 0; c < SERIAL_CHUNK; c++) {
+                if (!getRxCharSecond(&curr_char)) {
+                    more = false;
+                    break;
+                }
+                processSerial(curr_char);
+            }
+            xSemaphoreGive(protoMutex);
+        }
+        // whatever came in may have given the radio task something to do
+        xTaskNotifyGive(radioTaskHandle);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
 void app_main(void) {
     esp_event_loop_create_default();
     
@@ -760,9 +1536,10 @@ void app_main(void) {
     init_led();
     init_second_uart();
 
-    requestedData.blockId = 0xFF;
+    memset(blockSlots, 0, sizeof(blockSlots));
+    memset(blockCache, 0, sizeof(blockCache));
     // clear the array with pending information
-    memset(pendingDataArr, 0, sizeof(pendingDataArr));
+    initPendingSlots();
 
     radio_init(curChannel);
 #ifdef CONFIG_OEPL_SUBGIG_SUPPORT
@@ -785,96 +1562,11 @@ void app_main(void) {
     ESP_LOGI(TAG, "H2 ready!");
 #endif
 
-    housekeepingTimer = getMillis();
-    while (1) {
-        while ((getMillis() - housekeepingTimer) < ((1000 * HOUSEKEEPING_INTERVAL) - 100)) {
-            int32_t ret = commsRxUnencrypted(radiorxbuffer);
-            if (ret > 1) {
-                led_flash(0);
-
-                uint8_t PktType = getPacketType(radiorxbuffer);
-#if CONFIG_OEPL_VERBOSE_DEBUG
-                LOGV_RAW("Received %d byte ",ret);
-                for(uint8_t i = 0; gPktTypeLookupTbl[i].Name != NULL; i++) {
-                   if(gPktTypeLookupTbl[i].Type == PktType) {
-                      LOGV_RAW("%s",gPktTypeLookupTbl[i].Name);
-                      break;
-                   }
-                   if(gPktTypeLookupTbl[i].Name == NULL) {
-                      LOGV_RAW("undefined (0x%02x)",PktType);
-                   }
-                }
-                LOGV_RAW(" packet:\n");
-                LOGV_HEX(radiorxbuffer,ret);
-#endif
-                // received a packet, lets see what it is
-                switch (PktType) {
-                    case PKT_AVAIL_DATA_REQ:
-                        if (ret == 28) {
-                            // old version of the AvailDataReq struct, set all the new fields to zero, so it will pass the CRC
-                            memset(radiorxbuffer + 1 + sizeof(struct MacFrameBcast) + sizeof(struct oldAvailDataReq), 0,
-                                   sizeof(struct AvailDataReq) - sizeof(struct oldAvailDataReq) + 2);
-                            processAvailDataReq(radiorxbuffer);
-                        } else if (ret == 40) {
-                            // new version of the AvailDataReq struct
-                            processAvailDataReq(radiorxbuffer);
-                        }
-                        break;
-                    case PKT_BLOCK_REQUEST:
-                        processBlockRequest(radiorxbuffer, 1);
-                        break;
-                    case PKT_BLOCK_PARTIAL_REQUEST:
-                        processBlockRequest(radiorxbuffer, 0);
-                        break;
-                    case PKT_XFER_COMPLETE:
-                        processXferComplete(radiorxbuffer);
-                        break;
-                    case PKT_PING:
-                        sendPong(radiorxbuffer);
-                        break;
-                    case PKT_AVAIL_DATA_SHORTREQ:
-                        // a short AvailDataReq is basically a very short (1 byte payload) packet that requires little preparation on the tx side, for optimal
-                        // battery use bytes of the struct are set 0, so it passes the checksum test, and the ESP32 can detect that no interesting payload is
-                        // sent
-                        if (ret == 18) {
-                            memset(radiorxbuffer + 1 + sizeof(struct MacFrameBcast), 0, sizeof(struct AvailDataReq) + 2);
-                            processAvailDataReq(radiorxbuffer);
-                        }
-                        break;
-                    case PKT_TAG_RETURN_DATA:
-                        processTagReturnData(radiorxbuffer, ret);
-                        break;
-                    default:
-                        ESP_LOGI(TAG, "t=%02X" , getPacketType(radiorxbuffer));
-                        break;
-                }
-            } else if (blockStartTimer == 0) {
-                vTaskDelay(10 / portTICK_PERIOD_MS);
-            }
-
-            uint8_t curr_char;
-            while (getRxCharSecond(&curr_char)) processSerial(curr_char);
-
-            if (blockStartTimer) {
-                if (getMillis() > blockStartTimer) {
-                    sendBlockData();
-                    blockStartTimer = 0;
-                }
-            }
-        }
-
-        memset(&lastTagReturn, 0, 8);
-        for (uint8_t cCount = 0; cCount < MAX_PENDING_MACS; cCount++) {
-            if (pendingDataArr[cCount].attemptsLeft == 1) {
-                if (pendingDataArr[cCount].availdatainfo.dataType != DATATYPE_NOUPDATE) {
-                    espNotifyTimeOut(pendingDataArr[cCount].targetMac);
-                }
-                pendingDataArr[cCount].attemptsLeft = 0;
-            } else if (pendingDataArr[cCount].attemptsLeft > 1) {
-                pendingDataArr[cCount].attemptsLeft--;
-                if (pendingDataArr[cCount].availdatainfo.nextCheckIn) pendingDataArr[cCount].availdatainfo.nextCheckIn--;
-            }
-        }
-        housekeepingTimer = getMillis();
-    }
+    protoMutex = xSemaphoreCreateMutex();
+    const esp_timer_create_args_t radioTimerArgs = {.callback = radioTimerExpired, .name = "radio"};
+    esp_timer_create(&radioTimerArgs, &radioTimer);
+    xTaskCreate(radioTask, "radio", 4096, NULL, RADIO_TASK_PRIORITY, &radioTaskHandle);
+    radioSetTask(radioTaskHandle);
+    xTaskCreate(serialTask, "serial", 4096, NULL, SERIAL_TASK_PRIORITY, &serialTaskHandle);
+    uart_set_rx_task(serialTaskHandle);
 }
@@ -7,6 +7,7 @@
 #include "esp_ieee802154.h"
 #include "esp_log.h"
 #include "esp_phy_init.h"
+#include "esp_random.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
@@ -32,44 +33,158 @@
 static const char *TAG = "RADIO";
 
 uint8_t mSelfMac[8];
-volatile uint8_t isInTransmit = 0;
-QueueHandle_t packet_buffer = NULL;
+
+// received frames stay in the driver's rx buffers, the isr hands them over by ring index
+#define RX_RING_SIZE 16  // below CONFIG_IEEE802154_RX_BUFFER_SIZE, so the driver always has buffers left to receive into
+
+struct rxFrame {
+    uint8_t *frame;   // length byte, payload, fcs
+    uint32_t rxTime;  // us, esp_timer
+};
+
+static struct rxFrame   rxRing[RX_RING_SIZE];
+static volatile uint32_t rxHead = 0;  // written by the isr only
+static volatile uint32_t rxTail = 0;  // written by the radio task only
+static uint8_t          *rxHeld = NULL;  // frame handed out by commsRxUnencrypted
+static TaskHandle_t      radioTask = NULL;
+#ifdef CONFIG_OEPL_SUBGIG_SUPPORT
+static uint8_t subGigRxBuffer[130];
+#endif
+
+volatile uint32_t radioRxDropped = 0;
+volatile uint8_t  radioRxPeak    = 0;
+volatile uint32_t radioTxFrames  = 0;
+volatile uint32_t radioLastTx    = 0;
+
+// frames wait in two queues, so replies to the tags don't wait behind a burst of block parts.
+// The queues belong to the radio task; the isr only reports how the frame on air ended
+#define TX_QUEUE_SIZE      8
+#define TX_BULK_QUEUE_SIZE 16
+#define TX_TIMEOUT         20000  // us without transmit_done or _failed before a frame counts as aborted
+#define BACKOFF_PERIOD     320    // us, 20 symbols
+
+#ifdef CONFIG_OEPL_TX_CCA
+#define TX_CCA true
+#else
+#define TX_CCA false
+#endif
+
+struct txDescriptor {
+    uint8_t attempts;
+    uint8_t frame[130];
+};
+
+struct txQueue {
+    struct txDescriptor *descriptors;
+    uint8_t              size;
+    uint8_t              head;  // next frame to send
+    uint8_t              count;
+};
+
+static struct txDescriptor txDescriptors[TX_QUEUE_SIZE];
+static struct txDescriptor txBulkDescriptors[TX_BULK_QUEUE_SIZE];
+static struct txQueue      txQueue     = {txDescriptors, TX_QUEUE_SIZE, 0, 0};
+static struct txQueue      txBulkQueue = {txBulkDescriptors, TX_BULK_QUEUE_SIZE, 0, 0};
+
+static struct txQueue          *txOnAir = NULL;  // queue whose head frame is being sent
+static const uint8_t *volatile  txOnAirFrame = NULL;
+static volatile bool            txComplete   = false;  // set by the isr
+static volatile esp_ieee802154_tx_error_t txError;
+static volatile uint32_t        txEndTime;
+static uint32_t                 txStartTime;
+static volatile bool            txBackingOff = false;
+static esp_timer_handle_t       txBackoffTimer = NULL;
+static portMUX_TYPE             txLock = portMUX_INITIALIZER_UNLOCKED;
+
+struct radioTxStats radioTxStats;
+
+void IRAM_ATTR radioWakeFromISR() {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    if (radioTask != NULL) vTaskNotifyGiveFromISR(radioTask, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR_ARG(xHigherPriorityTaskWoken);
+}
+
 void esp_ieee802154_receive_done(uint8_t *frame, esp_ieee802154_frame_info_t *frame_info) {
     ESP_EARLY_LOGI(TAG, "RX %d", frame[0]);
-    BaseType_t xHigherPriorityTaskWoken;
-    static uint8_t inner_rxPKT[130];
-    memcpy(inner_rxPKT, &frame[0], frame[0] + 1);
-    xQueueSendFromISR(packet_buffer, (void *)&inner_rxPKT, &xHigherPriorityTaskWoken);
-    portYIELD_FROM_ISR_ARG(xHigherPriorityTaskWoken);
-    if(esp_ieee802154_receive_handle_done(frame)) {
-        ESP_EARLY_LOGI(TAG, "esp_ieee802154_receive_handle_done() failed");
+    uint32_t queued = rxHead - rxTail;
+    // too short to hold a packet type, or no room left
+    if ((frame[0] < 4) || (queued >= RX_RING_SIZE)) {
+        if (frame[0] >= 4) radioRxDropped++;
+        if(esp_ieee802154_receive_handle_done(frame)) {
+            ESP_EARLY_LOGI(TAG, "esp_ieee802154_receive_handle_done() failed");
+        }
+        return;
     }
+    rxRing[rxHead % RX_RING_SIZE].frame  = frame;
+    rxRing[rxHead % RX_RING_SIZE].rxTime = (uint32_t) esp_timer_get_time();
+    rxHead++;
+    if (queued + 1 > radioRxPeak) radioRxPeak = queued + 1;
+    radioWakeFromISR();
+}
+
+// hands the result to radioTxService, unless the frame was given up on already
+static bool txEnded(const uint8_t *frame, esp_ieee802154_tx_error_t error) {
+    bool ended = false;
+    portENTER_CRITICAL_SAFE(&txLock);
+    if (frame == txOnAirFrame) {
+        txOnAirFrame = NULL;
+        txEndTime    = (uint32_t) esp_timer_get_time();
+        txError      = error;
+        txComplete   = true;
+        ended        = true;
+    }
+    portEXIT_CRITICAL_SAFE(&txLock);
+    return ended;
 }
 
 void esp_ieee802154_transmit_failed(const uint8_t *frame, esp_ieee802154_tx_error_t error) {
-    isInTransmit = 0;
     ESP_EARLY_LOGE(TAG, "TX Err: %d", error);
+    if (txEnded(frame, error)) radioWakeFromISR();
 }
 
 void esp_ieee802154_transmit_done(const uint8_t *frame, const uint8_t *ack, esp_ieee802154_frame_info_t *ack_frame_info) {
-    isInTransmit = 0;
     ESP_EARLY_LOGI(TAG, "TX %d", frame[0]);
     if(ack != NULL) {
        if(esp_ieee802154_receive_handle_done(ack)) {
           ESP_EARLY_LOGI(TAG, "esp_ieee802154_receive_handle_done() failed");
        }
     }
+    if (txEnded(frame, ESP_IEEE802154_TX_ERR_NONE)) radioWakeFromISR();
+}
+
+static void txBackoffExpired(void *arg) {
+    txBackingOff = false;
+    if (radioTask != NULL) xTaskNotifyGive(radioTask);
+}
+
+void radioSetTask(TaskHandle_t task) {
+    radioTask = task;
+}
+
+// gives every queued frame back to the driver
+static void flushRxRing() {
+    commsRxRelease();
+    while (rxTail != rxHead) {
+        esp_ieee802154_receive_handle_done(rxRing[rxTail % RX_RING_SIZE].frame);
+        rxTail++;
+    }
 }
+
 static bool zigbee_is_enabled = false;
 void radio_init(uint8_t ch) {
-    if (packet_buffer == NULL) packet_buffer = xQueueCreate(32, 130);
-
     // this will trigger a "IEEE802154 MAC sleep init failed" when called a second time, but it works
     if(zigbee_is_enabled)
     {
         zigbee_is_enabled = false;
         esp_ieee802154_disable();
     }
+    flushRxRing();
+    // a frame that was on air won't be reported anymore
+    if (txOnAirFrame != NULL) txEnded(txOnAirFrame, ESP_IEEE802154_TX_ERR_ABORT);
+    if (txBackoffTimer == NULL) {
+        const esp_timer_create_args_t backoffArgs = {.callback = txBackoffExpired, .name = "backoff"};
+        esp_timer_create(&backoffArgs, &txBackoffTimer);
+    }
     zigbee_is_enabled = true;
     esp_ieee802154_enable();
     esp_ieee802154_set_channel(ch);
@@ -78,6 +193,10 @@ void radio_init(uint8_t ch) {
     esp_ieee802154_set_promiscuous(false);
     esp_ieee802154_set_coordinator(false);
     esp_ieee802154_set_pending_mode(ESP_IEEE802154_AUTO_PENDING_ZIGBEE);
+#ifdef CONFIG_OEPL_TX_CCA
+    esp_ieee802154_set_cca_mode(ESP_IEEE802154_CCA_MODE_ED);
+    esp_ieee802154_set_cca_threshold(CONFIG_OEPL_TX_CCA_THRESHOLD);
+#endif
 
     // esp_ieee802154_set_extended_address needs the MAC in reversed byte order
     esp_read_mac(mSelfMac, ESP_MAC_IEEE802154);
@@ -107,31 +226,105 @@ void radio_init(uint8_t ch) {
              esp_ieee802154_get_short_address());
 }
 
-// uint32_t lastZbTx = 0;
-bool radioTx(uint8_t *packet) {
-#ifdef CONFIG_OEPL_SUBGIG_SUPPORT
-// The subghz driver uses DMA 
-    static DMA_ATTR uint8_t txPKT[130];
-#else
-    static uint8_t txPKT[130];
-#endif
+static bool txEnqueue(struct txQueue *q, const uint8_t *packet) {
     led_flash(1);
-	// while (getMillis() - lastZbTx < 6) {
-	// }
-	// lastZbTx = getMillis();
-	memcpy(txPKT, packet, packet[0]);
+    radioLastTx = (uint32_t) esp_timer_get_time();
+    radioTxFrames++;
 #ifdef CONFIG_OEPL_SUBGIG_SUPPORT
 	struct MacFrameNormal  *txHeader = (struct MacFrameNormal *) (packet + 1);
 
 	if(txHeader->pan == PROTO_PAN_ID_SUBGHZ) {
-		return SubGig_radioTx(packet);
+		return SubGig_radioTx((uint8_t *) packet);
 	}
 #endif
-	while (isInTransmit) {
-	}
-	isInTransmit = 1;
-	esp_ieee802154_transmit(txPKT, false);
-	return true;
+    if (q->count == q->size) {
+        radioTxStats.queueFull++;
+        return false;
+    }
+    struct txDescriptor *td = &q->descriptors[(q->head + q->count) % q->size];
+    memcpy(td->frame, packet, packet[0]);
+    td->attempts = 0;
+    q->count++;
+    radioTxStats.queued++;
+    uint8_t queued = txQueue.count + txBulkQueue.count;
+    if (queued > radioTxStats.queuePeak) radioTxStats.queuePeak = queued;
+    radioTxService();
+    return true;
+}
+
+bool radioTx(uint8_t *packet) {
+    return txEnqueue(&txQueue, packet);
+}
+
+bool radioTxBulk(uint8_t *packet) {
+    return txEnqueue(&txBulkQueue, packet);
+}
+
+uint8_t radioTxBulkRoom() {
+    return txBulkQueue.size - txBulkQueue.count;
+}
+
+static void txDequeue(struct txQueue *q) {
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+}
+
+// deals with the frame that just ended, and puts the next one on air
+void radioTxService() {
+    if (txOnAir != NULL && !txComplete && ((uint32_t) esp_timer_get_time() - txStartTime) > TX_TIMEOUT) {
+        ESP_LOGE(TAG, "TX timeout");
+        radioTxStats.timeouts++;
+        txEnded(txOnAirFrame, ESP_IEEE802154_TX_ERR_ABORT);
+    }
+    if (txComplete) {
+        struct txQueue      *q  = txOnAir;
+        struct txDescriptor *td = &q->descriptors[q->head];
+        txComplete              = false;
+        txOnAir                 = NULL;
+        radioTxStats.airtimeUs += txEndTime - txStartTime;
+        if (txError == ESP_IEEE802154_TX_ERR_NONE) {
+            radioTxStats.sent++;
+            radioTxStats.bytes += td->frame[0];
+            if (q == &txBulkQueue) radioTxStats.bulkSent++;
+            txDequeue(q);
+        } else {
+            radioTxStats.errors[(txError < RADIO_TX_ERRORS) ? txError : RADIO_TX_ERRORS - 1]++;
+#ifdef CONFIG_OEPL_TX_CCA
+            if ((txError == ESP_IEEE802154_TX_ERR_CCA_BUSY) && (td->attempts <= CONFIG_OEPL_TX_CCA_RETRIES)) {
+                // unslotted CSMA, the backoff window doubles with every busy channel
+                uint8_t  exponent = CONFIG_OEPL_TX_CCA_MIN_BE + td->attempts - 1;
+                if (exponent > CONFIG_OEPL_TX_CCA_MAX_BE) exponent = CONFIG_OEPL_TX_CCA_MAX_BE;
+                uint32_t backoff = (esp_random() % (1 << exponent)) * BACKOFF_PERIOD;
+                radioTxStats.retries++;
+                if (backoff) {
+                    txBackingOff = true;
+                    esp_timer_start_once(txBackoffTimer, backoff);
+                }
+            } else
+#endif
+            {
+                radioTxStats.failed++;
+                txDequeue(q);
+            }
+        }
+    }
+    while (txOnAir == NULL && !txBackingOff) {
+        struct txQueue *q = (txQueue.count) ? &txQueue : &txBulkQueue;
+        if (q->count == 0) return;
+        struct txDescriptor *td = &q->descriptors[q->head];
+        td->attempts++;
+        txOnAir      = q;
+        txOnAirFrame = td->frame;
+        txStartTime  = (uint32_t) esp_timer_get_time();
+        if (esp_ieee802154_transmit(td->frame, TX_CCA) == ESP_OK) return;
+        // nothing will be reported for this one
+        ESP_LOGE(TAG, "esp_ieee802154_transmit() failed");
+        txOnAir      = NULL;
+        txOnAirFrame = NULL;
+        radioTxStats.errors[ESP_IEEE802154_TX_ERR_ABORT]++;
+        radioTxStats.failed++;
+        txDequeue(q);
+    }
 }
 
 void radioSetChannel(uint8_t ch) {
@@ -140,19 +333,32 @@ void radioSetChannel(uint8_t ch) {
 
 void radioSetTxPower(uint8_t power) {}
 
-int8_t commsRxUnencrypted(uint8_t *data) {
-    static uint8_t inner_rxPKT_out[130];
-    if (xQueueReceive(packet_buffer, (void *)&inner_rxPKT_out, pdMS_TO_TICKS(100)) == pdTRUE) {
-        memcpy(data, &inner_rxPKT_out[1], inner_rxPKT_out[0] + 1);
-        return inner_rxPKT_out[0] - 2;
+int8_t commsRxUnencrypted(uint8_t **data, uint32_t *rxTime) {
+    if (rxHeld == NULL && rxTail != rxHead) {
+        struct rxFrame *rf = &rxRing[rxTail % RX_RING_SIZE];
+        rxHeld             = rf->frame;
+        *data              = &rf->frame[1];
+        *rxTime            = rf->rxTime;
+        return rf->frame[0] - 2;
     }
 #ifdef CONFIG_OEPL_SUBGIG_SUPPORT
-    if(gSubGigData.Enabled) {
-       int8_t Ret = SubGig_commsRxUnencrypted(data);
+    if(rxHeld == NULL && gSubGigData.Enabled) {
+       int8_t Ret = SubGig_commsRxUnencrypted(subGigRxBuffer);
        if(Ret > 0) {
+          *data = subGigRxBuffer;
+          *rxTime = (uint32_t) esp_timer_get_time();
           return Ret;
         }
     }
 #endif
     return 0;
 }
+
+void commsRxRelease() {
+    if (rxHeld == NULL) return;
+    if(esp_ieee802154_receive_handle_done(rxHeld)) {
+        ESP_LOGI(TAG, "esp_ieee802154_receive_handle_done() failed");
+    }
+    rxHeld = NULL;
+    rxTail++;
+}
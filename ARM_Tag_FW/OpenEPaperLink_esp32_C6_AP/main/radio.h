@@ -1,15 +1,51 @@
 #pragma once
 #include <stdbool.h>
 #include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #define RAW_PKT_PADDING 2
 extern uint8_t mSelfMac[8];
 
+extern volatile uint32_t radioRxDropped;  // frames that found the rx ring full
+extern volatile uint8_t  radioRxPeak;     // most frames waiting in the rx ring
+extern volatile uint32_t radioTxFrames;
+extern volatile uint32_t radioLastTx;     // us, when the last frame was queued for the radio
+
+#define RADIO_TX_ERRORS 8
+
+struct radioTxStats {
+    uint32_t queued;
+    uint32_t queueFull;  // frames refused
+    uint8_t  queuePeak;
+    uint32_t sent;
+    uint32_t bulkSent;   // block parts among them
+    uint32_t bytes;      // sent
+    uint64_t airtimeUs;  // from esp_ieee802154_transmit to transmit_done or _failed, retries included
+    uint32_t retries;    // attempts after a busy channel
+    uint32_t failed;     // frames given up on
+    uint32_t timeouts;   // frames the radio never reported back on
+    uint32_t errors[RADIO_TX_ERRORS];  // failed attempts, by esp_ieee802154_tx_error_t
+};
+extern struct radioTxStats radioTxStats;
+
 void radio_init(uint8_t ch);
+// queue a copy of the frame, it goes out before any block part that's waiting
 bool radioTx(uint8_t *packet);
+// queue a block part, behind everything else
+bool radioTxBulk(uint8_t *packet);
+uint8_t radioTxBulkRoom();
+// puts the next queued frame on air once the last one is done. Call it from the task that queues frames
+void radioTxService();
 void radioSetChannel(uint8_t ch);
 void radioSetTxPower(uint8_t power);
-int8_t commsRxUnencrypted(uint8_t *data);
+// task that is notified when a frame was received or sent
+void radioSetTask(TaskHandle_t task);
+void radioWakeFromISR();
+// points data at the next received frame and returns its length, 0 if there is none.
+// The frame stays in the driver's buffer until commsRxRelease(), no other frame is handed out until then
+int8_t commsRxUnencrypted(uint8_t **data, uint32_t *rxTime);
+void commsRxRelease();
 
 #ifdef SUBGIG_SUPPORT
 void SubGig_radio_init(uint8_t ch);
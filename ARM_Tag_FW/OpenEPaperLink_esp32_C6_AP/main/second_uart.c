@@ -35,6 +35,8 @@ volatile int     curr_buff_pos   = 0;
 volatile int     worked_buff_pos = 0;
 volatile uint8_t buff_pos[MAX_BUFF_POS + 5];
 
+static TaskHandle_t rx_task = NULL;
+
 static void uart_event_task(void *pvParameters);
 void init_second_uart() {
     uart_config_t uart_config = {
@@ -66,6 +68,8 @@ void uart_switch_speed(int baudrate) {
 	ESP_ERROR_CHECK(uart_param_config(1, &uart_config));
 }
 
+void uart_set_rx_task(TaskHandle_t task) { rx_task = task; }
+
 void uartTx(uint8_t data) { uart_write_bytes(1, (const char *) &data, 1); }
 
 
@@ -93,6 +97,7 @@ static void uart_event_task(void *pvParameters) {
                         curr_buff_pos++;
                         curr_buff_pos %= MAX_BUFF_POS;
                     }
+                    if (rx_task != NULL) xTaskNotifyGive(rx_task);
                     break;
                 default:
                     // ESP_LOGI(TAG, "uart event type: %d", event.type);
@@ -1,12 +1,16 @@
 #pragma once
 
 #include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 void init_second_uart();
 void uart_switch_speed(int baudrate);
 
 void uartTx(uint8_t data);
 bool getRxCharSecond(uint8_t *newChar);
+// task that is notified when getRxCharSecond has new characters
+void uart_set_rx_task(TaskHandle_t task);
 
 void uart_printf(const char *format, ...);
 
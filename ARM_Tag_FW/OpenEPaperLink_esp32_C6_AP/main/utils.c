@@ -35,4 +35,48 @@ void init_nvs()
         ret = nvs_flash_init();
     }
 	ESP_ERROR_CHECK( ret );
-}
\ No newline at end of file
+}
+
+// CRC-16/CCITT-FALSE, continued from crc. Start with 0xFFFF
+uint16_t crc16(uint16_t crc, const uint8_t *data, uint32_t len) {
+    static const uint16_t table[16] = {0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+                                       0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+    for (uint32_t c = 0; c < len; c++) {
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[c] >> 4)];
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[c] & 0x0F)];
+    }
+    return crc;
+}
+
+// COBS encodes len bytes from src into dst, which needs room for len + len / 254 + 1 bytes
+uint32_t cobsEncode(const uint8_t *src, uint32_t len, uint8_t *dst) {
+    uint32_t codePos = 0;
+    uint32_t pos     = 1;
+    uint8_t  code    = 1;
+    for (uint32_t c = 0; c < len; c++) {
+        if (src[c] != 0) {
+            dst[pos++] = src[c];
+            code++;
+        }
+        if (src[c] == 0 || code == 0xFF) {
+            dst[codePos] = code;
+            codePos      = pos++;
+            code         = 1;
+        }
+    }
+    dst[codePos] = code;
+    return pos;
+}
+
+// decodes a COBS encoded frame in place, returns the decoded length or -1 if it isn't valid
+int32_t cobsDecode(uint8_t *buf, uint32_t len) {
+    uint32_t in  = 0;
+    uint32_t out = 0;
+    while (in < len) {
+        uint8_t code = buf[in++];
+        if (code == 0 || in + code - 1 > len) return -1;
+        for (uint8_t c = 1; c < code; c++) buf[out++] = buf[in++];
+        if (code != 0xFF && in < len) buf[out++] = 0;
+    }
+    return out;
+}
@@ -2,4 +2,7 @@
 
 void        delay(int ms);
 uint32_t    getMillis();
-void init_nvs();
\ No newline at end of file
+void init_nvs();
+uint16_t    crc16(uint16_t crc, const uint8_t *data, uint32_t len);
+uint32_t    cobsEncode(const uint8_t *src, uint32_t len, uint8_t *dst);
+int32_t     cobsDecode(uint8_t *buf, uint32_t len);
@@ -0,0 +1,1067 @@
+// Block transfers of the C6/H2 AP, simulated on the host. main.c runs as it is, its radio and serial
+// tasks as coroutines on a virtual clock. Modelled here, after the code on the other end:
+//  - the radio: 250 kbit/s, one frame on air at a time, tag frames included. Nothing gets lost
+//  - the serial link: 8N1 both ways, delivered to the AP in chunks of UART_RX_THRESHOLD bytes
+//  - the ESP32 (serialap.cpp, text mode): answers a block request with >D> and, once acked, the block
+//    like writeBlockData does. Then it pushes the blocks after it into the AP's cache, like prefetchBlocks
+//  - the tags (syncedproto.c): request a block, sleep pleaseWaitMs, listen 300 ms, ask again for the
+//    parts that are missing. A tag that is turned away tries again at its next check-in
+// Every tag downloads one image, starting at a random time in the first second. For 1 to max tags,
+// reported are the time until the last tag is done, the throughput and the requests it took. With -b,
+// the time an image takes for 1 to max blocks per image, with and without the blocks pushed ahead.
+//
+//   block_sched_sim [max tags] [blocks per image]
+//   block_sched_sim -b [max blocks per image] [tags]
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "driver/uart.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "led.h"
+#include "nvs_flash.h"
+#include "proto.h"
+#include "radio.h"
+#include "sdkconfig.h"
+#include "second_uart.h"
+#include "utils.h"
+
+// main.c
+void    app_main(void);
+void    addCRC(void *p, uint8_t len);
+bool    checkCRC(void *p, uint8_t len);
+uint8_t getPacketType(void *buffer);
+bool    storePendingData(const struct pendingData *pd);
+
+#define MS(ms) ((uint64_t) (ms) * 1000000ULL)  // the clock runs in ns
+
+#define SERIAL_BAUD        115200
+#define UART_RX_THRESHOLD  120     // bytes the uart driver collects before it hands them to the serial task
+#define AIR_BYTE_NS        32000   // 250 kbit/s
+#define AIR_OVERHEAD_BYTES 6       // preamble, start of frame delimiter and length
+#define AIR_TURNAROUND_NS  320000  // rx to tx turnaround and cca
+#define ESP_PREP_MS        10      // ESP32 looking up the block before it answers a request
+#define ESP_REPLY_TIMEOUT  200     // waitCmdReply
+#define ESP_PREFETCH_DEPTH 2       // BLOCK_PREFETCH_DEPTH
+#define ESP_PUSHED_BLOCKS  16      // MAX_PUSHED_BLOCKS
+#define ESP_PUSHED_CAPACITY ((CONFIG_OEPL_BLOCK_CACHE_ENTRIES < ESP_PUSHED_BLOCKS) ? CONFIG_OEPL_BLOCK_CACHE_ENTRIES : ESP_PUSHED_BLOCKS)
+#define TAG_ACK_WAIT       50      // performBlockRequest
+#define TAG_REQUEST_TRIES  30
+#define TAG_RX_WINDOW      300     // blockRxLoop
+#define TAG_BLOCK_ATTEMPTS 5       // BLOCK_TRANSFER_ATTEMPTS
+#define TAG_XFER_TRIES     8
+#define TAG_RETRY_DELAY    40000   // ms until a tag that gave up on a block checks in again
+#define TAG_START_SPREAD   1000    // ms over which the tags start
+#define SIM_LIMIT          MS(30 * 60 * 1000)
+#define VER_BASE           0x5EED000000000000ULL  // data version of the image for tag 0
+
+static uint64_t simNs = 0;
+
+// events, in a binary heap ordered by time and then by when they were scheduled
+enum { EV_TASK_WAKE, EV_TIMER, EV_AIR_DONE, EV_TO_AP, EV_TO_ESP, EV_ESP, EV_TAG };
+
+struct event {
+    uint64_t at;
+    uint64_t order;
+    uint8_t  type;
+    uint16_t who;
+    uint32_t gen;  // events for a state that has moved on are dropped
+};
+
+static struct event *events     = NULL;
+static size_t        eventCount = 0;
+static size_t        eventSize  = 0;
+static uint64_t      eventOrder = 0;
+
+static bool eventBefore(const struct event *a, const struct event *b) {
+    return (a->at < b->at) || ((a->at == b->at) && (a->order < b->order));
+}
+
+static void schedule(uint64_t at, uint8_t type, uint16_t who, uint32_t gen) {
+    if (eventCount == eventSize) {
+        eventSize = eventSize ? eventSize * 2 : 1024;
+        events    = realloc(events, eventSize * sizeof(struct event));
+    }
+    size_t i  = eventCount++;
+    events[i] = (struct event){at, eventOrder++, type, who, gen};
+    while (i && eventBefore(&events[i], &events[(i - 1) / 2])) {
+        struct event e        = events[i];
+        events[i]             = events[(i - 1) / 2];
+        events[(i - 1) / 2]   = e;
+        i                     = (i - 1) / 2;
+    }
+}
+
+static bool nextEvent(struct event *ev) {
+    if (eventCount == 0) return false;
+    *ev       = events[0];
+    events[0] = events[--eventCount];
+    size_t i  = 0;
+    for (;;) {
+        size_t first = i;
+        size_t l     = 2 * i + 1;
+        size_t r     = l + 1;
+        if ((l < eventCount) && eventBefore(&events[l], &events[first])) first = l;
+        if ((r < eventCount) && eventBefore(&events[r], &events[first])) first = r;
+        if (first == i) break;
+        struct event e = events[i];
+        events[i]      = events[first];
+        events[first]  = e;
+        i              = first;
+    }
+    return true;
+}
+
+// FreeRTOS: tasks are coroutines that run until they wait for a notification or a delay
+#define MAX_TASKS  4
+#define TASK_STACK (256 * 1024)
+
+struct task {
+    ucontext_t  ctx;
+    void (*fn)(void *);
+    void       *arg;
+    UBaseType_t priority;
+    uint32_t    notified;
+    bool        blocked;
+    bool        delaying;  // in vTaskDelay, notifications don't wake it
+    uint32_t    gen;
+};
+
+static struct task  tasks[MAX_TASKS];
+static int          taskCount = 0;
+static struct task *current   = NULL;
+static ucontext_t   schedulerCtx;
+
+static void taskEntry(int index) {
+    tasks[index].fn(tasks[index].arg);
+}
+
+BaseType_t xTaskCreate(void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle) {
+    if (taskCount == MAX_TASKS) abort();
+    struct task *t = &tasks[taskCount];
+    memset(t, 0, sizeof(*t));
+    t->fn       = task;
+    t->arg      = arg;
+    t->priority = priority;
+    getcontext(&t->ctx);
+    t->ctx.uc_stack.ss_sp   = malloc(TASK_STACK);
+    t->ctx.uc_stack.ss_size = TASK_STACK;
+    t->ctx.uc_link          = &schedulerCtx;
+    makecontext(&t->ctx, (void (*)(void)) taskEntry, 1, taskCount);
+    taskCount++;
+    if (handle) *handle = t;
+    return pdPASS;
+}
+
+static void taskBlock(TickType_t ticks, bool delaying) {
+    struct task *t = current;
+    t->blocked     = true;
+    t->delaying    = delaying;
+    t->gen++;
+    if (ticks != portMAX_DELAY) schedule(simNs + MS(ticks), EV_TASK_WAKE, t - tasks, t->gen);
+    swapcontext(&t->ctx, &schedulerCtx);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    if (!current->notified && ticks) taskBlock(ticks, false);
+    uint32_t notified = current->notified;
+    if (clear) {
+        current->notified = 0;
+    } else if (notified) {
+        current->notified--;
+    }
+    return notified;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+    struct task *t = handle;
+    t->notified++;
+    if (t->blocked && !t->delaying) t->blocked = false;
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    taskBlock(ticks, true);
+}
+
+// runs whatever is ready, highest priority first, until every task waits for something
+static void runTasks(void) {
+    static uint64_t lastNs   = 0;
+    static uint32_t switches = 0;
+    for (;;) {
+        struct task *next = NULL;
+        for (int c = 0; c < taskCount; c++) {
+            if (!tasks[c].blocked && (!next || tasks[c].priority > next->priority)) next = &tasks[c];
+        }
+        if (!next) return;
+        if (simNs != lastNs) {
+            lastNs   = simNs;
+            switches = 0;
+        } else if (++switches > 100000) {
+            fprintf(stderr, "FAIL: the tasks keep running without time passing, at %.3f s\n", simNs / 1e9);
+            exit(2);
+        }
+        current = next;
+        swapcontext(&schedulerCtx, &next->ctx);
+        current = NULL;
+    }
+}
+
+// there is no preemption, so the mutex is never contended
+static int mutexHeld = 0;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return &mutexHeld;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    if ((*(int *) sem)++) abort();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    (*(int *) sem)--;
+    return pdTRUE;
+}
+
+// esp_timer
+struct timer {
+    void (*callback)(void *);
+    void    *arg;
+    uint32_t gen;
+};
+
+static struct timer timers[2];
+static int          timerCount = 0;
+
+int64_t esp_timer_get_time(void) {
+    return simNs / 1000;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+    if (timerCount == 2) abort();
+    timers[timerCount].callback = args->callback;
+    timers[timerCount].arg      = args->arg;
+    *handle                     = &timers[timerCount++];
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t handle, uint64_t timeoutUs) {
+    struct timer *t = handle;
+    schedule(simNs + timeoutUs * 1000, EV_TIMER, t - timers, ++t->gen);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t handle) {
+    ((struct timer *) handle)->gen++;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_create_default(void) { return ESP_OK; }
+esp_err_t nvs_flash_init(void) { return ESP_OK; }
+esp_err_t nvs_flash_erase(void) { return ESP_OK; }
+void      init_led() {}
+void      led_set(int nr, bool state) {}
+void      led_flash(int nr) {}
+
+// serial link, bytes are handed over in chunks at the time the last byte of the chunk is in
+#define LINE_FIFO_SIZE 65536
+
+struct serialLine {
+    uint64_t busyUntil;
+    uint32_t byteNs;
+    uint8_t  event;
+    uint8_t  fifo[LINE_FIFO_SIZE];
+    uint32_t head;
+    uint32_t count;
+};
+
+static struct serialLine toAP  = {.event = EV_TO_AP};
+static struct serialLine toESP = {.event = EV_TO_ESP};
+
+static void lineSend(struct serialLine *line, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    uint64_t       t     = (line->busyUntil > simNs) ? line->busyUntil : simNs;
+    uint16_t       chunk = 0;
+    if (line->count + len > LINE_FIFO_SIZE) abort();
+    for (size_t c = 0; c < len; c++) {
+        line->fifo[(line->head + line->count++) % LINE_FIFO_SIZE] = bytes[c];
+        t += line->byteNs;
+        if ((++chunk == UART_RX_THRESHOLD) || (c == len - 1)) {
+            schedule(t, line->event, chunk, 0);
+            chunk = 0;
+        }
+    }
+    line->busyUntil = t;
+}
+
+static uint8_t linePop(struct serialLine *line) {
+    uint8_t c  = line->fifo[line->head];
+    line->head = (line->head + 1) % LINE_FIFO_SIZE;
+    line->count--;
+    return c;
+}
+
+// second_uart.c
+#define AP_RX_BUFFER 8000
+
+static uint8_t      apRx[AP_RX_BUFFER];
+static uint32_t     apRxHead  = 0;
+static uint32_t     apRxCount = 0;
+static TaskHandle_t apRxTask  = NULL;
+
+void init_second_uart() {}
+
+void uart_switch_speed(int baudrate) {
+    toAP.byteNs  = 10 * 1000000000ULL / baudrate;
+    toESP.byteNs = toAP.byteNs;
+}
+
+int uart_write_bytes(int port, const void *src, size_t size) {
+    lineSend(&toESP, src, size);
+    return size;
+}
+
+void uartTx(uint8_t data) {
+    uart_write_bytes(1, &data, 1);
+}
+
+bool getRxCharSecond(uint8_t *newChar) {
+    if (apRxCount == 0) return false;
+    *newChar = apRx[apRxHead];
+    apRxHead = (apRxHead + 1) % AP_RX_BUFFER;
+    apRxCount--;
+    return true;
+}
+
+void uart_set_rx_task(TaskHandle_t task) {
+    apRxTask = task;
+}
+
+void uart_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    char buffer[128];
+    int  len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len > 0) uart_write_bytes(1, buffer, len);
+}
+
+// radio.c: the same queues, frames go on air one at a time, a finished frame wakes the radio task
+#define TX_QUEUE_SIZE      8
+#define TX_BULK_QUEUE_SIZE 16
+#define RX_RING_SIZE       16
+#define AIR_POOL_SIZE      64
+#define FROM_AP            -1
+
+uint8_t                mSelfMac[8]    = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0xC6, 0x00};
+volatile uint32_t      radioRxDropped = 0;
+volatile uint8_t       radioRxPeak    = 0;
+volatile uint32_t      radioTxFrames  = 0;
+volatile uint32_t      radioLastTx    = 0;
+struct radioTxStats    radioTxStats;
+
+struct frameQueue {
+    uint8_t frames[TX_BULK_QUEUE_SIZE][128];
+    uint8_t size;
+    uint8_t head;
+    uint8_t count;
+};
+
+static struct frameQueue  txQueue     = {.size = TX_QUEUE_SIZE};
+static struct frameQueue  txBulkQueue = {.size = TX_BULK_QUEUE_SIZE};
+static struct frameQueue *txOnAir     = NULL;
+static bool               txComplete  = false;
+static uint64_t           txStartNs   = 0;
+static TaskHandle_t       radioTaskHandle_ = NULL;
+
+struct rxFrame {
+    uint8_t  len;
+    uint32_t rxTime;
+    uint8_t  frame[128];
+};
+
+static struct rxFrame rxRing[RX_RING_SIZE];
+static uint8_t        rxHead  = 0;
+static uint8_t        rxCount = 0;
+
+struct airFrame {
+    bool    used;
+    int16_t from;  // tag index, or FROM_AP
+    uint8_t packet[128];
+};
+
+static struct airFrame airFrames[AIR_POOL_SIZE];
+static uint64_t        airBusyUntil = 0;
+
+// puts a frame on air after whatever is on air already, returns when it has been sent
+static uint64_t airSend(const uint8_t *packet, int16_t from) {
+    uint16_t slot = 0;
+    while (airFrames[slot].used) {
+        if (++slot == AIR_POOL_SIZE) abort();
+    }
+    airFrames[slot].used = true;
+    airFrames[slot].from = from;
+    memcpy(airFrames[slot].packet, packet, sizeof(airFrames[slot].packet));
+    uint64_t start = (airBusyUntil > simNs) ? airBusyUntil : simNs;
+    airBusyUntil   = start + AIR_TURNAROUND_NS + (uint64_t) (AIR_OVERHEAD_BYTES + packet[0]) * AIR_BYTE_NS;
+    schedule(airBusyUntil, EV_AIR_DONE, slot, 0);
+    return airBusyUntil;
+}
+
+void radio_init(uint8_t ch) {}
+void radioSetChannel(uint8_t ch) {}
+void radioSetTxPower(uint8_t power) {}
+
+void radioSetTask(TaskHandle_t task) {
+    radioTaskHandle_ = task;
+}
+
+void radioTxService() {
+    if (txComplete) {
+        struct frameQueue *q = txOnAir;
+        radioTxStats.sent++;
+        radioTxStats.bytes += q->frames[q->head][0];
+        radioTxStats.airtimeUs += (simNs - txStartNs) / 1000;
+        if (q == &txBulkQueue) radioTxStats.bulkSent++;
+        q->head = (q->head + 1) % q->size;
+        q->count--;
+        txComplete = false;
+        txOnAir    = NULL;
+    }
+    if (txOnAir) return;
+    struct frameQueue *q = txQueue.count ? &txQueue : (txBulkQueue.count ? &txBulkQueue : NULL);
+    if (!q) return;
+    txOnAir   = q;
+    txStartNs = simNs;
+    airSend(q->frames[q->head], FROM_AP);
+}
+
+static bool txEnqueue(struct frameQueue *q, const uint8_t *packet) {
+    radioLastTx = (uint32_t) esp_timer_get_time();
+    radioTxFrames++;
+    if (q->count == q->size) {
+        radioTxStats.queueFull++;
+        return false;
+    }
+    memcpy(q->frames[(q->head + q->count) % q->size], packet, packet[0]);
+    q->count++;
+    radioTxStats.queued++;
+    radioTxService();
+    return true;
+}
+
+bool radioTx(uint8_t *packet) {
+    return txEnqueue(&txQueue, packet);
+}
+
+bool radioTxBulk(uint8_t *packet) {
+    return txEnqueue(&txBulkQueue, packet);
+}
+
+uint8_t radioTxBulkRoom() {
+    return txBulkQueue.size - txBulkQueue.count;
+}
+
+int8_t commsRxUnencrypted(uint8_t **data, uint32_t *rxTime) {
+    if (rxCount == 0) return 0;
+    *data   = rxRing[rxHead].frame;
+    *rxTime = rxRing[rxHead].rxTime;
+    return rxRing[rxHead].len;
+}
+
+void commsRxRelease() {
+    if (rxCount == 0) return;
+    rxHead = (rxHead + 1) % RX_RING_SIZE;
+    rxCount--;
+}
+
+// the ESP32
+#define ESP_QUEUE_SIZE 32
+
+enum { ESP_IDLE, ESP_PREPARING, ESP_WAIT_REPLY, ESP_SENDING, ESP_WAIT_PUSH_REPLY, ESP_PUSHING };
+
+struct pushedBlock {
+    bool     valid;
+    uint64_t ver;
+    uint8_t  blockId;
+};
+
+static struct {
+    uint8_t                cmd[4];
+    bool                   inRequest;
+    uint8_t                requestLen;
+    uint8_t                request[sizeof(struct espBlockRequest)];
+    struct espBlockRequest queue[ESP_QUEUE_SIZE];
+    uint8_t                queueHead;
+    uint8_t                queueCount;
+    struct espBlockRequest current;
+    uint8_t                state;
+    uint32_t               gen;
+    uint8_t                prefetchDepth;  // blocks pushed after the one asked for, 0 if the AP has no cache
+    uint8_t                prefetchNext;   // block being pushed
+    struct pushedBlock     pushed[ESP_PUSHED_BLOCKS];
+    uint8_t                pushedNext;
+    uint32_t               blocksSent;
+    uint32_t               blocksPushed;
+    uint32_t               refused;
+    uint32_t               timeouts;
+} esp;
+
+// the tags
+enum { TAG_WAITING, TAG_WAIT_ACK, TAG_SLEEP, TAG_RX, TAG_WAIT_XFER_ACK, TAG_DONE };
+
+struct tag {
+    uint8_t             mac[8];
+    uint8_t             state;
+    uint32_t            gen;
+    uint32_t            size;
+    uint8_t             blocks;
+    uint8_t             attemptsLeft;
+    uint8_t             tries;  // frames sent without an answer
+    uint8_t             partsThisBlock;
+    bool                partial;
+    uint8_t             seq;
+    struct blockRequest request;
+    uint8_t             blockbuffer[BLOCK_MAX_PARTS * BLOCK_PART_DATA_SIZE];
+    uint64_t            started;
+    uint64_t            finished;
+    uint32_t            requests;
+    uint32_t            partials;
+    uint32_t            cancels;
+    uint32_t            giveUps;
+    uint32_t            badBlocks;
+};
+
+static struct tag *tags      = NULL;
+static int         tagCount  = 0;
+static int         tagsDone  = 0;
+
+static uint8_t imageByte(int tag, uint32_t offset) {
+    return (uint8_t) (((offset * 2654435761u) ^ (tag * 40503u)) >> 13);
+}
+
+static void espNext();
+
+// the block as writeBlockData sends it, everything xor'ed but the padding
+static void espSendBlock(uint64_t ver, uint8_t blockId) {
+    int      t      = (int) (ver - VER_BASE);
+    uint32_t offset = blockId * BLOCK_DATA_SIZE;
+    uint32_t len    = tags[t].size - offset;
+    if (len > BLOCK_DATA_SIZE) len = BLOCK_DATA_SIZE;
+
+    uint8_t           buffer[sizeof(struct blockData) + BLOCK_DATA_SIZE + 32];
+    struct blockData *bd = (struct blockData *) buffer;
+    bd->size             = len;
+    bd->checksum         = 0;
+    for (uint32_t c = 0; c < len; c++) {
+        bd->data[c] = imageByte(t, offset + c);
+        bd->checksum += bd->data[c];
+    }
+    for (uint32_t c = 0; c < sizeof(struct blockData) + len; c++) buffer[c] ^= 0xAA;
+    memset(buffer + sizeof(struct blockData) + len, 0x55, BLOCK_DATA_SIZE - len);
+    memset(buffer + sizeof(struct blockData) + BLOCK_DATA_SIZE, 0xF5, 32);
+    lineSend(&toAP, buffer, sizeof(buffer));
+}
+
+static bool espIsPushed(uint64_t ver, uint8_t blockId) {
+    for (uint8_t c = 0; c < ESP_PUSHED_BLOCKS; c++) {
+        if (esp.pushed[c].valid && (esp.pushed[c].ver == ver) && (esp.pushed[c].blockId == blockId)) return true;
+    }
+    return false;
+}
+
+// pushes the next block after the one just sent, as long as no other request is waiting
+static void espPrefetch() {
+    uint8_t totalblocks = tags[esp.current.ver - VER_BASE].blocks;
+    for (; (esp.prefetchNext < totalblocks) && (esp.prefetchNext <= esp.current.blockId + esp.prefetchDepth); esp.prefetchNext++) {
+        if (esp.queueCount) break;
+        if (espIsPushed(esp.current.ver, esp.prefetchNext)) continue;
+        struct espBlockPush bp = {0};
+        bp.ver                 = esp.current.ver;
+        bp.blockId             = esp.prefetchNext;
+        addCRC(&bp, sizeof(struct espBlockPush));
+        lineSend(&toAP, "BKP>", 4);
+        lineSend(&toAP, &bp, sizeof(struct espBlockPush));
+        esp.state = ESP_WAIT_PUSH_REPLY;
+        schedule(simNs + MS(ESP_REPLY_TIMEOUT), EV_ESP, 0, ++esp.gen);
+        return;
+    }
+    esp.state = ESP_IDLE;
+    espNext();
+}
+
+static void espReply(bool ack) {
+    if ((esp.state != ESP_WAIT_REPLY) && (esp.state != ESP_WAIT_PUSH_REPLY)) return;
+    if (!ack) {
+        esp.refused++;
+        esp.state = ESP_IDLE;
+        espNext();
+        return;
+    }
+    if (esp.state == ESP_WAIT_REPLY) {
+        espSendBlock(esp.current.ver, esp.current.blockId);
+        esp.state = ESP_SENDING;
+    } else {
+        espSendBlock(esp.current.ver, esp.prefetchNext);
+        esp.state = ESP_PUSHING;
+    }
+    schedule(toAP.busyUntil, EV_ESP, 0, ++esp.gen);
+}
+
+static void espNext() {
+    if ((esp.state != ESP_IDLE) || (esp.queueCount == 0)) return;
+    esp.current   = esp.queue[esp.queueHead];
+    esp.queueHead = (esp.queueHead + 1) % ESP_QUEUE_SIZE;
+    esp.queueCount--;
+    esp.state = ESP_PREPARING;
+    schedule(simNs + MS(ESP_PREP_MS), EV_ESP, 0, ++esp.gen);
+}
+
+static void espTimer() {
+    switch (esp.state) {
+        case ESP_PREPARING:
+            lineSend(&toAP, ">D>", 3);
+            esp.state = ESP_WAIT_REPLY;
+            schedule(simNs + MS(ESP_REPLY_TIMEOUT), EV_ESP, 0, ++esp.gen);
+            break;
+        case ESP_WAIT_REPLY:
+        case ESP_WAIT_PUSH_REPLY:
+            esp.timeouts++;
+            esp.state = ESP_IDLE;
+            espNext();
+            break;
+        case ESP_SENDING:
+            esp.blocksSent++;
+            esp.prefetchNext = esp.current.blockId + 1;
+            espPrefetch();
+            break;
+        case ESP_PUSHING:
+            esp.blocksPushed++;
+            // the AP's cache keeps the blocks last pushed, so does this list
+            esp.pushedNext %= ESP_PUSHED_CAPACITY;
+            esp.pushed[esp.pushedNext].valid   = true;
+            esp.pushed[esp.pushedNext].ver     = esp.current.ver;
+            esp.pushed[esp.pushedNext].blockId = esp.prefetchNext;
+            esp.pushedNext                     = (esp.pushedNext + 1) % ESP_PUSHED_CAPACITY;
+            esp.prefetchNext++;
+            espPrefetch();
+            break;
+    }
+}
+
+static void espReceive(uint8_t c) {
+    if (esp.inRequest) {
+        esp.request[esp.requestLen++] = c;
+        if (esp.requestLen < sizeof(esp.request)) return;
+        esp.inRequest = false;
+        if (checkCRC(esp.request, sizeof(esp.request)) && (esp.queueCount < ESP_QUEUE_SIZE)) {
+            memcpy(&esp.queue[(esp.queueHead + esp.queueCount++) % ESP_QUEUE_SIZE], esp.request, sizeof(esp.request));
+            espNext();
+        }
+        return;
+    }
+    memmove(esp.cmd, esp.cmd + 1, 3);
+    esp.cmd[3] = c;
+    if (memcmp(esp.cmd, "RQB>", 4) == 0) {
+        esp.inRequest  = true;
+        esp.requestLen = 0;
+        memset(esp.cmd, 0, 4);
+    } else if (memcmp(esp.cmd, "ACK>", 4) == 0) {
+        espReply(true);
+    } else if (memcmp(esp.cmd, "NOK>", 4) == 0) {
+        espReply(false);
+    }
+}
+
+static void tagTimer(struct tag *t, uint64_t at) {
+    schedule(at, EV_TAG, t - tags, ++t->gen);
+}
+
+static uint64_t tagSend(struct tag *t, uint8_t type, const void *payload, uint8_t len) {
+    uint8_t                packet[128] = {0};
+    struct MacFrameNormal *f           = (struct MacFrameNormal *) (packet + 1);
+    packet[0]                          = sizeof(struct MacFrameNormal) + 1 + len + RAW_PKT_PADDING;
+    f->fcs.frameType                   = 1;
+    f->fcs.panIdCompressed             = 1;
+    f->fcs.destAddrType                = 3;
+    f->fcs.srcAddrType                 = 3;
+    f->seq                             = t->seq++;
+    f->pan                             = PROTO_PAN_ID;
+    memcpy(f->dst, mSelfMac, 8);
+    memcpy(f->src, t->mac, 8);
+    packet[sizeof(struct MacFrameNormal) + 1] = type;
+    memcpy(packet + sizeof(struct MacFrameNormal) + 2, payload, len);
+    return airSend(packet, t - tags);
+}
+
+static void tagSendRequest(struct tag *t) {
+    addCRC(&t->request, sizeof(struct blockRequest));
+    uint64_t sent = tagSend(t, t->partial ? PKT_BLOCK_PARTIAL_REQUEST : PKT_BLOCK_REQUEST, &t->request, sizeof(struct blockRequest));
+    t->requests++;
+    t->state = TAG_WAIT_ACK;
+    tagTimer(t, sent + MS(TAG_ACK_WAIT));
+}
+
+static void tagSendXferComplete(struct tag *t) {
+    uint64_t sent = tagSend(t, PKT_XFER_COMPLETE, NULL, 0);
+    t->state      = TAG_WAIT_XFER_ACK;
+    tagTimer(t, sent + MS(TAG_ACK_WAIT));
+}
+
+// sleeps until the next check-in, then carries on with the same block
+static void tagGiveUp(struct tag *t) {
+    t->giveUps++;
+    t->state = TAG_WAITING;
+    tagTimer(t, simNs + MS(TAG_RETRY_DELAY));
+}
+
+static void tagAttempt(struct tag *t) {
+    if (t->attemptsLeft == 0) {
+        tagGiveUp(t);
+        return;
+    }
+    t->attemptsLeft--;
+    t->tries = 0;
+    if (t->partial) t->partials++;
+    tagSendRequest(t);
+}
+
+// getDataBlock
+static void tagStartBlock(struct tag *t) {
+    uint32_t blockSize = t->size - t->request.blockId * BLOCK_DATA_SIZE;
+    if (blockSize > BLOCK_DATA_SIZE) blockSize = BLOCK_DATA_SIZE;
+    t->partsThisBlock = (sizeof(struct blockData) + blockSize + BLOCK_PART_DATA_SIZE - 1) / BLOCK_PART_DATA_SIZE;
+    memset(t->request.requestedParts, 0, BLOCK_REQ_PARTS_BYTES);
+    for (uint8_t c = 0; c < t->partsThisBlock; c++) t->request.requestedParts[c / 8] |= (1 << (c % 8));
+    t->partial      = false;
+    t->attemptsLeft = TAG_BLOCK_ATTEMPTS;
+    tagAttempt(t);
+}
+
+static void tagListen(struct tag *t) {
+    t->state = TAG_RX;
+    tagTimer(t, simNs + MS(TAG_RX_WINDOW));
+}
+
+static void tagDone(struct tag *t) {
+    t->state    = TAG_DONE;
+    t->finished = simNs;
+    tagsDone++;
+}
+
+static bool tagBlockValid(struct tag *t) {
+    struct blockData *bd     = (struct blockData *) t->blockbuffer;
+    uint32_t          offset = t->request.blockId * BLOCK_DATA_SIZE;
+    uint32_t          len    = t->size - offset;
+    if (len > BLOCK_DATA_SIZE) len = BLOCK_DATA_SIZE;
+    if (bd->size != len) return false;
+    for (uint32_t c = 0; c < len; c++) {
+        if (bd->data[c] != imageByte(t - tags, offset + c)) return false;
+    }
+    return true;
+}
+
+static void tagRxDone(struct tag *t) {
+    bool complete = true;
+    for (uint8_t c = 0; c < t->partsThisBlock; c++) {
+        if (t->request.requestedParts[c / 8] & (1 << (c % 8))) complete = false;
+    }
+    if (complete) {
+        if (tagBlockValid(t)) {
+            if (++t->request.blockId == t->blocks) {
+                t->tries = 0;
+                tagSendXferComplete(t);
+            } else {
+                tagStartBlock(t);
+            }
+            return;
+        }
+        t->badBlocks++;
+        for (uint8_t c = 0; c < t->partsThisBlock; c++) t->request.requestedParts[c / 8] |= (1 << (c % 8));
+        t->partial = false;
+    } else {
+        t->partial = true;
+    }
+    tagAttempt(t);
+}
+
+static void tagTimerExpired(struct tag *t) {
+    switch (t->state) {
+        case TAG_WAITING:
+            if (!t->started) t->started = simNs;
+            tagStartBlock(t);
+            break;
+        case TAG_WAIT_ACK:
+            // no answer, ask again. After that many tries, listen anyway
+            if (++t->tries < TAG_REQUEST_TRIES) {
+                tagSendRequest(t);
+            } else {
+                tagListen(t);
+            }
+            break;
+        case TAG_SLEEP:
+            tagListen(t);
+            break;
+        case TAG_RX:
+            tagRxDone(t);
+            break;
+        case TAG_WAIT_XFER_ACK:
+            if (++t->tries < TAG_XFER_TRIES) {
+                tagSendXferComplete(t);
+            } else {
+                tagDone(t);
+            }
+            break;
+    }
+}
+
+static void tagReceive(struct tag *t, uint8_t *frame) {
+    uint8_t  type    = getPacketType(frame);
+    uint8_t *payload = frame + sizeof(struct MacFrameNormal) + 1;
+    switch (t->state) {
+        case TAG_WAIT_ACK:
+            if ((type == PKT_BLOCK_REQUEST_ACK) && checkCRC(payload, sizeof(struct blockRequestAck))) {
+                uint16_t pleaseWaitMs = ((struct blockRequestAck *) payload)->pleaseWaitMs;
+                if (pleaseWaitMs > 10) {
+                    t->state = TAG_SLEEP;
+                    tagTimer(t, simNs + MS(pleaseWaitMs - 10));
+                } else {
+                    tagListen(t);
+                }
+            } else if (type == PKT_BLOCK_PART) {
+                // the block started while we were waiting for the ack
+                tagListen(t);
+            } else if (type == PKT_CANCEL_XFER) {
+                t->cancels++;
+                tagGiveUp(t);
+            }
+            break;
+        case TAG_RX:
+            if (type == PKT_BLOCK_PART) {
+                struct blockPart *bp = (struct blockPart *) payload;
+                if (!checkCRC(bp, sizeof(struct blockPart) + BLOCK_PART_DATA_SIZE)) break;
+                if ((bp->blockId != t->request.blockId) || (bp->blockPart >= BLOCK_MAX_PARTS)) break;
+                memcpy(t->blockbuffer + bp->blockPart * BLOCK_PART_DATA_SIZE, bp->data, BLOCK_PART_DATA_SIZE);
+                t->request.requestedParts[bp->blockPart / 8] &= ~(1 << (bp->blockPart % 8));
+            }
+            break;
+        case TAG_WAIT_XFER_ACK:
+            if (type == PKT_XFER_COMPLETE_ACK) tagDone(t);
+            break;
+    }
+}
+
+static void airDone(uint16_t slot) {
+    struct airFrame *af = &airFrames[slot];
+    af->used            = false;
+    if (af->from == FROM_AP) {
+        struct MacFrameNormal *f = (struct MacFrameNormal *) (af->packet + 1);
+        for (int c = 0; c < tagCount; c++) {
+            if (memcmp(tags[c].mac, f->dst, 8) == 0) tagReceive(&tags[c], af->packet + 1);
+        }
+        txComplete = true;
+        xTaskNotifyGive(radioTaskHandle_);
+        return;
+    }
+    if (rxCount == RX_RING_SIZE) {
+        radioRxDropped++;
+        return;
+    }
+    struct rxFrame *rf = &rxRing[(rxHead + rxCount++) % RX_RING_SIZE];
+    rf->len            = af->packet[0];
+    rf->rxTime         = (uint32_t) esp_timer_get_time();
+    memcpy(rf->frame, af->packet + 1, sizeof(rf->frame) - 1);
+    if (rxCount > radioRxPeak) radioRxPeak = rxCount;
+    xTaskNotifyGive(radioTaskHandle_);
+}
+
+static void handleEvent(const struct event *ev) {
+    switch (ev->type) {
+        case EV_TASK_WAKE:
+            if (tasks[ev->who].blocked && (tasks[ev->who].gen == ev->gen)) tasks[ev->who].blocked = false;
+            break;
+        case EV_TIMER:
+            if (timers[ev->who].gen == ev->gen) timers[ev->who].callback(timers[ev->who].arg);
+            break;
+        case EV_AIR_DONE:
+            airDone(ev->who);
+            break;
+        case EV_TO_AP:
+            for (uint16_t c = 0; c < ev->who; c++) {
+                uint8_t byte = linePop(&toAP);
+                if (apRxCount == AP_RX_BUFFER) continue;
+                apRx[(apRxHead + apRxCount++) % AP_RX_BUFFER] = byte;
+            }
+            if (apRxTask) xTaskNotifyGive(apRxTask);
+            break;
+        case EV_TO_ESP:
+            for (uint16_t c = 0; c < ev->who; c++) espReceive(linePop(&toESP));
+            break;
+        case EV_ESP:
+            if (ev->gen == esp.gen) espTimer();
+            break;
+        case EV_TAG:
+            if (tags[ev->who].gen == ev->gen) tagTimerExpired(&tags[ev->who]);
+            break;
+    }
+}
+
+struct result {
+    bool     done;  // every tag has its image
+    double   seconds;
+    double   imageSeconds;
+    double   imageMaxSeconds;
+    uint32_t requests;
+    uint32_t partials;
+    uint32_t cancels;
+    uint32_t giveUps;
+    uint32_t badBlocks;
+    uint32_t blocksSent;
+    uint32_t blocksPushed;
+    uint32_t lost;  // block requests the ESP32 gave up on
+};
+
+// one run from a fresh AP, in a child process so main.c starts from its initial state
+static void simulate(int tagTotal, int blocks, bool prefetch, struct result *r) {
+    uart_switch_speed(SERIAL_BAUD);
+    app_main();
+    runTasks();
+    if (prefetch) {
+        // the ESP32 leaves half the cache for the other tags
+        esp.prefetchDepth = CONFIG_OEPL_BLOCK_CACHE_ENTRIES / 2;
+        if (esp.prefetchDepth > ESP_PREFETCH_DEPTH) esp.prefetchDepth = ESP_PREFETCH_DEPTH;
+        if (esp.prefetchDepth == 0) esp.prefetchDepth = 1;
+    }
+
+    tagCount = tagTotal;
+    tags     = calloc(tagCount, sizeof(struct tag));
+    srand(tagTotal);
+    for (int c = 0; c < tagCount; c++) {
+        struct tag *t = &tags[c];
+        t->mac[0]     = c;
+        t->mac[7]     = 0x42;
+        t->size       = blocks * BLOCK_DATA_SIZE;
+        t->blocks     = blocks;
+
+        struct pendingData pd        = {0};
+        pd.availdatainfo.dataVer     = VER_BASE + c;
+        pd.availdatainfo.dataSize    = t->size;
+        pd.availdatainfo.dataType    = 0x20;
+        pd.availdatainfo.nextCheckIn = 1;
+        pd.attemptsLeft              = 60;
+        memcpy(pd.targetMac, t->mac, 8);
+        storePendingData(&pd);
+
+        t->request.ver = VER_BASE + c;
+        tagTimer(t, MS(rand() % TAG_START_SPREAD));
+    }
+
+    struct event ev;
+    while ((tagsDone < tagCount) && nextEvent(&ev) && (ev.at < SIM_LIMIT)) {
+        simNs = ev.at;
+        handleEvent(&ev);
+        runTasks();
+    }
+
+    uint64_t first = UINT64_MAX, last = 0, totalNs = 0, maxNs = 0;
+    for (int c = 0; c < tagCount; c++) {
+        struct tag *t = &tags[c];
+        if (t->started < first) first = t->started;
+        if (t->finished > last) last = t->finished;
+        totalNs += t->finished - t->started;
+        if (t->finished - t->started > maxNs) maxNs = t->finished - t->started;
+        r->requests += t->requests;
+        r->partials += t->partials;
+        r->cancels += t->cancels;
+        r->giveUps += t->giveUps;
+        r->badBlocks += t->badBlocks;
+    }
+    r->done            = (tagsDone == tagCount);
+    r->seconds         = (last - first) / 1e9;
+    r->imageSeconds    = totalNs / 1e9 / tagCount;
+    r->imageMaxSeconds = maxNs / 1e9;
+    r->blocksSent      = esp.blocksSent;
+    r->blocksPushed    = esp.blocksPushed;
+    r->lost            = esp.refused + esp.timeouts;
+}
+
+static bool run(int tagTotal, int blocks, bool prefetch, struct result *r) {
+    static struct result *shared = NULL;
+    if (!shared) shared = mmap(NULL, sizeof(struct result), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    memset(shared, 0, sizeof(struct result));
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        simulate(tagTotal, blocks, prefetch, shared);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    *r = *shared;
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) return false;
+    if (!r->done) {
+        printf("FAIL: %d tags, %d blocks: not every tag got its image\n", tagTotal, blocks);
+        return false;
+    }
+    if (r->badBlocks) {
+        printf("FAIL: %d tags, %d blocks: %u blocks didn't hold the data that was asked for\n", tagTotal, blocks, r->badBlocks);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bool sweepBlocks = (argc > 1) && (strcmp(argv[1], "-b") == 0);
+    if (sweepBlocks) {
+        argc--;
+        argv++;
+    }
+    int first  = (argc > 1) ? atoi(argv[1]) : 8;
+    int second = (argc > 2) ? atoi(argv[2]) : (sweepBlocks ? 1 : 4);
+    if ((first < 1) || (second < 1) || ((sweepBlocks ? first : second) > 255)) {
+        fprintf(stderr, "usage: block_sched_sim [max tags] [blocks per image]\n       block_sched_sim -b [max blocks per image] [tags]\n");
+        return 2;
+    }
+
+    int           failures = 0;
+    struct result r;
+    if (sweepBlocks) {
+        struct result pushed;
+        printf("%d block slots, %d cache entries, %d tags, %d baud serial\n", CONFIG_OEPL_BLOCK_SLOTS, CONFIG_OEPL_BLOCK_CACHE_ENTRIES, second, SERIAL_BAUD);
+        printf("blocks  image s  pushed ahead  saved  per block  requests  pushed\n");
+        for (int blocks = 1; blocks <= first; blocks++) {
+            if (!run(second, blocks, false, &r) || !run(second, blocks, true, &pushed)) {
+                failures++;
+                continue;
+            }
+            printf("%6d %8.2f %13.2f %5.0f%% %10.2f %9u %7u\n", blocks, r.imageSeconds, pushed.imageSeconds,
+                   100.0 * (r.imageSeconds - pushed.imageSeconds) / r.imageSeconds, pushed.imageSeconds / blocks, pushed.requests, pushed.blocksPushed);
+        }
+    } else {
+        printf("%d block slots, %d cache entries, %d blocks of %lu bytes per image, %d baud serial\n", CONFIG_OEPL_BLOCK_SLOTS, CONFIG_OEPL_BLOCK_CACHE_ENTRIES,
+               second, BLOCK_DATA_SIZE, SERIAL_BAUD);
+        printf("tags  total s    kB/s  image s    max s  requests  partial  busy  gaveup  blocks  pushed  lost\n");
+        for (int tagTotal = 1; tagTotal <= first; tagTotal++) {
+            if (!run(tagTotal, second, true, &r)) {
+                failures++;
+                continue;
+            }
+            printf("%4d %8.2f %7.2f %8.2f %8.2f %9u %8u %5u %7u %7u %7u %5u\n", tagTotal, r.seconds, tagTotal * second * BLOCK_DATA_SIZE / 1024.0 / r.seconds,
+                   r.imageSeconds, r.imageMaxSeconds, r.requests, r.partials, r.cancels, r.giveUps, r.blocksSent, r.blocksPushed, r.lost);
+        }
+    }
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
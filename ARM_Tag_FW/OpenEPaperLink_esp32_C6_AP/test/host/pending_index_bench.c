@@ -0,0 +1,263 @@
+// Benchmark of the AvailDataReq answer in main.c: the pending data for the tag's mac looked up through
+// the index and copied into the reply, against the scan over every slot it replaced, which is kept
+// below. Reported is the time per lookup with the table full, for a tag that has data and for one that
+// hasn't. The table size is CONFIG_OEPL_PENDING_SLOTS, a target is built per size.
+//
+// Checked against a model of the old array, with its countdown per housekeeping pass: random stores,
+// deletes and housekeeping passes, after each pass processAvailDataReq has to answer every mac the way
+// the old table would, the scan has to find the same macs, and the pending counts have to match.
+//
+//   pending_index_bench [housekeeping passes]
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "driver/uart.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "led.h"
+#include "nvs_flash.h"
+#include "proto.h"
+#include "radio.h"
+#include "sdkconfig.h"
+#include "second_uart.h"
+
+// main.c
+void                      addCRC(void *p, uint8_t len);
+void                      initPendingSlots(void);
+int32_t                   findSlotForMac(const uint8_t *mac);
+bool                      storePendingData(const struct pendingData *pd);
+void                      deleteAllPendingDataForMac(const uint8_t *mac);
+void                      expirePendingSlots(void);
+uint16_t                  pendingNextCheckIn(uint16_t slot);
+void                      processAvailDataReq(uint8_t *buffer);
+extern struct pendingData pendingDataArr[];
+extern uint16_t           curPendingData;
+extern uint16_t           curNoUpdate;
+
+#define SLOTS   CONFIG_OEPL_PENDING_SLOTS
+#define MACS    (SLOTS * 2)  // half of them fit at a time
+#define LOOKUPS 200000
+
+// what the rest of the AP would provide, none of it does anything
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return (SemaphoreHandle_t) 1; }
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) { return pdTRUE; }
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t sem) { return pdTRUE; }
+BaseType_t        xTaskCreate(void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle) { return pdPASS; }
+BaseType_t        xTaskNotifyGive(TaskHandle_t task) { return pdPASS; }
+uint32_t          ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) { return 0; }
+void              vTaskDelay(TickType_t ticks) {}
+int64_t           esp_timer_get_time(void) { return 0; }
+esp_err_t         esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) { return ESP_OK; }
+esp_err_t         esp_timer_start_once(esp_timer_handle_t handle, uint64_t timeoutUs) { return ESP_OK; }
+esp_err_t         esp_timer_stop(esp_timer_handle_t handle) { return ESP_OK; }
+esp_err_t         esp_event_loop_create_default(void) { return ESP_OK; }
+esp_err_t         nvs_flash_init(void) { return ESP_OK; }
+esp_err_t         nvs_flash_erase(void) { return ESP_OK; }
+void              init_led() {}
+void              led_set(int nr, bool state) {}
+void              led_flash(int nr) {}
+void              init_second_uart() {}
+void              uart_switch_speed(int baudrate) {}
+int               uart_write_bytes(int port, const void *src, size_t size) { return size; }
+void              uartTx(uint8_t data) {}
+bool              getRxCharSecond(uint8_t *newChar) { return false; }
+void              uart_set_rx_task(TaskHandle_t task) {}
+void              uart_printf(const char *format, ...) {}
+
+uint8_t             mSelfMac[8]    = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0xC6, 0x00};
+volatile uint32_t   radioRxDropped = 0;
+volatile uint8_t    radioRxPeak    = 0;
+volatile uint32_t   radioTxFrames  = 0;
+volatile uint32_t   radioLastTx    = 0;
+struct radioTxStats radioTxStats;
+
+void    radio_init(uint8_t ch) {}
+void    radioSetChannel(uint8_t ch) {}
+void    radioSetTxPower(uint8_t power) {}
+void    radioSetTask(TaskHandle_t task) {}
+void    radioTxService() {}
+bool    radioTxBulk(uint8_t *packet) { return true; }
+uint8_t radioTxBulkRoom() { return 16; }
+int8_t  commsRxUnencrypted(uint8_t **data, uint32_t *rxTime) { return 0; }
+void    commsRxRelease() {}
+
+// the last reply, the AvailDataInfo after the mac header and the packet type
+static struct AvailDataInfo reply;
+
+bool radioTx(uint8_t *packet) {
+    memcpy(&reply, packet + sizeof(struct MacFrameNormal) + 2, sizeof(reply));
+    return true;
+}
+
+// the lookup in processAvailDataReq as it was, with a 16 bit counter for tables over 255 slots
+static bool lookupBefore(const uint8_t *mac, struct AvailDataInfo *availDataInfo) {
+    for (uint16_t c = 0; c < SLOTS; c++) {
+        if (pendingDataArr[c].attemptsLeft) {
+            if (memcmp(pendingDataArr[c].targetMac, mac, 8) == 0) {
+                memcpy((void *) availDataInfo, &(pendingDataArr[c].availdatainfo), sizeof(struct AvailDataInfo));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool lookupAfter(const uint8_t *mac, struct AvailDataInfo *availDataInfo) {
+    int32_t slot = findSlotForMac(mac);
+    if (slot == -1) return false;
+    memcpy((void *) availDataInfo, &(pendingDataArr[slot].availdatainfo), sizeof(struct AvailDataInfo));
+    availDataInfo->nextCheckIn = pendingNextCheckIn(slot);
+    return true;
+}
+
+// the old table: attemptsLeft and nextCheckIn counted down by every housekeeping pass
+struct model {
+    uint64_t             mac;
+    struct AvailDataInfo info;
+    uint16_t             attemptsLeft;
+};
+
+static struct model macs[MACS];
+static uint32_t     modelUsed = 0;
+
+static uint64_t rng = 0x5EED5EED5EED5EEDULL;
+
+static uint64_t rnd(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static void makePending(struct pendingData *pd, uint64_t mac, uint16_t attemptsLeft, uint16_t nextCheckIn, uint8_t dataType) {
+    memset(pd, 0, sizeof(*pd));
+    memcpy(pd->targetMac, &mac, 8);
+    pd->attemptsLeft              = attemptsLeft;
+    pd->availdatainfo.dataVer     = mac * 3;
+    pd->availdatainfo.dataSize    = (uint32_t) mac;
+    pd->availdatainfo.dataType    = dataType;
+    pd->availdatainfo.nextCheckIn = nextCheckIn;
+}
+
+static void sendAvailDataReq(uint64_t mac) {
+    uint8_t               buffer[sizeof(struct MacFrameBcast) + 1 + sizeof(struct AvailDataReq)] = {0};
+    struct MacFrameBcast *rxHeader = (struct MacFrameBcast *) buffer;
+    memcpy(rxHeader->src, &mac, 8);
+    buffer[sizeof(struct MacFrameBcast)] = PKT_AVAIL_DATA_REQ;
+    addCRC(buffer + sizeof(struct MacFrameBcast) + 1, sizeof(struct AvailDataReq));
+    processAvailDataReq(buffer);
+}
+
+static bool check(int pass) {
+    uint32_t pending = 0, noUpdate = 0;
+    bool     ok      = true;
+    for (uint32_t i = 0; i < MACS; i++) {
+        const struct model *m = &macs[i];
+        struct AvailDataInfo expected, scanned;
+        memset(&expected, 0, sizeof(expected));
+        if (m->attemptsLeft) {
+            expected = m->info;
+            if (m->info.dataType != 0) {
+                pending++;
+            } else {
+                noUpdate++;
+            }
+        }
+        sendAvailDataReq(m->mac);
+        reply.checksum = expected.checksum = 0;
+        if (memcmp(&reply, &expected, sizeof(reply)) != 0) {
+            printf("FAIL: pass %d, mac %016llx: type %u, next check-in %u, expected type %u, next check-in %u\n", pass, (unsigned long long) m->mac,
+                   reply.dataType, reply.nextCheckIn, expected.dataType, expected.nextCheckIn);
+            ok = false;
+        }
+        if (lookupBefore((const uint8_t *) &m->mac, &scanned) != (m->attemptsLeft != 0)) {
+            printf("FAIL: pass %d, mac %016llx: the scan finds it %s\n", pass, (unsigned long long) m->mac, m->attemptsLeft ? "gone" : "there");
+            ok = false;
+        }
+    }
+    if ((curPendingData != pending) || (curNoUpdate != noUpdate)) {
+        printf("FAIL: pass %d: %u pending and %u without an update, expected %u and %u\n", pass, curPendingData, curNoUpdate, pending, noUpdate);
+        ok = false;
+    }
+    return ok;
+}
+
+static double lookupNs(bool (*lookup)(const uint8_t *, struct AvailDataInfo *), bool miss) {
+    struct AvailDataInfo info;
+    volatile uint32_t    found = 0;
+    struct timespec      start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < LOOKUPS; i++) {
+        uint64_t mac = macs[(i * 7919) % SLOTS].mac ^ (miss ? 0x8000000000000000ULL : 0);
+        found += lookup((const uint8_t *) &mac, &info);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / LOOKUPS;
+}
+
+int main(int argc, char **argv) {
+    int  passes = (argc > 1) ? atoi(argv[1]) : 300;
+    bool ok     = true;
+
+    for (uint32_t i = 0; i < MACS; i++) macs[i].mac = (rnd() & 0x0000FFFFFFFFFFFFULL) | 0x1234000000000000ULL;
+
+    initPendingSlots();
+    for (int pass = 0; (pass < passes) && ok; pass++) {
+        for (uint32_t n = 0; n < SLOTS / 4; n++) {
+            struct model *m = &macs[rnd() % MACS];
+            if (rnd() % 5 == 0) {
+                deleteAllPendingDataForMac((const uint8_t *) &m->mac);
+                if (m->attemptsLeft) modelUsed--;
+                m->attemptsLeft = 0;
+                continue;
+            }
+            struct pendingData pd;
+            uint16_t           attemptsLeft = (rnd() % 8 == 0) ? 0 : 1 + rnd() % 150;
+            makePending(&pd, m->mac, attemptsLeft, rnd() % 200, (rnd() % 3 == 0) ? 0 : 0x20);
+            // an update for a mac replaces what it had, a new mac needs a free slot
+            bool fits = (attemptsLeft == 0) || m->attemptsLeft || (modelUsed < SLOTS);
+            if (storePendingData(&pd) != fits) {
+                printf("FAIL: pass %d: store %s\n", pass, fits ? "refused" : "took more than the table holds");
+                ok = false;
+            }
+            if (!fits) continue;
+            if (m->attemptsLeft) modelUsed--;
+            m->info         = pd.availdatainfo;
+            m->attemptsLeft = attemptsLeft;
+            if (attemptsLeft) modelUsed++;
+        }
+        expirePendingSlots();
+        for (uint32_t i = 0; i < MACS; i++) {
+            struct model *m = &macs[i];
+            if (m->attemptsLeft == 0) continue;
+            if (--m->attemptsLeft == 0) {
+                modelUsed--;
+            } else if (m->info.nextCheckIn) {
+                m->info.nextCheckIn--;
+            }
+        }
+        ok &= check(pass);
+    }
+    printf("%u slots, %d housekeeping passes checked against the old table\n", SLOTS, passes);
+
+    // a full table, the first SLOTS macs
+    initPendingSlots();
+    for (uint32_t i = 0; i < SLOTS; i++) {
+        struct pendingData pd;
+        makePending(&pd, macs[i].mac, 100, 10, 0x20);
+        storePendingData(&pd);
+    }
+    printf("lookup and copy, ns   hit    miss\n");
+    printf("  scan            %6.0f  %6.0f\n", lookupNs(lookupBefore, false), lookupNs(lookupBefore, true));
+    printf("  index           %6.0f  %6.0f\n", lookupNs(lookupAfter, false), lookupNs(lookupAfter, true));
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,359 @@
+// The C6/H2 AP on a pty, in real time, for harnesses on the ESP32 side of the serial link. main.c runs
+// as it is, its tasks as threads. The uart is the pty given on the command line. Writes are paced at
+// the baud rate and return once the rest fits in the driver's transmit buffer. There is no radio, so
+// nothing goes on air and no tag ever checks in.
+// With a damage rate, that share of the writes to the ESP32 gets a byte flipped once SIGUSR1 comes in,
+// so the harness can bring the link up first. When the other end closes the pty, the pending data
+// counts are printed to stdout and the AP exits.
+//
+//   pty_ap <pty> [damage rate]
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "driver/uart.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "led.h"
+#include "nvs_flash.h"
+#include "proto.h"
+#include "radio.h"
+#include "second_uart.h"
+
+// main.c
+void                     app_main(void);
+extern SemaphoreHandle_t protoMutex;
+extern uint16_t          curPendingData;
+extern uint16_t          curNoUpdate;
+
+#define UART_TX_BUFFER 2048  // init_second_uart
+#define AP_RX_BUFFER   8000
+
+static int                   uartFd     = -1;
+static double                damageRate = 0;
+static volatile sig_atomic_t damaging   = 0;
+
+static void startDamaging(int sig) {
+    damaging = 1;
+}
+
+static uint64_t nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void sleepUs(uint64_t us) {
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts) && (errno == EINTR)) {
+    }
+}
+
+static void deadlineIn(struct timespec *ts, uint64_t us) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    uint64_t ns = (uint64_t) ts->tv_nsec + us * 1000;
+    ts->tv_sec += ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+}
+
+static pthread_cond_t *newCond(void) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_t *cond = malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return cond;
+}
+
+// FreeRTOS: a task is a thread, its notification value a counter under a lock
+struct task {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t *cond;
+    uint32_t        notified;
+    void (*fn)(void *);
+    void *arg;
+};
+
+static __thread struct task *current = NULL;
+
+static void *taskEntry(void *arg) {
+    current = arg;
+    current->fn(current->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle) {
+    struct task *t = calloc(1, sizeof(struct task));
+    pthread_mutex_init(&t->lock, NULL);
+    t->cond = newCond();
+    t->fn   = task;
+    t->arg  = arg;
+    // the handle is in place before the task runs, main.c notifies tasks through it
+    if (handle) *handle = t;
+    pthread_create(&t->thread, NULL, taskEntry, t);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    struct task *t = current;
+    pthread_mutex_lock(&t->lock);
+    if (ticks == portMAX_DELAY) {
+        while (!t->notified) pthread_cond_wait(t->cond, &t->lock);
+    } else if (!t->notified && ticks) {
+        struct timespec deadline;
+        deadlineIn(&deadline, (uint64_t) ticks * 1000);
+        while (!t->notified && (pthread_cond_timedwait(t->cond, &t->lock, &deadline) != ETIMEDOUT)) {
+        }
+    }
+    uint32_t notified = t->notified;
+    if (clear) {
+        t->notified = 0;
+    } else if (notified) {
+        t->notified--;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return notified;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+    struct task *t = handle;
+    pthread_mutex_lock(&t->lock);
+    t->notified++;
+    pthread_cond_signal(t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sleepUs((uint64_t) ticks * 1000);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    pthread_mutex_t *mutex = malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(mutex, NULL);
+    return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    pthread_mutex_lock(sem);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    pthread_mutex_unlock(sem);
+    return pdTRUE;
+}
+
+// esp_timer: one thread per timer, waiting for its deadline
+struct timer {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t *cond;
+    bool            armed;
+    struct timespec deadline;
+    void (*callback)(void *);
+    void *arg;
+};
+
+static uint64_t startUs = 0;
+
+int64_t esp_timer_get_time(void) {
+    return nowUs() - startUs;
+}
+
+static void *timerThread(void *arg) {
+    struct timer *t = arg;
+    pthread_mutex_lock(&t->lock);
+    while (1) {
+        if (!t->armed) {
+            pthread_cond_wait(t->cond, &t->lock);
+        } else if (pthread_cond_timedwait(t->cond, &t->lock, &t->deadline) == ETIMEDOUT) {
+            t->armed = false;
+            pthread_mutex_unlock(&t->lock);
+            t->callback(t->arg);
+            pthread_mutex_lock(&t->lock);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+    struct timer *t = calloc(1, sizeof(struct timer));
+    pthread_mutex_init(&t->lock, NULL);
+    t->cond     = newCond();
+    t->callback = args->callback;
+    t->arg      = args->arg;
+    pthread_create(&t->thread, NULL, timerThread, t);
+    *handle = t;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t handle, uint64_t timeoutUs) {
+    struct timer *t = handle;
+    pthread_mutex_lock(&t->lock);
+    deadlineIn(&t->deadline, timeoutUs);
+    t->armed = true;
+    pthread_cond_signal(t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t handle) {
+    struct timer *t = handle;
+    pthread_mutex_lock(&t->lock);
+    t->armed = false;
+    pthread_cond_signal(t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_create_default(void) { return ESP_OK; }
+esp_err_t nvs_flash_init(void) { return ESP_OK; }
+esp_err_t nvs_flash_erase(void) { return ESP_OK; }
+void      init_led() {}
+void      led_set(int nr, bool state) {}
+void      led_flash(int nr) {}
+
+// second_uart.c, on the pty
+static pthread_mutex_t txLock       = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t        txBusyUntil  = 0;
+static uint32_t        byteNs       = 10 * 1000000000ULL / 115200;  // a byte on the wire, 8N1
+static pthread_mutex_t rxLock       = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t         apRx[AP_RX_BUFFER];
+static uint32_t        apRxHead     = 0;
+static uint32_t        apRxCount    = 0;
+static uint32_t        apRxOverflow = 0;
+static TaskHandle_t    apRxTask     = NULL;
+
+void init_second_uart() {}
+
+void uart_switch_speed(int baudrate) {
+    pthread_mutex_lock(&txLock);
+    byteNs = 10 * 1000000000ULL / baudrate;
+    pthread_mutex_unlock(&txLock);
+}
+
+int uart_write_bytes(int port, const void *src, size_t size) {
+    uint8_t buffer[size];
+    memcpy(buffer, src, size);
+    if (damaging && (size > 2) && (drand48() < damageRate)) buffer[1 + lrand48() % (size - 2)] ^= 0x5A;
+    pthread_mutex_lock(&txLock);
+    for (size_t off = 0; off < size;) {
+        ssize_t n = write(uartFd, buffer + off, size - off);
+        if (n > 0) off += n;
+        if ((n < 0) && (errno != EINTR) && (errno != EAGAIN)) break;
+    }
+    uint64_t now = nowUs();
+    txBusyUntil  = ((txBusyUntil > now) ? txBusyUntil : now) + size * byteNs / 1000;
+    uint64_t free = txBusyUntil - (uint64_t) UART_TX_BUFFER * byteNs / 1000;
+    pthread_mutex_unlock(&txLock);
+    if (free > now) sleepUs(free - now);
+    return size;
+}
+
+void uartTx(uint8_t data) {
+    uart_write_bytes(1, &data, 1);
+}
+
+bool getRxCharSecond(uint8_t *newChar) {
+    pthread_mutex_lock(&rxLock);
+    bool got = (apRxCount != 0);
+    if (got) {
+        *newChar = apRx[apRxHead];
+        apRxHead = (apRxHead + 1) % AP_RX_BUFFER;
+        apRxCount--;
+    }
+    pthread_mutex_unlock(&rxLock);
+    return got;
+}
+
+void uart_set_rx_task(TaskHandle_t task) {
+    apRxTask = task;
+}
+
+void uart_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    char buffer[128];
+    int  len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len > 0) uart_write_bytes(1, buffer, len);
+}
+
+// radio.c, without a radio. Frames are taken and dropped
+uint8_t             mSelfMac[8]    = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0xC6, 0x00};
+volatile uint32_t   radioRxDropped = 0;
+volatile uint8_t    radioRxPeak    = 0;
+volatile uint32_t   radioTxFrames  = 0;
+volatile uint32_t   radioLastTx    = 0;
+struct radioTxStats radioTxStats;
+
+void    radio_init(uint8_t ch) {}
+void    radioSetChannel(uint8_t ch) {}
+void    radioSetTxPower(uint8_t power) {}
+void    radioSetTask(TaskHandle_t task) {}
+void    radioTxService() {}
+bool    radioTx(uint8_t *packet) { return true; }
+bool    radioTxBulk(uint8_t *packet) { return true; }
+uint8_t radioTxBulkRoom() { return 16; }
+int8_t  commsRxUnencrypted(uint8_t **data, uint32_t *rxTime) { return 0; }
+void    commsRxRelease() {}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: pty_ap <pty> [damage rate]\n");
+        return 2;
+    }
+    uartFd = open(argv[1], O_RDWR | O_NOCTTY);
+    if (uartFd < 0) {
+        perror(argv[1]);
+        return 2;
+    }
+    struct termios tio;
+    tcgetattr(uartFd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(uartFd, TCSANOW, &tio);
+    damageRate = (argc > 2) ? atof(argv[2]) : 0;
+    signal(SIGUSR1, startDamaging);
+    srand48(getpid());
+    startUs = nowUs();
+
+    app_main();
+
+    // the uart driver's event task: what comes in goes into the rx buffer, and wakes the serial task
+    uint8_t chunk[256];
+    while (1) {
+        ssize_t n = read(uartFd, chunk, sizeof(chunk));
+        if ((n < 0) && (errno == EINTR)) continue;
+        if (n <= 0) break;
+        pthread_mutex_lock(&rxLock);
+        for (ssize_t c = 0; c < n; c++) {
+            if (apRxCount == AP_RX_BUFFER) {
+                apRxOverflow++;
+                continue;
+            }
+            apRx[(apRxHead + apRxCount++) % AP_RX_BUFFER] = chunk[c];
+        }
+        pthread_mutex_unlock(&rxLock);
+        if (apRxTask) xTaskNotifyGive(apRxTask);
+    }
+    xSemaphoreTake(protoMutex, portMAX_DELAY);
+    printf("pending %u noupdate %u overflow %u\n", curPendingData, curNoUpdate, apRxOverflow);
+    fflush(stdout);
+    _exit(0);
+}
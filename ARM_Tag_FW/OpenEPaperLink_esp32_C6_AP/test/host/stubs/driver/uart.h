@@ -0,0 +1,4 @@
+// Host stand-in for ESP-IDF, declarations only. The simulation defines what it uses
+#pragma once
+#include <stddef.h>
+int uart_write_bytes(int port, const void *src, size_t size);
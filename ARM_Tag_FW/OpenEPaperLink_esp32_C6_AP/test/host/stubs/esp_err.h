@@ -0,0 +1,7 @@
+// Host stand-in for ESP-IDF, declarations only. The simulation defines what it uses
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK                        0
+#define ESP_ERR_NVS_NO_FREE_PAGES     0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND 0x1110
+#define ESP_ERROR_CHECK(x)            (void) (x)
@@ -0,0 +1,4 @@
+// Host stand-in for ESP-IDF, declarations only. The simulation defines what it uses
+#pragma once
+#include "esp_err.h"
+esp_err_t esp_event_loop_create_default(void);
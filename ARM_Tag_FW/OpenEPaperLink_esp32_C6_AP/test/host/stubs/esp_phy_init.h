@@ -0,0 +1,2 @@
+// Host stand-in for ESP-IDF, the radio itself is modelled by the simulation in place of radio.c
+#pragma once
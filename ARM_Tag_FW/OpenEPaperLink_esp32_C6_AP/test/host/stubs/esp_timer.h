@@ -0,0 +1,17 @@
+// Host stand-in for ESP-IDF, declarations only. The simulation defines what it uses, on its own clock
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+typedef void *esp_timer_handle_t;
+typedef struct {
+    void (*callback)(void *arg);
+    void       *arg;
+    int         dispatch_method;
+    const char *name;
+    bool        skip_unhandled_events;
+} esp_timer_create_args_t;
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+int64_t   esp_timer_get_time(void);
@@ -0,0 +1,3 @@
+// Host stand-in for FreeRTOS, nothing of it is used by the sources built on the host
+#pragma once
+#include "FreeRTOS.h"
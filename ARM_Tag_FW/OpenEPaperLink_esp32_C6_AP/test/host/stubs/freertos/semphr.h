@@ -0,0 +1,6 @@
+// Host stand-in for FreeRTOS, declarations only. The simulation defines what it uses
+#pragma once
+#include "FreeRTOS.h"
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t sem);
@@ -0,0 +1,7 @@
+// Host stand-in for FreeRTOS, declarations only. The simulation defines what it uses
+#pragma once
+#include "FreeRTOS.h"
+BaseType_t xTaskCreate(void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t   ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+void       vTaskDelay(TickType_t ticks);
@@ -0,0 +1,18 @@
+// Host stand-in for the generated sdkconfig.h, the Kconfig defaults of main/Kconfig.projbuild.
+// The block and pending slot settings can be overridden from the compiler command line
+#pragma once
+#define CONFIG_IDF_TARGET_ESP32C6 1
+#define CONFIG_OEPL_HARDWARE_PROFILE_DEFAULT 1
+#ifndef CONFIG_OEPL_BLOCK_SLOTS
+#define CONFIG_OEPL_BLOCK_SLOTS 4
+#endif
+#ifndef CONFIG_OEPL_BLOCK_CACHE_ENTRIES
+#define CONFIG_OEPL_BLOCK_CACHE_ENTRIES 8
+#endif
+#ifndef CONFIG_OEPL_PENDING_SLOTS
+#define CONFIG_OEPL_PENDING_SLOTS 2000
+#endif
+#define CONFIG_OEPL_TX_CCA_THRESHOLD -60
+#define CONFIG_OEPL_TX_CCA_RETRIES 4
+#define CONFIG_OEPL_TX_CCA_MIN_BE 3
+#define CONFIG_OEPL_TX_CCA_MAX_BE 5
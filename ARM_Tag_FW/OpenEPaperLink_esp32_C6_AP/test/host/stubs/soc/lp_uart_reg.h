@@ -0,0 +1,2 @@
+// Host stand-in for ESP-IDF, nothing of it is used off target
+#pragma once
@@ -1,6 +1,26 @@
 #pragma once
 #ifdef HAS_BLE_WRITER
+#include <Arduino.h>
+
+struct BLEWriterStats {
+    uint32_t uploads;
+    uint32_t failures;         // uploads that were cut short
+    uint32_t connectFailures;
+    uint32_t bytes;
+    uint32_t resends;          // parts sent again after an error or a lost answer
+    uint32_t connectionMs;     // all connections together
+    uint32_t lastBytes;
+    uint32_t lastUploadMs;
+    uint32_t lastBytesPerSecond;
+    uint32_t lastConnectionMs;  // from connecting until the disconnect
+    uint16_t mtu;               // negotiated on the last connection
+};
 
 void BLETask(void* parameter);
 
+/// @brief Look for pending BLE uploads now instead of at the next interval
+void BLE_queue_ready();
+
+BLEWriterStats getBLEWriterStats();
+
 #endif
@@ -0,0 +1,52 @@
+#include <Arduino.h>
+#include <FS.h>
+
+#pragma once
+
+// Upper limit for unreferenced buffers that are kept around for reuse.
+// Referenced buffers are never evicted and don't count against it.
+#ifndef BUFFERPOOL_BUDGET
+#ifdef BOARD_HAS_PSRAM
+#define BUFFERPOOL_BUDGET (1024 * 1024)
+#else
+#define BUFFERPOOL_BUDGET (32 * 1024)
+#endif
+#endif
+
+/// @brief Refcounted data buffers, shared between tags and queue items.
+///
+/// Buffers can be keyed by the dataVer (first 8 bytes of the md5) of their
+/// content, so tags receiving the same image share one buffer and one flash read.
+/// Every pointer handed out holds one reference and must be given back with release().
+namespace bufferpool {
+
+struct Stats {
+    uint32_t buffers;
+    uint32_t bytes;
+    uint32_t cachedBytes;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+};
+
+/// @brief Allocate a new, unkeyed buffer
+/// @return buffer with one reference, or nullptr if out of memory
+uint8_t* alloc(const uint32_t len);
+
+/// @brief Look up a buffer by content version
+/// @return buffer with one extra reference, or nullptr if not cached
+uint8_t* find(const uint64_t dataVer, const uint32_t len);
+
+/// @brief Make a buffer from alloc() findable by its content version
+void publish(uint8_t* data, const uint64_t dataVer);
+
+/// @brief Get the content of a file, reading it only if its version isn't cached yet
+/// @param dataVer content version, or 0 to always read the file
+uint8_t* readFile(fs::File& file, const uint64_t dataVer);
+
+void retain(uint8_t* data);
+void release(uint8_t* data);
+
+Stats getStats();
+
+}  // namespace bufferpool
@@ -0,0 +1,123 @@
+#include <Arduino.h>
+
+#pragma once
+
+// Number of worker tasks fetching content. Every https request in flight takes its own tls buffers.
+#ifndef CONTENTFETCH_WORKERS
+#ifdef BOARD_HAS_PSRAM
+#define CONTENTFETCH_WORKERS 3
+#else
+#define CONTENTFETCH_WORKERS 1
+#endif
+#endif
+
+// Requests to the same host at the same time.
+#ifndef CONTENTFETCH_PER_HOST
+#define CONTENTFETCH_PER_HOST 1
+#endif
+
+// Largest response body that can be staged. Longer responses fail like a broken connection.
+#ifndef CONTENTFETCH_MAX_BODY
+#ifdef BOARD_HAS_PSRAM
+#define CONTENTFETCH_MAX_BODY (512 * 1024)
+#else
+#define CONTENTFETCH_MAX_BODY (48 * 1024)
+#endif
+#endif
+
+// Seconds before a tag's nextupdate its content is fetched.
+#ifndef CONTENTFETCH_LEAD
+#define CONTENTFETCH_LEAD 60
+#endif
+
+// Seconds a staged response is kept when nobody takes it.
+#ifndef CONTENTFETCH_MAX_AGE
+#define CONTENTFETCH_MAX_AGE 300
+#endif
+
+/// @brief Fetches content for the renderer in the background.
+///
+/// Worker tasks fetch requests into a staging area, earliest deadline first and
+/// at most CONTENTFETCH_PER_HOST at a time per host. The renderer only takes
+/// staged responses, so a slow or dead endpoint only holds up the tags using it.
+/// Requests are identified by normalised url, mac, ifModifiedSince and arg: asking
+/// again for a request that is queued, in flight or staged doesn't fetch it twice,
+/// and responses that can be shared come from httpcache while they are fresh.
+namespace contentfetch {
+
+struct Response {
+    int httpCode = 0;  // http status, or a negative HTTPClient error
+    uint8_t* body = nullptr;  // zero terminated
+    size_t len = 0;
+    time_t fetched = 0;
+
+    Response() = default;
+    Response(const Response&) = delete;
+    Response& operator=(const Response&) = delete;
+    ~Response() { free(body); }
+};
+
+struct Request {
+    String url;
+    uint16_t timeout = 5000;     // ms, for connecting and for every read
+    String ifModifiedSince;      // sends If-Modified-Since when set
+    String mac;                  // sends X-ESL-MAC when set
+    // for content that isn't a plain GET, runs on a worker instead of HTTPClient
+    void (*fetch)(const Request& req, Response& response) = nullptr;
+    uint16_t arg = 0;  // for fetch
+    // seconds other tags may reuse the response for, when the server doesn't say.
+    // Requests with a mac or ifModifiedSince are per tag and never reused.
+    uint32_t ttl = 0;
+};
+
+struct Stats {
+    uint32_t queued;
+    uint32_t inFlight;
+    uint32_t staged;
+    uint32_t stagedBytes;
+    uint32_t fetches;
+    uint32_t failures;
+    uint32_t prefetched;  // staged before the renderer asked for it
+    uint32_t waits;       // renderer asked before it was staged
+    uint32_t expired;
+};
+
+/// @brief Start the worker tasks
+void begin();
+
+/// @brief Ask for a request to be staged by the deadline
+void prefetch(const Request& req, const time_t deadline);
+
+/// @brief Check if a response is staged, asking for it now if not
+/// @return true if take() will return it
+bool ready(const Request& req);
+
+/// @brief Take a staged response out of the staging area
+/// @return false if nothing is staged for the request
+bool take(const Request& req, Response& response);
+
+/// @brief Stream over a response body, for parsers that read from a Stream
+class BodyStream : public Stream {
+   public:
+    explicit BodyStream(const Response& response) : data(response.body), len(response.len) {}
+    int available() override { return len - pos; }
+    int read() override { return pos < len ? data[pos++] : -1; }
+    int peek() override { return pos < len ? data[pos] : -1; }
+    size_t readBytes(char* buffer, size_t length) override {
+        length = std::min(length, len - pos);
+        memcpy(buffer, data + pos, length);
+        pos += length;
+        return length;
+    }
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+   private:
+    const uint8_t* data;
+    size_t len;
+    size_t pos = 0;
+};
+
+Stats getStats();
+
+}  // namespace contentfetch
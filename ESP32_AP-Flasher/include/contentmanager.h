@@ -15,13 +15,21 @@ struct contentTypes {
     String optionList;
 };
 
+struct RenderCacheStats {
+    uint32_t entries;
+    uint32_t hits;
+    uint32_t misses;
+};
+
 void contentRunner();
 void checkVars();
+RenderCacheStats getRenderCacheStats();
 void drawNew(const uint8_t mac[8], tagRecord *&taginfo);
 bool updateTagImage(String &filename, const uint8_t *dst, uint16_t nextCheckin, tagRecord *&taginfo, imgParam &imageParams);
 void drawString(TFT_eSprite &spr, String content, int16_t posx, int16_t posy, String font, byte align = 0, uint16_t color = TFT_BLACK, uint16_t size = 30, uint16_t bgcolor = TFT_WHITE);
 void drawTextBox(TFT_eSprite &spr, String &content, int16_t &posx, int16_t &posy, int16_t boxwidth, int16_t boxheight, String font, uint16_t color = TFT_BLACK, uint16_t bgcolor = TFT_WHITE, float lineheight = 1, byte align = TL_DATUM);
 void initSprite(TFT_eSprite &spr, int w, int h, imgParam &imageParams);
+void renderImage(String &filename, imgParam &imageParams, const std::function<void(TFT_eSprite &)> &draw);
 void drawDate(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, imgParam &imageParams);
 void drawNumber(String &filename, int32_t count, int32_t thresholdred, tagRecord *&taginfo, imgParam &imageParams);
 void drawWeather(String &filename, JsonObject &cfgobj, const tagRecord *taginfo, imgParam &imageParams);
@@ -45,7 +53,7 @@ char *formatHttpDate(const time_t t);
 String urlEncode(const char *msg);
 int windSpeedToBeaufort(const float windSpeed);
 String windDirectionIcon(const int degrees);
-void getLocation(JsonObject &cfgobj);
+bool getLocation(JsonObject &cfgobj);
 void prepareNFCReq(const uint8_t *dst, const char *url);
 void prepareLUTreq(const uint8_t *dst, const String &input);
 void prepareConfigFile(const uint8_t *dst, const JsonObject &config);
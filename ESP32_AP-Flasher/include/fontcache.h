@@ -0,0 +1,70 @@
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#pragma once
+
+class truetypeClass;
+
+// Number of fonts (ttf and vlw together) that are kept loaded.
+#ifndef FONTCACHE_FONTS
+#ifdef BOARD_HAS_PSRAM
+#define FONTCACHE_FONTS 8
+#else
+#define FONTCACHE_FONTS 3
+#endif
+#endif
+
+// Upper limit for ttf file contents kept in memory, over all fonts.
+// Fonts that don't fit are read from the file system, like before.
+#ifndef FONTCACHE_DATA_BUDGET
+#ifdef BOARD_HAS_PSRAM
+#define FONTCACHE_DATA_BUDGET (1024 * 1024)
+#else
+#define FONTCACHE_DATA_BUDGET 0
+#endif
+#endif
+
+// Upper limit for rasterised glyphs, per ttf font.
+#ifndef FONTCACHE_GLYPH_BUDGET
+#ifdef BOARD_HAS_PSRAM
+#define FONTCACHE_GLYPH_BUDGET (128 * 1024)
+#else
+#define FONTCACHE_GLYPH_BUDGET (8 * 1024)
+#endif
+#endif
+
+/// @brief Parsed fonts, shared between drawString/drawTextBox calls.
+///
+/// Keeps ttf tables and vlw glyph metrics loaded instead of reading them
+/// again for every string, evicting the least recently used font.
+/// Only to be used from the content task, fileChanged() and getStats() excepted.
+namespace fontcache {
+
+struct Stats {
+    uint32_t fonts;
+    uint32_t dataBytes;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t glyphs;
+    uint32_t glyphBytes;
+    uint32_t glyphHits;
+    uint32_t glyphMisses;
+};
+
+/// @brief Get a loaded ttf font
+/// @return font, or nullptr if it can't be read. Stays valid until the next call.
+truetypeClass* getTtf(const String& path);
+
+/// @brief Use a loaded vlw font in a sprite, instead of spr.loadFont()
+/// @return false if the font can't be read
+bool attachVlw(TFT_eSprite& spr, const String& path);
+
+/// @brief Remove a font set by attachVlw() from a sprite, instead of spr.unloadFont()
+void detachVlw(TFT_eSprite& spr);
+
+/// @brief Drop cached fonts on the next use, after a font file was written or removed
+void fileChanged(const String& path);
+
+Stats getStats();
+
+}  // namespace fontcache
@@ -0,0 +1,75 @@
+#include <Arduino.h>
+
+#pragma once
+
+#include "contentfetch.h"
+
+// Upper limit for cached response bodies, over all entries.
+#ifndef HTTPCACHE_BUDGET
+#if defined(HAS_SDCARD)
+#define HTTPCACHE_BUDGET (4 * 1024 * 1024)
+#elif defined(BOARD_HAS_PSRAM)
+#define HTTPCACHE_BUDGET (1024 * 1024)
+#else
+#define HTTPCACHE_BUDGET (32 * 1024)
+#endif
+#endif
+
+// Number of responses that are kept.
+#ifndef HTTPCACHE_ENTRIES
+#define HTTPCACHE_ENTRIES 64
+#endif
+
+/// @brief Responses of content sources, shared by all tags using the same source.
+///
+/// Entries are keyed by normalised url. They are fresh for as long as
+/// Cache-Control or Expires says, or for the ttl of the request when the
+/// server says nothing. Stale entries with an ETag or Last-Modified are
+/// revalidated with a conditional request. Bodies are kept in psram, or in
+/// /temp on the sd card when HAS_SDCARD is set. The least recently used
+/// entry is evicted when the budget runs out.
+namespace httpcache {
+
+// response headers that decide how long a response may be used
+struct Headers {
+    String cacheControl;
+    String expires;
+    String date;
+    String etag;
+    String lastModified;
+};
+
+struct Stats {
+    uint32_t entries;
+    uint32_t bytes;
+    uint32_t hits;         // served without transferring the body
+    uint32_t misses;       // body transferred
+    uint32_t revalidated;  // hits that took a 304
+    uint32_t bytesSaved;
+};
+
+/// @brief Lowercase scheme and host, default port and fragment removed, query parameters sorted
+String normalise(const String& url);
+
+/// @brief Check if a response is cached that is still fresh at a given time
+bool fresh(const String& key, const time_t at);
+
+/// @brief Copy a fresh response out of the cache
+/// @return false if there is none
+bool get(const String& key, contentfetch::Response& response);
+
+/// @brief Get what to send in a conditional request for a stale response
+/// @return false if nothing is cached that can be revalidated
+bool validators(const String& key, String& etag, String& lastModified);
+
+/// @brief Use the cached response after a 304
+/// @return false if it is gone by now
+bool revalidated(const String& key, const Headers& headers, const uint32_t ttl, contentfetch::Response& response);
+
+/// @brief Store a transferred response, if the headers allow
+/// @param ttl seconds it may be used for when the headers don't say
+void put(const String& key, const contentfetch::Response& response, const Headers& headers, const uint32_t ttl);
+
+Stats getStats();
+
+}  // namespace httpcache
@@ -0,0 +1,36 @@
+#include <Arduino.h>
+
+#pragma once
+
+class tagRecord;
+
+/// @brief Delta image updates (DATATYPE_IMG_DIFF).
+///
+/// For tags whose tag type has diff_compression, the packed planes of every
+/// image sent are kept next to it. Once the tag acknowledges the image they
+/// become /current/<MAC>.base, and the next image is sent as the changed
+/// rectangle, xor'ed with the base and compressed like a normal image, when
+/// that is smaller than the full image.
+namespace imagediff {
+
+struct Stats {
+    uint32_t deltas;
+    uint32_t fallbacks;
+    uint32_t fullBytes;   // size of the full images replaced by a delta
+    uint32_t deltaBytes;  // size of those deltas
+};
+
+/// @brief Prepare a pending image file for a tag
+/// @param filename full image, as queued in /current
+/// @param dataVer version of the full image
+/// @return name of the delta file to send instead, or an empty string to send the full image
+String prepare(const tagRecord* taginfo, const String& filename, uint8_t dataType, uint64_t dataVer, uint32_t& deltaSize);
+
+/// @brief Keep the planes of an acknowledged image as the base for the next delta
+/// @param filename the queued file
+/// @return the full image that was delivered, to be kept as preview or removed
+String xferComplete(const uint8_t mac[8], const String& filename);
+
+Stats getStats();
+
+}  // namespace imagediff
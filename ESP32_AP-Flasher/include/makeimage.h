@@ -1,6 +1,8 @@
 #include <Arduino.h>
 #include <TFT_eSPI.h>
 
+#include <functional>
+
 #pragma once
 
 #include "tag_db.h"
@@ -39,7 +41,15 @@ struct imgParam {
 
     uint8_t zlib;
     uint8_t g5;
+
+    uint64_t fingerprint = 0xcbf29ce484222325;  // FNV-1a offset basis, see Fingerprint in contentmanager
+    bool unchanged = false;
 };
 
 void spr2buffer(TFT_eSprite &spr, String &fileout, imgParam &imageParams);
 void jpg2buffer(String filein, String fileout, imgParam &imageParams);
+bool drawBanded(String &fileout, imgParam &imageParams, const std::function<void(TFT_eSprite &)> &draw);
+bool getSpriteBand(TFT_eSprite &spr, int16_t &x, int16_t &y, uint16_t &w, uint16_t &h);
+#ifndef SAVE_SPACE
+uint8_t *g5Compress(uint16_t width, uint16_t height, uint8_t *buffer, uint16_t buffersize, uint16_t &outBufferSize);
+#endif
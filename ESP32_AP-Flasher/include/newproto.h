@@ -1,6 +1,8 @@
 #include <Arduino.h>
 #include <FS.h>
 
+#include <mutex>
+
 #include "commstructs.h"
 
 struct PendingItem {
@@ -18,7 +20,7 @@ extern void prepareCancelPending(const uint8_t dst[8]);
 extern void prepareIdleReq(const uint8_t* dst, uint16_t nextCheckin);
 extern void prepareDataAvail(const uint8_t* dst);
 extern void prepareDataAvail(uint8_t* data, uint16_t len, uint8_t dataType, const uint8_t* dst);
-extern bool prepareDataAvail(String& filename, uint8_t dataType, uint8_t dataTypeArgument, const uint8_t* dst, uint16_t nextCheckin, bool resend = false);
+extern bool prepareDataAvail(String& filename, uint8_t dataType, uint8_t dataTypeArgument, const uint8_t* dst, uint16_t nextCheckin, bool resend = false, uint64_t* dataVer = nullptr);
 extern void prepareExternalDataAvail(struct pendingData* pending, IPAddress remoteIP);
 extern void processXferComplete(struct espXferComplete* xfc, bool local);
 extern void processXferTimeout(struct espXferComplete* xfc, bool local);
@@ -36,6 +38,9 @@ void refreshAllPending();
 void updateContent(const uint8_t* dst);
 void setAPchannel();
 
+// Guards the pending queue. Pointers returned by getQueueItem are only valid while holding it.
+extern std::recursive_mutex queueMutex;
+
 void enqueueItem(const PendingItem& item);
 bool dequeueItem(const uint8_t* targetMac);
 bool dequeueItem(const uint8_t* targetMac, const uint64_t dataVer);
@@ -44,4 +49,4 @@ extern PendingItem* getQueueItem(const uint8_t* targetMac);
 extern PendingItem* getQueueItem(const uint8_t* targetMac, const uint64_t dataVer);
 void checkQueue(const uint8_t* targetMac);
 bool queueDataAvail(struct pendingData* pending, bool local);
-uint8_t* getDataForFile(fs::File& file);
+uint8_t* loadQueueItemData(PendingItem* queueItem);
@@ -2,6 +2,15 @@
 
 extern struct espSetChannelPower curChannel;
 
+// Bytes of frames to the AP that may be in flight, kept until the AP answers so they can be sent again.
+#ifndef FRAME_WINDOW_BYTES
+#ifdef BOARD_HAS_PSRAM
+#define FRAME_WINDOW_BYTES (32 * 1024)
+#else
+#define FRAME_WINDOW_BYTES (12 * 1024)
+#endif
+#endif
+
 #define AP_STATE_OFFLINE 0
 #define AP_STATE_ONLINE 1
 #define AP_STATE_FLASHING 2
@@ -21,6 +30,8 @@ struct APInfoS {
     uint8_t power;
     uint8_t pendingBuffer;
     uint8_t nop;
+    uint8_t blockCache = 0;
+    uint8_t framing = 0;  // framed protocol version the AP supports, 0 if it only speaks text
 #ifdef HAS_SUBGHZ
     bool hasSubGhz = false;
     uint8_t SubGhzChannel;
@@ -40,10 +51,23 @@ enum ApSerialState {
 
 extern volatile ApSerialState gSerialTaskState;
 
+struct SerialAPStats {
+    bool framed;
+    uint32_t frames;       // commands sent in frames
+    uint32_t batched;      // SDA and CXD entries that shared a frame
+    uint32_t retransmits;
+    uint32_t naks;
+    uint32_t failed;       // commands the AP never answered
+    uint32_t crcErrors;
+    uint32_t lost;         // frames from the AP that never arrived
+    uint8_t inFlightPeak;
+};
+
 void APTask(void* parameter);
 
 bool sendCancelPending(struct pendingData* pending);
 bool sendDataAvail(struct pendingData* pending);
+void prefetchBlocks(const uint8_t* data, const uint32_t datalen, const uint64_t ver, const uint8_t blockId);
 bool sendPing();
 void APEnterEarlyReset();
 bool sendChannelPower(struct espSetChannelPower* scp);
@@ -51,3 +75,4 @@ void rxSerialTask2(void* parameter);
 void APTagReset();
 bool bringAPOnline(uint8_t newState = AP_STATE_ONLINE);
 void setAPstate(bool isOnline, uint8_t state);
+SerialAPStats getSerialAPStats();
@@ -1,5 +1,7 @@
 #include <Arduino.h>
 
+#pragma once
+
 #define WAKEUP_REASON_TIMED 0
 #define WAKEUP_REASON_BOOT 1
 #define WAKEUP_REASON_GPIO 2
@@ -12,7 +14,37 @@
 #define WAKEUP_REASON_NETWORK_SCAN 0xFD
 #define WAKEUP_REASON_WDT_RESET 0xFE
 
+// Bytes of log lines held in RAM until the log task writes them to /log.txt. A power of two.
+#ifndef LOG_BUFFER
+#ifdef BOARD_HAS_PSRAM
+#define LOG_BUFFER 16384
+#else
+#define LOG_BUFFER 4096
+#endif
+#endif
+
+// How often the log task writes the buffer out, in ms. It is woken earlier when the buffer is half full.
+#ifndef LOG_FLUSH_INTERVAL
+#define LOG_FLUSH_INTERVAL 2000
+#endif
+
+// /log.txt is moved to /logold.txt when it grows past this.
+#ifndef LOG_ROTATE_SIZE
+#define LOG_ROTATE_SIZE (10 * 1024)
+#endif
+
+struct LogStats {
+    uint32_t lines;
+    uint32_t dropped;  // the buffer was full
+    uint32_t flushes;
+    uint32_t bytes;    // written to the file
+    uint32_t peak;     // most bytes in the buffer at once
+};
+
 void initTime(void* parameter);
+void initLog();
 void logLine(const char* buffer);
 void logLine(const String& text);
+void logFlush();
+LogStats getLogStats();
 void logStartUp();
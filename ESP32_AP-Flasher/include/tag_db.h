@@ -1,6 +1,7 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -13,9 +14,59 @@
 #define RUNSTATUS_INIT 3
 
 #define NO_SUBGHZ_CHANNEL  255
+
+// tagRecord dirty bits, one per field that is stored, shown in the web UI or synced to other APs
+#define TAGFIELD_HASH (1UL << 0)
+#define TAGFIELD_LASTSEEN (1UL << 1)
+#define TAGFIELD_NEXTUPDATE (1UL << 2)
+#define TAGFIELD_NEXTCHECKIN (1UL << 3)
+#define TAGFIELD_PENDING (1UL << 4)
+#define TAGFIELD_ALIAS (1UL << 5)
+#define TAGFIELD_CONTENTMODE (1UL << 6)
+#define TAGFIELD_LQI (1UL << 7)
+#define TAGFIELD_RSSI (1UL << 8)
+#define TAGFIELD_TEMPERATURE (1UL << 9)
+#define TAGFIELD_BATTERY (1UL << 10)
+#define TAGFIELD_HWTYPE (1UL << 11)
+#define TAGFIELD_WAKEUPREASON (1UL << 12)
+#define TAGFIELD_CAPABILITIES (1UL << 13)
+#define TAGFIELD_MODECFG (1UL << 14)
+#define TAGFIELD_ISEXTERNAL (1UL << 15)
+#define TAGFIELD_APIP (1UL << 16)
+#define TAGFIELD_ROTATE (1UL << 17)
+#define TAGFIELD_LUT (1UL << 18)
+#define TAGFIELD_INVERT (1UL << 19)
+#define TAGFIELD_UPDATECOUNT (1UL << 20)
+#define TAGFIELD_UPDATELAST (1UL << 21)
+#define TAGFIELD_CHANNEL (1UL << 22)
+#define TAGFIELD_SWVERSION (1UL << 23)
+#define TAGFIELD_PENDINGIDLE (1UL << 24)
+#define TAGFIELD_ALL ((1UL << 25) - 1)
+
+// fields written by saveDBbin
+#define TAGFIELD_STORED (TAGFIELD_ALL & ~(TAGFIELD_PENDING | TAGFIELD_PENDINGIDLE))
+// fields sent to the web UI
+#define TAGFIELD_WEB (TAGFIELD_ALL & ~TAGFIELD_PENDINGIDLE)
+// fields carried by a TagInfo packet, per syncMode
+#define TAGFIELD_SYNC_USERCFG (TAGFIELD_CONTENTMODE | TAGFIELD_ALIAS | TAGFIELD_NEXTUPDATE)
+#define TAGFIELD_SYNC_TAGSTATUS (TAGFIELD_CONTENTMODE | TAGFIELD_LASTSEEN | TAGFIELD_NEXTUPDATE | TAGFIELD_PENDING | TAGFIELD_NEXTCHECKIN | TAGFIELD_HWTYPE | TAGFIELD_WAKEUPREASON | TAGFIELD_CAPABILITIES | TAGFIELD_PENDINGIDLE)
+
+// Held while changing a tagRecord or the tagDB list, and while reading records on
+// another task than the one changing them. The setters and markDirty take it.
+extern std::recursive_mutex tagDBMutex;
+
+// no references here, the class is packed
+#define TAGFIELD_SETTER(setter, type, field, bit)               \
+    void setter(type value) {                                   \
+        std::lock_guard<std::recursive_mutex> lock(tagDBMutex); \
+        if (field == value) return;                             \
+        field = value;                                          \
+        markDirty(bit);                                         \
+    }
+
 class tagRecord {
    public:
-    tagRecord() : mac{0}, version(0), alias(""), lastseen(0), nextupdate(0), contentMode(0), pendingCount(0), md5{0}, expectedNextCheckin(0), modeConfigJson(""), LQI(0), RSSI(0), temperature(0), batteryMv(0), hwType(0), wakeupReason(0), capabilities(0), lastfullupdate(0), isExternal(false), apIp(IPAddress(0, 0, 0, 0)), pendingIdle(0), rotate(0), lut(0), tagSoftwareVersion(0), currentChannel(0), dataType(0), filename(""), data(nullptr), len(0), invert(0), updateCount(0), updateLast(0) {}
+    tagRecord() : mac{0}, version(0), alias(""), lastseen(0), nextupdate(0), contentMode(0), pendingCount(0), md5{0}, expectedNextCheckin(0), modeConfigJson(""), LQI(0), RSSI(0), temperature(0), batteryMv(0), hwType(0), wakeupReason(0), capabilities(0), lastfullupdate(0), isExternal(false), apIp(IPAddress(0, 0, 0, 0)), pendingIdle(0), rotate(0), lut(0), tagSoftwareVersion(0), currentChannel(0), dataType(0), filename(""), data(nullptr), len(0), invert(0), updateCount(0), updateLast(0), dirtyStore(TAGFIELD_ALL), dirtyWeb(TAGFIELD_ALL), dirtySync(TAGFIELD_ALL), lastChange(time(nullptr)) {}
 
     uint8_t mac[8];
     uint8_t version;
@@ -51,9 +102,68 @@ class tagRecord {
     uint8_t* data;
     uint32_t len;
 
+    // TAGFIELD_ bits changed since the last save, websocket update and UDP sync
+    uint32_t dirtyStore;
+    uint32_t dirtyWeb;
+    uint32_t dirtySync;
+    // when a field shown in the web UI last changed
+    uint32_t lastChange;
+
+    void markDirty(const uint32_t fields) {
+        std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+        dirtyStore |= fields;
+        dirtyWeb |= fields;
+        dirtySync |= fields;
+        if (fields & TAGFIELD_WEB) lastChange = time(nullptr);
+    }
+    void markClean() {
+        std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+        dirtyStore = 0;
+        dirtyWeb = 0;
+        dirtySync = 0;
+    }
+
+    // setters for the tracked fields, these only mark the record dirty on an actual change
+    void setMd5(const uint8_t value[16]) {
+        std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+        if (memcmp(md5, value, sizeof(md5)) == 0) return;
+        memcpy(md5, value, sizeof(md5));
+        markDirty(TAGFIELD_HASH);
+    }
+    void clearMd5() {
+        const uint8_t zero[16] = {0};
+        setMd5(zero);
+    }
+    TAGFIELD_SETTER(setAlias, const String&, alias, TAGFIELD_ALIAS)
+    TAGFIELD_SETTER(setLastseen, const uint32_t, lastseen, TAGFIELD_LASTSEEN)
+    TAGFIELD_SETTER(setNextupdate, const uint32_t, nextupdate, TAGFIELD_NEXTUPDATE)
+    TAGFIELD_SETTER(setContentMode, const uint8_t, contentMode, TAGFIELD_CONTENTMODE)
+    TAGFIELD_SETTER(setPendingCount, const uint16_t, pendingCount, TAGFIELD_PENDING)
+    TAGFIELD_SETTER(setExpectedNextCheckin, const uint32_t, expectedNextCheckin, TAGFIELD_NEXTCHECKIN)
+    TAGFIELD_SETTER(setModeConfigJson, const String&, modeConfigJson, TAGFIELD_MODECFG)
+    TAGFIELD_SETTER(setLQI, const uint8_t, LQI, TAGFIELD_LQI)
+    TAGFIELD_SETTER(setRSSI, const int8_t, RSSI, TAGFIELD_RSSI)
+    TAGFIELD_SETTER(setTemperature, const int8_t, temperature, TAGFIELD_TEMPERATURE)
+    TAGFIELD_SETTER(setBatteryMv, const uint16_t, batteryMv, TAGFIELD_BATTERY)
+    TAGFIELD_SETTER(setHwType, const uint8_t, hwType, TAGFIELD_HWTYPE)
+    TAGFIELD_SETTER(setWakeupReason, const uint8_t, wakeupReason, TAGFIELD_WAKEUPREASON)
+    TAGFIELD_SETTER(setCapabilities, const uint8_t, capabilities, TAGFIELD_CAPABILITIES)
+    TAGFIELD_SETTER(setIsExternal, const bool, isExternal, TAGFIELD_ISEXTERNAL)
+    TAGFIELD_SETTER(setApIp, const IPAddress&, apIp, TAGFIELD_APIP)
+    TAGFIELD_SETTER(setPendingIdle, const uint16_t, pendingIdle, TAGFIELD_PENDINGIDLE)
+    TAGFIELD_SETTER(setRotate, const uint8_t, rotate, TAGFIELD_ROTATE)
+    TAGFIELD_SETTER(setLut, const uint8_t, lut, TAGFIELD_LUT)
+    TAGFIELD_SETTER(setTagSoftwareVersion, const uint16_t, tagSoftwareVersion, TAGFIELD_SWVERSION)
+    TAGFIELD_SETTER(setCurrentChannel, const uint8_t, currentChannel, TAGFIELD_CHANNEL)
+    TAGFIELD_SETTER(setInvert, const uint8_t, invert, TAGFIELD_INVERT)
+    TAGFIELD_SETTER(setUpdateCount, const uint32_t, updateCount, TAGFIELD_UPDATECOUNT)
+    TAGFIELD_SETTER(setUpdateLast, const uint32_t, updateLast, TAGFIELD_UPDATELAST)
+
     static tagRecord* findByMAC(const uint8_t mac[8]);
 };
 
+#undef TAGFIELD_SETTER
+
 struct Config {
     uint8_t channel;
     uint8_t subghzchannel;
@@ -94,10 +204,77 @@ struct HwType {
     uint8_t shortlut;
     uint8_t zlib;
     uint8_t g5;
+    uint8_t diff;
     uint16_t highlightColor;
     std::vector<Color> colortable;
 };
 
+struct TagTypeCacheStats {
+    uint32_t types;
+    uint32_t templates;
+    uint32_t templateBytes;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t flushes;
+};
+
+// selects the tags /get_db returns, all of them by default
+struct TagFilter {
+    bool byMac = false;
+    uint8_t mac[8] = {0};
+    uint32_t changedSince = 0;  // lastChange at or after
+    int16_t hwType = -1;
+    int16_t contentMode = -1;
+    bool timedOut = false;
+    bool lowBattery = false;
+};
+
+/// @brief Serializes the tags matching a filter as {"tags":[...]}, a piece at a time
+///
+/// Only the tag being written is held in memory, however many tags there are. tagDB
+/// is walked by position. A delete moves the last tag into the gap, when that puts a
+/// tag that wasn't written yet behind the position, its mac is kept and the tag is
+/// written at the end. Tags deleted meanwhile are left out, none is skipped or repeated.
+class TagDBJsonWriter {
+   public:
+    TagDBJsonWriter(const TagFilter& filter, const uint32_t startPos);
+    ~TagDBJsonWriter();
+    TagDBJsonWriter(const TagDBJsonWriter&) = delete;
+    TagDBJsonWriter& operator=(const TagDBJsonWriter&) = delete;
+
+    /// @brief Keeps the writers in progress right when tagDB[erased] makes way for tagDB[last]
+    /// Called by tag_db.cpp with tagDBMutex held, before the records are moved
+    static void onErase(const uint32_t erased, const uint32_t last);
+
+    /// @brief Write the next piece of the response
+    /// @return bytes written, 0 when the response is complete
+    size_t read(uint8_t* buffer, const size_t maxLen);
+
+   private:
+    enum class State : uint8_t {
+        Start,
+        Tags,
+        Done,
+    };
+
+    void next();
+    const tagRecord* nextRecord();
+
+    TagFilter filter;
+    uint32_t pos;
+    std::vector<uint64_t> moved;  // macs of tags moved behind pos before they were written
+    uint32_t count = 0;
+    State state = State::Start;
+    String pending;  // what is left of the current piece
+    size_t pendingPos = 0;
+};
+
+enum DBBinLoad {
+    DBBIN_LOADED,
+    DBBIN_MISSING,  // no binary store yet, import the json database
+    DBBIN_DAMAGED   // moved aside to .damaged, tagDB holds what the .bak had, if anything
+};
+
 struct varStruct {
     String value;
     bool changed;
@@ -107,11 +284,13 @@ extern Config config;
 extern std::vector<tagRecord*> tagDB;
 extern std::unordered_map<int, HwType> hwtype;
 extern std::unordered_map<std::string, varStruct> varDB;
-extern String tagDBtoJson(const uint8_t mac[8] = nullptr, uint8_t startPos = 0);
+extern tagRecord* addRecord(const uint8_t mac[8]);
 extern bool deleteRecord(const uint8_t mac[8], bool allVersions = true);
-extern void fillNode(JsonObject& tag, const tagRecord* taginfo);
+extern void fillNode(JsonObject& tag, const tagRecord* taginfo, const uint32_t fields = TAGFIELD_ALL);
 extern void saveDB(const String& filename);
 extern bool loadDB(const String& filename);
+extern void saveDBbin(const String& filename);
+extern DBBinLoad loadDBbin(const String& filename);
 extern void destroyDB();
 extern uint32_t getTagCount();
 extern uint32_t getTagCount(uint32_t& timeoutcount, uint32_t& lowbattcount);
@@ -122,6 +301,14 @@ extern void initAPconfig();
 extern void saveAPconfig();
 extern HwType getHwType(const uint8_t id);
 
+/// @brief Get the template for a content id from a tag type, following usetemplate
+/// @return false if the tag type has no template for it
+extern bool getHwTemplate(JsonDocument& json, const uint8_t id, const uint8_t hwtype);
+
+/// @brief Drop the parsed tag types on their next use if path is a tag type file
+extern void tagTypeFileChanged(const String& path);
+extern TagTypeCacheStats getTagTypeCacheStats();
+
 /// @brief Update a variable with the given key and value
 ///
 /// @param key Variable key
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Open-addressing index from MAC to position in tagDB. Only records with
+// version 0 are indexed; pushed copies (version 1) live in tagDB unindexed.
+class TagIndex {
+   public:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    uint32_t find(const uint64_t key) const {
+        if (slots.empty()) return EMPTY;
+        for (uint32_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            if (slots[i].pos == EMPTY) return EMPTY;
+            if (slots[i].key == key) return slots[i].pos;
+        }
+    }
+
+    void set(const uint64_t key, const uint32_t pos) {
+        if ((used + 1) * 4 > slots.size() * 3) grow();
+        uint32_t i = hash(key) & mask;
+        while (slots[i].pos != EMPTY && slots[i].key != key) i = (i + 1) & mask;
+        if (slots[i].pos == EMPTY) used++;
+        slots[i] = {key, pos};
+    }
+
+    void erase(const uint64_t key) {
+        if (slots.empty()) return;
+        uint32_t i = hash(key) & mask;
+        while (slots[i].key != key) {
+            if (slots[i].pos == EMPTY) return;
+            i = (i + 1) & mask;
+        }
+        if (slots[i].pos == EMPTY) return;
+        // backward shift deletion, keeps probe chains intact without tombstones
+        uint32_t j = i;
+        while (true) {
+            slots[i].pos = EMPTY;
+            do {
+                j = (j + 1) & mask;
+                if (slots[j].pos == EMPTY) {
+                    used--;
+                    return;
+                }
+                const uint32_t home = hash(slots[j].key) & mask;
+                if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) continue;
+                break;
+            } while (true);
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+
+    void clear() {
+        slots.clear();
+        mask = 0;
+        used = 0;
+    }
+
+   private:
+    struct Slot {
+        uint64_t key;
+        uint32_t pos;
+    };
+    std::vector<Slot> slots;
+    uint32_t mask = 0;
+    uint32_t used = 0;
+
+    static uint32_t hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return static_cast<uint32_t>(key);
+    }
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(slots);
+        const size_t size = old.empty() ? 64 : old.size() * 2;
+        slots.assign(size, {0, EMPTY});
+        mask = size - 1;
+        used = 0;
+        for (const Slot& slot : old) {
+            if (slot.pos != EMPTY) set(slot.key, slot.pos);
+        }
+    }
+};
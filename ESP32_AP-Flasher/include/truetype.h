@@ -21,6 +21,8 @@ lots of bugfixes and improvements by Nic.
 #include "FS.h"
 #endif /*FS_H*/
 
+#include <unordered_map>
+
 #define FLAG_ONCURVE (1 << 0)
 #define FLAG_XSHORT (1 << 1)
 #define FLAG_YSHORT (1 << 2)
@@ -39,6 +41,7 @@ lots of bugfixes and improvements by Nic.
 
 #define FILE_BUF_SIZE 256
 typedef void(TTF_DRAWPIXEL)(int16_t _x, int16_t _y, uint16_t _colorCode);
+typedef void(TTF_DRAWCOVERAGE)(int16_t _x, int16_t _y, uint8_t _coverage);
 
 typedef struct {
     char name[5];
@@ -148,11 +151,40 @@ typedef struct {
     int16_t leftSideBearing;
 } ttHMetric_t;
 
+/* outline edge for the scanline fill, all values in sample units */
 typedef struct {
-    uint16_t p1;
-    uint16_t p2;
-    uint8_t up;
-} ttWindIntersect_t;
+    int32_t yTop;     // first sample row crossing the edge
+    int32_t yBottom;  // first sample row no longer crossing it
+    int32_t x;        // first sample column right of the crossing, on the current row
+    int32_t err;      // x minus the exact crossing, in 1/dy
+    int32_t dy;
+    int32_t stepX;  // change of x and err per sample row
+    int32_t stepErr;
+    int8_t dir;  // 1 for edges going down (y grows), -1 for edges going up
+} ttEdge_t;
+
+/* rasterised glyph, 1 bit per pixel with rows padded to whole bytes following the struct */
+typedef struct ttGlyphBitmap_s {
+    uint32_t key;           // character size << 16 | character code
+    uint32_t size;          // bytes allocated, including this struct
+    uint16_t glyphId;       // glyph the character code maps to
+    uint16_t metricId;      // glyph whose metrics are used when drawing (differs for some compound glyphs)
+    uint16_t advanceWidth;  // advance when drawing
+    uint16_t measureWidth;  // advance when measuring the string
+    int16_t x;              // position of the bitmap relative to the pen position
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    struct ttGlyphBitmap_s *prev;  // lru list, most recently used first
+    struct ttGlyphBitmap_s *next;
+} ttGlyphBitmap_t;
+
+typedef struct {
+    uint32_t glyphs;
+    uint32_t bytes;
+    uint32_t hits;
+    uint32_t misses;
+} ttGlyphCacheStats_t;
 
 class truetypeClass {
    public:
@@ -161,12 +193,17 @@ class truetypeClass {
     uint8_t setTtfFile(File _file, uint8_t _checkCheckSum = 0);
     uint8_t setTtfPointer(uint8_t *pTTF, uint32_t u32Size, uint8_t _checkCheckSum = 0, bool bFlash = true);
     void setTtfDrawPixel(TTF_DRAWPIXEL *p);
+    void setTtfDrawCoverage(TTF_DRAWCOVERAGE *p);
     void setFramebuffer(uint16_t _framebufferWidth, uint16_t _framebufferHeight, uint16_t _framebuffer_bit, uint8_t *_framebuffer);
+    void setFramebufferWindow(int16_t _x, int16_t _y, uint16_t _width, uint16_t _height);
     void setCharacterSpacing(int16_t _characterSpace, uint8_t _kerning = 1);
     void setCharacterSize(uint16_t _characterSize);
     void setTextBoundary(uint16_t _start_x, uint16_t _end_x, uint16_t _end_y);
     void setTextColor(uint16_t _onLine, uint16_t _inside);
     void setTextRotation(uint16_t _rotation);
+    void setSupersampling(uint8_t _samples);
+    void setGlyphCacheSize(uint32_t _bytes);
+    ttGlyphCacheStats_t getGlyphCacheStats();
 
     uint16_t getStringWidth(const wchar_t _character[]);
     uint16_t getStringWidth(const char _character[]);
@@ -193,6 +230,7 @@ class truetypeClass {
     uint32_t iCurrentBufSize = 0;
 
     TTF_DRAWPIXEL *pfnDrawPixel = NULL;
+    TTF_DRAWCOVERAGE *pfnDrawCoverage = NULL;
 
     uint16_t charCode;
     int16_t xMin, xMax, yMin, yMax;
@@ -201,7 +239,7 @@ class truetypeClass {
     const int tablePos = 12;
 
     uint16_t numTables;
-    ttTable_t *table;
+    ttTable_t *table = nullptr;
     ttHeadttTable_t headTable;
 
     uint8_t getUInt8t();
@@ -225,7 +263,7 @@ class truetypeClass {
 
     // cmap. maps character codes to glyph indices
     ttCmapIndex_t cmapIndex;
-    ttCmapEncoding_t *cmapEncoding;
+    ttCmapEncoding_t *cmapEncoding = nullptr;
     ttCmapFormat4_t cmapFormat4;
     uint8_t readCmapFormat4();
     uint8_t readCmap();
@@ -254,14 +292,36 @@ class truetypeClass {
     uint16_t numEndPoints = 0;
 
     // glyf
-    ttGlyph_t glyph;
-    ttWindIntersect_t *pointsToFill = nullptr;
+    ttGlyph_t glyph = {0, 0, 0, 0, 0, nullptr, 0, nullptr};
     void generateOutline(int16_t _x, int16_t _y, uint16_t characterSize);
     void freePointsAll();
     void fillGlyph(int16_t _x_min, int16_t _y_min, uint16_t characterSize);
     uint8_t readGlyph(uint16_t code, uint8_t _justSize = 0);
     void freeGlyph();
 
+    // scanline fill. the buffers are kept between glyphs, freeEdges() releases them
+    ttEdge_t *edges = nullptr;
+    uint16_t *activeEdges = nullptr;
+    uint16_t edgesSize = 0;
+    uint8_t *coverage = nullptr;
+    uint16_t coverageSize = 0;
+    uint8_t supersampling = 1;
+    uint16_t buildEdges(int16_t _y_start, int32_t _scale, int32_t _offset);
+    void fillSpan(int32_t _x0, int32_t _x1, int16_t _y, int16_t _x_start, int16_t _x_end, int32_t _scale, int32_t _offset);
+    void freeEdges();
+
+    // glyph cache. rasterised glyphs, evicted least recently used first
+    std::unordered_map<uint32_t, ttGlyphBitmap_t *> glyphCache;
+    ttGlyphBitmap_t *glyphCacheHead = nullptr;
+    ttGlyphBitmap_t *glyphCacheTail = nullptr;
+    uint32_t glyphCacheSize = 0;
+    ttGlyphCacheStats_t glyphCacheStats = {0, 0, 0, 0};
+    ttGlyphBitmap_t *rasterTarget = nullptr;
+    ttGlyphBitmap_t *getGlyphBitmap(uint16_t _code);
+    void drawGlyphBitmap(ttGlyphBitmap_t *_bitmap, int16_t _x, int16_t _y);
+    void freeGlyphBitmap(ttGlyphBitmap_t *_bitmap);
+    void freeGlyphCache();
+
     void addLine(float _x0, float _y0, float _x1, float _y1);
     void addPoint(int16_t _x, int16_t _y);
     void freePoints();
@@ -269,7 +329,6 @@ class truetypeClass {
     void freeBeginPoints();
     void addEndPoint(uint16_t _ep);
     void freeEndPoints();
-    float isLeft(ttCoordinate_t *_p0, ttCoordinate_t *_p1, ttCoordinate_t *_point);
 
     // write user framebuffer
     uint16_t characterSize = 20;
@@ -281,6 +340,10 @@ class truetypeClass {
     uint16_t displayWidth = 400;
     uint16_t displayHeight = 400;
     uint16_t displayWidthFrame = 400;
+    int16_t frameX = 0;
+    int16_t frameY = 0;
+    uint16_t frameWidth = 400;
+    uint16_t frameHeight = 400;
     uint16_t framebufferBit = 8;
     uint8_t stringRotation = 0x00;
     uint16_t colorLine = 0x00;
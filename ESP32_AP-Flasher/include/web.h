@@ -3,13 +3,41 @@
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 
+#pragma once
+
+// Tag updates and log lines are collected and sent to the web UI once per interval, in ms.
+#ifndef WS_FLUSH_INTERVAL
+#define WS_FLUSH_INTERVAL 250
+#endif
+
+// Log lines sent per interval. Under pressure older lines are dropped, errors last.
+#ifndef WS_LOG_LINES
+#define WS_LOG_LINES 20
+#endif
+
+// Clients with this many messages still queued are skipped until they catch up.
+#ifndef WS_CLIENT_QUEUE
+#define WS_CLIENT_QUEUE 8
+#endif
+
+struct WebsocketStats {
+    uint32_t messages;
+    uint32_t tagUpdates;
+    uint32_t logLines;
+    uint32_t droppedLines;
+    uint32_t skipped;  // times a client was behind
+};
+
 void init_web();
 void doImageUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final);
 void doJsonUpload(AsyncWebServerRequest *request);
 void dotagDBUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final);
 void wsLog(const String &text);
 void wsErr(const String &text);
+void wsSysLog(const String &text);
 void wsSendTaginfo(const uint8_t *mac, uint8_t syncMode);
+void wsFlush();
+WebsocketStats getWebsocketStats();
 void wsSendSysteminfo();
 void wsSendAPitem(struct APlist *apitem);
 void wsSerial(const String &text);
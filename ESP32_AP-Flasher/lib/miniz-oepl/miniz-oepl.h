@@ -137,7 +137,7 @@ namespace Miniz {
 // #define MINIZ_NO_DEFLATE_APIS 
 
 /* Define MINIZ_NO_INFLATE_APIS to disable all decompression API's. */
-#define MINIZ_NO_INFLATE_APIS
+// #define MINIZ_NO_INFLATE_APIS
 
 /* Define MINIZ_NO_ARCHIVE_APIS to disable all ZIP archive API's. */
 #define MINIZ_NO_ARCHIVE_APIS 
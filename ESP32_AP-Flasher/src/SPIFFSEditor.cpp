@@ -2,6 +2,9 @@
 
 #include <FS.h>
 
+#include "fontcache.h"
+#include "tag_db.h"
+
 #define SPIFFS_MAXLENGTH_FILEPATH 32
 
 SPIFFSEditor::SPIFFSEditor(const fs::FS &fs, const String &username, const String &password)
@@ -98,6 +101,8 @@ void SPIFFSEditor::handleRequest(AsyncWebServerRequest *request) {
     } else if (request->method() == HTTP_DELETE) {
         if (request->hasParam("path", true)) {
             _fs.remove("/" + request->getParam("path", true)->value());
+            fontcache::fileChanged(request->getParam("path", true)->value());
+            tagTypeFileChanged(request->getParam("path", true)->value());
             request->send(200, "", "DELETE: " + request->getParam("path", true)->value());
         } else {
             request->send(404);
@@ -161,6 +166,8 @@ void SPIFFSEditor::handleUpload(AsyncWebServerRequest *request, const String &fi
         }
         if (final) {
             request->_tempFile.close();
+            fontcache::fileChanged(filename);
+            tagTypeFileChanged(filename);
         }
     }
 }
@@ -192,17 +192,18 @@ bool BLE_filter_add_device(BLEAdvertisedDevice advertisedDevice) {
     return false;
 }
 
+// pendingCount goes up before the image is queued, so only the queue item says it is ready
 bool BLE_is_image_pending(uint8_t address[8]) {
     for (int16_t c = 0; c < tagDB.size(); c++) {
         tagRecord* taginfo = tagDB.at(c);
-        if (taginfo->pendingCount > 0 && taginfo->version == 0 && ((taginfo->hwType & 0xB0) == 0xB0)) {
+        if (taginfo->pendingCount > 0 && taginfo->version == 0 && ((taginfo->hwType & 0xB0) == 0xB0) && getQueueItem(taginfo->mac) != nullptr) {
             memcpy(address, taginfo->mac, 8);
             return true;
         }
     }
     for (int16_t c = 0; c < tagDB.size(); c++) {
         tagRecord* taginfo = tagDB.at(c);
-        if (taginfo->pendingCount > 0 && taginfo->version == 0 && (taginfo->mac[7] == 0x13) && (taginfo->mac[6] == 0x37)) {
+        if (taginfo->pendingCount > 0 && taginfo->version == 0 && (taginfo->mac[7] == 0x13) && (taginfo->mac[6] == 0x37) && getQueueItem(taginfo->mac) != nullptr) {
             memcpy(address, taginfo->mac, 8);
             Serial.printf("ATC BLE OEPL data Waiting\r\n");
             return true;
@@ -220,23 +221,17 @@ uint8_t swapBits(uint8_t num) {
 }
 
 uint32_t compress_image(uint8_t address[8], uint8_t* buffer, uint32_t max_len) {
-    uint32_t t = millis();
+    std::lock_guard<std::recursive_mutex> lock(queueMutex);
     PendingItem* queueItem = getQueueItem(address, 0);
     if (queueItem == nullptr) {
         prepareCancelPending(address);
         Serial.printf("blockrequest: couldn't find taginfo %02X%02X%02X%02X%02X%02X%02X%02X\r\n", address[7], address[6], address[5], address[4], address[3], address[2], address[1], address[0]);
         return 0;
     }
-    if (queueItem->data == nullptr) {
-        fs::File file = contentFS->open(queueItem->filename);
-        if (!file) {
-            Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
-            prepareCancelPending(address);
-            return 0;
-        }
-        queueItem->data = getDataForFile(file);
-        Serial.println("Reading file " + String(queueItem->filename) + " in  " + String(millis() - t) + "ms");
-        file.close();
+    if (loadQueueItemData(queueItem) == nullptr) {
+        Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
+        prepareCancelPending(address);
+        return 0;
     }
 
     uint16_t giciType = (address[7] << 8) | address[6];  // here we "extract" the display info again
@@ -433,23 +428,17 @@ uint32_t compress_image(uint8_t address[8], uint8_t* buffer, uint32_t max_len) {
 }
 
 uint32_t get_ATC_BLE_OEPL_image(uint8_t address[8], uint8_t* buffer, uint32_t max_len, uint8_t* dataType, uint8_t* dataTypeArgument, uint16_t* nextCheckIn) {
-    uint32_t t = millis();
+    std::lock_guard<std::recursive_mutex> lock(queueMutex);
     PendingItem* queueItem = getQueueItem(address, 0);
     if (queueItem == nullptr) {
         prepareCancelPending(address);
         Serial.printf("blockrequest: couldn't find taginfo %02X%02X%02X%02X%02X%02X%02X%02X\r\n", address[7], address[6], address[5], address[4], address[3], address[2], address[1], address[0]);
         return 0;
     }
-    if (queueItem->data == nullptr) {
-        fs::File file = contentFS->open(queueItem->filename);
-        if (!file) {
-            Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
-            prepareCancelPending(address);
-            return 0;
-        }
-        queueItem->data = getDataForFile(file);
-        Serial.println("Reading file " + String(queueItem->filename) + " in  " + String(millis() - t) + "ms");
-        file.close();
+    if (loadQueueItemData(queueItem) == nullptr) {
+        Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
+        prepareCancelPending(address);
+        return 0;
     }
     if (queueItem->len > max_len) {
         Serial.print("The upload is too big better cencel it\r\n");
@@ -2,14 +2,40 @@
 #include <Arduino.h>
 #include <MD5Builder.h>
 
+#include <mutex>
+
 #include "BLEDevice.h"
 #include "ble_filter.h"
+#include "ble_writer.h"
 #include "newproto.h"
 
 #define INTERVAL_BLE_SCANNING_SECONDS 60
 #define INTERVAL_HANDLE_PENDING_SECONDS 10
 #define BUFFER_MAX_SIZE_COMPRESSING 135000
 
+// Parts of a block that may be on their way to an ATC BLE OEPL tag. Every ack or error it notifies frees one.
+#ifndef BLE_WRITER_WINDOW
+#define BLE_WRITER_WINDOW 4
+#endif
+
+// ATT MTU asked for when connecting, the tag answers with what it can do
+#ifndef BLE_WRITER_MTU
+#define BLE_WRITER_MTU 517
+#endif
+
+// Link layer payload asked for, 251 is the most data length extension allows
+#ifndef BLE_WRITER_DLE
+#define BLE_WRITER_DLE 251
+#endif
+
+// ms without an answer before the parts in flight are sent again
+#ifndef BLE_WRITER_PART_TIMEOUT
+#define BLE_WRITER_PART_TIMEOUT 1000
+#endif
+
+#define BLE_NOTIFY_QUEUE_LEN 16
+#define BLE_NOTIFY_SIZE 64
+
 #define BLE_MAIN_STATE_IDLE 0
 #define BLE_MAIN_STATE_PREPARE 1
 #define BLE_MAIN_STATE_CONNECT 2
@@ -53,7 +79,9 @@ BLERemoteCharacteristic* imgChar;
 BLEAdvertisedDevice* myDevice;
 BLEClient* pClient;
 
-uint8_t BLE_notify_buffer[256] = {0};
+QueueHandle_t BLE_notify_queue = nullptr;
+uint8_t BLE_notify_buffer[BLE_NOTIFY_SIZE] = {0};
+volatile bool BLE_pending_ready = false;
 
 uint32_t BLE_err_counter = 0;
 uint32_t BLE_curr_part = 0;
@@ -67,6 +95,11 @@ uint8_t BLE_curr_address[8] = {0};
 uint32_t BLE_compressed_len = 0;
 uint8_t* BLE_image_buffer;
 
+uint32_t BLE_connect_start = 0;
+uint32_t BLE_upload_start = 0;
+std::mutex BLE_stats_mutex;
+BLEWriterStats BLE_stats = {0};
+
 static void notifyCallback(
     BLERemoteCharacteristic* pBLERemoteCharacteristic,
     uint8_t* pData,
@@ -77,13 +110,17 @@ static void notifyCallback(
     Serial.print(" of data length ");
     Serial.println(length);
     Serial.print("data: ");
+    uint8_t notify[BLE_NOTIFY_SIZE] = {0};
     for (int i = 0; i < length; i++) {
         Serial.printf("%02X", pData[i]);
-        BLE_notify_buffer[1 + i] = pData[i];
+        if (1 + i < sizeof(notify))
+            notify[1 + i] = pData[i];
     }
-    BLE_notify_buffer[0] = length;
+    notify[0] = min(length, (size_t)0xff);
     Serial.println();
-    BLE_new_notify = true;
+    // the tag can answer several parts before BLETask gets to look, none of them may get lost
+    if (xQueueSend(BLE_notify_queue, notify, 0) != pdTRUE)
+        Serial.println("BLE notify queue full");
 }
 
 class MyClientCallback : public BLEClientCallbacks {
@@ -150,11 +187,16 @@ bool BLE_connect(uint8_t addr[8], BLE_CONNECTION_TYPE conn_type) {
         pClient->disconnect();
         return false;
     }
-    if (pClient->setMTU(255) == false) {
+    if (pClient->setMTU(BLE_WRITER_MTU) == false) {
         Serial.printf("BLE MTU failed\r\n");
         pClient->disconnect();
         return false;
     }
+#ifdef CONFIG_BLUEDROID_ENABLED
+    // longer link layer packets, so a part doesn't need to be split over several of them
+    if (esp_ble_gap_set_pkt_data_len(temp_Address, BLE_WRITER_DLE) != ESP_OK)
+        Serial.printf("BLE data length extension not available\r\n");
+#endif
     Serial.printf("BLE Connected fully to: %02X:%02X:%02X:%02X:%02X:%02X\r\n", addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
     return true;
 }
@@ -176,8 +218,18 @@ void BLE_startScan(uint32_t timeout) {
 
 #define BLOCK_DATA_SIZE_BLE 4096
 #define BLOCK_PART_DATA_SIZE_BLE 230
-uint8_t tempBlockBuffer[BLOCK_DATA_SIZE_BLE + 4];
+#define BLOCK_MAX_PARTS_BLE ((BLOCK_DATA_SIZE_BLE + 4 + BLOCK_PART_DATA_SIZE_BLE - 1) / BLOCK_PART_DATA_SIZE_BLE)
+static_assert(BLOCK_MAX_PARTS_BLE <= 32, "parts of a block are tracked in a uint32_t");
+uint8_t tempBlockBuffer[BLOCK_MAX_PARTS_BLE * BLOCK_PART_DATA_SIZE_BLE];  // the last part is sent whole
 uint8_t tempPacketBuffer[2 + 3 + BLOCK_PART_DATA_SIZE_BLE];
+
+uint32_t BLE_parts_acked = 0;  // bit per part of the current block
+uint32_t BLE_parts_in_flight = 0;
+uint8_t BLE_in_flight[BLE_WRITER_WINDOW];  // oldest first, the order the tag answers in
+uint8_t BLE_in_flight_count = 0;
+uint8_t BLE_window = 1;
+bool BLE_write_no_response = false;
+uint32_t BLE_last_progress = 0;
 void ATC_BLE_OEPL_PrepareBlk(uint8_t indexBlockId) {
     if (BLE_image_buffer == nullptr) {
         return;
@@ -200,6 +252,9 @@ void ATC_BLE_OEPL_PrepareBlk(uint8_t indexBlockId) {
         BLE_max_block_parts++;
     Serial.println("Preparing block: " + String(indexBlockId) + " BuffPos: " + String(bufferPosition) + " LenNow: " + String(lenNow) + " MaxBLEparts: " + String(BLE_max_block_parts));
     BLE_curr_part = 0;
+    BLE_parts_acked = 0;
+    BLE_parts_in_flight = 0;
+    BLE_in_flight_count = 0;
 }
 
 void ATC_BLE_OEPL_SendPart(uint8_t indexBlockId, uint8_t indexPkt) {
@@ -213,27 +268,107 @@ void ATC_BLE_OEPL_SendPart(uint8_t indexBlockId, uint8_t indexPkt) {
     tempPacketBuffer[2] = crcCalc;
     tempPacketBuffer[3] = indexBlockId;
     tempPacketBuffer[4] = indexPkt;
-    Serial.println("BLE Sending packet Len " + String(sizeof(tempPacketBuffer)));
-    ctrlChar->writeValue(tempPacketBuffer, sizeof(tempPacketBuffer), true);
+    ctrlChar->writeValue(tempPacketBuffer, sizeof(tempPacketBuffer), !BLE_write_no_response);
+}
+
+// sends the oldest parts the tag doesn't have yet, until the window is full
+void ATC_BLE_OEPL_FillWindow() {
+    for (uint8_t part = 0; part < BLE_max_block_parts && BLE_in_flight_count < BLE_window; part++) {
+        const uint32_t bit = 1UL << part;
+        if ((BLE_parts_acked | BLE_parts_in_flight) & bit)
+            continue;
+        if (BLE_in_flight_count == 0)
+            BLE_last_progress = millis();
+        ATC_BLE_OEPL_SendPart(BLEblkRequst.blockId, part);
+        BLE_parts_in_flight |= bit;
+        BLE_in_flight[BLE_in_flight_count++] = part;
+    }
+}
+
+// the tag answered the oldest part in flight, returns false for a late answer to a part that was already sent again
+bool ATC_BLE_OEPL_PartAnswered(bool acked) {
+    if (BLE_in_flight_count == 0)
+        return false;
+    const uint8_t part = BLE_in_flight[0];
+    BLE_in_flight_count--;
+    memmove(&BLE_in_flight[0], &BLE_in_flight[1], BLE_in_flight_count);
+    BLE_parts_in_flight &= ~(1UL << part);
+    if (acked)
+        BLE_parts_acked |= 1UL << part;
+    return true;
+}
+
+// ends the upload and the connection, and tells the tag db the transfer is done if asked to
+void BLE_end_upload(bool success, bool xferComplete) {
+    const uint32_t now = millis();
+    const uint32_t uploadMs = now - BLE_upload_start;
+    const uint32_t connectionMs = now - BLE_connect_start;
+    const uint32_t bytesPerSecond = uploadMs ? (uint64_t)BLE_compressed_len * 1000 / uploadMs : BLE_compressed_len;
+    const uint16_t mtu = pClient->getMTU();
+    free(BLE_image_buffer);
+    pClient->disconnect();
+    ble_main_state = BLE_MAIN_STATE_IDLE;
+    BLE_last_pending_check = now;
+    Serial.printf("BLE upload %s: %u bytes in %u ms, %u bytes/s, connected for %u ms, MTU %u\r\n", success ? "done" : "failed", BLE_compressed_len, uploadMs, bytesPerSecond, connectionMs, mtu);
+    {
+        std::lock_guard<std::mutex> lock(BLE_stats_mutex);
+        if (success) {
+            BLE_stats.uploads++;
+            BLE_stats.bytes += BLE_compressed_len;
+            BLE_stats.lastBytes = BLE_compressed_len;
+            BLE_stats.lastUploadMs = uploadMs;
+            BLE_stats.lastBytesPerSecond = bytesPerSecond;
+        } else {
+            BLE_stats.failures++;
+        }
+        BLE_stats.connectionMs += connectionMs;
+        BLE_stats.lastConnectionMs = connectionMs;
+        BLE_stats.mtu = mtu;
+    }
+    if (xferComplete) {
+        struct espXferComplete reportStruct;
+        memcpy((uint8_t*)&reportStruct.src, BLE_curr_address, 8);
+        processXferComplete(&reportStruct, true);
+    }
+    BLE_err_counter = 0;
+    BLE_max_block_parts = 0;
+    BLE_curr_part = 0;
+}
+
+void BLE_connect_failed() {
+    std::lock_guard<std::mutex> lock(BLE_stats_mutex);
+    BLE_stats.connectFailures++;
+}
+
+void BLE_queue_ready() {
+    BLE_pending_ready = true;
+}
+
+BLEWriterStats getBLEWriterStats() {
+    std::lock_guard<std::mutex> lock(BLE_stats_mutex);
+    return BLE_stats;
 }
 
 void BLETask(void* parameter) {
     vTaskDelay(5000 / portTICK_PERIOD_MS);
     Serial.println("BLE task started");
+    BLE_notify_queue = xQueueCreate(BLE_NOTIFY_QUEUE_LEN, BLE_NOTIFY_SIZE);
     BLEDevice::init("");
     while (1) {
         switch (ble_main_state) {
             default:
             case BLE_MAIN_STATE_IDLE:
+                BLE_new_notify = false;  // nothing to answer while not uploading
                 if (millis() - last_ble_scan > (INTERVAL_BLE_SCANNING_SECONDS * 1000)) {
                     last_ble_scan = millis();
                     Serial.println("Doing the BLE Scan");
                     BLE_startScan(10);  // timeout in seconds, this is blocking but only for this thread!
                 }
-                if (millis() - BLE_last_pending_check >= (INTERVAL_HANDLE_PENDING_SECONDS * 1000)) {
-                    if (BLE_is_image_pending(BLE_curr_address)) {
-                        Serial.println("BLE Image is pending but we wait a bit");
-                        delay(5000);                                                       // We better wait here, since the pending image needs to be created first
+                if (BLE_pending_ready || millis() - BLE_last_pending_check >= (INTERVAL_HANDLE_PENDING_SECONDS * 1000)) {
+                    BLE_pending_ready = false;
+                    if (BLE_is_image_pending(BLE_curr_address)) {  // only once its queue item is there, so the image is ready
+                        Serial.println("BLE Image is pending");
+                        BLE_connect_start = millis();
                         if (BLE_curr_address[7] == 0x13 && BLE_curr_address[6] == 0x37) {  // This is an ATC BLE OEPL display
                             // Here we create the compressed buffer
                             BLE_image_buffer = (uint8_t*)malloc(BUFFER_MAX_SIZE_COMPRESSING);
@@ -268,11 +403,15 @@ void BLETask(void* parameter) {
                                     for (uint16_t c = 1; c < sizeof(struct AvailDataInfo); c++) {
                                         BLEavaildatainfo.checksum += (uint8_t)((uint8_t*)&BLEavaildatainfo)[c];
                                     }
+                                    xQueueReset(BLE_notify_queue);
+                                    BLE_upload_start = millis();
                                     BLE_upload_state = BLE_UPLOAD_STATE_INIT;
                                     ble_main_state = BLE_MAIN_STATE_ATC_BLE_OEPL_UPLOAD;
                                     BLE_new_notify = true;  // trigger the upload here
                                 } else {
                                     free(BLE_image_buffer);
+                                    if (BLE_compressed_len)
+                                        BLE_connect_failed();
                                     if (BLE_err_counter++ >= 5) {  // 5 Retries for a BLE Connection
                                         struct espXferComplete reportStruct;
                                         memcpy((uint8_t*)&reportStruct.src, BLE_curr_address, 8);
@@ -294,11 +433,15 @@ void BLETask(void* parameter) {
                                     BLE_err_counter = 0;
                                     BLE_curr_part = 0;
                                     memset(BLE_notify_buffer, 0x00, sizeof(BLE_notify_buffer));
+                                    xQueueReset(BLE_notify_queue);
+                                    BLE_upload_start = millis();
                                     BLE_upload_state = BLE_UPLOAD_STATE_INIT;
                                     ble_main_state = BLE_MAIN_STATE_UPLOAD;
                                     BLE_new_notify = true;  // trigger the upload here
                                 } else {
                                     free(BLE_image_buffer);
+                                    if (BLE_compressed_len)
+                                        BLE_connect_failed();
                                     if (BLE_err_counter++ >= 5) {  // 5 Retries for a BLE Connection
                                         struct espXferComplete reportStruct;
                                         memcpy((uint8_t*)&reportStruct.src, BLE_curr_address, 8);
@@ -338,24 +481,14 @@ void BLETask(void* parameter) {
                             break;
                         case BLE_UPLOAD_STATE_UPLOAD:
                             if (BLE_notify_buffer[2] == 0x08) {
-                                free(BLE_image_buffer);
-                                pClient->disconnect();
-                                ble_main_state = BLE_MAIN_STATE_IDLE;
-                                BLE_last_pending_check = millis();
                                 // Done and the image is refreshing now
-                                struct espXferComplete reportStruct;
-                                memcpy((uint8_t*)&reportStruct.src, BLE_curr_address, 8);
-                                processXferComplete(&reportStruct, true);
-                                BLE_err_counter = 0;
-                                BLE_curr_part = 0;
+                                BLE_end_upload(true, true);
                             } else {
                                 uint32_t req_curr_part = (BLE_notify_buffer[6] << 24) | (BLE_notify_buffer[5] << 24) | (BLE_notify_buffer[4] << 24) | BLE_notify_buffer[3];
                                 if (req_curr_part != BLE_curr_part) {
                                     Serial.printf("Something went wrong, expected req part: %i but got: %i we better abort here.\r\n", req_curr_part, BLE_curr_part);
-                                    free(BLE_image_buffer);
-                                    pClient->disconnect();
-                                    ble_main_state = BLE_MAIN_STATE_IDLE;
-                                    BLE_last_pending_check = millis();
+                                    BLE_end_upload(false, false);
+                                    break;
                                 }
                                 uint32_t curr_len = 240;
                                 if (BLE_compressed_len - (BLE_curr_part * 240) < 240)
@@ -374,11 +507,7 @@ void BLETask(void* parameter) {
                 } else {
                     if (millis() - BLE_last_notify > 30000) {  // Something odd, better reset connection!
                         Serial.println("BLE err going back to IDLE");
-                        free(BLE_image_buffer);
-                        pClient->disconnect();
-                        BLE_err_counter = 0;
-                        ble_main_state = BLE_MAIN_STATE_IDLE;
-                        BLE_last_pending_check = millis();
+                        BLE_end_upload(false, false);
                     }
                 }
                 break;
@@ -387,6 +516,7 @@ void BLETask(void* parameter) {
                 if (BLE_connected && BLE_new_notify) {
                     BLE_new_notify = false;
                     BLE_last_notify = millis();
+                    BLE_last_progress = BLE_last_notify;
                     switch (BLE_upload_state) {
                         default:
                         case BLE_UPLOAD_STATE_INIT:
@@ -405,34 +535,33 @@ void BLETask(void* parameter) {
                                     if (notifyLen == (sizeof(struct blockRequest) + 2)) {
                                         Serial.println("We got a request for a BLK");
                                         memcpy(&BLEblkRequst, &BLE_notify_buffer[3], sizeof(struct blockRequest));
-                                        BLE_curr_part = 0;
                                         ATC_BLE_OEPL_PrepareBlk(BLEblkRequst.blockId);
-                                        ATC_BLE_OEPL_SendPart(BLEblkRequst.blockId, BLE_curr_part);
+                                        // parts go out without waiting for a write response when they fit in one packet
+                                        BLE_write_no_response = ctrlChar->canWriteNoResponse() && pClient->getMTU() >= sizeof(tempPacketBuffer) + 3;
+                                        BLE_window = BLE_write_no_response ? BLE_WRITER_WINDOW : 1;
+                                        ATC_BLE_OEPL_FillWindow();
                                     }
                                     break;
                                 case BLE_CMD_ACK_BLKPRT:
-                                    BLE_curr_part++;
-                                    BLE_err_counter = 0;
+                                    if (ATC_BLE_OEPL_PartAnswered(true))
+                                        BLE_err_counter = 0;
+                                    ATC_BLE_OEPL_FillWindow();  // once all parts are in, the tag asks for the next block or acks
+                                    break;
                                 case BLE_CMD_ERR_BLKPRT:
-                                    if (BLE_curr_part <= BLE_max_block_parts && BLE_err_counter++ < 15) {
-                                        ATC_BLE_OEPL_SendPart(BLEblkRequst.blockId, BLE_curr_part);
+                                    if (ATC_BLE_OEPL_PartAnswered(false)) {
+                                        std::lock_guard<std::mutex> lock(BLE_stats_mutex);
+                                        BLE_stats.resends++;
+                                    }
+                                    if (BLE_err_counter++ < 15) {
+                                        ATC_BLE_OEPL_FillWindow();
                                         break;
-                                    }  // FALLTROUGH!!! We cancel the upload if we land here since we dont have so many parts of a block!
+                                    }  // FALLTROUGH!!! We cancel the upload if the tag keeps refusing parts
                                 case BLE_CMD_ACK:
                                 case BLE_CMD_ACK_IS_SHOWN:
                                 case BLE_CMD_ACK_FW_UPDATED:
                                     Serial.println("BLE Upload done");
-                                    free(BLE_image_buffer);
-                                    pClient->disconnect();
-                                    ble_main_state = BLE_MAIN_STATE_IDLE;
-                                    BLE_last_pending_check = millis();
                                     // Done and the image is refreshing now
-                                    struct espXferComplete reportStruct;
-                                    memcpy((uint8_t*)&reportStruct.src, BLE_curr_address, 8);
-                                    processXferComplete(&reportStruct, true);
-                                    BLE_err_counter = 0;
-                                    BLE_max_block_parts = 0;
-                                    BLE_curr_part = 0;
+                                    BLE_end_upload(notifyCMD != BLE_CMD_ERR_BLKPRT, true);
                                     break;
                             }
                         } break;
@@ -440,17 +569,25 @@ void BLETask(void* parameter) {
                 } else {
                     if (millis() - BLE_last_notify > 30000) {  // Something odd, better reset connection!
                         Serial.println("BLE err going back to IDLE");
-                        free(BLE_image_buffer);
-                        pClient->disconnect();
-                        BLE_err_counter = 0;
-                        ble_main_state = BLE_MAIN_STATE_IDLE;
-                        BLE_last_pending_check = millis();
+                        BLE_end_upload(false, false);
+                    } else if (BLE_in_flight_count && millis() - BLE_last_progress > BLE_WRITER_PART_TIMEOUT) {
+                        // an answer got lost, send what the tag doesn't have yet again
+                        Serial.printf("BLE no answer for %u parts, sending again\r\n", BLE_in_flight_count);
+                        {
+                            std::lock_guard<std::mutex> lock(BLE_stats_mutex);
+                            BLE_stats.resends += BLE_in_flight_count;
+                        }
+                        BLE_parts_in_flight = 0;
+                        BLE_in_flight_count = 0;
+                        ATC_BLE_OEPL_FillWindow();
                     }
                 }
                 break;
             }
         }
-        vTaskDelay(15 / portTICK_PERIOD_MS);
+        // wait for the tag to answer, or for the next look at what is pending
+        if (!BLE_new_notify && xQueueReceive(BLE_notify_queue, BLE_notify_buffer, 15 / portTICK_PERIOD_MS) == pdTRUE)
+            BLE_new_notify = true;
     }
 }
 
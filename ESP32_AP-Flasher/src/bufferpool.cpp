@@ -0,0 +1,170 @@
+#include "bufferpool.h"
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <mutex>
+#include <unordered_map>
+
+#include "util.h"
+#include "web.h"
+
+namespace bufferpool {
+
+// lives in front of every buffer, so release() doesn't need a lookup
+struct Entry {
+    uint64_t dataVer;
+    uint32_t len;
+    uint16_t refs;
+    bool keyed;
+    Entry* prev;  // lru list of unreferenced, keyed entries
+    Entry* next;
+} __attribute__((aligned(8)));
+
+static std::mutex poolMutex;
+static std::unordered_map<uint64_t, Entry*> keyedEntries;
+static Entry* lruHead = nullptr;  // most recently released
+static Entry* lruTail = nullptr;
+static Stats stats = {0};
+
+static inline Entry* entryOf(uint8_t* data) {
+    return reinterpret_cast<Entry*>(data) - 1;
+}
+
+static inline uint8_t* dataOf(Entry* entry) {
+    return reinterpret_cast<uint8_t*>(entry + 1);
+}
+
+static void lruUnlink(Entry* entry) {
+    if (entry->prev) entry->prev->next = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    if (lruHead == entry) lruHead = entry->next;
+    if (lruTail == entry) lruTail = entry->prev;
+    entry->prev = entry->next = nullptr;
+    stats.cachedBytes -= entry->len;
+}
+
+static void lruPush(Entry* entry) {
+    entry->prev = nullptr;
+    entry->next = lruHead;
+    if (lruHead) lruHead->prev = entry;
+    lruHead = entry;
+    if (!lruTail) lruTail = entry;
+    stats.cachedBytes += entry->len;
+}
+
+static void destroy(Entry* entry) {
+    if (entry->keyed) keyedEntries.erase(entry->dataVer);
+    stats.buffers--;
+    stats.bytes -= entry->len;
+    free(entry);
+}
+
+static void evict(const uint32_t budget) {
+    while (lruTail && stats.cachedBytes > budget) {
+        Entry* entry = lruTail;
+        lruUnlink(entry);
+        destroy(entry);
+        stats.evictions++;
+    }
+}
+
+static uint8_t* allocLocked(const uint32_t len) {
+    Entry* entry = static_cast<Entry*>(malloc(sizeof(Entry) + len));
+    if (entry == nullptr) {
+        // drop everything that's only cached and try again
+        evict(0);
+        entry = static_cast<Entry*>(malloc(sizeof(Entry) + len));
+    }
+    if (entry == nullptr) return nullptr;
+    *entry = {0, len, 1, false, nullptr, nullptr};
+    stats.buffers++;
+    stats.bytes += len;
+    return dataOf(entry);
+}
+
+static uint8_t* findLocked(const uint64_t dataVer, const uint32_t len) {
+    auto it = keyedEntries.find(dataVer);
+    if (it == keyedEntries.end() || it->second->len != len) {
+        stats.misses++;
+        return nullptr;
+    }
+    Entry* entry = it->second;
+    if (entry->refs == 0) lruUnlink(entry);
+    entry->refs++;
+    stats.hits++;
+    return dataOf(entry);
+}
+
+static void publishLocked(uint8_t* data, const uint64_t dataVer) {
+    Entry* entry = entryOf(data);
+    if (entry->keyed || dataVer == 0) return;
+    // first one wins, an existing entry with the same version has the same content
+    if (keyedEntries.emplace(dataVer, entry).second) {
+        entry->dataVer = dataVer;
+        entry->keyed = true;
+    }
+}
+
+uint8_t* alloc(const uint32_t len) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return allocLocked(len);
+}
+
+uint8_t* find(const uint64_t dataVer, const uint32_t len) {
+    if (dataVer == 0) return nullptr;
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return findLocked(dataVer, len);
+}
+
+void publish(uint8_t* data, const uint64_t dataVer) {
+    if (data == nullptr) return;
+    std::lock_guard<std::mutex> lock(poolMutex);
+    publishLocked(data, dataVer);
+}
+
+uint8_t* readFile(fs::File& file, const uint64_t dataVer) {
+    const size_t fileSize = file.size();
+    uint8_t* ret = find(dataVer, fileSize);
+    if (ret) return ret;
+
+    ret = alloc(fileSize);
+    if (ret) {
+        file.seek(0);
+        file.readBytes((char*)ret, fileSize);
+        publish(ret, dataVer);
+    } else {
+        Serial.printf("malloc failed for file with size %u\r\n", (unsigned int)fileSize);
+        wsErr("malloc failed while reading file");
+        util::printHeap();
+    }
+    return ret;
+}
+
+void retain(uint8_t* data) {
+    if (data == nullptr) return;
+    std::lock_guard<std::mutex> lock(poolMutex);
+    Entry* entry = entryOf(data);
+    if (entry->refs == 0) lruUnlink(entry);
+    entry->refs++;
+}
+
+void release(uint8_t* data) {
+    if (data == nullptr) return;
+    std::lock_guard<std::mutex> lock(poolMutex);
+    Entry* entry = entryOf(data);
+    if (--entry->refs > 0) return;
+    if (entry->keyed && entry->len <= BUFFERPOOL_BUDGET) {
+        lruPush(entry);
+        evict(BUFFERPOOL_BUDGET);
+    } else {
+        destroy(entry);
+    }
+}
+
+Stats getStats() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return stats;
+}
+
+}  // namespace bufferpool
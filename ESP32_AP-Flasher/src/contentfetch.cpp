@@ -0,0 +1,283 @@
+#include "contentfetch.h"
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+
+#include <map>
+#include <mutex>
+
+#include "httpcache.h"
+
+namespace contentfetch {
+
+enum class State : uint8_t {
+    Queued,
+    Fetching,
+    Staged,
+};
+
+struct Entry {
+    Request req;
+    String key;
+    String host;
+    State state;
+    bool asked;  // the renderer has been waiting for it
+    time_t deadline;
+    Response response;
+};
+
+static std::mutex fetchMutex;
+static std::map<String, Entry*> entries;
+static std::map<String, uint8_t> hostsInFlight;
+static SemaphoreHandle_t wakeup = nullptr;
+static Stats stats = {0};
+
+static String keyOf(const Request& req) {
+    return httpcache::normalise(req.url) + "\n" + req.mac + "\n" + req.ifModifiedSince + "\n" + String(req.arg);
+}
+
+// responses to requests that aren't tied to a tag can be shared through httpcache
+static bool cacheable(const Request& req) {
+    return req.mac.isEmpty() && req.ifModifiedSince.isEmpty();
+}
+
+static String hostOf(const String& url) {
+    int start = url.indexOf("://");
+    start = (start < 0) ? 0 : start + 3;
+    int end = url.indexOf('/', start);
+    if (end < 0) end = url.length();
+    return url.substring(start, end);
+}
+
+static void* allocBody(void* ptr, size_t len) {
+#ifdef BOARD_HAS_PSRAM
+    return ps_realloc(ptr, len);
+#else
+    return realloc(ptr, len);
+#endif
+}
+
+// collects the body as HTTPClient writes it, refusing anything over CONTENTFETCH_MAX_BODY
+class BodyWriter : public Stream {
+   public:
+    explicit BodyWriter(Response& response) : response(response) {}
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override {}
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (response.len + size > CONTENTFETCH_MAX_BODY) return 0;
+        if (response.len + size + 1 > capacity) {
+            size_t newCapacity = std::max(capacity * 2, response.len + size + 1);
+            newCapacity = std::min(newCapacity, (size_t)CONTENTFETCH_MAX_BODY + 1);
+            uint8_t* body = static_cast<uint8_t*>(allocBody(response.body, newCapacity));
+            if (body == nullptr) return 0;
+            response.body = body;
+            capacity = newCapacity;
+        }
+        memcpy(response.body + response.len, buffer, size);
+        response.len += size;
+        response.body[response.len] = 0;
+        return size;
+    }
+
+   private:
+    Response& response;
+    size_t capacity = 0;
+};
+
+static void httpGet(const Request& req, Response& response, httpcache::Headers& headers, const String& etag, const String& lastModified) {
+    static const char* headerKeys[] = {"Cache-Control", "Expires", "Date", "ETag", "Last-Modified"};
+    HTTPClient http;
+    http.begin(req.url);
+    if (!req.ifModifiedSince.isEmpty()) http.addHeader("If-Modified-Since", req.ifModifiedSince);
+    if (!req.mac.isEmpty()) http.addHeader("X-ESL-MAC", req.mac);
+    if (!etag.isEmpty()) http.addHeader("If-None-Match", etag);
+    if (!lastModified.isEmpty()) http.addHeader("If-Modified-Since", lastModified);
+    http.collectHeaders(headerKeys, 5);
+    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    http.setConnectTimeout(req.timeout);
+    http.setTimeout(req.timeout);
+    response.httpCode = http.GET();
+    headers.cacheControl = http.header("Cache-Control");
+    headers.expires = http.header("Expires");
+    headers.date = http.header("Date");
+    headers.etag = http.header("ETag");
+    headers.lastModified = http.header("Last-Modified");
+    if (response.httpCode == 200) {
+        BodyWriter writer(response);
+        const int written = http.writeToStream(&writer);
+        if (written < 0) {
+            response.httpCode = written;
+        }
+    }
+    http.end();
+}
+
+static void fetch(const Request& req, const String& key, Response& response) {
+    httpcache::Headers headers;
+    if (req.fetch) {
+        req.fetch(req, response);
+    } else {
+        String etag, lastModified;
+        const bool conditional = cacheable(req) && httpcache::validators(key, etag, lastModified);
+        httpGet(req, response, headers, etag, lastModified);
+        if (conditional && response.httpCode == 304) {
+            if (httpcache::revalidated(key, headers, req.ttl, response)) return;
+            // evicted in the meantime, get all of it
+            headers = httpcache::Headers();
+            httpGet(req, response, headers, "", "");
+        }
+    }
+    if (cacheable(req)) httpcache::put(key, response, headers, req.ttl);
+}
+
+// earliest deadline first, skipping hosts that are busy enough
+static Entry* nextJobLocked() {
+    Entry* job = nullptr;
+    for (auto& kv : entries) {
+        Entry* entry = kv.second;
+        if (entry->state != State::Queued) continue;
+        if (hostsInFlight[entry->host] >= CONTENTFETCH_PER_HOST) continue;
+        if (job == nullptr || entry->deadline < job->deadline) job = entry;
+    }
+    return job;
+}
+
+static void fetchTask(void* parameter) {
+    while (true) {
+        xSemaphoreTake(wakeup, portMAX_DELAY);
+        Entry* job;
+        {
+            std::lock_guard<std::mutex> lock(fetchMutex);
+            job = nextJobLocked();
+            if (job == nullptr) continue;
+            job->state = State::Fetching;
+            hostsInFlight[job->host]++;
+            stats.queued--;
+            stats.inFlight++;
+        }
+
+        Response response;
+        const uint32_t t = millis();
+        fetch(job->req, job->key, response);
+        time(&response.fetched);
+        if (response.httpCode < 200 || response.httpCode >= 400) {
+            Serial.println("fetch " + job->req.url + " failed: " + String(response.httpCode) + " after " + String(millis() - t) + "ms");
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(fetchMutex);
+            job->response.httpCode = response.httpCode;
+            job->response.body = response.body;
+            job->response.len = response.len;
+            job->response.fetched = response.fetched;
+            response.body = nullptr;
+            job->state = State::Staged;
+            if (--hostsInFlight[job->host] == 0) hostsInFlight.erase(job->host);
+            stats.inFlight--;
+            stats.staged++;
+            stats.stagedBytes += job->response.len;
+            stats.fetches++;
+            if (job->response.httpCode < 200 || job->response.httpCode >= 400) stats.failures++;
+            if (!job->asked) stats.prefetched++;
+        }
+        // a request held back for this host can go now
+        xSemaphoreGive(wakeup);
+    }
+}
+
+static void dropLocked(std::map<String, Entry*>::iterator it) {
+    stats.staged--;
+    stats.stagedBytes -= it->second->response.len;
+    delete it->second;
+    entries.erase(it);
+}
+
+static void expireLocked(const time_t now) {
+    for (auto it = entries.begin(); it != entries.end();) {
+        auto current = it++;
+        if (current->second->state == State::Staged && now - current->second->response.fetched > CONTENTFETCH_MAX_AGE) {
+            dropLocked(current);
+            stats.expired++;
+        }
+    }
+}
+
+// returns the entry for the request, queueing it if there is none
+static Entry* requestLocked(const Request& req, const String& key, const time_t deadline) {
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        Entry* entry = it->second;
+        if (entry->state == State::Queued && deadline < entry->deadline) entry->deadline = deadline;
+        return entry;
+    }
+    Entry* entry = new Entry{req, key, hostOf(req.url), State::Queued, false, deadline};
+    entries[key] = entry;
+    stats.queued++;
+    if (wakeup) xSemaphoreGive(wakeup);
+    return entry;
+}
+
+void begin() {
+    if (wakeup) return;
+    wakeup = xSemaphoreCreateCounting(64, 0);
+    for (uint8_t i = 0; i < CONTENTFETCH_WORKERS; i++) {
+        xTaskCreate(fetchTask, "contentfetch", 12000, NULL, 2, NULL);
+    }
+}
+
+void prefetch(const Request& req, const time_t deadline) {
+    time_t now;
+    time(&now);
+    const String key = keyOf(req);
+    if (cacheable(req) && httpcache::fresh(key, deadline)) return;
+    std::lock_guard<std::mutex> lock(fetchMutex);
+    expireLocked(now);
+    requestLocked(req, key, deadline);
+}
+
+bool ready(const Request& req) {
+    time_t now;
+    time(&now);
+    const String key = keyOf(req);
+    if (cacheable(req) && httpcache::fresh(key, now)) return true;
+    std::lock_guard<std::mutex> lock(fetchMutex);
+    expireLocked(now);
+    Entry* entry = requestLocked(req, key, now);
+    if (entry->state == State::Staged) return true;
+    if (!entry->asked) {
+        entry->asked = true;
+        stats.waits++;
+    }
+    return false;
+}
+
+bool take(const Request& req, Response& response) {
+    const String key = keyOf(req);
+    std::unique_lock<std::mutex> lock(fetchMutex);
+    auto it = entries.find(key);
+    if (it == entries.end() || it->second->state != State::Staged) {
+        lock.unlock();
+        return cacheable(req) && httpcache::get(key, response);
+    }
+    Response& staged = it->second->response;
+    free(response.body);
+    response.httpCode = staged.httpCode;
+    response.body = staged.body;
+    response.len = staged.len;
+    response.fetched = staged.fetched;
+    staged.body = nullptr;
+    stats.stagedBytes -= response.len;
+    staged.len = 0;
+    dropLocked(it);
+    return true;
+}
+
+Stats getStats() {
+    std::lock_guard<std::mutex> lock(fetchMutex);
+    return stats;
+}
+
+}  // namespace contentfetch
@@ -28,6 +28,8 @@
 #include <map>
 
 #include "commstructs.h"
+#include "contentfetch.h"
+#include "fontcache.h"
 #include "makeimage.h"
 #include "newproto.h"
 #include "storage.h"
@@ -50,6 +52,278 @@ bool needRedraw(uint8_t contentMode, uint8_t wakeupReason) {
     return false;
 }
 
+// what each content mode fetches, built the same way for prefetching and for drawing.
+// ttl is how long tags showing the same source share a response, unless the server says otherwise.
+
+contentfetch::Request locationRequest(JsonObject &cfgobj) {
+    contentfetch::Request req;
+    req.url = "https://geocoding-api.open-meteo.com/v1/search?name=" + urlEncode(cfgobj["location"]) + "&count=1";
+    req.ttl = 86400;
+    return req;
+}
+
+bool needsLocation(JsonObject &cfgobj) {
+    return util::isEmptyOrNull(cfgobj["#lat"]) || util::isEmptyOrNull(cfgobj["#lon"]);
+}
+
+contentfetch::Request weatherRequest(JsonObject &cfgobj, const bool forecast) {
+    const String lat = cfgobj["#lat"];
+    const String lon = cfgobj["#lon"];
+    const String tz = cfgobj["#tz"];
+    String units = "";
+    if (cfgobj["units"] == "1") {
+        units += "&temperature_unit=fahrenheit&windspeed_unit=mph&precipitation_unit=inch";
+    }
+    contentfetch::Request req;
+    if (forecast) {
+        req.url = "https://api.open-meteo.com/v1/forecast?latitude=" + lat + "&longitude=" + lon + "&daily=weathercode,temperature_2m_max,temperature_2m_min,precipitation_sum,windspeed_10m_max,winddirection_10m_dominant&current_weather=true&windspeed_unit=ms&timeformat=unixtime&timezone=" + tz + units;
+    } else {
+        req.url = "https://api.open-meteo.com/v1/forecast?latitude=" + lat + "&longitude=" + lon + "&current_weather=true&windspeed_unit=ms&timezone=" + tz + units;
+    }
+    req.ttl = 900;
+    return req;
+}
+
+// the day is what matters, rounded so the prefetched request is the same one
+contentfetch::Request daylengthRequest(JsonObject &cfgobj, const time_t when) {
+    contentfetch::Request req;
+    req.url = "https://api.farmsense.net/v1/daylengths/?d=" + String(when - when % 3600) + "&lat=" + cfgobj["#lat"].as<String>() + "&lon=" + cfgobj["#lon"].as<String>() + "&tz=UTC";
+    req.ttl = 3600;
+    return req;
+}
+
+contentfetch::Request moonphaseRequest(const time_t when) {
+    contentfetch::Request req;
+    req.url = "https://api.farmsense.net/v1/moonphases/?d=" + String(when - when % 3600);
+    req.ttl = 3600;
+    return req;
+}
+
+contentfetch::Request imageUrlRequest(const String &URL, const time_t fetched, const String &MAC, const uint16_t timeout) {
+    contentfetch::Request req;
+    req.url = URL;
+    req.ifModifiedSince = formatHttpDate(fetched);
+    req.mac = MAC;
+    req.timeout = timeout;
+    return req;
+}
+
+contentfetch::Request jsonUrlRequest(const String &URL) {
+    contentfetch::Request req;
+    req.url = URL;
+    req.timeout = 1000;
+    return req;
+}
+
+#ifdef CONTENT_RSS
+// rssClass fetches and parses in one go, so that runs on the worker and the articles are handed over as json
+void fetchRss(const contentfetch::Request &req, contentfetch::Response &response) {
+    static std::mutex rssMutex;
+    std::lock_guard<std::mutex> lock(rssMutex);
+    const int rssTitleSize = 255;
+    const int rssDescSize = 1000;
+    rssClass reader;
+    const int n = reader.getArticles(req.url.c_str(), rssTitleSize, rssDescSize, req.arg);
+    JsonDocument doc;
+    JsonArray articles = doc.to<JsonArray>();
+    for (int i = 0; i < n; i++) {
+        JsonObject article = articles.add<JsonObject>();
+        if (reader.titleData[i] != NULL) article["title"] = (const char *)reader.titleData[i];
+        if (reader.descData[i] != NULL) article["desc"] = (const char *)reader.descData[i];
+    }
+    reader.clearItemData();
+    response.len = measureJson(doc);
+    response.body = (uint8_t *)malloc(response.len + 1);
+    if (response.body) {
+        serializeJson(doc, (char *)response.body, response.len + 1);
+        response.httpCode = 200;
+    } else {
+        response.len = 0;
+        response.httpCode = HTTPC_ERROR_TOO_LESS_RAM;
+    }
+}
+
+contentfetch::Request rssRequest(const String &URL, const uint8_t hwType) {
+    JsonDocument loc;
+    getTemplate(loc, 9, hwType);
+    contentfetch::Request req;
+    req.url = URL;
+    req.fetch = fetchRss;
+    req.arg = loc["items"];
+    req.ttl = 600;
+    return req;
+}
+#endif
+
+#ifdef CONTENT_CAL
+contentfetch::Request calendarRequest(JsonObject &cfgobj, const uint8_t hwType) {
+    JsonDocument loc;
+    getTemplate(loc, 11, hwType);
+    contentfetch::Request req;
+    req.url = cfgobj["apps_script_url"].as<String>() + "?days=" + loc["days"].as<String>();
+    req.timeout = 10000;
+    req.ttl = 300;
+    return req;
+}
+#endif
+
+#ifdef CONTENT_DAYAHEAD
+contentfetch::Request dayAheadRequest(JsonObject &cfgobj) {
+    // This is a link to a Google Apps Script script, which fetches (and caches) the tariff from https://transparency.entsoe.eu/
+    // I made it available to provide easy access to the data, but please don't use this link in any projects other than OpenEpaperLink.
+    contentfetch::Request req;
+    req.url = "https://script.google.com/macros/s/AKfycbwMmeGAaPrWzVZrESSpmPmD--O132PzW_acnBsuEottKNATTqCRn6h8zN0Yts7S56ggsg/exec?country=" + cfgobj["country"].as<String>();
+    req.timeout = 10000;
+    req.ttl = 900;
+    return req;
+}
+#endif
+
+#ifdef CONTENT_BUIENRADAR
+contentfetch::Request buienradarRequest(JsonObject &cfgobj) {
+    contentfetch::Request req;
+    req.url = "https://gadgets.buienradar.nl/data/raintext/?lat=" + cfgobj["#lat"].as<String>() + "&lon=" + cfgobj["#lon"].as<String>();
+    req.ttl = 120;
+    return req;
+}
+#endif
+
+/// @brief Parse a staged response as json
+/// @return false if it isn't staged, the fetch failed or it isn't json
+bool takeJson(const contentfetch::Request &req, JsonDocument &json, JsonDocument *filter = nullptr) {
+    contentfetch::Response response;
+    if (!contentfetch::take(req, response)) {
+        return false;
+    }
+    if (response.httpCode != 200) {
+        wsErr("http " + req.url + " code " + String(response.httpCode));
+        return false;
+    }
+    DeserializationError error;
+    if (filter) {
+        error = deserializeJson(json, (const char *)response.body, response.len, DeserializationOption::Filter(*filter));
+    } else {
+        error = deserializeJson(json, (const char *)response.body, response.len);
+    }
+    if (error) {
+        Serial.printf("[takeJson] JSON: %s\r\n", error.c_str());
+        wsErr("[takeJson] JSON: " + String(error.c_str()));
+        return false;
+    }
+    return true;
+}
+
+/// @brief Get everything a tag's content is drawn from
+/// @param when Time the content will be drawn
+/// @param requests Filled with the requests, the location first if that isn't known yet
+void contentRequests(const tagRecord *taginfo, JsonObject &cfgobj, const time_t when, std::vector<contentfetch::Request> &requests) {
+    char hexmac[17];
+    mac2hex(taginfo->mac, hexmac);
+
+    switch (taginfo->contentMode) {
+        case 1:  // Today
+            if (cfgobj["location"]) {
+                JsonDocument loc;
+                getTemplate(loc, 1, taginfo->hwType);
+                if (loc["sunrise"].is<JsonArray>()) {
+                    requests.push_back(daylengthRequest(cfgobj, when));
+                    if (loc["moonicon"].is<JsonArray>()) requests.push_back(moonphaseRequest(when));
+                }
+            }
+            break;
+        case 4:  // Weather
+        case 8:  // Forecast
+            if (needsLocation(cfgobj)) {
+                requests.push_back(locationRequest(cfgobj));
+            } else {
+                requests.push_back(weatherRequest(cfgobj, taginfo->contentMode == 8));
+            }
+            break;
+        case 7:  // ImageUrl
+            requests.push_back(imageUrlRequest(cfgobj["url"], (time_t)cfgobj["#fetched"], String(hexmac), 5000));
+            break;
+#ifdef CONTENT_RSS
+        case 9:  // RSSFeed
+            requests.push_back(rssRequest(cfgobj["url"], taginfo->hwType));
+            break;
+#endif
+#ifdef CONTENT_CAL
+        case 11:  // Calendar
+            requests.push_back(calendarRequest(cfgobj, taginfo->hwType));
+            break;
+#endif
+#ifdef CONTENT_BUIENRADAR
+        case 16:  // buienradar
+            if (needsLocation(cfgobj)) {
+                requests.push_back(locationRequest(cfgobj));
+            } else {
+                requests.push_back(buienradarRequest(cfgobj));
+            }
+            break;
+#endif
+        case 19:  // json template
+            if (util::isEmptyOrNull(cfgobj["filename"])) {
+                requests.push_back(imageUrlRequest(cfgobj["url"], (time_t)cfgobj["#fetched"], String(hexmac), 20000));
+            } else if (!util::isEmptyOrNull(cfgobj["url"])) {
+                String configUrl = cfgobj["url"].as<String>();
+                configUrl.replace("{mac}", hexmac);
+                requests.push_back(jsonUrlRequest(configUrl));
+            }
+            break;
+#ifdef CONTENT_DAYAHEAD
+        case 27:  // Day Ahead
+            requests.push_back(dayAheadRequest(cfgobj));
+            break;
+#endif
+    }
+}
+
+/// @brief Check if everything the content of a tag is drawn from has been fetched, asking for what hasn't
+/// @param cfgChanged Set when the location was looked up and stored in cfgobj
+/// @return true if the tag can be drawn
+bool contentReady(const tagRecord *taginfo, JsonObject &cfgobj, const time_t now, bool &cfgChanged) {
+    std::vector<contentfetch::Request> requests;
+    contentRequests(taginfo, cfgobj, now, requests);
+    bool ready = true;
+    for (const contentfetch::Request &req : requests) {
+        ready = contentfetch::ready(req) && ready;
+    }
+    if (!ready) return false;
+
+    if ((taginfo->contentMode == 4 || taginfo->contentMode == 8 || taginfo->contentMode == 16) && needsLocation(cfgobj)) {
+        // without a location the content can't be fetched, drawing it fails like before
+        if (!getLocation(cfgobj)) return true;
+        cfgChanged = true;
+        requests.clear();
+        contentRequests(taginfo, cfgobj, now, requests);
+        for (const contentfetch::Request &req : requests) {
+            ready = contentfetch::ready(req) && ready;
+        }
+    }
+    return ready;
+}
+
+// nextupdate each tag's content was prefetched for
+std::map<uint64_t, time_t> prefetched;
+
+/// @brief Fetch the content of a tag ahead of its nextupdate, once per update
+void prefetchContent(const tagRecord *taginfo) {
+    uint64_t key;
+    memcpy(&key, taginfo->mac, sizeof(key));
+    const auto entry = prefetched.find(key);
+    if (entry != prefetched.end() && entry->second == taginfo->nextupdate) return;
+    prefetched[key] = taginfo->nextupdate;
+
+    JsonDocument doc;
+    deserializeJson(doc, taginfo->modeConfigJson);
+    JsonObject cfgobj = doc.as<JsonObject>();
+    std::vector<contentfetch::Request> requests;
+    contentRequests(taginfo, cfgobj, taginfo->nextupdate, requests);
+    for (const contentfetch::Request &req : requests) {
+        contentfetch::prefetch(req, taginfo->nextupdate);
+    }
+}
+
 void contentRunner() {
     if (config.runStatus == RUNSTATUS_STOP) return;
 
@@ -67,7 +341,11 @@ void contentRunner() {
             config.runStatus == RUNSTATUS_RUN && (taginfo->expectedNextCheckin < now + 300 || isAp) &&
              Storage.freeSpace() > 31000 && !util::isSleeping(config.sleepTime1, config.sleepTime2)) {
             drawNew(taginfo->mac, taginfo);
-            taginfo->wakeupReason = 0;
+            taginfo->setWakeupReason(0);
+        }
+        if (taginfo->RSSI && taginfo->nextupdate > now && taginfo->nextupdate <= now + CONTENTFETCH_LEAD &&
+            config.runStatus == RUNSTATUS_RUN && (taginfo->expectedNextCheckin < taginfo->nextupdate + 300 || isAp)) {
+            prefetchContent(taginfo);
         }
 
         if (taginfo->expectedNextCheckin > now - 10 && taginfo->expectedNextCheckin < now + 30 && taginfo->pendingIdle == 0 && taginfo->pendingCount == 0 && !isAp) {
@@ -87,8 +365,8 @@ void contentRunner() {
                 minutesUntilNextUpdate = (nextWakeTime - now) / 60 - 2;
             }
             if (minutesUntilNextUpdate > 1 && (wsClientCount() == 0 || config.stopsleep == 0)) {
-                taginfo->pendingIdle = minutesUntilNextUpdate * 60;
-                taginfo->expectedNextCheckin = now + taginfo->pendingIdle;
+                taginfo->setPendingIdle(minutesUntilNextUpdate * 60);
+                taginfo->setExpectedNextCheckin(now + taginfo->pendingIdle);
                 if (taginfo->isExternal == false) {
                     prepareIdleReq(taginfo->mac, minutesUntilNextUpdate);
                 }
@@ -117,7 +395,7 @@ void checkVars() {
                     for (const auto &entry : varDB) {
                         if (entry.second.changed && strstr(contentPtr, entry.first.c_str()) != nullptr) {
                             Serial.println("updating " + jsonfile + " because of var " + entry.first.c_str());
-                            tag->nextupdate = 0;
+                            tag->setNextupdate(0);
                         }
                     }
                 }
@@ -126,7 +404,7 @@ void checkVars() {
         }
         if (tag->contentMode == 21) {
             if (varDB["ap_tagcount"].changed || varDB["ap_ip"].changed || varDB["ap_ch"].changed) {
-                tag->nextupdate = 0;
+                tag->setNextupdate(0);
             }
         }
     }
@@ -135,6 +413,109 @@ void checkVars() {
     }
 }
 
+struct renderCacheEntry {
+    uint64_t fingerprint;
+    uint64_t dataVer;
+};
+
+// fingerprint of the inputs of the last image rendered per tag (by mac),
+// with the dataVer of that image once it was handed to prepareDataAvail
+std::map<uint64_t, renderCacheEntry> renderCache;
+uint32_t renderCacheHits = 0;
+uint32_t renderCacheMisses = 0;
+
+void updateTimeVar() {
+    time_t now;
+    time(&now);
+    struct tm timedef;
+    localtime_r(&now, &timedef);
+    char timeBuffer[80];
+    strftime(timeBuffer, sizeof(timeBuffer), "%H:%M:%S", &timedef);
+    setVarDB("ap_time", timeBuffer, false);
+}
+
+/// @brief Print target that hashes (FNV-1a) everything written to it into imageParams.fingerprint
+/// @note For every {variable} passing through, the current value from varDB is hashed as well
+class Fingerprint : public Print {
+   public:
+    explicit Fingerprint(imgParam &imageParams) : _hash(imageParams.fingerprint) {}
+
+    size_t write(uint8_t c) override {
+        add(c);
+        if (c == '{') {
+            _varLen = 0;
+        } else if (_varLen >= 0) {
+            if (c == '}') {
+                _var[_varLen] = '\0';
+                addVar(_var);
+                _varLen = -1;
+            } else if (_varLen < (int8_t)sizeof(_var) - 1) {
+                _var[_varLen++] = c;
+            } else {
+                _varLen = -1;
+            }
+        }
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override {
+        for (size_t i = 0; i < size; i++) write(buffer[i]);
+        return size;
+    }
+
+   private:
+    uint64_t &_hash;
+    char _var[32];
+    int8_t _varLen = -1;
+
+    void add(uint8_t c) {
+        _hash ^= c;
+        _hash *= 0x100000001b3;
+    }
+
+    void addVar(const char *name) {
+        if (strcmp(name, "ap_time") == 0) updateTimeVar();
+        const auto var = varDB.find(name);
+        if (var == varDB.end()) return;
+        for (const char *p = var->second.value.c_str(); *p; p++) add(*p);
+    }
+};
+
+/// @brief Check if the tag already has the image the fingerprinted inputs render to
+/// @note Call when everything the content depends on is in imageParams.fingerprint
+/// @param taginfo Tag information
+/// @param imageParams Image parameters, marked unchanged on a hit
+/// @return true if rendering can be skipped
+bool renderUnchanged(const tagRecord *taginfo, imgParam &imageParams) {
+    uint64_t key;
+    memcpy(&key, taginfo->mac, sizeof(key));
+    const auto entry = renderCache.find(key);
+    if (entry != renderCache.end() && entry->second.fingerprint == imageParams.fingerprint &&
+        entry->second.dataVer != 0 && memcmp(&entry->second.dataVer, taginfo->md5, sizeof(uint64_t)) == 0) {
+        renderCacheHits++;
+        imageParams.unchanged = true;
+        wsLog("content unchanged, not rendering");
+        return true;
+    }
+    renderCacheMisses++;
+    renderCache[key] = {imageParams.fingerprint, 0};
+    return false;
+}
+
+/// @brief Remember which image the fingerprint checked by renderUnchanged rendered to
+void rememberRender(const tagRecord *taginfo, const imgParam &imageParams, const uint64_t dataVer) {
+    uint64_t key;
+    memcpy(&key, taginfo->mac, sizeof(key));
+    const auto entry = renderCache.find(key);
+    if (entry != renderCache.end() && entry->second.fingerprint == imageParams.fingerprint) {
+        entry->second.dataVer = dataVer;
+    }
+}
+
+RenderCacheStats getRenderCacheStats() {
+    return {(uint32_t)renderCache.size(), renderCacheHits, renderCacheMisses};
+}
+
 /// @brief Draw a counter
 /// @param mac Destination mac
 /// @param taginfo Tag information
@@ -150,7 +531,7 @@ void drawCounter(const uint8_t mac[8], tagRecord *&taginfo, JsonObject &cfgobj,
         counter = 0;
     }
     drawNumber(filename, counter, (int32_t)cfgobj["thresholdred"], taginfo, imageParams);
-    taginfo->nextupdate = nextupdate;
+    taginfo->setNextupdate(nextupdate);
     updateTagImage(filename, mac, (buttonPressed ? 0 : nextCheckin), taginfo, imageParams);
     cfgobj["counter"] = counter + 1;
 }
@@ -161,7 +542,7 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
 
     const HwType hwdata = getHwType(taginfo->hwType);
     if (hwdata.bpp == 0) {
-        taginfo->nextupdate = now + 300;
+        taginfo->setNextupdate(now + 300);
         Serial.println("No definition found for tag type " + String(taginfo->hwType));
         return;
     }
@@ -173,18 +554,18 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
     const bool isAp = memcmp(mac, wifimac, 8) == 0;
     if ((taginfo->wakeupReason == WAKEUP_REASON_FIRSTBOOT || taginfo->wakeupReason == WAKEUP_REASON_WDT_RESET) && taginfo->contentMode == 0) {
         if (isAp) {
-            taginfo->contentMode = 21;
-            taginfo->nextupdate = 0;
+            taginfo->setContentMode(21);
+            taginfo->setNextupdate(0);
         } else if (contentFS->exists("/tag_defaults.json")) {
             JsonDocument doc;
             fs::File tagDefaults = contentFS->open("/tag_defaults.json", "r");
             DeserializationError err = deserializeJson(doc, tagDefaults);
             if (!err) {
                 if (doc["contentMode"].is<uint8_t>()) {
-                    taginfo->contentMode = doc["contentMode"];
+                    taginfo->setContentMode(doc["contentMode"]);
                 }
                 if (doc["modecfgjson"].is<String>()) {
-                    taginfo->modeConfigJson = doc["modecfgjson"].as<String>();
+                    taginfo->setModeConfigJson(doc["modecfgjson"].as<String>());
                 }
             }
             tagDefaults.close();
@@ -205,8 +586,15 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
     JsonObject cfgobj = doc.as<JsonObject>();
     char buffer[64];
 
+    // wait for the fetch workers instead of blocking here, the next pass tries again
+    bool cfgChanged = false;
+    if (!contentReady(taginfo, cfgobj, now, cfgChanged)) {
+        if (cfgChanged) taginfo->setModeConfigJson(doc.as<String>());
+        return;
+    }
+
     wsLog("Updating " + String(hexmac));
-    taginfo->nextupdate = now + 60;
+    taginfo->setNextupdate(now + 60);
 
     imgParam imageParams;
     imageParams.hwdata = hwdata;
@@ -248,6 +636,14 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         taginfo->lastfullupdate = now;
     }
 
+    {
+        Fingerprint fp(imageParams);
+        fp.printf("%d,%d,%d,%d,%d,%d,%d,%d,", taginfo->contentMode, taginfo->hwType, imageParams.rotate, imageParams.invert, imageParams.lut, imageParams.zlib, imageParams.g5, config.language);
+        fp.printf("%u,", getTagTypeCacheStats().flushes);  // tag type templates changed
+        if (config.showtimestamp) fp.print(now);  // the timestamp makes every image different
+        fp.print(taginfo->modeConfigJson);
+    }
+
     int32_t interval = cfgobj["interval"].as<int>() * 60;
     if (interval == -1440 * 60) {
         interval = util::getMidnightTime() - now;
@@ -272,7 +668,7 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
                 }
 
                 if (!contentFS->exists(configFilename)) {
-                    taginfo->nextupdate = 3216153600;
+                    taginfo->setNextupdate(3216153600);
                     wsErr("Not found: " + configFilename);
                     break;
                 }
@@ -331,13 +727,13 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
                 // fixme: doesn't work yet
                 // prepareDataAvail(mac);
             }
-            taginfo->nextupdate = 3216153600;
+            taginfo->setNextupdate(3216153600);
         } break;
 
         case 1:  // Today
 
             drawDate(filename, cfgobj, taginfo, imageParams);
-            taginfo->nextupdate = util::getMidnightTime();
+            taginfo->setNextupdate(util::getMidnightTime());
             updateTagImage(filename, mac, (taginfo->nextupdate - now) / 60 - 10, taginfo, imageParams);
             break;
 
@@ -357,14 +753,14 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
             // https://github.com/erikflowers/weather-icons
 
             drawWeather(filename, cfgobj, taginfo, imageParams);
-            taginfo->nextupdate = now + interval;
+            taginfo->setNextupdate(now + interval);
             updateTagImage(filename, mac, interval / 60, taginfo, imageParams);
             break;
 
         case 8:  // Forecast
 
             drawForecast(filename, cfgobj, taginfo, imageParams);
-            taginfo->nextupdate = now + interval;
+            taginfo->setNextupdate(now + interval);
             updateTagImage(filename, mac, interval / 60, taginfo, imageParams);
             break;
 
@@ -385,9 +781,9 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
                         }
                     }
                 }
-                taginfo->nextupdate = 3216153600;
+                taginfo->setNextupdate(3216153600);
             } else {
-                taginfo->nextupdate = now + 300;
+                taginfo->setNextupdate(now + 300);
             }
             break;
 
@@ -396,13 +792,13 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         {
             const int httpcode = getImgURL(filename, cfgobj["url"], (time_t)cfgobj["#fetched"], imageParams, String(hexmac));
             if (httpcode == 200) {
-                taginfo->nextupdate = now + interval;
+                taginfo->setNextupdate(now + interval);
                 updateTagImage(filename, mac, interval / 60, taginfo, imageParams);
                 cfgobj["#fetched"] = now;
             } else if (httpcode == 304) {
-                taginfo->nextupdate = now + interval;
+                taginfo->setNextupdate(now + interval);
             } else {
-                taginfo->nextupdate = now + 300;
+                taginfo->setNextupdate(now + 300);
             }
             break;
         }
@@ -411,10 +807,10 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         case 9:  // RSSFeed
 
             if (getRssFeed(filename, cfgobj["url"], cfgobj["title"], taginfo, imageParams)) {
-                taginfo->nextupdate = now + interval;
+                taginfo->setNextupdate(now + interval);
                 updateTagImage(filename, mac, interval / 60, taginfo, imageParams);
             } else {
-                taginfo->nextupdate = now + 300;
+                taginfo->setNextupdate(now + 300);
             }
             break;
 #endif
@@ -423,7 +819,7 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         case 10:  // QRcode:
 
             drawQR(filename, cfgobj["qr-content"], cfgobj["title"], taginfo, imageParams);
-            taginfo->nextupdate = now + 12 * 3600;
+            taginfo->setNextupdate(now + 12 * 3600);
             updateTagImage(filename, mac, 0, taginfo, imageParams);
             break;
 #endif
@@ -432,30 +828,30 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         case 11:  // Calendar:
 
             if (getCalFeed(filename, cfgobj, taginfo, imageParams)) {
-                taginfo->nextupdate = now + interval;
+                taginfo->setNextupdate(now + interval);
                 updateTagImage(filename, mac, interval / 60, taginfo, imageParams);
             } else {
-                taginfo->nextupdate = now + 300;
+                taginfo->setNextupdate(now + 300);
             }
             break;
 #endif
 
         case 12:  // RemoteAP
 
-            taginfo->nextupdate = 3216153600;
+            taginfo->setNextupdate(3216153600);
             break;
 
         case 13:  // SegStatic
 
             sprintf(buffer, "%-4.4s%-2.2s%-4.4s", cfgobj["line1"].as<const char *>(), cfgobj["line2"].as<const char *>(), cfgobj["line3"].as<const char *>());
-            taginfo->nextupdate = 3216153600;
+            taginfo->setNextupdate(3216153600);
             sendAPSegmentedData(mac, (String)buffer, 0x0000, false, (taginfo->isExternal == false));
             break;
 
 #ifdef CONTENT_NFCLUT
         case 14:  // NFC URL
 
-            taginfo->nextupdate = 3216153600;
+            taginfo->setNextupdate(3216153600);
             prepareNFCReq(mac, cfgobj["url"].as<const char *>());
             break;
 #endif
@@ -465,7 +861,7 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
 
         {
             const uint8_t refresh = drawBuienradar(filename, cfgobj, taginfo, imageParams);
-            taginfo->nextupdate = now + refresh * 60;
+            taginfo->setNextupdate(now + refresh * 60);
             updateTagImage(filename, mac, refresh, taginfo, imageParams);
             break;
         }
@@ -474,7 +870,7 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         case 17:  // tag command
         {
             sendTagCommand(mac, cfgobj["cmd"].as<int>(), (taginfo->isExternal == false));
-            taginfo->nextupdate = 3216153600;
+            taginfo->setNextupdate(3216153600);
             break;
         }
 
@@ -482,7 +878,7 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         case 18:  // tag config
         {
             prepareConfigFile(mac, cfgobj);
-            taginfo->nextupdate = 3216153600;
+            taginfo->setNextupdate(3216153600);
             break;
         }
 #endif
@@ -496,22 +892,17 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
                     JsonDocument json;
                     Serial.println("Get json url + file");
 
-                    int index = configUrl.indexOf("{mac}");
-                    if (index != -1) {
-                        char macStr[17];
-                        mac2hex(mac, macStr);
-                        configUrl.replace("{mac}", macStr);
-                    }
+                    configUrl.replace("{mac}", hexmac);
 
-                    if (util::httpGetJson(configUrl, json, 1000)) {
-                        taginfo->nextupdate = now + interval;
+                    if (takeJson(jsonUrlRequest(configUrl), json)) {
+                        taginfo->setNextupdate(now + interval);
                         if (getJsonTemplateFileExtractVariables(filename, configFilename, json, taginfo, imageParams)) {
                             updateTagImage(filename, mac, interval / 60, taginfo, imageParams);
                         } else {
                             wsErr("error opening file " + configFilename);
                         }
                     } else {
-                        taginfo->nextupdate = now + 600;
+                        taginfo->setNextupdate(now + 600);
                     }
 
                 } else {
@@ -521,18 +912,18 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
                     } else {
                         wsErr("error opening file " + configFilename);
                     }
-                    taginfo->nextupdate = 3216153600;
+                    taginfo->setNextupdate(3216153600);
                 }
             } else {
                 const int httpcode = getJsonTemplateUrl(filename, cfgobj["url"], (time_t)cfgobj["#fetched"], String(hexmac), taginfo, imageParams);
                 if (httpcode == 200) {
-                    taginfo->nextupdate = now + interval;
+                    taginfo->setNextupdate(now + interval);
                     updateTagImage(filename, mac, interval / 60, taginfo, imageParams);
                     cfgobj["#fetched"] = now;
                 } else if (httpcode == 304) {
-                    taginfo->nextupdate = now + interval;
+                    taginfo->setNextupdate(now + interval);
                 } else {
-                    taginfo->nextupdate = now + 600;
+                    taginfo->setNextupdate(now + 600);
                 }
             }
             break;
@@ -544,12 +935,12 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         case 21:  // ap info
             drawAPinfo(filename, cfgobj, taginfo, imageParams);
             updateTagImage(filename, mac, 0, taginfo, imageParams);
-            taginfo->nextupdate = 3216153600;
+            taginfo->setNextupdate(3216153600);
             break;
 
 #ifdef CONTENT_TIMESTAMP
         case 26:  // timestamp
-            taginfo->nextupdate = 3216153600;
+            taginfo->setNextupdate(3216153600);
             drawTimestamp(filename, cfgobj, taginfo, imageParams);
             updateTagImage(filename, mac, 0, taginfo, imageParams);
             break;
@@ -559,10 +950,10 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         case 27:  // Day Ahead:
 
             if (getDayAheadFeed(filename, cfgobj, taginfo, imageParams)) {
-                taginfo->nextupdate = now + (3600 - now % 3600);
+                taginfo->setNextupdate(now + (3600 - now % 3600));
                 updateTagImage(filename, mac, 0, taginfo, imageParams);
             } else {
-                taginfo->nextupdate = now + 300;
+                taginfo->setNextupdate(now + 300);
             }
             break;
 #endif
@@ -571,22 +962,23 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
             uint64_t newmac;
             sscanf(cfgobj["mac"].as<String>().c_str(), "%llx", &newmac);
             sendTagMac(mac, newmac, (taginfo->isExternal == false));
-            taginfo->nextupdate = 3216153600;
+            taginfo->setNextupdate(3216153600);
             break;
         }
 #ifdef CONTENT_TIME_RAWDATA
         case 29:  // Time and raw data like strings etc. in the future
         
-            taginfo->nextupdate = now + 1800;
+            taginfo->setNextupdate(now + 1800);
             prepareTIME_RAW(mac, now);
             break;
 #endif
     }
 
-    taginfo->modeConfigJson = doc.as<String>();
+    taginfo->setModeConfigJson(doc.as<String>());
 }
 
 bool updateTagImage(String &filename, const uint8_t *dst, uint16_t nextCheckin, tagRecord *&taginfo, imgParam &imageParams) {
+    if (imageParams.unchanged) return true;
     if (taginfo->hwType == SOLUM_SEG_UK) {
         sendAPSegmentedData(dst, (String)imageParams.segments, imageParams.symbols, (imageParams.invert == 1), (taginfo->isExternal == false));
     } else {
@@ -611,7 +1003,9 @@ bool updateTagImage(String &filename, const uint8_t *dst, uint16_t nextCheckin,
             Serial.println("datatype: DATATYPE_IMG_RAW_2BPP");
         }
         if (nextCheckin > 0x7fff) nextCheckin = 0;
-        prepareDataAvail(filename, imageParams.dataType, imageParams.lut, dst, nextCheckin);
+        uint64_t dataVer = 0;
+        prepareDataAvail(filename, imageParams.dataType, imageParams.lut, dst, nextCheckin, false, &dataVer);
+        rememberRender(taginfo, imageParams, dataVer);
     }
     return true;
 }
@@ -632,13 +1026,7 @@ void replaceVariables(String &format) {
     size_t startIndex = 0;
     size_t openBraceIndex, closeBraceIndex;
 
-    time_t now;
-    time(&now);
-    struct tm timedef;
-    localtime_r(&now, &timedef);
-    char timeBuffer[80];
-    strftime(timeBuffer, sizeof(timeBuffer), "%H:%M:%S", &timedef);
-    setVarDB("ap_time", timeBuffer, false);
+    updateTimeVar();
 
     while ((openBraceIndex = format.indexOf('{', startIndex)) != -1 &&
            (closeBraceIndex = format.indexOf('}', openBraceIndex + 1)) != -1) {
@@ -683,41 +1071,45 @@ void drawString(TFT_eSprite &spr, String content, int16_t posx, int16_t posy, St
     switch (processFontPath(font)) {
         case 2: {
             // truetype
-            time_t t = millis();
-            truetypeClass truetype = truetypeClass();
-            void *framebuffer = spr.getPointer();
-            truetype.setFramebuffer(spr.width(), spr.height(), spr.getColorDepth(), static_cast<uint8_t *>(framebuffer));
-            File fontFile = contentFS->open(font, "r");
-            if (!truetype.setTtfFile(fontFile)) {
+            truetypeClass *truetype = fontcache::getTtf(font);
+            if (truetype == nullptr) {
                 Serial.println("read ttf failed");
                 return;
             }
+            void *framebuffer = spr.getPointer();
+            truetype->setFramebuffer(spr.width(), spr.height(), spr.getColorDepth(), static_cast<uint8_t *>(framebuffer));
+            int16_t bandx, bandy;
+            uint16_t bandw, bandh;
+            if (getSpriteBand(spr, bandx, bandy, bandw, bandh)) {
+                truetype->setFramebufferWindow(bandx, bandy, bandw, bandh);
+            }
 
-            truetype.setCharacterSize(size);
-            truetype.setCharacterSpacing(0);
+            truetype->setCharacterSize(size);
+            truetype->setCharacterSpacing(0);
             if (align == TC_DATUM) {
-                posx -= truetype.getStringWidth(content) / 2;
+                posx -= truetype->getStringWidth(content) / 2;
             }
             if (align == TR_DATUM) {
-                posx -= truetype.getStringWidth(content);
+                posx -= truetype->getStringWidth(content);
             }
-            truetype.setTextBoundary(posx, spr.width(), spr.height());
+            truetype->setTextBoundary(posx, spr.width(), spr.height());
             if (spr.getColorDepth() == 8) {
-                truetype.setTextColor(spr.color16to8(color), spr.color16to8(color));
+                truetype->setTextColor(spr.color16to8(color), spr.color16to8(color));
             } else {
-                truetype.setTextColor(color, color);
+                truetype->setTextColor(color, color);
             }
-            truetype.textDraw(posx, posy, content);
-            truetype.end();
+            truetype->textDraw(posx, posy, content);
         } break;
         case 3: {
             // vlw bitmap font
             spr.setTextDatum(align);
-            if (font != "") spr.loadFont(font.substring(1), *contentFS);
+            const bool cached = (font != "") && fontcache::attachVlw(spr, font);
+            if (font != "" && !cached) spr.loadFont(font.substring(1), *contentFS);
             spr.setTextColor(color, bgcolor);
             spr.setTextWrap(false, false);
             spr.drawString(content, posx, posy);
-            if (font != "") spr.unloadFont();
+            if (cached) fontcache::detachVlw(spr);
+            if (font != "" && !cached) spr.unloadFont();
         }
     }
 }
@@ -733,7 +1125,8 @@ void drawTextBox(TFT_eSprite &spr, String &content, int16_t &posx, int16_t &posy
             // vlw bitmap font
             // spr.drawRect(posx, posy, boxwidth, boxheight, TFT_BLACK);
             spr.setTextDatum(align);
-            if (font != "") spr.loadFont(font.substring(1), *contentFS);
+            const bool cached = (font != "") && fontcache::attachVlw(spr, font);
+            if (font != "" && !cached) spr.loadFont(font.substring(1), *contentFS);
             spr.setTextWrap(false, false);
             spr.setTextColor(color, bgcolor);
 
@@ -761,7 +1154,8 @@ void drawTextBox(TFT_eSprite &spr, String &content, int16_t &posx, int16_t &posy
                     startPos++;
                 }
             }
-            if (font != "") spr.unloadFont();
+            if (cached) fontcache::detachVlw(spr);
+            if (font != "" && !cached) spr.unloadFont();
         }
     }
 }
@@ -790,6 +1184,27 @@ void initSprite(TFT_eSprite &spr, int w, int h, imgParam &imageParams) {
     spr.fillSprite(TFT_WHITE);
 }
 
+/// @brief Draw content and write it as image, on a sprite of the whole image if there is memory for one, otherwise band by band
+/// @note draw can be called several times, so it should do nothing but drawing
+/// @param filename Output file
+/// @param imageParams Image parameters
+/// @param draw Draws the content on the sprite it gets
+void renderImage(String &filename, imgParam &imageParams, const std::function<void(TFT_eSprite &)> &draw) {
+    TFT_eSprite spr = TFT_eSprite(&tft);
+    spr.setColorDepth(16);
+    spr.createSprite(imageParams.width, imageParams.height);
+    if (spr.getPointer() == nullptr) {
+        if (drawBanded(filename, imageParams, draw)) return;
+        initSprite(spr, imageParams.width, imageParams.height, imageParams);
+    } else {
+        spr.setRotation(3);
+        spr.fillSprite(TFT_WHITE);
+    }
+    draw(spr);
+    spr2buffer(spr, filename, imageParams);
+    spr.deleteSprite();
+}
+
 String utf8FromCodepoint(uint16_t cp) {
     char buf[4] = {0}; 
     if (cp < 0x80) {
@@ -842,53 +1257,59 @@ void drawDate(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, imgPara
     JsonDocument loc;
     getTemplate(loc, 1, taginfo->hwType);
 
-    TFT_eSprite spr = TFT_eSprite(&tft);
-    initSprite(spr, imageParams.width, imageParams.height, imageParams);
-
     auto date = loc["date"];
     auto weekday = loc["weekday"];
     const auto &month = loc["month"];
     const auto &day = loc["day"];
 
-    if (cfgobj["location"]) {
-        const String lat = cfgobj["#lat"];
-        const String lon = cfgobj["#lon"];
+    String sunrise, sunset, moonIcon;
+    if (cfgobj["location"] && loc["sunrise"].is<JsonArray>()) {
         JsonDocument doc;
 
-        const bool success = util::httpGetJson("https://api.farmsense.net/v1/daylengths/?d=" + String(now) + "&lat=" + lat + "&lon=" + lon + "&tz=UTC", doc, 5000);
-        if (success && loc["sunrise"].is<JsonArray>()) {
-            String sunrise = formatUtcToLocal(doc[0]["Sunrise"]);
-            String sunset = formatUtcToLocal(doc[0]["Sunset"]);
-            const auto &sunriseicon = loc["sunrise"];
-            const auto &sunseticon = loc["sunset"];
-            drawString(spr, String("\uF046 "), sunriseicon[0], sunriseicon[1].as<int>(), "/fonts/weathericons.ttf", TR_DATUM, TFT_BLACK, sunriseicon[3]);
-            drawString(spr, String("\uF047 "), sunseticon[0], sunseticon[1].as<int>(), "/fonts/weathericons.ttf", TR_DATUM, TFT_BLACK, sunseticon[3]);
-            drawString(spr, sunrise, sunriseicon[0], sunriseicon[1], sunriseicon[2], TL_DATUM, TFT_BLACK, sunriseicon[3]);
-            drawString(spr, sunset, sunseticon[0], sunseticon[1], sunseticon[2], TL_DATUM, TFT_BLACK, sunseticon[3]);
+        const bool success = takeJson(daylengthRequest(cfgobj, now), doc);
+        if (success) {
+            sunrise = formatUtcToLocal(doc[0]["Sunrise"]);
+            sunset = formatUtcToLocal(doc[0]["Sunset"]);
 
-            const bool success = util::httpGetJson("https://api.farmsense.net/v1/moonphases/?d=" + String(now), doc, 5000);
-            if (success && loc["moonicon"].is<JsonArray>()) {
+            const bool success = loc["moonicon"].is<JsonArray>() && takeJson(moonphaseRequest(now), doc);
+            if (success) {
                 uint8_t moonage = doc[0]["Index"].as<int>();
-                const auto &moonicon = loc["moonicon"];
                 uint16_t moonIconId = 0xf095 + moonage;
-                String moonIcon = utf8FromCodepoint(moonIconId);
-                drawString(spr, moonIcon, moonicon[0], moonicon[1], "/fonts/weathericons.ttf", TC_DATUM, TFT_BLACK, moonicon[2]);
+                moonIcon = utf8FromCodepoint(moonIconId);
             }
 
             date = loc["altdate"];
             weekday = loc["altweekday"];
         }
     }
-    if (date.is<JsonArray>()) {
-        drawString(spr, languageDays[timeinfo.tm_wday], weekday[0], weekday[1], weekday[2], TC_DATUM, imageParams.highlightColor, weekday[3]);
-        drawString(spr, String(timeinfo.tm_mday) + " " + languageMonth[timeinfo.tm_mon], date[0], date[1], date[2], TC_DATUM, TFT_BLACK, date[3]);
-    } else {
-        drawString(spr, languageDays[timeinfo.tm_wday], weekday[0], weekday[1], weekday[2], TC_DATUM, TFT_BLACK, weekday[3]);
-        drawString(spr, String(languageMonth[timeinfo.tm_mon]), month[0], month[1], month[2], TC_DATUM, TFT_BLACK, month[3]);
-        drawString(spr, String(timeinfo.tm_mday), day[0], day[1], day[2], TC_DATUM, imageParams.highlightColor, day[3]);
-    }
-    spr2buffer(spr, filename, imageParams);
-    spr.deleteSprite();
+
+    Fingerprint fp(imageParams);
+    fp.printf("%d,%d,%s,%s,%s,", timeinfo.tm_year, timeinfo.tm_yday, sunrise.c_str(), sunset.c_str(), moonIcon.c_str());
+    serializeJson(loc, fp);
+    if (renderUnchanged(taginfo, imageParams)) return;
+
+    renderImage(filename, imageParams, [&](TFT_eSprite &spr) {
+        if (sunrise.length() > 0) {
+            const auto &sunriseicon = loc["sunrise"];
+            const auto &sunseticon = loc["sunset"];
+            drawString(spr, String("\uF046 "), sunriseicon[0], sunriseicon[1].as<int>(), "/fonts/weathericons.ttf", TR_DATUM, TFT_BLACK, sunriseicon[3]);
+            drawString(spr, String("\uF047 "), sunseticon[0], sunseticon[1].as<int>(), "/fonts/weathericons.ttf", TR_DATUM, TFT_BLACK, sunseticon[3]);
+            drawString(spr, sunrise, sunriseicon[0], sunriseicon[1], sunriseicon[2], TL_DATUM, TFT_BLACK, sunriseicon[3]);
+            drawString(spr, sunset, sunseticon[0], sunseticon[1], sunseticon[2], TL_DATUM, TFT_BLACK, sunseticon[3]);
+        }
+        if (moonIcon.length() > 0) {
+            const auto &moonicon = loc["moonicon"];
+            drawString(spr, moonIcon, moonicon[0], moonicon[1], "/fonts/weathericons.ttf", TC_DATUM, TFT_BLACK, moonicon[2]);
+        }
+        if (date.is<JsonArray>()) {
+            drawString(spr, languageDays[timeinfo.tm_wday], weekday[0], weekday[1], weekday[2], TC_DATUM, imageParams.highlightColor, weekday[3]);
+            drawString(spr, String(timeinfo.tm_mday) + " " + languageMonth[timeinfo.tm_mon], date[0], date[1], date[2], TC_DATUM, TFT_BLACK, date[3]);
+        } else {
+            drawString(spr, languageDays[timeinfo.tm_wday], weekday[0], weekday[1], weekday[2], TC_DATUM, TFT_BLACK, weekday[3]);
+            drawString(spr, String(languageMonth[timeinfo.tm_mon]), month[0], month[1], month[2], TC_DATUM, TFT_BLACK, month[3]);
+            drawString(spr, String(timeinfo.tm_mday), day[0], day[1], day[2], TC_DATUM, imageParams.highlightColor, day[3]);
+        }
+    });
 }
 
 void drawNumber(String &filename, int32_t count, int32_t thresholdred, tagRecord *&taginfo, imgParam &imageParams) {
@@ -913,12 +1334,9 @@ void drawNumber(String &filename, int32_t count, int32_t thresholdred, tagRecord
         return;
     }
 
-    TFT_eSprite spr = TFT_eSprite(&tft);
-
     JsonDocument loc;
     getTemplate(loc, 2, taginfo->hwType);
 
-    initSprite(spr, imageParams.width, imageParams.height, imageParams);
     uint16_t color = TFT_BLACK;
     if (countTemp > thresholdred) {
         color = imageParams.highlightColor;
@@ -930,10 +1348,15 @@ void drawNumber(String &filename, int32_t count, int32_t thresholdred, tagRecord
     if (count > 999) size = loc["fonts"][4].as<uint16_t>();
     if (count > 9999) size = loc["fonts"][5].as<uint16_t>();
     if (count > 99999) size = loc["fonts"][6].as<uint16_t>();
-    drawString(spr, String(count), loc["xy"][0].as<uint16_t>(), loc["xy"][1].as<uint16_t>() - size / 1.8, font, TC_DATUM, color, size);
 
-    spr2buffer(spr, filename, imageParams);
-    spr.deleteSprite();
+    Fingerprint fp(imageParams);
+    fp.printf("%d,%d,", (int)countTemp, (int)thresholdred);
+    serializeJson(loc, fp);
+    if (renderUnchanged(taginfo, imageParams)) return;
+
+    renderImage(filename, imageParams, [&](TFT_eSprite &spr) {
+        drawString(spr, String(count), loc["xy"][0].as<uint16_t>(), loc["xy"][1].as<uint16_t>() - size / 1.8, font, TC_DATUM, color, size);
+    });
 }
 
 /// @brief Get a weather icon
@@ -1001,143 +1424,134 @@ void drawWeatherContent(JsonDocument &doc, JsonDocument &loc, TFT_eSprite &spr,
     }
 }
 
+/// @brief Add the current weather values drawWeatherContent uses to the fingerprint
+/// @note The whole response isn't used, as its time field changes on every update
+void fingerprintWeather(Fingerprint &fp, JsonDocument &doc) {
+    const auto &currentWeather = doc["current_weather"];
+    for (const char *key : {"temperature", "windspeed", "winddirection", "is_day", "weathercode"}) {
+        serializeJson(currentWeather[key], fp);
+        fp.print(',');
+    }
+}
+
 void drawWeather(String &filename, JsonObject &cfgobj, const tagRecord *taginfo, imgParam &imageParams) {
     wsLog("get weather");
 
-    getLocation(cfgobj);
-
-    const String lat = cfgobj["#lat"];
-    const String lon = cfgobj["#lon"];
-    const String tz = cfgobj["#tz"];
-    String units = "";
-    if (cfgobj["units"] == "1") {
-        units += "&temperature_unit=fahrenheit&windspeed_unit=mph&precipitation_unit=inch";
-    }
-
     JsonDocument doc;
-    const bool success = util::httpGetJson("https://api.open-meteo.com/v1/forecast?latitude=" + lat + "&longitude=" + lon + "&current_weather=true&windspeed_unit=ms&timezone=" + tz + units, doc, 5000);
+    const bool success = takeJson(weatherRequest(cfgobj, false), doc);
     if (!success) {
         return;
     }
     JsonDocument loc;
     getTemplate(loc, 4, taginfo->hwType);
 
-    TFT_eSprite spr = TFT_eSprite(&tft);
-    tft.setTextWrap(false, false);
-    initSprite(spr, imageParams.width, imageParams.height, imageParams);
-
-    drawWeatherContent(doc, loc, spr, cfgobj, imageParams);
+    Fingerprint fp(imageParams);
+    fingerprintWeather(fp, doc);
+    serializeJson(loc, fp);
+    if (renderUnchanged(taginfo, imageParams)) return;
 
-    spr2buffer(spr, filename, imageParams);
-    spr.deleteSprite();
+    tft.setTextWrap(false, false);
+    renderImage(filename, imageParams, [&](TFT_eSprite &spr) {
+        drawWeatherContent(doc, loc, spr, cfgobj, imageParams);
+    });
 }
 
 void drawForecast(String &filename, JsonObject &cfgobj, const tagRecord *taginfo, imgParam &imageParams) {
     wsLog("get weather");
-    getLocation(cfgobj);
-
-    String lat = cfgobj["#lat"];
-    String lon = cfgobj["#lon"];
-    String tz = cfgobj["#tz"];
-    String units = "";
-    if (cfgobj["units"] == "1") {
-        units += "&temperature_unit=fahrenheit&windspeed_unit=mph&precipitation_unit=inch";
-    }
 
     JsonDocument doc;
-    const bool success = util::httpGetJson("https://api.open-meteo.com/v1/forecast?latitude=" + lat + "&longitude=" + lon + "&daily=weathercode,temperature_2m_max,temperature_2m_min,precipitation_sum,windspeed_10m_max,winddirection_10m_dominant&current_weather=true&windspeed_unit=ms&timeformat=unixtime&timezone=" + tz + units, doc, 5000);
+    const bool success = takeJson(weatherRequest(cfgobj, true), doc);
     if (!success) {
         return;
     }
 
-    TFT_eSprite spr = TFT_eSprite(&tft);
-    tft.setTextWrap(false, false);
-
     JsonDocument loc;
     getTemplate(loc, 8, taginfo->hwType);
-    initSprite(spr, imageParams.width, imageParams.height, imageParams);
 
-    if (loc["temp"]) drawWeatherContent(doc, loc, spr, cfgobj, imageParams, true);
+    Fingerprint fp(imageParams);
+    if (loc["temp"]) fingerprintWeather(fp, doc);
+    serializeJson(doc["daily"], fp);
+    serializeJson(doc["utc_offset_seconds"], fp);
+    serializeJson(loc, fp);
+    if (renderUnchanged(taginfo, imageParams)) return;
 
-    const auto &location = loc["location"];
-    drawString(spr, cfgobj["location"], location[0], location[1], location[2], TL_DATUM, TFT_BLACK);
-    const auto &daily = doc["daily"];
-    const auto &column = loc["column"];
-    const int column1 = column[1].as<int>();
-    const auto &day = loc["day"];
-    const unsigned long utc_offset = doc["utc_offset_seconds"];
-    for (uint8_t dag = 0; dag < column[0]; dag++) {
-        const time_t weatherday = (daily["time"][dag].as<time_t>() + utc_offset);
-        const struct tm *datum = localtime(&weatherday);
-
-        drawString(spr, String(languageDaysShort[datum->tm_wday]), dag * column1 + day[0].as<int>(), day[1], day[2], TC_DATUM, TFT_BLACK);
-
-        uint8_t weathercode = daily["weathercode"][dag].as<int>();
-        if (weathercode > 40) weathercode -= 40;
-
-        const int iconcolor = (weathercode == 55 || weathercode == 65 || weathercode == 75 || weathercode == 82 || weathercode == 86 || weathercode == 95 || weathercode == 96 || weathercode == 99)
-                                  ? imageParams.highlightColor
-                                  : TFT_BLACK;
-        drawString(spr, getWeatherIcon(weathercode), loc["icon"][0].as<int>() + dag * column1, loc["icon"][1], "/fonts/weathericons.ttf", TC_DATUM, iconcolor, loc["icon"][2]);
-
-        drawString(spr, windDirectionIcon(daily["winddirection_10m_dominant"][dag]), loc["wind"][0].as<int>() + dag * column1, loc["wind"][1], "/fonts/weathericons.ttf", TC_DATUM, TFT_BLACK, loc["icon"][2]);
-
-        const int8_t tmin = round(daily["temperature_2m_min"][dag].as<double>());
-        const int8_t tmax = round(daily["temperature_2m_max"][dag].as<double>());
-        uint8_t wind;
-        const int8_t beaufort = windSpeedToBeaufort(daily["windspeed_10m_max"][dag].as<double>());
-        if (cfgobj["units"] == "1") {
-            wind = daily["windspeed_10m_max"][dag].as<int>();
-        } else {
-            wind = beaufort;
-        }
+    tft.setTextWrap(false, false);
+    renderImage(filename, imageParams, [&](TFT_eSprite &spr) {
+        if (loc["temp"]) drawWeatherContent(doc, loc, spr, cfgobj, imageParams, true);
 
-        if (loc["rain"]) {
-            if (cfgobj["units"] == "0") {
-                const int8_t rain = round(daily["precipitation_sum"][dag].as<double>());
-                if (rain > 0) {
-                    drawString(spr, String(rain) + "mm", dag * column1 + loc["rain"][0].as<int>(), loc["rain"][1], day[2], TC_DATUM, (rain > 10 ? imageParams.highlightColor : TFT_BLACK));
-                }
+        const auto &location = loc["location"];
+        drawString(spr, cfgobj["location"], location[0], location[1], location[2], TL_DATUM, TFT_BLACK);
+        const auto &daily = doc["daily"];
+        const auto &column = loc["column"];
+        const int column1 = column[1].as<int>();
+        const auto &day = loc["day"];
+        const unsigned long utc_offset = doc["utc_offset_seconds"];
+        for (uint8_t dag = 0; dag < column[0]; dag++) {
+            const time_t weatherday = (daily["time"][dag].as<time_t>() + utc_offset);
+            const struct tm *datum = localtime(&weatherday);
+
+            drawString(spr, String(languageDaysShort[datum->tm_wday]), dag * column1 + day[0].as<int>(), day[1], day[2], TC_DATUM, TFT_BLACK);
+
+            uint8_t weathercode = daily["weathercode"][dag].as<int>();
+            if (weathercode > 40) weathercode -= 40;
+
+            const int iconcolor = (weathercode == 55 || weathercode == 65 || weathercode == 75 || weathercode == 82 || weathercode == 86 || weathercode == 95 || weathercode == 96 || weathercode == 99)
+                                      ? imageParams.highlightColor
+                                      : TFT_BLACK;
+            drawString(spr, getWeatherIcon(weathercode), loc["icon"][0].as<int>() + dag * column1, loc["icon"][1], "/fonts/weathericons.ttf", TC_DATUM, iconcolor, loc["icon"][2]);
+
+            drawString(spr, windDirectionIcon(daily["winddirection_10m_dominant"][dag]), loc["wind"][0].as<int>() + dag * column1, loc["wind"][1], "/fonts/weathericons.ttf", TC_DATUM, TFT_BLACK, loc["icon"][2]);
+
+            const int8_t tmin = round(daily["temperature_2m_min"][dag].as<double>());
+            const int8_t tmax = round(daily["temperature_2m_max"][dag].as<double>());
+            uint8_t wind;
+            const int8_t beaufort = windSpeedToBeaufort(daily["windspeed_10m_max"][dag].as<double>());
+            if (cfgobj["units"] == "1") {
+                wind = daily["windspeed_10m_max"][dag].as<int>();
             } else {
-                double fRain = daily["precipitation_sum"][dag].as<double>();
-                fRain = round(fRain * 100.0) / 100.0;
-                if (fRain > 0.0) {
-                    // inch, display if > .01 inches
-                    drawString(spr, String(fRain) + "in", dag * column1 + loc["rain"][0].as<int>(), loc["rain"][1], day[2], TC_DATUM, (fRain > 0.5 ? imageParams.highlightColor : TFT_BLACK));
+                wind = beaufort;
+            }
+
+            if (loc["rain"]) {
+                if (cfgobj["units"] == "0") {
+                    const int8_t rain = round(daily["precipitation_sum"][dag].as<double>());
+                    if (rain > 0) {
+                        drawString(spr, String(rain) + "mm", dag * column1 + loc["rain"][0].as<int>(), loc["rain"][1], day[2], TC_DATUM, (rain > 10 ? imageParams.highlightColor : TFT_BLACK));
+                    }
+                } else {
+                    double fRain = daily["precipitation_sum"][dag].as<double>();
+                    fRain = round(fRain * 100.0) / 100.0;
+                    if (fRain > 0.0) {
+                        // inch, display if > .01 inches
+                        drawString(spr, String(fRain) + "in", dag * column1 + loc["rain"][0].as<int>(), loc["rain"][1], day[2], TC_DATUM, (fRain > 0.5 ? imageParams.highlightColor : TFT_BLACK));
+                    }
                 }
             }
-        }
 
-        drawString(spr, String(tmin) + " ", dag * column1 + day[0].as<int>(), day[4], day[2], TR_DATUM, (tmin < 0 ? imageParams.highlightColor : TFT_BLACK));
-        drawString(spr, String(" ") + String(tmax), dag * column1 + day[0].as<int>(), day[4], day[2], TL_DATUM, (tmax < 0 ? imageParams.highlightColor : TFT_BLACK));
-        drawString(spr, " " + String(wind), dag * column1 + column1 / 2, day[3], day[2], TL_DATUM, (beaufort > 5 ? imageParams.highlightColor : TFT_BLACK));
-        if (dag > 0) {
-            for (int i = loc["line"][0]; i < loc["line"][1]; i += 3) {
-                spr.drawPixel(dag * column1, i, TFT_BLACK);
+            drawString(spr, String(tmin) + " ", dag * column1 + day[0].as<int>(), day[4], day[2], TR_DATUM, (tmin < 0 ? imageParams.highlightColor : TFT_BLACK));
+            drawString(spr, String(" ") + String(tmax), dag * column1 + day[0].as<int>(), day[4], day[2], TL_DATUM, (tmax < 0 ? imageParams.highlightColor : TFT_BLACK));
+            drawString(spr, " " + String(wind), dag * column1 + column1 / 2, day[3], day[2], TL_DATUM, (beaufort > 5 ? imageParams.highlightColor : TFT_BLACK));
+            if (dag > 0) {
+                for (int i = loc["line"][0]; i < loc["line"][1]; i += 3) {
+                    spr.drawPixel(dag * column1, i, TFT_BLACK);
+                }
             }
         }
-    }
-
-    spr2buffer(spr, filename, imageParams);
-    spr.deleteSprite();
+    });
 }
 
 int getImgURL(String &filename, String URL, time_t fetched, imgParam &imageParams, String MAC) {
     // https://images.klari.net/kat-bw29.jpg
 
-    HTTPClient http;
     logLine("http getImgURL " + URL);
-    http.begin(URL);
-    http.addHeader("If-Modified-Since", formatHttpDate(fetched));
-    http.addHeader("X-ESL-MAC", MAC);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    http.setTimeout(5000);  // timeout in ms
-    const int httpCode = http.GET();
+    contentfetch::Response response;
+    contentfetch::take(imageUrlRequest(URL, fetched, MAC, 5000), response);
+    const int httpCode = response.httpCode;
     if (httpCode == 200) {
         xSemaphoreTake(fsMutex, portMAX_DELAY);
         File f = contentFS->open("/temp/temp.jpg", "w");
         if (f) {
-            http.writeToStream(&f);
+            f.write(response.body, response.len);
             f.close();
             xSemaphoreGive(fsMutex);
             jpg2buffer("/temp/temp.jpg", filename, imageParams);
@@ -1149,14 +1563,9 @@ int getImgURL(String &filename, String URL, time_t fetched, imgParam &imageParam
             wsErr("http " + URL + " " + String(httpCode));
         }
     }
-    http.end();
     return httpCode;
 }
 
-#ifdef CONTENT_RSS
-rssClass reader;
-#endif
-
 void replaceHTMLentities(String &text) {
     text.replace("&gt;", ">");
     text.replace("&lt;", "<");
@@ -1199,10 +1608,6 @@ bool getRssFeed(String &filename, String URL, String title, tagRecord *&taginfo,
 
     wsLog("get rss feed");
 
-    const char *url = URL.c_str();
-    const int rssTitleSize = 255;
-    const int rssDescSize = 1000;
-
     TFT_eSprite spr = TFT_eSprite(&tft);
 
     JsonDocument loc;
@@ -1214,13 +1619,13 @@ bool getRssFeed(String &filename, String URL, String title, tagRecord *&taginfo,
     drawString(spr, title, loc["title"][0], loc["title"][1], loc["title"][2], TL_DATUM, TFT_BLACK, loc["title"][3]);
     int16_t posx = loc["line"][0];
     int16_t posy = loc["line"][1];
-    int n = reader.getArticles(url, rssTitleSize, rssDescSize, loc["items"]);
+    JsonDocument articles;
+    takeJson(rssRequest(URL, taginfo->hwType), articles);
 
     float lineheight = loc["desc"][3].as<float>();
-    for (int i = 0; i < n; i++) {
-        // if (reader.titleData[i] != NULL && *reader.titleData[i] != NULL) {
-        if (reader.titleData[i] != NULL) {
-            String title = String(reader.titleData[i]);
+    for (JsonObject article : articles.as<JsonArray>()) {
+        if (article["title"].is<const char *>()) {
+            String title = article["title"].as<String>();
             replaceHTMLentities(title);
             removeHTML(title);
 
@@ -1228,9 +1633,8 @@ bool getRssFeed(String &filename, String URL, String title, tagRecord *&taginfo,
                 drawTextBox(spr, title, posx, posy, imageParams.width - 2 * posx, 100, loc["line"][2], TFT_BLACK);
             }
         }
-        // if (reader.descData[i] != NULL && *reader.descData[i] != NULL) {
-        if (reader.descData[i] != NULL && loc["desc"][2] != "") {
-            String desc = String(reader.descData[i]);
+        if (article["desc"].is<const char *>() && loc["desc"][2] != "") {
+            String desc = article["desc"].as<String>();
             replaceHTMLentities(desc);
             removeHTML(desc);
 
@@ -1243,7 +1647,6 @@ bool getRssFeed(String &filename, String URL, String title, tagRecord *&taginfo,
             posy += loc["desc"][1].as<int>();
         }
     }
-    reader.clearItemData();
 
     spr2buffer(spr, filename, imageParams);
     spr.deleteSprite();
@@ -1282,8 +1685,6 @@ bool getCalFeed(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, imgPa
     JsonDocument loc;
     getTemplate(loc, 11, taginfo->hwType);
 
-    String URL = cfgobj["apps_script_url"].as<String>() + "?days=" + loc["days"].as<String>();
-
     time_t now;
     time(&now);
     struct tm timeinfo;
@@ -1291,23 +1692,19 @@ bool getCalFeed(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, imgPa
     char dateString[40];
     strftime(dateString, sizeof(dateString), languageDateFormat[0].c_str(), &timeinfo);
 
-    HTTPClient http;
-    // logLine("http getCalFeed " + URL);
-    http.begin(URL);
-    http.setTimeout(10000);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    int httpCode = http.GET();
+    contentfetch::Response response;
+    contentfetch::take(calendarRequest(cfgobj, taginfo->hwType), response);
+    int httpCode = response.httpCode;
     if (httpCode != 200) {
         wsErr("getCalFeed http error " + String(httpCode));
         return false;
     }
 
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, http.getString());
+    DeserializationError error = deserializeJson(doc, (const char *)response.body, response.len);
     if (error) {
         wsErr(error.c_str());
     }
-    http.end();
 
     TFT_eSprite spr = TFT_eSprite(&tft);
 
@@ -1650,10 +2047,6 @@ bool getDayAheadFeed(String &filename, JsonObject &cfgobj, tagRecord *&taginfo,
     JsonDocument loc;
     getTemplate(loc, 27, taginfo->hwType);
 
-    // This is a link to a Google Apps Script script, which fetches (and caches) the tariff from https://transparency.entsoe.eu/
-    // I made it available to provide easy access to the data, but please don't use this link in any projects other than OpenEpaperLink.
-    String URL = "https://script.google.com/macros/s/AKfycbwMmeGAaPrWzVZrESSpmPmD--O132PzW_acnBsuEottKNATTqCRn6h8zN0Yts7S56ggsg/exec?country=" + cfgobj["country"].as<String>();
-
     time_t now;
     time(&now);
     struct tm timeinfo;
@@ -1662,22 +2055,19 @@ bool getDayAheadFeed(String &filename, JsonObject &cfgobj, tagRecord *&taginfo,
     char dateString[40];
     strftime(dateString, sizeof(dateString), languageDateFormat[0].c_str(), &timeinfo);
 
-    HTTPClient http;
-    http.begin(URL);
-    http.setTimeout(10000);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    int httpCode = http.GET();
+    contentfetch::Response response;
+    contentfetch::take(dayAheadRequest(cfgobj), response);
+    int httpCode = response.httpCode;
     if (httpCode != 200) {
         wsErr("getDayAhead http error " + String(httpCode));
         return false;
     }
 
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, http.getString());
+    DeserializationError error = deserializeJson(doc, (const char *)response.body, response.len);
     if (error) {
         wsErr(error.c_str());
     }
-    http.end();
 
     TFT_eSprite spr = TFT_eSprite(&tft);
 
@@ -1799,7 +2189,14 @@ bool getDayAheadFeed(String &filename, JsonObject &cfgobj, tagRecord *&taginfo,
 
 #ifdef CONTENT_QR
 void drawQR(String &filename, String qrcontent, String title, tagRecord *&taginfo, imgParam &imageParams) {
-    TFT_eSprite spr = TFT_eSprite(&tft);
+    JsonDocument loc;
+    getTemplate(loc, 10, taginfo->hwType);
+
+    Fingerprint fp(imageParams);
+    fp.print(qrcontent);
+    fp.print(title);
+    serializeJson(loc, fp);
+    if (renderUnchanged(taginfo, imageParams)) return;
 
     const char *text = qrcontent.c_str();
     QRCode qrcode;
@@ -1808,26 +2205,22 @@ void drawQR(String &filename, String qrcontent, String title, tagRecord *&taginf
     // https://github.com/ricmoo/QRCode
     qrcode_initText(&qrcode, qrcodeData, version, ECC_MEDIUM, text);
 
-    JsonDocument loc;
-    getTemplate(loc, 10, taginfo->hwType);
-    initSprite(spr, imageParams.width, imageParams.height, imageParams);
-    drawString(spr, title, loc["title"][0], loc["title"][1], loc["title"][2], TC_DATUM, TFT_BLACK, loc["title"][3]);
-
     const int size = qrcode.size;
     const int dotsize = int((imageParams.height - loc["pos"][1].as<int>()) / size);
     const int xpos = loc["pos"][0].as<int>() - dotsize * size / 2;
     const int ypos = loc["pos"][1].as<int>() + (imageParams.height - loc["pos"][1].as<int>() - dotsize * size) / 2;
 
-    for (int y = 0; y < size; y++) {
-        for (int x = 0; x < size; x++) {
-            if (qrcode_getModule(&qrcode, x, y)) {
-                spr.fillRect(xpos + x * dotsize, ypos + y * dotsize, dotsize, dotsize, TFT_BLACK);
+    renderImage(filename, imageParams, [&](TFT_eSprite &spr) {
+        drawString(spr, title, loc["title"][0], loc["title"][1], loc["title"][2], TC_DATUM, TFT_BLACK, loc["title"][3]);
+
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                if (qrcode_getModule(&qrcode, x, y)) {
+                    spr.fillRect(xpos + x * dotsize, ypos + y * dotsize, dotsize, dotsize, TFT_BLACK);
+                }
             }
         }
-    }
-
-    spr2buffer(spr, filename, imageParams);
-    spr.deleteSprite();
+    });
 }
 #endif
 
@@ -1836,16 +2229,9 @@ uint8_t drawBuienradar(String &filename, JsonObject &cfgobj, tagRecord *&taginfo
     uint8_t refresh = 60;
     wsLog("get buienradar");
 
-    getLocation(cfgobj);
-    HTTPClient http;
-
-    String lat = cfgobj["#lat"];
-    String lon = cfgobj["#lon"];
-    // logLine("http drawBuienradar");
-    http.begin("https://gadgets.buienradar.nl/data/raintext/?lat=" + lat + "&lon=" + lon);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    http.setTimeout(5000);
-    int httpCode = http.GET();
+    contentfetch::Response raintext;
+    contentfetch::take(buienradarRequest(cfgobj), raintext);
+    int httpCode = raintext.httpCode;
 
     if (httpCode == 200) {
         TFT_eSprite spr = TFT_eSprite(&tft);
@@ -1856,7 +2242,7 @@ uint8_t drawBuienradar(String &filename, JsonObject &cfgobj, tagRecord *&taginfo
 
         tft.setTextWrap(false, false);
 
-        String response = http.getString();
+        String response = (const char *)raintext.body;
 
         drawString(spr, cfgobj["location"], loc["location"][0], loc["location"][1], loc["location"][2]);
 
@@ -1911,7 +2297,6 @@ uint8_t drawBuienradar(String &filename, JsonObject &cfgobj, tagRecord *&taginfo
     } else {
         wsErr("Buitenradar http " + String(httpCode));
     }
-    http.end();
     return refresh;
 }
 #endif
@@ -1923,13 +2308,33 @@ void drawAPinfo(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, imgPa
         return;
     }
 
-    TFT_eSprite spr = TFT_eSprite(&tft);
     JsonDocument loc;
-    uint8_t screenCurrentOrientation = 0;
     getTemplate(loc, 21, taginfo->hwType);
 
-    initSprite(spr, imageParams.width, imageParams.height, imageParams);
     const JsonArray jsonArray = loc.as<JsonArray>();
+    bool rotates = false;
+    for (const JsonVariant &elem : jsonArray) {
+        if (elem["rotate"].is<uint8_t>()) rotates = true;
+    }
+
+    Fingerprint fp(imageParams);
+    serializeJson(loc, fp);
+    if (renderUnchanged(taginfo, imageParams)) return;
+
+    if (!rotates) {
+        // no buffer rotation, so every element can be redrawn band by band
+        renderImage(filename, imageParams, [&](TFT_eSprite &spr) {
+            uint8_t screenCurrentOrientation = 0;
+            for (const JsonVariant &elem : jsonArray) {
+                drawElement(elem, spr, imageParams, screenCurrentOrientation);
+            }
+        });
+        return;
+    }
+
+    TFT_eSprite spr = TFT_eSprite(&tft);
+    uint8_t screenCurrentOrientation = 0;
+    initSprite(spr, imageParams.width, imageParams.height, imageParams);
     for (const JsonVariant &elem : jsonArray) {
         drawElement(elem, spr, imageParams, screenCurrentOrientation);
     }
@@ -2047,7 +2452,7 @@ void drawTimestamp(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, im
 
         if (nextaction > 0 && timestamp > 0) {
             timestamp += nextaction * 24 * 3600;
-            if (timestamp < taginfo->nextupdate) taginfo->nextupdate = timestamp;
+            if (timestamp < taginfo->nextupdate) taginfo->setNextupdate(timestamp);
             localtime_r(&timestamp, &timeinfo);
             strftime(dateString1, sizeof(dateString1), languageDateFormat[0].c_str(), &timeinfo);
 
@@ -2060,7 +2465,7 @@ void drawTimestamp(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, im
 
         if (nextaction > 0 && timestamp > 0) {
             timestamp += nextaction * 24 * 3600;
-            if (timestamp < taginfo->nextupdate) taginfo->nextupdate = timestamp;
+            if (timestamp < taginfo->nextupdate) taginfo->setNextupdate(timestamp);
             localtime_r(&timestamp, &timeinfo);
             strftime(dateString1, sizeof(dateString1), languageDateFormat[0].c_str(), &timeinfo);
 
@@ -2092,12 +2497,33 @@ void drawTimestamp(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, im
 }
 #endif
 
+/// @brief Add a json template file to the fingerprint
+/// @param fp Fingerprint
+/// @param file Template file, rewound afterwards
+/// @return false if the template draws images from other files, which aren't covered by the fingerprint
+bool fingerprintTemplate(Fingerprint &fp, File &file) {
+    uint8_t buffer[256];
+    size_t len;
+    while ((len = file.read(buffer, sizeof(buffer))) > 0) {
+        fp.write(buffer, len);
+    }
+    file.seek(0);
+    const bool hasImage = file.find("\"image\"");
+    file.seek(0);
+    return !hasImage;
+}
+
 bool getJsonTemplateFile(String &filename, String jsonfile, tagRecord *&taginfo, imgParam &imageParams) {
     if (jsonfile.c_str()[0] != '/') {
         jsonfile = "/" + jsonfile;
     }
     File file = contentFS->open(jsonfile, "r");
     if (file) {
+        Fingerprint fp(imageParams);
+        if (fingerprintTemplate(fp, file) && renderUnchanged(taginfo, imageParams)) {
+            file.close();
+            return true;
+        }
         drawJsonStream(file, filename, taginfo, imageParams);
         file.close();
         // contentFS->remove(jsonfile);
@@ -2247,6 +2673,12 @@ bool getJsonTemplateFileExtractVariables(String &filename, String jsonfile, Json
     }
     File file = contentFS->open(jsonfile, "r");
     if (file) {
+        Fingerprint fp(imageParams);
+        serializeJson(variables, fp);
+        if (fingerprintTemplate(fp, file) && renderUnchanged(taginfo, imageParams)) {
+            file.close();
+            return true;
+        }
         auto interceptor = DataInterceptor(file, variables);
         drawJsonStream(interceptor, filename, taginfo, imageParams);
         file.close();
@@ -2257,23 +2689,18 @@ bool getJsonTemplateFileExtractVariables(String &filename, String jsonfile, Json
 }
 
 int getJsonTemplateUrl(String &filename, String URL, time_t fetched, String MAC, tagRecord *&taginfo, imgParam &imageParams) {
-    HTTPClient http;
-    http.useHTTP10(true);
     logLine("http getJsonTemplateUrl " + URL);
-    http.begin(URL);
-    http.addHeader("If-Modified-Since", formatHttpDate(fetched));
-    http.addHeader("X-ESL-MAC", MAC);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    http.setTimeout(20000);
-    const int httpCode = http.GET();
+    contentfetch::Response response;
+    contentfetch::take(imageUrlRequest(URL, fetched, MAC, 20000), response);
+    const int httpCode = response.httpCode;
     if (httpCode == 200) {
-        drawJsonStream(http.getStream(), filename, taginfo, imageParams);
+        contentfetch::BodyStream stream(response);
+        drawJsonStream(stream, filename, taginfo, imageParams);
     } else {
         if (httpCode != 304) {
             wsErr("http " + URL + " status " + String(httpCode));
         }
     }
-    http.end();
     return httpCode;
 }
 
@@ -2490,23 +2917,21 @@ String windDirectionIcon(const int degrees) {
     return directions[index];
 }
 
-void getLocation(JsonObject &cfgobj) {
-    const String lat = cfgobj["#lat"];
-    const String lon = cfgobj["#lon"];
-
-    if (util::isEmptyOrNull(lat) || util::isEmptyOrNull(lon)) {
+bool getLocation(JsonObject &cfgobj) {
+    if (needsLocation(cfgobj)) {
         wsLog("get location");
         JsonDocument filter;
         filter["results"][0]["latitude"] = true;
         filter["results"][0]["longitude"] = true;
         filter["results"][0]["timezone"] = true;
         JsonDocument doc;
-        if (util::httpGetJson("https://geocoding-api.open-meteo.com/v1/search?name=" + urlEncode(cfgobj["location"]) + "&count=1", doc, 5000, &filter)) {
+        if (takeJson(locationRequest(cfgobj), doc, &filter)) {
             cfgobj["#lat"] = doc["results"][0]["latitude"].as<String>();
             cfgobj["#lon"] = doc["results"][0]["longitude"].as<String>();
             cfgobj["#tz"] = doc["results"][0]["timezone"].as<String>();
         }
     }
+    return !needsLocation(cfgobj);
 }
 
 #ifdef CONTENT_NFCLUT
@@ -2607,32 +3032,5 @@ void prepareTIME_RAW(const uint8_t *dst, time_t now) {
 #endif
 
 void getTemplate(JsonDocument &json, const uint8_t id, const uint8_t hwtype) {
-    JsonDocument filter;
-    JsonDocument doc;
-
-    const String idstr = String(id);
-    constexpr const char *templateKey = "template";
-
-    char filename[20];
-    snprintf(filename, sizeof(filename), "/tagtypes/%02X.json", hwtype);
-    File jsonFile = contentFS->open(filename, "r");
-
-    if (jsonFile) {
-        filter[templateKey][idstr] = true;
-        filter["usetemplate"] = true;
-        const DeserializationError error = deserializeJson(doc, jsonFile, DeserializationOption::Filter(filter));
-        jsonFile.close();
-        if (!error && doc[templateKey].is<JsonVariant>() && doc[templateKey][idstr].is<JsonVariant>()) {
-            json.set(doc[templateKey][idstr]);
-            return;
-        }
-        if (!error && doc["usetemplate"].is<uint8_t>()) {
-            getTemplate(json, id, doc["usetemplate"]);
-            return;
-        }
-        Serial.println("json error in " + String(filename));
-        Serial.println(error.c_str());
-    } else {
-        Serial.println("Failed to open " + String(filename));
-    }
+    getHwTemplate(json, id, hwtype);
 }
@@ -0,0 +1,197 @@
+#include "fontcache.h"
+
+#include <Arduino.h>
+#include <FS.h>
+#include <TFT_eSPI.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "makeimage.h"
+#include "storage.h"
+#include "truetype.h"
+
+namespace fontcache {
+
+struct Font {
+    String path;
+    truetypeClass* ttf;  // either this
+    TFT_eSprite* vlw;    // or this, holding the loaded font
+    uint8_t* data;       // ttf file contents, if they fit in the budget
+    uint32_t dataSize;
+    uint32_t lastUse;
+};
+
+static std::mutex cacheMutex;  // only for getStats(), the fonts are used by the content task
+static Font fonts[FONTCACHE_FONTS];
+static uint8_t fontCount = 0;
+static uint32_t useCounter = 0;
+static std::atomic<bool> flushPending(false);
+static Stats stats = {0};
+
+static void destroy(Font& font) {
+    if (font.ttf) {
+        const ttGlyphCacheStats_t glyphStats = font.ttf->getGlyphCacheStats();
+        stats.glyphHits += glyphStats.hits;
+        stats.glyphMisses += glyphStats.misses;
+        font.ttf->end();
+        delete font.ttf;
+    }
+    if (font.vlw) {
+        font.vlw->unloadFont();
+        delete font.vlw;
+    }
+    if (font.data) free(font.data);
+    stats.dataBytes -= font.dataSize;
+    font = Font();
+}
+
+static void flush() {
+    for (uint8_t i = 0; i < fontCount; i++) {
+        destroy(fonts[i]);
+    }
+    fontCount = 0;
+}
+
+// find a font, or make room for it. The returned slot is empty if the font isn't loaded yet.
+static Font& slotFor(const String& path) {
+    if (flushPending.exchange(false)) flush();
+
+    useCounter++;
+    for (uint8_t i = 0; i < fontCount; i++) {
+        if (fonts[i].path == path) {
+            fonts[i].lastUse = useCounter;
+            stats.hits++;
+            return fonts[i];
+        }
+    }
+    stats.misses++;
+
+    uint8_t slot = fontCount;
+    if (fontCount < FONTCACHE_FONTS) {
+        fontCount++;
+    } else {
+        slot = 0;
+        for (uint8_t i = 1; i < fontCount; i++) {
+            if (fonts[i].lastUse < fonts[slot].lastUse) slot = i;
+        }
+        destroy(fonts[slot]);
+    }
+    fonts[slot].path = path;
+    fonts[slot].lastUse = useCounter;
+    return fonts[slot];
+}
+
+static void drop(Font& font) {
+    destroy(font);
+    Font& last = fonts[--fontCount];
+    if (&font != &last) {
+        font = last;
+        last = Font();
+    }
+}
+
+truetypeClass* getTtf(const String& path) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    Font& font = slotFor(path);
+    if (font.ttf) return font.ttf;
+
+    File file = contentFS->open(path, "r");
+    if (!file) {
+        drop(font);
+        return nullptr;
+    }
+    font.ttf = new truetypeClass();
+
+    const uint32_t fileSize = file.size();
+    if (stats.dataBytes + fileSize <= FONTCACHE_DATA_BUDGET) {
+#ifdef BOARD_HAS_PSRAM
+        font.data = static_cast<uint8_t*>(ps_malloc(fileSize));
+#else
+        font.data = static_cast<uint8_t*>(malloc(fileSize));
+#endif
+    }
+    uint8_t loaded;
+    if (font.data) {
+        xSemaphoreTake(fsMutex, portMAX_DELAY);
+        file.read(font.data, fileSize);
+        xSemaphoreGive(fsMutex);
+        file.close();
+        font.dataSize = fileSize;
+        stats.dataBytes += fileSize;
+        loaded = font.ttf->setTtfPointer(font.data, fileSize, 0, false);
+    } else {
+        loaded = font.ttf->setTtfFile(file);
+    }
+    if (!loaded) {
+        drop(font);
+        return nullptr;
+    }
+    font.ttf->setGlyphCacheSize(FONTCACHE_GLYPH_BUDGET);
+    return font.ttf;
+}
+
+bool attachVlw(TFT_eSprite& spr, const String& path) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    Font& font = slotFor(path);
+    if (font.vlw == nullptr) {
+        font.vlw = new TFT_eSprite(&tft);
+        font.vlw->loadFont(path.substring(1), *contentFS);
+        if (!font.vlw->fontLoaded) {
+            drop(font);
+            return false;
+        }
+    }
+
+    // the sprite borrows the metrics and the open font file, detachVlw() hands them back
+    if (spr.fontLoaded) spr.unloadFont();
+    const TFT_eSprite& holder = *font.vlw;
+    spr.gFont = holder.gFont;
+    spr.gUnicode = holder.gUnicode;
+    spr.gHeight = holder.gHeight;
+    spr.gWidth = holder.gWidth;
+    spr.gxAdvance = holder.gxAdvance;
+    spr.gdY = holder.gdY;
+    spr.gdX = holder.gdX;
+    spr.gBitmap = holder.gBitmap;
+    spr.fontFile = holder.fontFile;
+    spr.fs_font = holder.fs_font;
+    spr.fontLoaded = true;
+    return true;
+}
+
+void detachVlw(TFT_eSprite& spr) {
+    spr.gFont.gArray = nullptr;
+    spr.gFont.gCount = 0;
+    spr.gUnicode = nullptr;
+    spr.gHeight = nullptr;
+    spr.gWidth = nullptr;
+    spr.gxAdvance = nullptr;
+    spr.gdY = nullptr;
+    spr.gdX = nullptr;
+    spr.gBitmap = nullptr;
+    spr.fontFile = fs::File();
+    spr.fs_font = false;
+    spr.fontLoaded = false;
+}
+
+void fileChanged(const String& path) {
+    if (path.endsWith(".ttf") || path.endsWith(".vlw")) flushPending = true;
+}
+
+Stats getStats() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    Stats ret = stats;
+    ret.fonts = fontCount;
+    for (uint8_t i = 0; i < fontCount; i++) {
+        if (fonts[i].ttf == nullptr) continue;
+        const ttGlyphCacheStats_t glyphStats = fonts[i].ttf->getGlyphCacheStats();
+        ret.glyphs += glyphStats.glyphs;
+        ret.glyphBytes += glyphStats.bytes;
+        ret.glyphHits += glyphStats.hits;
+        ret.glyphMisses += glyphStats.misses;
+    }
+    return ret;
+}
+
+}  // namespace fontcache
@@ -0,0 +1,276 @@
+#include "httpcache.h"
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "storage.h"
+
+namespace httpcache {
+
+struct Entry {
+    uint8_t* body;  // nullptr when it is on the sd card
+    uint32_t len;
+    uint32_t fileId;
+    time_t expires;
+    String etag;
+    String lastModified;
+    uint32_t lastUse;
+};
+
+static std::mutex cacheMutex;
+static std::map<String, Entry> entries;
+static uint32_t useCounter = 0;
+static uint32_t fileCounter = 0;
+static Stats stats = {0};
+
+static void* allocBody(size_t len) {
+#ifdef BOARD_HAS_PSRAM
+    return ps_malloc(len);
+#else
+    return malloc(len);
+#endif
+}
+
+#ifdef HAS_SDCARD
+static String pathOf(const Entry& entry) {
+    return "/temp/httpcache" + String(entry.fileId) + ".bin";
+}
+#endif
+
+// stores the body with the entry, in memory or on the card
+static bool storeBody(Entry& entry, const uint8_t* body, const uint32_t len) {
+    entry.len = len;
+#ifdef HAS_SDCARD
+    if (Storage.freeSpace() < len + 100000) return false;
+    entry.body = nullptr;
+    entry.fileId = ++fileCounter;
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    File file = contentFS->open(pathOf(entry), "w");
+    const bool written = file && file.write(body, len) == len;
+    if (file) file.close();
+    if (!written) contentFS->remove(pathOf(entry));
+    xSemaphoreGive(fsMutex);
+    return written;
+#else
+    entry.body = static_cast<uint8_t*>(allocBody(len));
+    if (entry.body == nullptr) return false;
+    memcpy(entry.body, body, len);
+    return true;
+#endif
+}
+
+static bool loadBody(const Entry& entry, contentfetch::Response& response) {
+    uint8_t* body = static_cast<uint8_t*>(allocBody(entry.len + 1));
+    if (body == nullptr) return false;
+#ifdef HAS_SDCARD
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    File file = contentFS->open(pathOf(entry), "r");
+    const bool read = file && file.read(body, entry.len) == entry.len;
+    if (file) file.close();
+    xSemaphoreGive(fsMutex);
+    if (!read) {
+        free(body);
+        return false;
+    }
+#else
+    memcpy(body, entry.body, entry.len);
+#endif
+    body[entry.len] = 0;
+    free(response.body);
+    response.body = body;
+    response.len = entry.len;
+    response.httpCode = 200;
+    return true;
+}
+
+static void dropLocked(std::map<String, Entry>::iterator it) {
+#ifdef HAS_SDCARD
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    contentFS->remove(pathOf(it->second));
+    xSemaphoreGive(fsMutex);
+#else
+    free(it->second.body);
+#endif
+    stats.entries--;
+    stats.bytes -= it->second.len;
+    entries.erase(it);
+}
+
+// makes room for a body of len bytes, dropping the least recently used entries
+static void evictLocked(const uint32_t len) {
+    while (!entries.empty() && (entries.size() >= HTTPCACHE_ENTRIES || stats.bytes + len > HTTPCACHE_BUDGET)) {
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->second.lastUse < oldest->second.lastUse) oldest = it;
+        }
+        dropLocked(oldest);
+    }
+}
+
+// "Sun, 06 Nov 1994 08:49:37 GMT"
+static time_t parseHttpDate(const String& value) {
+    static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    int day, year, hour, minute, second;
+    char month[4];
+    if (sscanf(value.c_str(), "%*[^,], %d %3s %d %d:%d:%d", &day, month, &year, &hour, &minute, &second) != 6) return 0;
+    const char* found = strstr(months, month);
+    if (found == nullptr || year < 1970) return 0;
+    int m = (found - months) / 3 + 1;
+
+    // days since 1970-01-01, from the civil date
+    int y = year - (m <= 2);
+    const int era = y / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const int64_t days = (int64_t)era * 146097 + doe - 719468;
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+// when a response stops being fresh, or -1 if it may not be stored
+static time_t expiryOf(const Headers& headers, const time_t now, const uint32_t ttl) {
+    String cacheControl = headers.cacheControl;
+    cacheControl.toLowerCase();
+    if (cacheControl.indexOf("no-store") >= 0) return -1;
+    if (cacheControl.indexOf("no-cache") >= 0) return now;
+    const int maxAge = cacheControl.indexOf("max-age=");
+    if (maxAge >= 0) return now + cacheControl.substring(maxAge + 8).toInt();
+    if (!headers.expires.isEmpty()) {
+        // relative to the server's clock, which need not match ours
+        const time_t expires = parseHttpDate(headers.expires);
+        time_t date = parseHttpDate(headers.date);
+        if (date == 0) date = now;
+        return (expires > date) ? now + (expires - date) : now;
+    }
+    return now + ttl;
+}
+
+String normalise(const String& url) {
+    int schemeEnd = url.indexOf("://");
+    if (schemeEnd < 0) return url;
+    String scheme = url.substring(0, schemeEnd);
+    scheme.toLowerCase();
+
+    String rest = url.substring(schemeEnd + 3);
+    const int fragment = rest.indexOf('#');
+    if (fragment >= 0) rest = rest.substring(0, fragment);
+
+    int pathStart = rest.indexOf('/');
+    if (pathStart < 0) pathStart = rest.length();
+    String host = rest.substring(0, pathStart);
+    host.toLowerCase();
+    if ((scheme == "http" && host.endsWith(":80")) || (scheme == "https" && host.endsWith(":443"))) {
+        host = host.substring(0, host.lastIndexOf(':'));
+    }
+
+    String path = rest.substring(pathStart);
+    if (path.isEmpty()) path = "/";
+    const int queryStart = path.indexOf('?');
+    if (queryStart < 0) return scheme + "://" + host + path;
+
+    std::vector<String> params;
+    String query = path.substring(queryStart + 1);
+    path = path.substring(0, queryStart);
+    int start = 0;
+    while (start <= (int)query.length()) {
+        int end = query.indexOf('&', start);
+        if (end < 0) end = query.length();
+        if (end > start) params.push_back(query.substring(start, end));
+        start = end + 1;
+    }
+    std::stable_sort(params.begin(), params.end(), [](const String& a, const String& b) {
+        return a.substring(0, a.indexOf('=')) < b.substring(0, b.indexOf('='));
+    });
+    String normalised = scheme + "://" + host + path;
+    for (size_t i = 0; i < params.size(); i++) {
+        normalised += (i == 0) ? "?" : "&";
+        normalised += params[i];
+    }
+    return normalised;
+}
+
+bool fresh(const String& key, const time_t at) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    const auto it = entries.find(key);
+    return it != entries.end() && it->second.expires > at;
+}
+
+bool get(const String& key, contentfetch::Response& response) {
+    time_t now;
+    time(&now);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    const auto it = entries.find(key);
+    if (it == entries.end() || it->second.expires <= now) return false;
+    if (!loadBody(it->second, response)) {
+        dropLocked(it);
+        return false;
+    }
+    response.fetched = now;
+    it->second.lastUse = ++useCounter;
+    stats.hits++;
+    stats.bytesSaved += it->second.len;
+    return true;
+}
+
+bool validators(const String& key, String& etag, String& lastModified) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    const auto it = entries.find(key);
+    if (it == entries.end()) return false;
+    etag = it->second.etag;
+    lastModified = it->second.lastModified;
+    return !etag.isEmpty() || !lastModified.isEmpty();
+}
+
+bool revalidated(const String& key, const Headers& headers, const uint32_t ttl, contentfetch::Response& response) {
+    time_t now;
+    time(&now);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    const auto it = entries.find(key);
+    if (it == entries.end() || !loadBody(it->second, response)) {
+        if (it != entries.end()) dropLocked(it);
+        return false;
+    }
+    const time_t expires = expiryOf(headers, now, ttl);
+    it->second.expires = (expires < 0) ? now : expires;
+    if (!headers.etag.isEmpty()) it->second.etag = headers.etag;
+    if (!headers.lastModified.isEmpty()) it->second.lastModified = headers.lastModified;
+    it->second.lastUse = ++useCounter;
+    stats.hits++;
+    stats.revalidated++;
+    stats.bytesSaved += it->second.len;
+    return true;
+}
+
+void put(const String& key, const contentfetch::Response& response, const Headers& headers, const uint32_t ttl) {
+    time_t now;
+    time(&now);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    stats.misses++;
+
+    const auto existing = entries.find(key);
+    if (existing != entries.end()) dropLocked(existing);
+
+    const time_t expires = expiryOf(headers, now, ttl);
+    const bool canRevalidate = !headers.etag.isEmpty() || !headers.lastModified.isEmpty();
+    if (response.httpCode != 200 || expires < 0 || (expires <= now && !canRevalidate)) return;
+    if (response.len == 0 || response.len > HTTPCACHE_BUDGET) return;
+
+    evictLocked(response.len);
+    Entry entry = {nullptr, 0, 0, expires, headers.etag, headers.lastModified, ++useCounter};
+    if (!storeBody(entry, response.body, response.len)) return;
+    entries[key] = entry;
+    stats.entries++;
+    stats.bytes += entry.len;
+}
+
+Stats getStats() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return stats;
+}
+
+}  // namespace httpcache
@@ -0,0 +1,389 @@
+#include "imagediff.h"
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include "commstructs.h"
+#include "makeimage.h"
+#include "miniz-oepl.h"
+#include "storage.h"
+#include "tag_db.h"
+
+#ifndef SAVE_SPACE
+#include "g5/Group5.h"
+#include "g5/g5dec.inl"
+#endif
+
+namespace imagediff {
+
+// [uint8_t header length][uint64_t base version][uint16_t x][uint16_t y][uint16_t w][uint16_t h][uint8_t planes][uint8_t payload type]
+static constexpr uint8_t DIFF_HEADER_SIZE = 19;
+
+struct Planes {
+    uint16_t bufw = 0;  // in buffer orientation, as the tag receives the rows
+    uint16_t bufh = 0;
+    uint8_t count = 0;
+    uint8_t* data = nullptr;
+
+    size_t planeSize() const { return (size_t)bufw / 8 * bufh; }
+    size_t size() const { return planeSize() * count; }
+    ~Planes() { free(data); }
+};
+
+struct BaseHeader {
+    uint64_t dataVer;
+    uint16_t bufw;
+    uint16_t bufh;
+    uint8_t count;
+} __attribute__((packed));
+
+static std::mutex statsMutex;
+static Stats stats = {0};
+
+static bool supportsDiff(const tagRecord* taginfo, HwType& hwdata) {
+    hwdata = getHwType(taginfo->hwType);
+    return hwdata.diff != 0 && taginfo->tagSoftwareVersion >= hwdata.diff && (hwdata.bpp == 1 || hwdata.bpp == 2);
+}
+
+static String basePath(const uint8_t mac[8]) {
+    char hexmac[17];
+    mac2hex(mac, hexmac);
+    return "/current/" + String(hexmac) + ".base";
+}
+
+// pending files are /current/<MAC>_<n>.pending, the planes and the delta go next to it
+static String companion(const String& filename, const char* suffix) {
+    const int dot = filename.indexOf('.');
+    if (!filename.startsWith("/current/") || dot < 0) return String();
+    return filename.substring(0, dot) + suffix;
+}
+
+static uint8_t* readAll(const String& filename, size_t& len) {
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    File file = contentFS->open(filename, "r");
+    uint8_t* ret = nullptr;
+    len = 0;
+    if (file) {
+        len = file.size();
+        ret = (uint8_t*)ps_malloc(len);
+        if (ret && file.read(ret, len) != len) {
+            free(ret);
+            ret = nullptr;
+        }
+        file.close();
+    }
+    xSemaphoreGive(fsMutex);
+    return ret;
+}
+
+static bool writeAll(const String& filename, const uint8_t* header, size_t headerLen, const uint8_t* data, size_t len) {
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    File file = contentFS->open(filename, "w");
+    bool ok = false;
+    if (file) {
+        ok = file.write(header, headerLen) == headerLen && file.write(data, len) == len;
+        file.close();
+        if (!ok) contentFS->remove(filename);
+    }
+    xSemaphoreGive(fsMutex);
+    return ok;
+}
+
+// unpacks a full image, as made by spr2buffer/drawBanded, into its planes
+static bool decodeImage(const uint8_t* file, size_t len, uint8_t dataType, const HwType& hwdata, Planes& planes) {
+    switch (dataType) {
+        case DATATYPE_IMG_RAW_1BPP:
+        case DATATYPE_IMG_RAW_2BPP: {
+            planes.bufw = (hwdata.rotatebuffer % 2) ? hwdata.height : hwdata.width;
+            planes.bufh = (hwdata.rotatebuffer % 2) ? hwdata.width : hwdata.height;
+            planes.count = (dataType == DATATYPE_IMG_RAW_2BPP) ? 2 : 1;
+            if (planes.bufw % 8 || len != planes.size()) return false;
+            planes.data = (uint8_t*)ps_malloc(len);
+            if (planes.data == nullptr) return false;
+            memcpy(planes.data, file, len);
+            return true;
+        }
+        case DATATYPE_IMG_ZLIB: {
+            // [uint32_t size][2 byte zlib header][deflate], the header was rewritten and is skipped
+            if (len < 6) return false;
+            uint32_t outLen;
+            memcpy(&outLen, file, sizeof(outLen));
+            if (outLen <= 6) return false;
+            // the decompressor is too big for the stack
+            Miniz::tinfl_decompressor* decomp = (Miniz::tinfl_decompressor*)malloc(sizeof(Miniz::tinfl_decompressor));
+            uint8_t* image = (uint8_t*)ps_malloc(outLen);
+            bool ok = decomp != nullptr && image != nullptr;
+            if (ok) {
+                tinfl_init(decomp);
+                size_t inBytes = len - 6, outBytes = outLen;
+                const Miniz::tinfl_status status = Miniz::tinfl_decompress(decomp, file + 6, &inBytes, image, image, &outBytes, Miniz::TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+                ok = status == Miniz::TINFL_STATUS_DONE && outBytes == outLen && image[0] >= 6 && outLen > image[0];
+            }
+            free(decomp);
+            if (ok) {
+                planes.bufw = image[1] | image[2] << 8;
+                planes.bufh = image[3] | image[4] << 8;
+                planes.count = image[5] & 0x0F;
+                ok = planes.bufw % 8 == 0 && (planes.count == 1 || planes.count == 2) && outLen - image[0] == planes.size();
+            }
+            if (ok) {
+                planes.data = (uint8_t*)ps_malloc(planes.size());
+                ok = planes.data != nullptr;
+                if (ok) memcpy(planes.data, image + image[0], planes.size());
+            }
+            free(image);
+            return ok;
+        }
+#ifndef SAVE_SPACE
+        case DATATYPE_IMG_G5: {
+            if (len <= 6) return false;
+            planes.bufw = file[1] | file[2] << 8;
+            planes.bufh = file[3] | file[4] << 8;
+            planes.count = file[5] & 0x0F;
+            if (planes.bufw % 8 || (planes.count != 1 && planes.count != 2)) return false;
+            G5DECIMAGE* g5dec = (G5DECIMAGE*)malloc(sizeof(G5DECIMAGE));
+            // a run up to the right edge touches the byte after the line
+            planes.data = (uint8_t*)ps_malloc(planes.size() + 1);
+            // the decoder reads 4 bytes at a time, don't let it run off the end
+            uint8_t* g5data = (uint8_t*)ps_malloc(len - 6 + 4);
+            int rc = G5_NOT_INITIALIZED;
+            if (g5dec && planes.data && g5data) {
+                memcpy(g5data, file + 6, len - 6);
+                memset(g5data + len - 6, 0, 4);
+                // two planes are one image of double height
+                rc = g5_decode_init(g5dec, planes.bufw, planes.bufh * planes.count, g5data, len - 6);
+            }
+            const size_t lineBytes = planes.bufw / 8;
+            for (size_t y = 0; y < (size_t)planes.bufh * planes.count && rc == G5_SUCCESS; y++) {
+                rc = g5_decode_line(g5dec, planes.data + y * lineBytes);
+            }
+            free(g5data);
+            free(g5dec);
+            return rc == G5_DECODE_COMPLETE;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+static bool loadBase(const uint8_t mac[8], Planes& base, uint64_t& baseVer) {
+    size_t len;
+    uint8_t* file = readAll(basePath(mac), len);
+    if (file == nullptr) return false;
+    BaseHeader header;
+    bool ok = len >= sizeof(header);
+    if (ok) {
+        memcpy(&header, file, sizeof(header));
+        base.bufw = header.bufw;
+        base.bufh = header.bufh;
+        base.count = header.count;
+        baseVer = header.dataVer;
+        ok = len == sizeof(header) + base.size();
+    }
+    if (ok) {
+        base.data = (uint8_t*)ps_malloc(base.size());
+        ok = base.data != nullptr;
+        if (ok) memcpy(base.data, file + sizeof(header), base.size());
+    }
+    free(file);
+    return ok;
+}
+
+// compresses the changed rectangle like a full image, in the best format the tag can take
+static uint8_t* encodePayload(const tagRecord* taginfo, const HwType& hwdata, uint8_t* rect, uint16_t w, uint16_t h, uint8_t count, size_t& outLen, uint8_t& payloadType) {
+    const size_t rectSize = (size_t)w / 8 * h * count;
+    if (hwdata.zlib != 0 && taginfo->tagSoftwareVersion >= hwdata.zlib) {
+        const uint8_t header[6] = {6, (uint8_t)(w & 0xFF), (uint8_t)(w >> 8), (uint8_t)(h & 0xFF), (uint8_t)(h >> 8), count};
+        Miniz::tdefl_compressor* comp = (Miniz::tdefl_compressor*)malloc(sizeof(Miniz::tdefl_compressor));
+        const size_t outSize = rectSize + rectSize / 8 + 64;
+        uint8_t* out = (uint8_t*)ps_malloc(outSize);
+        bool ok = comp && out && Miniz::tdefl_initOEPL(comp, NULL, NULL, Miniz::TDEFL_WRITE_ZLIB_HEADER | 1500) == Miniz::TDEFL_STATUS_OKAY;
+        size_t pos = 4;
+        if (ok) {
+            size_t inLen = sizeof(header), chunk = outSize - pos;
+            ok = Miniz::tdefl_compressOEPL(comp, header, &inLen, out + pos, &chunk, Miniz::TDEFL_NO_FLUSH) == Miniz::TDEFL_STATUS_OKAY;
+            pos += chunk;
+            inLen = rectSize;
+            chunk = outSize - pos;
+            ok = ok && Miniz::tdefl_compressOEPL(comp, rect, &inLen, out + pos, &chunk, Miniz::TDEFL_FINISH) == Miniz::TDEFL_STATUS_DONE;
+            pos += chunk;
+        }
+        free(comp);
+        if (ok) {
+            const uint32_t total = rectSize + sizeof(header);
+            memcpy(out, &total, sizeof(total));
+            // same zlib header as rewriteHeader() puts in full images: 4k window
+            out[4] = 0x48;
+            out[5] = 0xC7;
+            outLen = pos;
+            payloadType = DATATYPE_IMG_ZLIB;
+            return out;
+        }
+        free(out);
+    }
+#ifndef SAVE_SPACE
+    if (hwdata.g5 != 0 && taginfo->tagSoftwareVersion >= hwdata.g5 && rectSize <= UINT16_MAX) {
+        uint16_t g5Size = 0;
+        uint8_t* g5 = g5Compress(w, h * count, rect, rectSize, g5Size);
+        if (g5) {
+            uint8_t* out = (uint8_t*)ps_malloc(g5Size + 6);
+            if (out) {
+                const uint8_t header[6] = {6, (uint8_t)(w & 0xFF), (uint8_t)(w >> 8), (uint8_t)(h & 0xFF), (uint8_t)(h >> 8), count};
+                memcpy(out, header, sizeof(header));
+                memcpy(out + sizeof(header), g5, g5Size);
+                outLen = g5Size + sizeof(header);
+                payloadType = DATATYPE_IMG_G5;
+            }
+            free(g5);
+            if (out) return out;
+        }
+    }
+#endif
+    uint8_t* out = (uint8_t*)ps_malloc(rectSize);
+    if (out == nullptr) return nullptr;
+    memcpy(out, rect, rectSize);
+    outLen = rectSize;
+    payloadType = (count == 2) ? DATATYPE_IMG_RAW_2BPP : DATATYPE_IMG_RAW_1BPP;
+    return out;
+}
+
+static String writeDelta(const tagRecord* taginfo, const HwType& hwdata, const Planes& image, const Planes& base, uint64_t baseVer, const String& filename, size_t fullSize, uint32_t& deltaSize) {
+    // bounding rectangle of the changed bytes, over all planes
+    const size_t lineBytes = image.bufw / 8;
+    size_t x0 = lineBytes, x1 = 0, y0 = image.bufh, y1 = 0;
+    for (uint8_t p = 0; p < image.count; p++) {
+        const uint8_t* a = image.data + p * image.planeSize();
+        const uint8_t* b = base.data + p * base.planeSize();
+        for (size_t y = 0; y < image.bufh; y++) {
+            for (size_t x = 0; x < lineBytes; x++) {
+                if (a[y * lineBytes + x] != b[y * lineBytes + x]) {
+                    x0 = std::min(x0, x);
+                    x1 = std::max(x1, x + 1);
+                    y0 = std::min(y0, y);
+                    y1 = std::max(y1, y + 1);
+                }
+            }
+        }
+    }
+    // nothing changed in the pixels, the full image is small enough then
+    if (x0 >= x1) return String();
+
+    const uint16_t w = (x1 - x0) * 8, h = y1 - y0;
+    const size_t rectLine = x1 - x0;
+    // one spare byte, the G5 encoder reads one past the end of the last line
+    uint8_t* rect = (uint8_t*)ps_malloc(rectLine * h * image.count + 1);
+    if (rect == nullptr) return String();
+    uint8_t* out = rect;
+    for (uint8_t p = 0; p < image.count; p++) {
+        for (size_t y = y0; y < y1; y++) {
+            const size_t offset = p * image.planeSize() + y * lineBytes + x0;
+            for (size_t x = 0; x < rectLine; x++) *out++ = image.data[offset + x] ^ base.data[offset + x];
+        }
+    }
+
+    size_t payloadLen = 0;
+    uint8_t payloadType = 0;
+    uint8_t* payload = encodePayload(taginfo, hwdata, rect, w, h, image.count, payloadLen, payloadType);
+    free(rect);
+    if (payload == nullptr) return String();
+
+    String deltaFile;
+    if (payloadLen + DIFF_HEADER_SIZE < fullSize) {
+        uint8_t header[DIFF_HEADER_SIZE];
+        const uint16_t x = x0 * 8, y = y0;
+        header[0] = DIFF_HEADER_SIZE;
+        memcpy(header + 1, &baseVer, sizeof(uint64_t));
+        memcpy(header + 9, &x, sizeof(uint16_t));
+        memcpy(header + 11, &y, sizeof(uint16_t));
+        memcpy(header + 13, &w, sizeof(uint16_t));
+        memcpy(header + 15, &h, sizeof(uint16_t));
+        header[17] = image.count;
+        header[18] = payloadType;
+        deltaFile = companion(filename, ".diff.pending");
+        if (writeAll(deltaFile, header, sizeof(header), payload, payloadLen)) {
+            deltaSize = payloadLen + DIFF_HEADER_SIZE;
+        } else {
+            deltaFile = String();
+        }
+    }
+    free(payload);
+    return deltaFile;
+}
+
+String prepare(const tagRecord* taginfo, const String& filename, uint8_t dataType, uint64_t dataVer, uint32_t& deltaSize) {
+#ifdef BOARD_HAS_PSRAM
+    HwType hwdata;
+    if (!supportsDiff(taginfo, hwdata) || companion(filename, "").isEmpty()) return String();
+
+    size_t fullSize;
+    uint8_t* file = readAll(filename, fullSize);
+    if (file == nullptr) return String();
+    Planes image;
+    const bool decoded = decodeImage(file, fullSize, dataType, hwdata, image);
+    free(file);
+    if (!decoded) {
+        Serial.printf("imagediff: can't unpack image type 0x%02X\r\n", dataType);
+        return String();
+    }
+
+    // the planes become the base once the tag has this image
+    BaseHeader header = {dataVer, image.bufw, image.bufh, image.count};
+    writeAll(companion(filename, ".base.pending"), reinterpret_cast<uint8_t*>(&header), sizeof(header), image.data, image.size());
+
+    // only a delta against the image the tag is known to show, in the same layout
+    Planes base;
+    uint64_t baseVer = 0;
+    String deltaFile;
+    if (loadBase(taginfo->mac, base, baseVer) && memcmp(&baseVer, taginfo->md5, sizeof(uint64_t)) == 0 &&
+        base.bufw == image.bufw && base.bufh == image.bufh && base.count == image.count) {
+        deltaFile = writeDelta(taginfo, hwdata, image, base, baseVer, filename, fullSize, deltaSize);
+    }
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (deltaFile.isEmpty()) {
+        stats.fallbacks++;
+    } else {
+        stats.deltas++;
+        stats.fullBytes += fullSize;
+        stats.deltaBytes += deltaSize;
+        Serial.println("imagediff: sending " + String(deltaSize) + " bytes instead of " + String(fullSize));
+    }
+    return deltaFile;
+#else
+    return String();
+#endif
+}
+
+String xferComplete(const uint8_t mac[8], const String& filename) {
+    const String pendingBase = companion(filename, ".base.pending");
+    if (pendingBase.isEmpty()) return filename;
+    // mirrors get the file of the tag they mirror, its planes stay with that tag
+    char hexmac[17];
+    mac2hex(mac, hexmac);
+    if (!filename.startsWith("/current/" + String(hexmac) + "_")) return filename;
+
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    const String base = basePath(mac);
+    // a base that doesn't belong to the image on the tag is of no use anymore
+    if (contentFS->exists(base)) contentFS->remove(base);
+    if (contentFS->exists(pendingBase)) contentFS->rename(pendingBase, base);
+
+    String delivered = filename;
+    if (filename.endsWith(".diff.pending")) {
+        contentFS->remove(filename);
+        delivered = companion(filename, ".pending");
+    }
+    xSemaphoreGive(fsMutex);
+    return delivered;
+}
+
+Stats getStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
+
+}  // namespace imagediff
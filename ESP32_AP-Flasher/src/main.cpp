@@ -6,6 +6,7 @@
 #include <ETH.h>
 #endif
 
+#include "contentfetch.h"
 #include "contentmanager.h"
 #include "flasher.h"
 #include "serialap.h"
@@ -95,6 +96,7 @@ void setup() {
 #endif
 
     Storage.begin();
+    initLog();
 
     /*
     Serial.println("\n\n##################################");
@@ -140,14 +142,29 @@ void setup() {
     TagData::loadParsers("/parsers.json");
 #endif
 
-    if (!loadDB("/current/tagDB.json")) {
-        Serial.println("unable to load tagDB, reverting to backup");
-        loadDB("/current/tagDB.json.bak");
-    } else {
-        cleanupCurrent();
+    switch (loadDBbin("/current/tagDB.bin")) {
+        case DBBIN_LOADED:
+            cleanupCurrent();
+            break;
+        case DBBIN_MISSING:
+            // first boot after an upgrade, import the json database
+            if (!loadDB("/current/tagDB.json")) {
+                Serial.println("unable to load tagDB, reverting to backup");
+                loadDB("/current/tagDB.json.bak");
+            } else {
+                cleanupCurrent();
+            }
+            saveDBbin("/current/tagDB.bin");
+            break;
+        case DBBIN_DAMAGED:
+            // loadDBbin logged it and restored the last good copy if there was one. The json
+            // file is older than that, importing it would bring back stale tags
+            cleanupCurrent();
+            break;
     }
     xTaskCreate(APTask, "AP Process", 6000, NULL, 5, NULL);
     vTaskDelay(10 / portTICK_PERIOD_MS);
+    contentfetch::begin();
 
 #ifdef HAS_BLE_WRITER
     if (config.ble) {
@@ -194,7 +211,7 @@ void loop() {
         checkVars();
     }
     if (intervalSaveDB.doRun() && config.runStatus != RUNSTATUS_STOP) {
-        saveDB("/current/tagDB.json");
+        saveDBbin("/current/tagDB.bin");
     }
     if (intervalContentRunner.doRun() && (apInfo.state == AP_STATE_ONLINE || apInfo.state == AP_STATE_NORADIO)) {
         contentRunner();
@@ -114,177 +114,417 @@ std::tuple<int, int, float, float> findClosestColors(const Color &pixel, const s
     return { closestIndex, secondClosestIndex, closestDist, secondClosestDist};
 }
 
-void spr2color(TFT_eSprite &spr, imgParam &imageParams, uint8_t *buffer, size_t buffer_size, bool is_red) {
-    uint8_t rotate = imageParams.rotate;
-    long bufw = spr.width(), bufh = spr.height();
+// Nearest palette entries per raw sprite pixel. An entry holds the nearest color for dither 0 in bits 0-3,
+// the two closest colors and the ordered dithering level for dither 2 in bits 4-14, and LUT_VALID.
+// Entries are filled on first use and kept between renders while palette and sprite depth stay the same.
+#define LUT_VALID 0x8000
+
+struct PaletteLut {
+    std::vector<Color> palette;
+    int num_colors = 0;
+    uint16_t *entries = nullptr;
+    size_t size = 0;
+};
+
+static PaletteLut paletteLut;
+
+static bool samePalette(const std::vector<Color> &a, const std::vector<Color> &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].r != b[i].r || a[i].g != b[i].g || a[i].b != b[i].b) return false;
+    }
+    return true;
+}
+
+// one entry per possible pixel value, only for sprites we read directly
+static uint16_t *getPaletteLut(const std::vector<Color> &palette, int num_colors, uint8_t depth) {
+    const size_t size = (depth == 16) ? 65536 : (depth == 8) ? 256 : 0;
+    if (size == 0) return nullptr;
+    if (paletteLut.size == size && paletteLut.num_colors == num_colors && samePalette(paletteLut.palette, palette)) {
+        return paletteLut.entries;
+    }
+    if (paletteLut.size != size) {
+        free(paletteLut.entries);
+#ifdef BOARD_HAS_PSRAM
+        paletteLut.entries = (uint16_t *)ps_malloc(size * sizeof(uint16_t));
+#else
+        paletteLut.entries = (uint16_t *)malloc(size * sizeof(uint16_t));
+#endif
+        paletteLut.size = paletteLut.entries ? size : 0;
+        if (!paletteLut.entries) return nullptr;
+    }
+    memset(paletteLut.entries, 0, size * sizeof(uint16_t));
+    paletteLut.palette = palette;
+    paletteLut.num_colors = num_colors;
+    return paletteLut.entries;
+}
+
+// raw sprite pixel to color, the same conversion readPixel does
+static inline Color keyToColor(uint16_t key, uint8_t depth) {
+    if (depth == 16) return Color((uint16_t)((key >> 8) | (key << 8)));
+    if (depth == 8) {
+        static const uint8_t blue[] = {0, 11, 21, 31};
+        return Color((uint16_t)((key & 0xE0) << 8 | (key & 0xC0) << 5 | (key & 0x1C) << 6 | (key & 0x1C) << 3 | blue[key & 0x03]));
+    }
+    return Color(key);
+}
+
+static uint16_t lutEntry(const Color &color, const std::vector<Color> &palette, int num_colors) {
+    int nearest = 0;
+    uint32_t best_color_distance = colorDistance(color, palette[0], (Error){0, 0, 0});
+    for (int i = 1; i < num_colors; i++) {
+        if (best_color_distance == 0) break;
+        uint32_t distance = colorDistance(color, palette[i], (Error){0, 0, 0});
+        if (distance < best_color_distance) {
+            best_color_distance = distance;
+            nearest = i;
+        }
+    }
+
+    auto [c1Index, c2Index, distC1, distC2] = findClosestColors(color, palette);
+    if (c1Index < 0) c1Index = 0;
+    if (c2Index < 0) c2Index = c1Index;
+    float weight = distC1 / (distC1 + distC2);
+    uint8_t level = 4;
+    if (weight <= 0.03) {
+        level = 0;
+    } else if (weight < 0.30) {
+        level = 1;
+    } else if (weight < 0.70) {
+        level = 2;
+    } else if (weight < 0.97) {
+        level = 3;
+    }
+    return LUT_VALID | level << 12 | c2Index << 8 | c1Index << 4 | nearest;
+}
+
+// fills one row of the output image with raw sprite pixels, rotation is resolved here.
+// img holds the part of the sprite that starts at (ox, oy), which is the whole sprite unless rendering in bands
+template <typename T>
+static void readRowDirect(const T *img, long stride, long ox, long oy, uint8_t rotate, uint16_t y, long bufw, long bufh, uint16_t *keys) {
+    long sx, sy, step;
+    switch (rotate) {
+        case 0:
+            sx = 0;
+            sy = y;
+            step = 1;
+            break;
+        case 1:
+            sx = y;
+            sy = bufw - 1;
+            step = -stride;
+            break;
+        case 2:
+            sx = bufw - 1;
+            sy = bufh - 1 - y;
+            step = -1;
+            break;
+        default:
+            sx = bufh - 1 - y;
+            sy = 0;
+            step = stride;
+            break;
+    }
+    const T *p = img + (sy - oy) * stride + (sx - ox);
+    for (long x = 0; x < bufw; x++, p += step) keys[x] = *p;
+}
+
+static void readRow(TFT_eSprite &spr, uint8_t depth, uint8_t rotate, uint16_t y, long bufw, long bufh, uint16_t *keys) {
+    if (depth == 16) {
+        readRowDirect((const uint16_t *)spr.getPointer(), spr.width(), 0, 0, rotate, y, bufw, bufh, keys);
+    } else if (depth == 8) {
+        readRowDirect((const uint8_t *)spr.getPointer(), spr.width(), 0, 0, rotate, y, bufw, bufh, keys);
+    } else {
+        // packed sprite, or the rotated image doesn't match the sprite, leave it to the library
+        switch (rotate) {
+            case 0:
+                for (long x = 0; x < bufw; x++) keys[x] = spr.readPixel(x, y);
+                break;
+            case 1:
+                for (long x = 0; x < bufw; x++) keys[x] = spr.readPixel(y, bufw - 1 - x);
+                break;
+            case 2:
+                for (long x = 0; x < bufw; x++) keys[x] = spr.readPixel(bufw - 1 - x, bufh - 1 - y);
+                break;
+            case 3:
+                for (long x = 0; x < bufw; x++) keys[x] = spr.readPixel(bufh - 1 - y, x);
+                break;
+        }
+    }
+}
+
+static inline bool isGray(const Color &c) {
+    return abs(c.r - c.g) < 20 && abs(c.b - c.g) < 20;
+}
+
+static inline bool isColorful(const Color &c) {
+    return abs(c.r - c.g) > 20 || abs(c.b - c.g) > 20;
+}
+
+// Burkes error diffusion for one row, in integers. Distances are colorDistance scaled by 100.
+static void ditherRow(const uint16_t *keys, uint8_t depth, long bufw, const std::vector<Color> &palette, int num_colors, uint16_t colorfulMask, Error *error_bufferold, Error *error_buffernew, uint8_t *rowIdx) {
+    for (long x = 0; x < bufw; x++) {
+        const Color color = keyToColor(keys[x], depth);
+        const Error &e = error_bufferold[x];
+        const int32_t r = color.r + e.r, g = color.g + e.g, b = color.b + e.b;
+        // don't select color pixels on black and white
+        const uint16_t skip = isGray(color) ? colorfulMask : 0;
+
+        int best_color_index = 0;
+        uint32_t best_color_distance = UINT32_MAX;
+        for (int i = 0; i < num_colors; i++) {
+            uint32_t distance = UINT32_MAX;
+            if (!(skip & (1 << i))) {
+                const int32_t r_diff = r - palette[i].r, g_diff = g - palette[i].g, b_diff = b - palette[i].b;
+                distance = (300 * r_diff * r_diff + 547 * g_diff * g_diff + 153 * b_diff * b_diff) / 100;
+            }
+            if (i == 0 || distance < best_color_distance) {
+                best_color_distance = distance;
+                best_color_index = i;
+            }
+            if (best_color_distance == 0) break;
+        }
+        rowIdx[x] = best_color_index;
+
+        Error error = {r - palette[best_color_index].r, g - palette[best_color_index].g, b - palette[best_color_index].b};
+        const int32_t maxError = std::max(std::abs(error.r), std::max(std::abs(error.g), std::abs(error.b)));
+        if (maxError > 255) {
+            error.r = error.r * 255 / maxError;
+            error.g = error.g * 255 / maxError;
+            error.b = error.b * 255 / maxError;
+        }
+        const Error e4 = {error.r / 4, error.g / 4, error.b / 4};
+        const Error e8 = {error.r / 8, error.g / 8, error.b / 8};
+        const Error e16 = {error.r / 16, error.g / 16, error.b / 16};
+
+        error_buffernew[x].r += e4.r;
+        error_buffernew[x].g += e4.g;
+        error_buffernew[x].b += e4.b;
+        if (x > 0) {
+            error_buffernew[x - 1].r += e8.r;
+            error_buffernew[x - 1].g += e8.g;
+            error_buffernew[x - 1].b += e8.b;
+        }
+        if (x > 1) {
+            error_buffernew[x - 2].r += e16.r;
+            error_buffernew[x - 2].g += e16.g;
+            error_buffernew[x - 2].b += e16.b;
+        }
+        error_buffernew[x + 1].r += e8.r;
+        error_buffernew[x + 1].g += e8.g;
+        error_buffernew[x + 1].b += e8.b;
+        error_bufferold[x + 1].r += e4.r;
+        error_bufferold[x + 1].g += e4.g;
+        error_bufferold[x + 1].b += e4.b;
+        error_buffernew[x + 2].r += e16.r;
+        error_buffernew[x + 2].g += e16.g;
+        error_buffernew[x + 2].b += e16.b;
+        error_bufferold[x + 2].r += e8.r;
+        error_bufferold[x + 2].g += e8.g;
+        error_bufferold[x + 2].b += e8.b;
+    }
+}
+
+// bit planes for 1 and 2 bpp, planeMask has a bit set for each palette index that sets a pixel
+static void packPlaneRow(const uint8_t *rowIdx, uint16_t y, long bufw, uint16_t planeMask, uint8_t *buffer, bool &hasRed) {
+    const size_t rowStart = (size_t)y * bufw;
+    uint8_t reds = 0;
+    if (rowStart % 8 == 0) {
+        uint8_t *out = buffer + rowStart / 8;
+        long x = 0;
+        for (; x + 8 <= bufw; x += 8) {
+            uint8_t byte = 0;
+            for (uint8_t i = 0; i < 8; i++) {
+                const uint8_t idx = rowIdx[x + i];
+                byte = byte << 1 | ((planeMask >> idx) & 1);
+                reds |= idx == 2 || idx == 3;
+            }
+            *out++ |= byte;
+        }
+        for (; x < bufw; x++) {
+            const uint8_t idx = rowIdx[x];
+            if ((planeMask >> idx) & 1) *out |= 1 << (7 - (x % 8));
+            reds |= idx == 2 || idx == 3;
+        }
+    } else {
+        // rows don't start on a byte, keep the bit position of the original conversion
+        for (long x = 0; x < bufw; x++) {
+            const uint8_t idx = rowIdx[x];
+            if ((planeMask >> idx) & 1) buffer[(rowStart + x) / 8] |= 1 << (7 - (x % 8));
+            reds |= idx == 2 || idx == 3;
+        }
+    }
+    if (reds) hasRed = true;
+}
+
+static void pack4bppRow(const uint8_t *rowIdx, uint16_t y, long bufw, uint8_t *buffer) {
+    size_t nibble = (size_t)y * bufw;
+    for (long x = 0; x < bufw; x++, nibble++) {
+        buffer[nibble / 2] |= (nibble % 2) ? rowIdx[x] : rowIdx[x] << 4;
+    }
+}
 
+static void pack3bppRow(const uint8_t *rowIdx, uint16_t y, long bufw, uint8_t *buffer) {
+    size_t bitOffset = (size_t)y * bufw * 3;
+    for (long x = 0; x < bufw; x++, bitOffset += 3) {
+        const size_t byteIndex = bitOffset / 8;
+        const uint8_t bitIndex = bitOffset % 8;
+        if (bitIndex <= 5) {
+            buffer[byteIndex] |= rowIdx[x] << (5 - bitIndex);
+        } else {
+            buffer[byteIndex] |= rowIdx[x] >> (bitIndex - 5);
+            buffer[byteIndex + 1] |= rowIdx[x] << (13 - bitIndex);
+        }
+    }
+}
+
+static void packRow(uint8_t bpp, const uint8_t *rowIdx, uint16_t y, long bufw, uint16_t planeMask, uint8_t *buffer, bool &hasRed) {
+    switch (bpp) {
+        case 3:
+            pack3bppRow(rowIdx, y, bufw, buffer);
+            break;
+        case 4:
+            pack4bppRow(rowIdx, y, bufw, buffer);
+            break;
+        default:
+            packPlaneRow(rowIdx, y, bufw, planeMask, buffer, hasRed);
+            break;
+    }
+}
+
+// rotation from sprite to output buffer, and the size of the output buffer
+static uint8_t outputRotation(const imgParam &imageParams, long sprw, long sprh, long &bufw, long &bufh) {
+    uint8_t rotate = imageParams.rotate;
+    bufw = sprw;
+    bufh = sprh;
     if (imageParams.rotatebuffer % 2) {
         // turn the image 90 or 270
         rotate = (rotate + 3) % 4;
         rotate = (rotate + (imageParams.rotatebuffer - 1)) % 4;
-        bufw = spr.height();
-        bufh = spr.width();
+        bufw = sprh;
+        bufh = sprw;
     } else {
         // rotate 180
         rotate = (rotate + (imageParams.rotatebuffer)) % 4;
     }
+    return rotate;
+}
 
-    memset(buffer, 0, buffer_size);
+// palette indices for the output image, one row at a time from top to bottom. Dithering state is carried
+// from row to row, so an image can be converted in several parts.
+class RowConverter {
+   public:
+    uint16_t *keys;
+    uint8_t *rowIdx;
+
+    RowConverter(const imgParam &imageParams, long bufw, uint8_t depth, bool useLut = true) : bufw(bufw), depth(depth), dither(imageParams.dither) {
+        palette = imageParams.hwdata.colortable;
+        if (imageParams.invert == 1) {
+            std::swap(palette[0], palette[1]);
+        }
+        num_colors = palette.size();
+        if (imageParams.bufferbpp == 1) num_colors = 2;
 
-    std::vector<Color> palette = imageParams.hwdata.colortable;
-    if (imageParams.invert == 1) {
-        std::swap(palette[0], palette[1]);
-    }
-    Color color;
-    int num_colors = palette.size();
-    if (imageParams.bufferbpp == 1) num_colors = 2;
-    Error *error_bufferold = new Error[bufw + 4];
-    Error *error_buffernew = new Error[bufw + 4];
+        if (useLut && (dither == 0 || dither == 2)) lut = getPaletteLut(palette, num_colors, depth);
+        for (int i = 0; i < num_colors && i < 16; i++) {
+            if (isColorful(palette[i])) colorfulMask |= 1 << i;
+        }
 
-    size_t bitOffset = 0;
+        keys = new uint16_t[bufw];
+        rowIdx = new uint8_t[bufw];
+        if (dither == 1) {
+            error_bufferold = new Error[bufw + 4];
+            error_buffernew = new Error[bufw + 4];
+            memset(error_bufferold, 0, (bufw + 4) * sizeof(Error));
+        }
+    }
 
-    memset(error_bufferold, 0, bufw * sizeof(Error));
-    for (uint16_t y = 0; y < bufh; y++) {
-        memset(error_buffernew, 0, bufw * sizeof(Error));
-        for (uint16_t x = 0; x < bufw; x++) {
-            switch (rotate) {
-                case 0:
-                    color = Color(spr.readPixel(x, y));
-                    break;
-                case 1:
-                    color = Color(spr.readPixel(y, bufw - 1 - x));
-                    break;
-                case 2:
-                    color = Color(spr.readPixel(bufw - 1 - x, bufh - 1 - y));
-                    break;
-                case 3:
-                    color = Color(spr.readPixel(bufh - 1 - y, x));
-                    break;
-            }
+    ~RowConverter() {
+        delete[] error_buffernew;
+        delete[] error_bufferold;
+        delete[] rowIdx;
+        delete[] keys;
+    }
 
-            int best_color_index = 0;
-            if (imageParams.dither == 2) {
-                // special ordered dithering
-                auto [c1Index, c2Index, distC1, distC2] = findClosestColors(color, palette);
-                Color c1 = palette[c1Index];
-                Color c2 = palette[c2Index];
-                float weight = distC1 / (distC1 + distC2);
-                if (weight <= 0.03) {
-                    best_color_index = c1Index;
-                } else if (weight < 0.30) {
-                    best_color_index = ((y % 2 && ((y / 2 + x) % 2)) ? c2Index : c1Index);
-                } else if (weight < 0.70) {
-                    best_color_index = ((x + y) % 2 ? c2Index : c1Index);
-                } else if (weight < 0.97) {
-                    best_color_index = ((y % 2 && ((y / 2 + x) % 2)) % 2 ? c1Index : c2Index);
+    // keys holds the raw pixels of row y, rowIdx gets the palette indices
+    void convert(uint16_t y) {
+        if (dither == 1) {
+            memset(error_buffernew, 0, (bufw + 4) * sizeof(Error));
+            ditherRow(keys, depth, bufw, palette, num_colors, colorfulMask, error_bufferold, error_buffernew, rowIdx);
+            memcpy(error_bufferold, error_buffernew, bufw * sizeof(Error));
+        } else if (dither == 0 || dither == 2) {
+            for (long x = 0; x < bufw; x++) {
+                const uint16_t key = keys[x];
+                uint16_t entry;
+                if (lut) {
+                    entry = lut[key];
+                    if (!(entry & LUT_VALID)) entry = lut[key] = lutEntry(keyToColor(key, depth), palette, num_colors);
                 } else {
-                    best_color_index = c2Index;
+                    if (!(lastEntry & LUT_VALID) || key != lastKey) lastEntry = lutEntry(keyToColor(key, depth), palette, num_colors);
+                    lastKey = key;
+                    entry = lastEntry;
                 }
-            }
-
-            if (imageParams.dither == 1 || imageParams.dither == 0) {
-                uint32_t best_color_distance = colorDistance(color, palette[0], error_bufferold[x]);
-
-                for (int i = 1; i < num_colors; i++) {
-                    if (best_color_distance == 0) break;
-                    uint32_t distance = colorDistance(color, palette[i], error_bufferold[x]);
-                    if (distance < best_color_distance) {
-                        best_color_distance = distance;
-                        best_color_index = i;
-                    }
-                }
-            }
-
-            if (imageParams.bpp == 3 || imageParams.bpp == 4) {
-                size_t byteIndex = bitOffset / 8;
-                uint8_t bitIndex = bitOffset % 8;
-
-                if (bitIndex + imageParams.bpp <= 8) {
-                    buffer[byteIndex] |= best_color_index << (8 - bitIndex - imageParams.bpp);
-                } else {
-                    uint8_t highPart = best_color_index >> (bitIndex + imageParams.bpp - 8);
-                    uint8_t lowPart = best_color_index & ((1 << (bitIndex + imageParams.bpp - 8)) - 1);
-                    buffer[byteIndex] |= highPart;
-                    buffer[byteIndex + 1] |= lowPart << (8 - (bitIndex + imageParams.bpp - 8));
+                if (dither == 0) {
+                    rowIdx[x] = entry & 0x0F;
+                    continue;
                 }
-                bitOffset += imageParams.bpp;
-            } else {
-                uint8_t bitIndex = 7 - (x % 8);
-                uint32_t byteIndex = (y * bufw + x) / 8;
-
-                // this looks a bit ugly, but it's performing better than shorter notations
-                switch (best_color_index) {
+                // special ordered dithering
+                const uint8_t c1Index = (entry >> 4) & 0x0F, c2Index = (entry >> 8) & 0x0F;
+                switch ((entry >> 12) & 0x07) {
+                    case 0:
+                        rowIdx[x] = c1Index;
+                        break;
                     case 1:
-                        if (!is_red)
-                            buffer[byteIndex] |= (1 << bitIndex);
+                        rowIdx[x] = (y % 2 && ((y / 2 + x) % 2)) ? c2Index : c1Index;
                         break;
                     case 2:
-                        imageParams.hasRed = true;
-                        if (is_red)
-                            buffer[byteIndex] |= (1 << bitIndex);
+                        rowIdx[x] = (x + y) % 2 ? c2Index : c1Index;
                         break;
                     case 3:
-                        imageParams.hasRed = true;
-                        buffer[byteIndex] |= (1 << bitIndex);
+                        rowIdx[x] = (y % 2 && ((y / 2 + x) % 2)) ? c1Index : c2Index;
+                        break;
+                    default:
+                        rowIdx[x] = c2Index;
                         break;
                 }
             }
+        } else {
+            memset(rowIdx, 0, bufw);
+        }
+    }
 
-            if (imageParams.dither == 1) {
-                // Burkes Dithering
-
-                Error error = {
-                    color.r + error_bufferold[x].r - palette[best_color_index].r,
-                    color.g + error_bufferold[x].g - palette[best_color_index].g,
-                    color.b + error_bufferold[x].b - palette[best_color_index].b};
-
-                float scaling_factor = 255.0f / std::max(std::abs(error.r), std::max(std::abs(error.g), std::abs(error.b)));
-                if (scaling_factor < 1.0f) {
-                    error.r *= scaling_factor;
-                    error.g *= scaling_factor;
-                    error.b *= scaling_factor;
-                }
-
-                error_buffernew[x].r += error.r / 4;
-                error_buffernew[x].g += error.g / 4;
-                error_buffernew[x].b += error.b / 4;
-
-                if (x > 0) {
-                    error_buffernew[x - 1].r += error.r / 8;
-                    error_buffernew[x - 1].g += error.g / 8;
-                    error_buffernew[x - 1].b += error.b / 8;
-                }
-
-                if (x > 1) {
-                    error_buffernew[x - 2].r += error.r / 16;
-                    error_buffernew[x - 2].g += error.g / 16;
-                    error_buffernew[x - 2].b += error.b / 16;
-                }
+    int colors() const { return num_colors; }
+
+   private:
+    long bufw;
+    uint8_t depth;
+    uint8_t dither;
+    std::vector<Color> palette;
+    int num_colors;
+    uint16_t *lut = nullptr;
+    uint16_t lastKey = 0, lastEntry = 0;
+    uint16_t colorfulMask = 0;
+    Error *error_bufferold = nullptr;
+    Error *error_buffernew = nullptr;
+};
 
-                error_buffernew[x + 1].r += error.r / 8;
-                error_buffernew[x + 1].g += error.g / 8;
-                error_buffernew[x + 1].b += error.b / 8;
+void spr2color(TFT_eSprite &spr, imgParam &imageParams, uint8_t *buffer, size_t buffer_size, bool is_red) {
+    long bufw, bufh;
+    const uint8_t rotate = outputRotation(imageParams, spr.width(), spr.height(), bufw, bufh);
 
-                error_bufferold[x + 1].r += error.r / 4;
-                error_bufferold[x + 1].g += error.g / 4;
-                error_bufferold[x + 1].b += error.b / 4;
+    memset(buffer, 0, buffer_size);
 
-                error_buffernew[x + 2].r += error.r / 16;
-                error_buffernew[x + 2].g += error.g / 16;
-                error_buffernew[x + 2].b += error.b / 16;
+    // raw pixels are read directly when the rotated image covers the sprite exactly, otherwise as RGB565 through readPixel
+    const bool fits = (rotate % 2) ? (bufw == spr.height() && bufh == spr.width()) : (bufw == spr.width() && bufh == spr.height());
+    const uint8_t depth = (spr.getPointer() && fits) ? spr.getColorDepth() : 0;
+    const uint16_t planeMask = is_red ? (1 << 2 | 1 << 3) : (1 << 1 | 1 << 3);
 
-                error_bufferold[x + 2].r += error.r / 8;
-                error_bufferold[x + 2].g += error.g / 8;
-                error_bufferold[x + 2].b += error.b / 8;
-            }
-        }
-        memcpy(error_bufferold, error_buffernew, bufw * sizeof(Error));
+    RowConverter converter(imageParams, bufw, depth);
+    for (uint16_t y = 0; y < bufh; y++) {
+        readRow(spr, depth, rotate, y, bufw, bufh, converter.keys);
+        converter.convert(y);
+        packRow(imageParams.bpp, converter.rowIdx, y, bufw, planeMask, buffer, imageParams.hasRed);
     }
-
-    delete[] error_buffernew;
-    delete[] error_bufferold;
-
-    return;
 }
 
 size_t prepareHeader(uint8_t headerbuf[], uint16_t bufw, uint16_t bufh, imgParam imageParams, size_t buffer_size) {
@@ -574,3 +814,315 @@ void spr2buffer(TFT_eSprite &spr, String &fileout, imgParam &imageParams) {
     xSemaphoreGive(fsMutex);
     Serial.println("finished writing buffer " + String(millis() - t) + "ms");
 }
+
+// Rendering in bands. The content is drawn once for every band of output rows, into a sprite that only holds
+// that band. A viewport keeps the drawing code in image coordinates and clips everything outside the band.
+// Each band is converted, packed and written or compressed before the next one is drawn, so the memory needed
+// is a few band buffers instead of a 16 bit sprite and a plane buffer of the whole image.
+
+static TFT_eSprite *bandSprite = nullptr;
+static int16_t bandX = 0, bandY = 0;
+static uint16_t bandW = 0, bandH = 0;
+
+bool getSpriteBand(TFT_eSprite &spr, int16_t &x, int16_t &y, uint16_t &w, uint16_t &h) {
+    if (&spr != bandSprite) return false;
+    x = bandX;
+    y = bandY;
+    w = bandW;
+    h = bandH;
+    return true;
+}
+
+// top left corner, in sprite coordinates, of the sprite area that output rows y0 up to y0 + rows come from
+static void bandOrigin(uint8_t rotate, long y0, long rows, long bufh, int16_t &ox, int16_t &oy) {
+    ox = 0;
+    oy = 0;
+    switch (rotate) {
+        case 0:
+            oy = y0;
+            break;
+        case 1:
+            ox = y0;
+            break;
+        case 2:
+            oy = bufh - y0 - rows;
+            break;
+        default:
+            ox = bufh - y0 - rows;
+            break;
+    }
+}
+
+static void writeLocked(File &f_out, const uint8_t *data, size_t len) {
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    f_out.write(data, len);
+    xSemaphoreGive(fsMutex);
+}
+
+// feeds everything to the compressor, writing the output as it comes
+static bool compressStream(Miniz::tdefl_compressor *comp, const uint8_t *inbuf, size_t inbytes, uint8_t *zlibbuf, size_t outsize, File &f_out, Miniz::tdefl_flush flush) {
+    Miniz::tdefl_status status;
+    size_t outbytes;
+    do {
+        size_t inbytes_compressed = inbytes;
+        outbytes = outsize;
+        status = Miniz::tdefl_compressOEPL(comp, inbuf, &inbytes_compressed, zlibbuf, &outbytes, flush);
+        if (status < Miniz::TDEFL_STATUS_OKAY) return false;
+        if (outbytes) writeLocked(f_out, zlibbuf, outbytes);
+        inbuf += inbytes_compressed;
+        inbytes -= inbytes_compressed;
+    } while (status != Miniz::TDEFL_STATUS_DONE && (inbytes || outbytes == outsize || flush == Miniz::TDEFL_FINISH));
+    return true;
+}
+
+typedef std::function<bool(const uint8_t *data, size_t len, bool last)> BandSink;
+
+class BandRenderer {
+   public:
+    long bufw = 0, bufh = 0;
+
+    BandRenderer(imgParam &imageParams, const std::function<void(TFT_eSprite &)> &draw) : imageParams(imageParams), draw(draw), spr(&tft) {}
+
+    ~BandRenderer() {
+        if (bandSprite == &spr) bandSprite = nullptr;
+        spr.deleteSprite();
+        free(buffer);
+    }
+
+    bool begin() {
+        rotate = outputRotation(imageParams, imageParams.width, imageParams.height, bufw, bufh);
+        // band sprites are read directly, which needs the rotated image to cover the sprite exactly
+        const bool fits = (rotate % 2) ? (bufw == imageParams.height && bufh == imageParams.width) : (bufw == imageParams.width && bufh == imageParams.height);
+        if (!fits || bufw == 0 || bufh == 0) return false;
+
+        // bands are a multiple of 8 rows, so every band starts on a byte in all output formats
+        const size_t budget = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) / 4;
+        rows = std::min<long>(budget / (bufw * 2), bufh + 7) & ~7L;
+        if (rows < 8) rows = 8;
+        spr.setColorDepth(16);
+        while (true) {
+            if (rotate % 2) {
+                spr.createSprite(rows, bufw);
+            } else {
+                spr.createSprite(bufw, rows);
+            }
+            if (spr.getPointer() != nullptr) break;
+            if (rows == 8) {
+                Serial.println("Failed to create band sprite");
+                util::printLargestFreeBlock();
+                return false;
+            }
+            rows = std::max(8L, (rows / 2) & ~7L);
+        }
+
+        bitsPerPixel = (imageParams.bpp == 3 || imageParams.bpp == 4) ? imageParams.bpp : 1;
+        bufferSize = (rows * bufw * bitsPerPixel + 7) / 8;
+        // one spare byte, the G5 encoder reads a byte past the end of a line
+        buffer = (uint8_t *)malloc(bufferSize + 1);
+        if (!buffer) {
+            Serial.println("Failed to allocate band buffer");
+            return false;
+        }
+#ifdef BOARD_HAS_PSRAM
+        useLut = true;
+#else
+        // a 16 bit lookup table would take more memory than the bands save
+        useLut = false;
+#endif
+        bandSprite = &spr;
+        Serial.printf("rendering %ldx%ld in bands of %ld rows\r\n", bufw, bufh, rows);
+        return true;
+    }
+
+    // sets hasRed when any pixel ends up red or yellow, the number of planes goes in front of compressed data
+    void findRed() {
+        imageParams.hasRed = false;
+        RowConverter converter(imageParams, bufw, 16, useLut);
+        if (converter.colors() <= 2) return;
+        for (long y0 = 0; y0 < bufh; y0 += rows) {
+            drawBand(y0);
+            const long y1 = std::min(y0 + rows, bufh);
+            for (long y = y0; y < y1; y++) {
+                readRowDirect((const uint16_t *)spr.getPointer(), bandW, bandX, bandY, rotate, y, bufw, bufh, converter.keys);
+                converter.convert(y);
+                for (long x = 0; x < bufw; x++) {
+                    if (converter.rowIdx[x] == 2 || converter.rowIdx[x] == 3) {
+                        imageParams.hasRed = true;
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    // renders one plane (or the whole image for 3 and 4 bpp) and hands the packed bytes to sink band by band
+    bool renderPlane(bool is_red, const BandSink &sink) {
+        const uint16_t planeMask = is_red ? (1 << 2 | 1 << 3) : (1 << 1 | 1 << 3);
+        RowConverter converter(imageParams, bufw, 16, useLut);
+        for (long y0 = 0; y0 < bufh; y0 += rows) {
+            drawBand(y0);
+            const long y1 = std::min(y0 + rows, bufh);
+            memset(buffer, 0, bufferSize + 1);
+            for (long y = y0; y < y1; y++) {
+                readRowDirect((const uint16_t *)spr.getPointer(), bandW, bandX, bandY, rotate, y, bufw, bufh, converter.keys);
+                converter.convert(y);
+                packRow(imageParams.bpp, converter.rowIdx, y - y0, bufw, planeMask, buffer, imageParams.hasRed);
+            }
+            const size_t start = (size_t)y0 * bufw * bitsPerPixel / 8, end = (size_t)y1 * bufw * bitsPerPixel / 8;
+            if (!sink(buffer, end - start, y1 == bufh)) return false;
+        }
+        return true;
+    }
+
+   private:
+    imgParam &imageParams;
+    const std::function<void(TFT_eSprite &)> &draw;
+    TFT_eSprite spr;
+    uint8_t rotate = 0;
+    long rows = 0;
+    uint8_t bitsPerPixel = 1;
+    uint8_t *buffer = nullptr;
+    size_t bufferSize = 0;
+    bool useLut = true;
+
+    void drawBand(long y0) {
+        bandOrigin(rotate, y0, rows, bufh, bandX, bandY);
+        bandW = (rotate % 2) ? rows : bufw;
+        bandH = (rotate % 2) ? bufw : rows;
+        spr.setViewport(-bandX, -bandY, imageParams.width, imageParams.height);
+        spr.fillSprite(TFT_WHITE);
+        draw(spr);
+        if (config.showtimestamp) doTimestamp(&spr);
+    }
+};
+
+bool drawBanded(String &fileout, imgParam &imageParams, const std::function<void(TFT_eSprite &)> &draw) {
+#ifdef HAS_TFT
+    if (fileout == "direct") return false;
+#endif
+    if (imageParams.bpp < 1 || imageParams.bpp > 4) return false;
+    long t = millis();
+
+    BandRenderer bands(imageParams, draw);
+    if (!bands.begin()) return false;
+    const long bufw = bands.bufw, bufh = bands.bufh;
+    const size_t planeSize = (bufw * bufh) / 8;
+
+    if (imageParams.bpp > 2) {
+        imageParams.zlib = 0;
+        imageParams.g5 = 0;
+    }
+#ifdef SAVE_SPACE
+    imageParams.g5 = 0;
+#else
+    // lines are fed to the encoder straight from the packed plane
+    if (bufw % 8) imageParams.g5 = 0;
+#endif
+    if (imageParams.bpp == 2 && (imageParams.zlib || imageParams.g5)) bands.findRed();
+
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    fs::File f_out = contentFS->open(fileout, "w");
+    xSemaphoreGive(fsMutex);
+
+    auto restart = [&]() {
+        xSemaphoreTake(fsMutex, portMAX_DELAY);
+        f_out.close();
+        f_out = contentFS->open(fileout, "w");
+        xSemaphoreGive(fsMutex);
+    };
+
+    if (imageParams.zlib) {
+        Miniz::tdefl_compressor *comp = (Miniz::tdefl_compressor *)malloc(sizeof(Miniz::tdefl_compressor));
+        const size_t outsize = 4096;
+        uint8_t *zlibbuf = (uint8_t *)malloc(outsize);
+
+        uint8_t headerbuf[6];
+        size_t totalbytes = prepareHeader(headerbuf, imageParams.width, imageParams.height, imageParams, planeSize);
+        const uint8_t planes = (headerbuf[5] == 2) ? 2 : 1;
+
+        // 768 = compression level 9, 1500 = unofficial level 10
+        bool success = comp != NULL && zlibbuf != NULL && initializeCompressor(comp, Miniz::TDEFL_WRITE_ZLIB_HEADER | 1500);
+        if (success) {
+            writeLocked(f_out, reinterpret_cast<uint8_t *>(&totalbytes), sizeof(uint32_t));
+            success = compressStream(comp, headerbuf, sizeof(headerbuf), zlibbuf, outsize, f_out, Miniz::TDEFL_NO_FLUSH);
+        }
+        for (uint8_t plane = 0; plane < planes && success; plane++) {
+            success = bands.renderPlane(plane == 1, [&](const uint8_t *data, size_t len, bool last) {
+                return compressStream(comp, data, len, zlibbuf, outsize, f_out, (last && plane == planes - 1) ? Miniz::TDEFL_FINISH : Miniz::TDEFL_NO_FLUSH);
+            });
+        }
+        free(zlibbuf);
+        free(comp);
+
+        if (success) {
+            xSemaphoreTake(fsMutex, portMAX_DELAY);
+            rewriteHeader(f_out);
+            xSemaphoreGive(fsMutex);
+        } else {
+            Serial.println("Failed to compress with zlib, falling back to raw");
+            imageParams.zlib = 0;
+            restart();
+        }
+#ifndef SAVE_SPACE
+    } else if (imageParams.g5) {
+        uint8_t headerbuf[6];
+        prepareHeader(headerbuf, imageParams.width, imageParams.height, imageParams, planeSize);
+        const uint8_t planes = (headerbuf[5] == 2) ? 2 : 1;
+
+        // the output is moved to the file after every line, so the encoder only needs room for one line
+        const int g5size = bufw * 2 + 64;
+        G5ENCIMAGE *g5enc = (G5ENCIMAGE *)malloc(sizeof(G5ENCIMAGE));
+        uint8_t *g5buf = (uint8_t *)malloc(g5size);
+        size_t outSize = 0;
+        int rc = G5_NOT_INITIALIZED;
+        if (g5enc != NULL && g5buf != NULL) {
+            writeLocked(f_out, headerbuf, sizeof(headerbuf));
+            // two planes are encoded as one image of double height
+            rc = g5_encode_init(g5enc, bufw, bufh * planes, g5buf, g5size);
+        }
+        for (uint8_t plane = 0; plane < planes && rc == G5_SUCCESS; plane++) {
+            bands.renderPlane(plane == 1, [&](const uint8_t *data, size_t len, bool last) {
+                for (size_t pos = 0; pos < len && rc == G5_SUCCESS; pos += bufw / 8) {
+                    rc = g5_encode_encodeLine(g5enc, const_cast<uint8_t *>(data + pos));
+                    const size_t lineBytes = g5enc->bb.pBuf - g5enc->pOutBuf;
+                    writeLocked(f_out, g5enc->pOutBuf, lineBytes);
+                    outSize += lineBytes;
+                    g5enc->bb.pBuf = g5enc->pOutBuf;
+                }
+                return rc == G5_SUCCESS || rc == G5_ENCODE_COMPLETE;
+            });
+        }
+        free(g5buf);
+        free(g5enc);
+
+        if (rc == G5_ENCODE_COMPLETE && outSize <= planeSize * planes) {
+            printf("Compressed %d to %d bytes\n", planeSize * planes, outSize);
+        } else {
+            // if we failed to compress the image, or the resulting image was larger than a raw file, fallback
+            printf("G5 encoding failed or wasn't very useful (rc=%d), falling back to raw\n", rc);
+            imageParams.g5 = false;
+            if (imageParams.hasRed && imageParams.bpp > 1) {
+                imageParams.dataType = DATATYPE_IMG_RAW_2BPP;
+            } else {
+                imageParams.dataType = DATATYPE_IMG_RAW_1BPP;
+            }
+            restart();
+        }
+#endif
+    }
+
+    if (!imageParams.zlib && !imageParams.g5) {
+        auto writeBand = [&](const uint8_t *data, size_t len, bool last) {
+            writeLocked(f_out, data, len);
+            return true;
+        };
+        bands.renderPlane(false, writeBand);
+        if (imageParams.hasRed && imageParams.bpp == 2) bands.renderPlane(true, writeBand);
+    }
+
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    f_out.close();
+    xSemaphoreGive(fsMutex);
+    Serial.println("finished writing buffer " + String(millis() - t) + "ms");
+    return true;
+}
@@ -8,9 +8,16 @@
 
 #include <algorithm>
 #include <cstring>
+#include <list>
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 
+#include "bufferpool.h"
+#ifdef HAS_BLE_WRITER
+#include "ble_writer.h"
+#endif
+#include "imagediff.h"
 #include "serialap.h"
 #include "settings.h"
 #include "storage.h"
@@ -21,10 +28,18 @@
 #include "util.h"
 #include "web.h"
 
-extern uint16_t sendBlock(const void* data, const uint16_t len);
+extern uint16_t sendBlock(const void* data, const uint16_t len, const uint64_t ver, const uint8_t blockId);
 extern UDPcomm udpsync;
-std::vector<PendingItem> pendingQueue;
-std::mutex queueMutex;
+// pending items per tag MAC, oldest first. List nodes keep item addresses stable.
+std::unordered_map<uint64_t, std::list<PendingItem>> pendingQueue;
+uint32_t pendingQueueSize = 0;
+std::recursive_mutex queueMutex;
+
+static inline uint64_t queueKey(const uint8_t* mac) {
+    uint64_t key;
+    memcpy(&key, mac, sizeof(key));
+    return key;
+}
 
 void addCRC(void* p, uint8_t len) {
     uint8_t total = 0;
@@ -41,20 +56,6 @@ bool checkCRC(void* p, uint8_t len) {
     return ((uint8_t*)p)[0] == total;
 }
 
-uint8_t* getDataForFile(fs::File& file) {
-    const size_t fileSize = file.size();
-    uint8_t* ret = (uint8_t*)malloc(fileSize);
-    if (ret) {
-        file.seek(0);
-        file.readBytes((char*)ret, fileSize);
-    } else {
-        Serial.printf("malloc failed for file with size %d\r\n", fileSize);
-        wsErr("malloc failed while reading file");
-        util::printHeap();
-    }
-    return ret;
-}
-
 void prepareCancelPending(const uint8_t dst[8]) {
     struct pendingData pending = {0};
     memcpy(pending.targetMac, dst, 8);
@@ -69,7 +70,7 @@ void prepareCancelPending(const uint8_t dst[8]) {
     clearPending(taginfo);
     while (dequeueItem(dst)) {
     };
-    taginfo->pendingCount = countQueueItem(dst);
+    taginfo->setPendingCount(countQueueItem(dst));
     wsSendTaginfo(dst, SYNC_TAGSTATUS);
 }
 
@@ -95,8 +96,8 @@ void prepareDataAvail(const uint8_t* dst) {
         return;
     }
 
-    taginfo->pendingCount++;
-    taginfo->pendingIdle = 0;
+    taginfo->setPendingCount(taginfo->pendingCount + 1);
+    taginfo->setPendingIdle(0);
 
     struct pendingData pending = {0};
     memcpy(pending.targetMac, dst, 8);
@@ -123,7 +124,7 @@ void prepareDataAvail(uint8_t* data, uint16_t len, uint8_t dataType, const uint8
     }
 
     clearPending(taginfo);
-    taginfo->data = (uint8_t*)malloc(len);
+    taginfo->data = bufferpool::alloc(len);
     if (taginfo->data == nullptr) {
         wsErr("no memory allocation for data");
         return;
@@ -139,9 +140,10 @@ void prepareDataAvail(uint8_t* data, uint16_t len, uint8_t dataType, const uint8
     }
 
     memcpy(taginfo->data, data, len);
-    taginfo->pendingCount++;
+    bufferpool::publish(taginfo->data, *((uint64_t*)md5bytes));
+    taginfo->setPendingCount(taginfo->pendingCount + 1);
     taginfo->len = len;
-    taginfo->pendingIdle = 0;
+    taginfo->setPendingIdle(0);
     taginfo->filename = String();
     taginfo->dataType = dataType;
 
@@ -161,7 +163,7 @@ void prepareDataAvail(uint8_t* data, uint16_t len, uint8_t dataType, const uint8
     wsSendTaginfo(dst, SYNC_TAGSTATUS);
 }
 
-bool prepareDataAvail(String& filename, uint8_t dataType, uint8_t dataTypeArgument, const uint8_t* dst, uint16_t nextCheckin, bool resend) {
+bool prepareDataAvail(String& filename, uint8_t dataType, uint8_t dataTypeArgument, const uint8_t* dst, uint16_t nextCheckin, bool resend, uint64_t* dataVer) {
     if ((nextCheckin & 0x8000) == 0 && nextCheckin > config.maxsleep) nextCheckin = config.maxsleep;
     if ((nextCheckin & 0x8000) == 0 && wsClientCount() && (config.stopsleep == 1)) nextCheckin = 0;
 #ifdef HAS_TFT
@@ -207,6 +209,7 @@ bool prepareDataAvail(String& filename, uint8_t dataType, uint8_t dataTypeArgume
     }
 
     file.close();
+    if (dataVer) memcpy(dataVer, md5bytes, sizeof(uint64_t));
 
     if (memcmp(md5bytes, taginfo->md5, 8) == 0) {
         wsLog("new image is the same as current image. not updating tag.");
@@ -232,7 +235,7 @@ bool prepareDataAvail(String& filename, uint8_t dataType, uint8_t dataTypeArgume
         time_t now;
         time(&now);
 
-        taginfo->pendingIdle = (nextCheckin & 0x8000) ? (nextCheckin & 0x7FFF) + 5 : (nextCheckin * 60) + 60;
+        taginfo->setPendingIdle((nextCheckin & 0x8000) ? (nextCheckin & 0x7FFF) + 5 : (nextCheckin * 60) + 60);
         clearPending(taginfo);
     } else {
         wsLog("firmware upload pending");
@@ -241,7 +244,7 @@ bool prepareDataAvail(String& filename, uint8_t dataType, uint8_t dataTypeArgume
     taginfo->filename = filename;
     taginfo->len = filesize;
     taginfo->dataType = dataType;
-    taginfo->pendingCount++;
+    taginfo->setPendingCount(taginfo->pendingCount + 1);
 
     struct pendingData pending = {0};
     memcpy(pending.targetMac, dst, 8);
@@ -252,6 +255,21 @@ bool prepareDataAvail(String& filename, uint8_t dataType, uint8_t dataTypeArgume
     pending.availdatainfo.nextCheckIn = nextCheckin;
     pending.attemptsLeft = MAX_XFER_ATTEMPTS;
     checkMirror(taginfo, &pending);
+    // mirrors got the full image, this tag may only need what changed. Not with other images queued,
+    // a delta is against the image the tag shows now.
+    if (dataType != DATATYPE_FW_UPDATE && !resend && !taginfo->isExternal && countQueueItem(dst) == 0) {
+        uint32_t deltaSize = 0;
+        const String deltaFile = imagediff::prepare(taginfo, filename, dataType, pending.availdatainfo.dataVer, deltaSize);
+        if (!deltaFile.isEmpty()) {
+            bufferpool::release(taginfo->data);
+            taginfo->data = nullptr;
+            taginfo->filename = deltaFile;
+            taginfo->len = deltaSize;
+            taginfo->dataType = DATATYPE_IMG_DIFF;
+            pending.availdatainfo.dataType = DATATYPE_IMG_DIFF;
+            pending.availdatainfo.dataSize = deltaSize;
+        }
+    }
     queueDataAvail(&pending, !taginfo->isExternal);
     if (taginfo->isExternal == false) {
         Serial.printf(">SDA %02X%02X%02X%02X%02X%02X%02X%02X TYPE 0x%02X\r\n", dst[7], dst[6], dst[5], dst[4], dst[3], dst[2], dst[1], dst[0], pending.availdatainfo.dataType);
@@ -335,7 +353,7 @@ void prepareExternalDataAvail(struct pendingData* pending, IPAddress remoteIP) {
                 taginfo->filename = filename;
                 taginfo->len = filesize;
                 taginfo->dataType = pending->availdatainfo.dataType;
-                taginfo->pendingCount++;
+                taginfo->setPendingCount(taginfo->pendingCount + 1);
                 break;
             }
             case DATATYPE_NFC_RAW_CONTENT:
@@ -355,11 +373,15 @@ void prepareExternalDataAvail(struct pendingData* pending, IPAddress remoteIP) {
                     size_t len = http.getSize();
                     if (len > 0) {
                         clearPending(taginfo);
-                        taginfo->data = new uint8_t[len];
+                        taginfo->data = bufferpool::alloc(len);
+                        if (taginfo->data == nullptr) {
+                            http.end();
+                            return;
+                        }
                         WiFiClient* stream = http.getStreamPtr();
                         stream->readBytes(taginfo->data, len);
                         taginfo->dataType = pending->availdatainfo.dataType;
-                        taginfo->pendingCount++;
+                        taginfo->setPendingCount(taginfo->pendingCount + 1);
                         taginfo->len = len;
                     }
                 }
@@ -378,7 +400,6 @@ void prepareExternalDataAvail(struct pendingData* pending, IPAddress remoteIP) {
 }
 
 void processBlockRequest(struct espBlockRequest* br) {
-    uint32_t t = millis();
     if (config.runStatus == RUNSTATUS_STOP) {
         return;
     }
@@ -387,37 +408,48 @@ void processBlockRequest(struct espBlockRequest* br) {
         return;
     }
 
-    PendingItem* queueItem = getQueueItem(br->src, br->ver);
-    if (queueItem == nullptr) {
+    uint8_t* data = nullptr;
+    uint32_t datalen = 0;
+    char filename[sizeof(PendingItem::filename)];
+    {
+        std::lock_guard<std::recursive_mutex> lock(queueMutex);
+        PendingItem* queueItem = getQueueItem(br->src, br->ver);
+        if (queueItem != nullptr) {
+            data = loadQueueItemData(queueItem);
+            strcpy(filename, queueItem->filename);
+            datalen = queueItem->len;
+            // keep the buffer alive while sending, the item can be dequeued meanwhile
+            bufferpool::retain(data);
+            if (data == nullptr) {
+                Serial.print("No current file. " + String(filename) + " Canceling request\r\n");
+            }
+        } else {
+            Serial.printf("blockrequest: couldn't find taginfo %02X%02X%02X%02X%02X%02X%02X%02X\r\n", br->src[7], br->src[6], br->src[5], br->src[4], br->src[3], br->src[2], br->src[1], br->src[0]);
+        }
+    }
+    if (data == nullptr) {
         prepareCancelPending(br->src);
-        Serial.printf("blockrequest: couldn't find taginfo %02X%02X%02X%02X%02X%02X%02X%02X\r\n", br->src[7], br->src[6], br->src[5], br->src[4], br->src[3], br->src[2], br->src[1], br->src[0]);
         return;
     }
-    if (queueItem->data == nullptr) {
-        fs::File file = contentFS->open(queueItem->filename);
-        if (!file) {
-            Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
-            prepareCancelPending(br->src);
-            return;
-        }
-        queueItem->data = getDataForFile(file);
-        Serial.println("Reading file " + String(queueItem->filename) + " in  " + String(millis() - t) + "ms");
-        file.close();
-    }
 
+    const uint8_t requestedBlock = br->blockId;
     // check if we're not exceeding max blocks (to prevent sendBlock from exceeding its boundary)
-    uint8_t totalblocks = (queueItem->len / BLOCK_DATA_SIZE);
-    if (queueItem->len % BLOCK_DATA_SIZE) totalblocks++;
+    uint8_t totalblocks = (datalen / BLOCK_DATA_SIZE);
+    if (datalen % BLOCK_DATA_SIZE) totalblocks++;
     if (br->blockId >= totalblocks) {
         br->blockId = totalblocks - 1;
     }
-    uint32_t len = queueItem->len - (BLOCK_DATA_SIZE * br->blockId);
+    uint32_t len = datalen - (BLOCK_DATA_SIZE * br->blockId);
     if (len > BLOCK_DATA_SIZE) len = BLOCK_DATA_SIZE;
-    uint16_t checksum = sendBlock(queueItem->data + (br->blockId * BLOCK_DATA_SIZE), len);
+    uint16_t checksum = sendBlock(data + (br->blockId * BLOCK_DATA_SIZE), len, br->ver, requestedBlock);
     char buffer[150];
-    sprintf(buffer, "%02X%02X%02X%02X%02X%02X%02X%02X block request %s block %d, len %d checksum %u\0", br->src[7], br->src[6], br->src[5], br->src[4], br->src[3], br->src[2], br->src[1], br->src[0], queueItem->filename, br->blockId, len, checksum);
+    sprintf(buffer, "%02X%02X%02X%02X%02X%02X%02X%02X block request %s block %d, len %d checksum %u\0", br->src[7], br->src[6], br->src[5], br->src[4], br->src[3], br->src[2], br->src[1], br->src[0], filename, br->blockId, len, checksum);
     wsLog((String)buffer);
-    Serial.printf("<RQB file %s block %d, len %d checksum %u\r\n\0", queueItem->filename, br->blockId, len, checksum);
+    Serial.printf("<RQB file %s block %d, len %d checksum %u\r\n\0", filename, br->blockId, len, checksum);
+
+    // the tag will ask for the next blocks soon, get them into the AP while the serial link is idle
+    prefetchBlocks(data, datalen, br->ver, br->blockId);
+    bufferpool::release(data);
 }
 
 void processXferComplete(struct espXferComplete* xfc, bool local) {
@@ -440,34 +472,46 @@ void processXferComplete(struct espXferComplete* xfc, bool local) {
     char dst_path[64];
     sprintf(dst_path, "/current/%02X%02X%02X%02X%02X%02X%02X%02X.raw\0", xfc->src[7], xfc->src[6], xfc->src[5], xfc->src[4], xfc->src[3], xfc->src[2], xfc->src[1], xfc->src[0]);
 
-    uint8_t md5bytes[16];
-    PendingItem* queueItem = getQueueItem(xfc->src);
-    if (queueItem != nullptr) {
-        if (contentFS->exists(dst_path) && contentFS->exists(queueItem->filename)) {
+    uint8_t md5bytes[16] = {0};
+    char filename[sizeof(PendingItem::filename)];
+    uint8_t dataType = 0;
+    bool dequeued = false;
+    {
+        // only take the item out here, the file work below would hold up every queue lookup on the radio path
+        std::lock_guard<std::recursive_mutex> lock(queueMutex);
+        PendingItem* queueItem = getQueueItem(xfc->src);
+        if (queueItem != nullptr) {
+            strcpy(filename, queueItem->filename);
+            dataType = queueItem->pendingdata.availdatainfo.dataType;
+            memcpy(md5bytes, &queueItem->pendingdata.availdatainfo.dataVer, sizeof(uint64_t));
+            dequeueItem(xfc->src);
+            dequeued = true;
+        }
+    }
+    if (dequeued) {
+        // after a delta, the full image is what the tag shows now
+        const String delivered = imagediff::xferComplete(xfc->src, filename);
+        if (contentFS->exists(dst_path) && contentFS->exists(delivered)) {
             contentFS->remove(dst_path);
         }
-        if (contentFS->exists(queueItem->filename)) {
-            uint8_t dataType = queueItem->pendingdata.availdatainfo.dataType;
+        if (contentFS->exists(delivered)) {
             if (config.preview && dataType != DATATYPE_FW_UPDATE && dataType != DATATYPE_NOUPDATE) {
-                contentFS->rename(queueItem->filename, String(dst_path));
+                contentFS->rename(delivered, String(dst_path));
                 }
             else {
-                if (queueItem->pendingdata.availdatainfo.dataType != DATATYPE_FW_UPDATE) contentFS->remove(queueItem->filename);
+                if (dataType != DATATYPE_FW_UPDATE) contentFS->remove(delivered);
             }
         }
-        memcpy(md5bytes, &queueItem->pendingdata.availdatainfo.dataVer, sizeof(uint64_t));
-        memset(md5bytes + sizeof(uint64_t), 0, 16 - sizeof(uint64_t));
-        dequeueItem(xfc->src);
     }
 
     tagRecord* taginfo = tagRecord::findByMAC(xfc->src);
     if (taginfo != nullptr) {
         clearPending(taginfo);
-        memcpy(taginfo->md5, md5bytes, sizeof(md5bytes));
-        taginfo->updateCount++;
-        taginfo->updateLast = now;
-        taginfo->pendingCount = countQueueItem(xfc->src);
-        taginfo->wakeupReason = 0;
+        if (dequeued) taginfo->setMd5(md5bytes);
+        taginfo->setUpdateCount(taginfo->updateCount + 1);
+        taginfo->setUpdateLast(now);
+        taginfo->setPendingCount(countQueueItem(xfc->src));
+        taginfo->setWakeupReason(0);
         if (taginfo->contentMode == 12 && local == false) {
             if (contentFS->exists(dst_path)) {
                 contentFS->remove(dst_path);
@@ -476,7 +520,7 @@ void processXferComplete(struct espXferComplete* xfc, bool local) {
         if (taginfo->contentMode == 5 || taginfo->contentMode == 17 || taginfo->contentMode == 18) {
             popTagInfo(xfc->src);
             taginfo = tagRecord::findByMAC(xfc->src);
-            taginfo->nextupdate = now;
+            taginfo->setNextupdate(now);
         }
     }
 
@@ -505,7 +549,7 @@ void processXferTimeout(struct espXferComplete* xfc, bool local) {
     time(&now);
     tagRecord* taginfo = tagRecord::findByMAC(xfc->src);
     if (taginfo != nullptr) {
-        taginfo->pendingIdle = 60;
+        taginfo->setPendingIdle(60);
         clearPending(taginfo);
     }
     while (dequeueItem(xfc->src)) {
@@ -538,10 +582,7 @@ void processDataReq(struct espAvailDataReq* eadr, bool local, IPAddress remoteIP
             Serial.printf("Tag %s reports illegal channel %d\r\n", hexmac, eadr->adr.currentChannel);
             return;
         }
-        taginfo = new tagRecord;
-        memcpy(taginfo->mac, eadr->src, sizeof(taginfo->mac));
-        taginfo->pendingCount = 0;
-        tagDB.push_back(taginfo);
+        taginfo = addRecord(eadr->src);
     }
     time_t now;
     time(&now);
@@ -549,32 +590,32 @@ void processDataReq(struct espAvailDataReq* eadr, bool local, IPAddress remoteIP
     if (!local) {
         if (taginfo->isExternal == false) {
             wsLog("moved AP from local to external " + String(hexmac));
-            taginfo->isExternal = true;
+            taginfo->setIsExternal(true);
         }
-        taginfo->apIp = remoteIP;
+        taginfo->setApIp(remoteIP);
     } else {
         if (taginfo->isExternal == true) {
             wsLog("moved AP from external to local " + String(hexmac));
-            taginfo->isExternal = false;
+            taginfo->setIsExternal(false);
         }
-        taginfo->apIp = IPAddress(0, 0, 0, 0);
+        taginfo->setApIp(IPAddress(0, 0, 0, 0));
     }
 
     if (taginfo->pendingIdle == 0 || countQueueItem(eadr->src) > 0) {
-        if (taginfo->expectedNextCheckin < now + 60) taginfo->expectedNextCheckin = now + 60;
+        if (taginfo->expectedNextCheckin < now + 60) taginfo->setExpectedNextCheckin(now + 60);
     } else if (taginfo->pendingIdle == 9999) {
-        taginfo->expectedNextCheckin = 3216153600;
+        taginfo->setExpectedNextCheckin(3216153600);
     } else {
-        taginfo->expectedNextCheckin = now + taginfo->pendingIdle;
+        taginfo->setExpectedNextCheckin(now + taginfo->pendingIdle);
     }
-    taginfo->pendingIdle = 0;
-    taginfo->lastseen = now;
+    taginfo->setPendingIdle(0);
+    taginfo->setLastseen(now);
 
     if (eadr->adr.lastPacketRSSI != 0) {
         if (eadr->adr.wakeupReason >= 0xE0) {
             if (taginfo->pendingCount == 0) {
-                taginfo->nextupdate = 0;
-                memset(taginfo->md5, 0, sizeof(taginfo->md5));
+                taginfo->setNextupdate(0);
+                taginfo->clearMd5();
             }
 
             if (local) {
@@ -592,16 +633,16 @@ void processDataReq(struct espAvailDataReq* eadr, bool local, IPAddress remoteIP
             }
         }
 
-        taginfo->LQI = eadr->adr.lastPacketLQI;
-        taginfo->hwType = eadr->adr.hwType;
-        taginfo->RSSI = eadr->adr.lastPacketRSSI;
-        taginfo->temperature = eadr->adr.temperature;
-        taginfo->batteryMv = eadr->adr.batteryMv;
-        taginfo->hwType = eadr->adr.hwType;
-        taginfo->wakeupReason = eadr->adr.wakeupReason;
-        taginfo->capabilities = eadr->adr.capabilities;
-        taginfo->currentChannel = eadr->adr.currentChannel;
-        taginfo->tagSoftwareVersion = eadr->adr.tagSoftwareVersion;
+        taginfo->setLQI(eadr->adr.lastPacketLQI);
+        taginfo->setHwType(eadr->adr.hwType);
+        taginfo->setRSSI(eadr->adr.lastPacketRSSI);
+        taginfo->setTemperature(eadr->adr.temperature);
+        taginfo->setBatteryMv(eadr->adr.batteryMv);
+        taginfo->setHwType(eadr->adr.hwType);
+        taginfo->setWakeupReason(eadr->adr.wakeupReason);
+        taginfo->setCapabilities(eadr->adr.capabilities);
+        taginfo->setCurrentChannel(eadr->adr.currentChannel);
+        taginfo->setTagSoftwareVersion(eadr->adr.tagSoftwareVersion);
     }
     if (local) {
         sprintf(buffer, "<ADR %02X%02X%02X%02X%02X%02X%02X%02X\r\n\0", eadr->src[7], eadr->src[6], eadr->src[5], eadr->src[4], eadr->src[3], eadr->src[2], eadr->src[1], eadr->src[0]);
@@ -641,7 +682,7 @@ void refreshAllPending() {
         tagRecord* taginfo = tagDB.at(c);
         if (taginfo->pendingCount > 0 && taginfo->version == 0) {
             clearPending(taginfo);
-            taginfo->nextupdate = 0;
+            taginfo->setNextupdate(0);
             wsSendTaginfo(taginfo->mac, SYNC_TAGSTATUS);
         }
     }
@@ -651,8 +692,8 @@ void updateContent(const uint8_t* dst) {
     tagRecord* taginfo = tagRecord::findByMAC(dst);
     if (taginfo != nullptr) {
         clearPending(taginfo);
-        memset(taginfo->md5, 0, sizeof(taginfo->md5));
-        taginfo->nextupdate = 0;
+        taginfo->clearMd5();
+        taginfo->setNextupdate(0);
         wsSendTaginfo(taginfo->mac, SYNC_TAGSTATUS);
     }
 }
@@ -739,7 +780,7 @@ bool sendTagCommand(const uint8_t* dst, uint8_t cmd, bool local, const uint8_t*
 
     tagRecord* taginfo = tagRecord::findByMAC(dst);
     if (taginfo != nullptr) {
-        taginfo->pendingCount++;
+        taginfo->setPendingCount(taginfo->pendingCount + 1);
         wsSendTaginfo(taginfo->mac, SYNC_TAGSTATUS);
     }
 
@@ -768,7 +809,7 @@ bool sendTagMac(const uint8_t* dst, const uint64_t newmac, bool local) {
 
     tagRecord* taginfo = tagRecord::findByMAC(dst);
     if (taginfo != nullptr) {
-        taginfo->pendingCount++;
+        taginfo->setPendingCount(taginfo->pendingCount + 1);
         wsSendTaginfo(taginfo->mac, SYNC_TAGSTATUS);
     }
 
@@ -782,31 +823,33 @@ bool sendTagMac(const uint8_t* dst, const uint64_t newmac, bool local) {
 }
 
 void updateTaginfoitem(struct TagInfo* taginfoitem, IPAddress remoteIP) {
+    // the dirty bits are put aside and restored around the setters, keep wsFlush out meanwhile
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
     tagRecord* taginfo = tagRecord::findByMAC(taginfoitem->mac);
 
     if (taginfo == nullptr) {
         if (config.lock) return;
-        taginfo = new tagRecord;
-        memcpy(taginfo->mac, taginfoitem->mac, sizeof(taginfo->mac));
-        taginfo->pendingCount = 0;
-        tagDB.push_back(taginfo);
+        taginfo = addRecord(taginfoitem->mac);
     }
-    tagRecord initialTagInfo = *taginfo;
+    // collect what this packet changes separately from changes that are still unsent
+    const uint32_t dirtyWeb = taginfo->dirtyWeb;
+    const uint32_t dirtySync = taginfo->dirtySync;
+    taginfo->dirtyWeb = 0;
 
     switch (taginfoitem->syncMode) {
         case SYNC_USERCFG:
-            taginfo->alias = String(taginfoitem->alias);
-            taginfo->nextupdate = taginfoitem->nextupdate;
+            taginfo->setAlias(String(taginfoitem->alias));
+            taginfo->setNextupdate(taginfoitem->nextupdate);
             break;
         case SYNC_TAGSTATUS:
-            taginfo->lastseen = taginfoitem->lastseen;
-            taginfo->nextupdate = taginfoitem->nextupdate;
-            taginfo->pendingCount = taginfoitem->pendingCount;
-            taginfo->expectedNextCheckin = taginfoitem->expectedNextCheckin;
-            taginfo->hwType = taginfoitem->hwType;
-            taginfo->wakeupReason = taginfoitem->wakeupReason;
-            taginfo->capabilities = taginfoitem->capabilities;
-            taginfo->pendingIdle = taginfoitem->pendingIdle;
+            taginfo->setLastseen(taginfoitem->lastseen);
+            taginfo->setNextupdate(taginfoitem->nextupdate);
+            taginfo->setPendingCount(taginfoitem->pendingCount);
+            taginfo->setExpectedNextCheckin(taginfoitem->expectedNextCheckin);
+            taginfo->setHwType(taginfoitem->hwType);
+            taginfo->setWakeupReason(taginfoitem->wakeupReason);
+            taginfo->setCapabilities(taginfoitem->capabilities);
+            taginfo->setPendingIdle(taginfoitem->pendingIdle);
             break;
     }
 
@@ -814,15 +857,18 @@ void updateTaginfoitem(struct TagInfo* taginfoitem, IPAddress remoteIP) {
     mac2hex(taginfo->mac, hexmac);
     if (taginfo->contentMode != 12 && taginfoitem->contentMode != 12 && taginfoitem->contentMode != 0) {
         wsLog("Remote AP at " + remoteIP.toString() + " takes control over tag " + String(hexmac));
-        taginfo->contentMode = 12;
+        taginfo->setContentMode(12);
     }
 
     if (taginfoitem->syncMode == SYNC_DELETE) {
-        taginfo->contentMode = 255;
+        taginfo->setContentMode(255);
         wsSendTaginfo(taginfo->mac, SYNC_NOSYNC);
         deleteRecord(taginfoitem->mac);
     } else {
-        bool hasChanges = (memcmp(&initialTagInfo, taginfo, sizeof(tagRecord)) != 0);
+        const bool hasChanges = (taginfo->dirtyWeb != 0);
+        taginfo->dirtyWeb |= dirtyWeb;
+        // these changes came from the remote AP, don't sync them back
+        taginfo->dirtySync = dirtySync;
         if (hasChanges) {
             wsSendTaginfo(taginfo->mac, SYNC_NOSYNC);
         }
@@ -843,18 +889,19 @@ bool checkMirror(struct tagRecord* taginfo, struct pendingData* pending) {
                     if (!file) {
                         return false;
                     }
-                    taginfo->data = getDataForFile(file);
+                    taginfo->data = bufferpool::readFile(file, pending->availdatainfo.dataVer);
                     file.close();
                 }
 
                 clearPending(taginfo2);
-                taginfo2->expectedNextCheckin = taginfo->expectedNextCheckin;
+                taginfo2->setExpectedNextCheckin(taginfo->expectedNextCheckin);
                 taginfo2->filename = taginfo->filename;
                 taginfo2->len = taginfo->len;
-                taginfo2->data = taginfo->data;  // copy buffer pointer
+                taginfo2->data = taginfo->data;  // share the buffer
+                bufferpool::retain(taginfo2->data);
                 taginfo2->dataType = taginfo->dataType;
-                taginfo2->pendingCount++;
-                taginfo2->nextupdate = 3216153600;
+                taginfo2->setPendingCount(taginfo2->pendingCount + 1);
+                taginfo2->setNextupdate(3216153600);
 
                 struct pendingData pending2 = {0};
                 memcpy(pending2.targetMac, taginfo2->mac, 8);
@@ -890,9 +937,27 @@ bool checkMirror(struct tagRecord* taginfo, struct pendingData* pending) {
     return false;
 }
 
-void enqueueItem(struct PendingItem& item) {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    pendingQueue.push_back(item);
+uint8_t* loadQueueItemData(PendingItem* queueItem) {
+    std::lock_guard<std::recursive_mutex> lock(queueMutex);
+    if (queueItem->data == nullptr) {
+        uint32_t t = millis();
+        fs::File file = contentFS->open(queueItem->filename);
+        if (!file) {
+            return nullptr;
+        }
+        const uint8_t dataType = queueItem->pendingdata.availdatainfo.dataType;
+        queueItem->data = bufferpool::readFile(file, dataType == DATATYPE_IMG_DIFF ? 0 : queueItem->pendingdata.availdatainfo.dataVer);
+        Serial.println("Reading file " + String(queueItem->filename) + " in  " + String(millis() - t) + "ms");
+        file.close();
+    }
+    return queueItem->data;
+}
+
+void enqueueItem(const PendingItem& item) {
+    std::lock_guard<std::recursive_mutex> lock(queueMutex);
+    // the queue takes over the reference to item.data
+    pendingQueue[queueKey(item.pendingdata.targetMac)].push_back(item);
+    pendingQueueSize++;
 }
 
 bool dequeueItem(const uint8_t* targetMac) {
@@ -900,39 +965,26 @@ bool dequeueItem(const uint8_t* targetMac) {
 }
 
 bool dequeueItem(const uint8_t* targetMac, const uint64_t dataVer) {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    auto it = std::find_if(pendingQueue.begin(), pendingQueue.end(),
-                           [targetMac, dataVer](const PendingItem& item) {
-                               bool macMatches = memcmp(item.pendingdata.targetMac, targetMac, sizeof(item.pendingdata.targetMac)) == 0;
-                               bool dataVerMatches = (dataVer == 0) || (dataVer == item.pendingdata.availdatainfo.dataVer);
-                               return macMatches && dataVerMatches;
+    std::lock_guard<std::recursive_mutex> lock(queueMutex);
+    auto tagQueue = pendingQueue.find(queueKey(targetMac));
+    if (tagQueue == pendingQueue.end()) return false;
+    std::list<PendingItem>& items = tagQueue->second;
+    auto it = std::find_if(items.begin(), items.end(),
+                           [dataVer](const PendingItem& item) {
+                               return (dataVer == 0) || (dataVer == item.pendingdata.availdatainfo.dataVer);
                            });
-    if (it != pendingQueue.end()) {
-        if (it->data != nullptr) {
-            int datacount = 0;
-            for (const PendingItem& item : pendingQueue) {
-                if (item.data == it->data) {
-                    datacount++;
-                }
-            }
-            if (datacount == 1) {
-                free(it->data);
-            }
-            it->data = nullptr;
-        }
-        pendingQueue.erase(it);
-        return true;
-    }
-    return false;
+    if (it == items.end()) return false;
+    bufferpool::release(it->data);
+    items.erase(it);
+    pendingQueueSize--;
+    if (items.empty()) pendingQueue.erase(tagQueue);
+    return true;
 }
 
 uint16_t countQueueItem(const uint8_t* targetMac) {
-    std::unique_lock<std::mutex> lock(queueMutex);
-    int count = std::count_if(pendingQueue.begin(), pendingQueue.end(),
-                              [targetMac](const PendingItem& item) {
-                                  return memcmp(item.pendingdata.targetMac, targetMac, sizeof(item.pendingdata.targetMac)) == 0;
-                              });
-    return count;
+    std::lock_guard<std::recursive_mutex> lock(queueMutex);
+    auto tagQueue = pendingQueue.find(queueKey(targetMac));
+    return tagQueue == pendingQueue.end() ? 0 : tagQueue->second.size();
 }
 
 PendingItem* getQueueItem(const uint8_t* targetMac) {
@@ -940,31 +992,30 @@ PendingItem* getQueueItem(const uint8_t* targetMac) {
 }
 
 PendingItem* getQueueItem(const uint8_t* targetMac, const uint64_t dataVer) {
-    auto it = std::find_if(pendingQueue.begin(), pendingQueue.end(),
-                           [targetMac, dataVer](const PendingItem& item) {
-                               bool macMatches = memcmp(item.pendingdata.targetMac, targetMac, sizeof(item.pendingdata.targetMac)) == 0;
-                               bool dataVerMatches = (dataVer == 0) || (dataVer == item.pendingdata.availdatainfo.dataVer);
-                               return macMatches && dataVerMatches;
-                           });
-    if (it != pendingQueue.end()) {
-        return &(*it);
-    } else {
-        return nullptr;
+    std::lock_guard<std::recursive_mutex> lock(queueMutex);
+    auto tagQueue = pendingQueue.find(queueKey(targetMac));
+    if (tagQueue == pendingQueue.end()) return nullptr;
+    for (PendingItem& item : tagQueue->second) {
+        if (dataVer == 0 || dataVer == item.pendingdata.availdatainfo.dataVer) {
+            return &item;
+        }
     }
+    return nullptr;
 }
 
 void checkQueue(const uint8_t* targetMac) {
-    uint16_t queueCount;
-    queueCount = countQueueItem(targetMac);
-    if (queueCount > 0) {
-        Serial.printf("queue: total %d elements\r\n", pendingQueue.size());
-        PendingItem* queueItem = getQueueItem(targetMac);
-        if (queueItem == nullptr) {
-            return;
-        }
-        if (queueCount > 1) queueItem->pendingdata.availdatainfo.nextCheckIn = 5 | 0x8000;
-        sendDataAvail(&queueItem->pendingdata);
-    }
+    struct pendingData pending;
+    {
+        std::lock_guard<std::recursive_mutex> lock(queueMutex);
+        auto tagQueue = pendingQueue.find(queueKey(targetMac));
+        if (tagQueue == pendingQueue.end()) return;
+        Serial.printf("queue: total %d elements\r\n", pendingQueueSize);
+        PendingItem& queueItem = tagQueue->second.front();
+        if (tagQueue->second.size() > 1) queueItem.pendingdata.availdatainfo.nextCheckIn = 5 | 0x8000;
+        pending = queueItem.pendingdata;
+    }
+    // send outside of the lock, the serial link can take a while to ack
+    sendDataAvail(&pending);
 }
 
 bool queueDataAvail(struct pendingData* pending, bool local) {
@@ -986,35 +1037,51 @@ bool queueDataAvail(struct pendingData* pending, bool local) {
         taginfo->data = nullptr;
     } else {
         newPending.data = nullptr;
-        
-        if (pendingQueue.size() < 5) {   // maximized to 5 to save some memory
-            // optional: read data early, don't wait for block request.
-            fs::File file = contentFS->open(newPending.filename);
-            if (file) {
-                newPending.data = getDataForFile(file);
-                Serial.println("Reading file " + String(newPending.filename));
-                file.close();
-            } else {
-                Serial.println("Warning: not found: " + String(newPending.filename));
-            }
-        }
     }
     newPending.len = taginfo->len;
 
+    bool preload;
+    {
+        std::lock_guard<std::recursive_mutex> lock(queueMutex);
+        preload = newPending.data == nullptr && pendingQueueSize < 5;  // maximized to 5 to save some memory
+    }
+    if (preload) {
+        // optional: read data early, don't wait for block request. Not under the lock, block requests shouldn't wait for the file system.
+        fs::File file = contentFS->open(newPending.filename);
+        if (file) {
+            // a delta only fits the tag it was made for, don't share it by version
+            newPending.data = bufferpool::readFile(file, pending->availdatainfo.dataType == DATATYPE_IMG_DIFF ? 0 : pending->availdatainfo.dataVer);
+            Serial.println("Reading file " + String(newPending.filename));
+            file.close();
+        } else {
+            Serial.println("Warning: not found: " + String(newPending.filename));
+        }
+    }
+
+    std::unique_lock<std::recursive_mutex> lock(queueMutex);
     uint8_t dataType = pending->availdatainfo.dataType;
-    if (dataType != DATATYPE_FW_UPDATE && dataType != DATATYPE_NOUPDATE && pending->availdatainfo.dataTypeArgument & 0xF8 == 0x00) {
+    auto tagQueue = pendingQueue.find(queueKey(pending->targetMac));
+    if (tagQueue != pendingQueue.end() && dataType != DATATYPE_FW_UPDATE && dataType != DATATYPE_NOUPDATE && (pending->availdatainfo.dataTypeArgument & 0xF8) == 0x00) {
         // in case of an image (no preload), remove already queued images
-        pendingQueue.erase(std::remove_if(pendingQueue.begin(), pendingQueue.end(),
-                                          [pending](const PendingItem& item) {
-                                              bool macMatches = memcmp(item.pendingdata.targetMac, pending->targetMac, sizeof(item.pendingdata.targetMac)) == 0;
-                                              bool dataTypeArgumentMatches = (pending->availdatainfo.dataType == item.pendingdata.availdatainfo.dataType) && ((item.pendingdata.availdatainfo.dataTypeArgument & 0xF8) == 0x00);
-                                              return macMatches && dataTypeArgumentMatches;
-                                          }),
-                           pendingQueue.end());
+        std::list<PendingItem>& items = tagQueue->second;
+        for (auto it = items.begin(); it != items.end();) {
+            if ((pending->availdatainfo.dataType == it->pendingdata.availdatainfo.dataType) && ((it->pendingdata.availdatainfo.dataTypeArgument & 0xF8) == 0x00)) {
+                bufferpool::release(it->data);
+                it = items.erase(it);
+                pendingQueueSize--;
+            } else {
+                ++it;
+            }
+        }
+        if (items.empty()) pendingQueue.erase(tagQueue);
     }
 
     enqueueItem(newPending);
-    taginfo->pendingCount = countQueueItem(pending->targetMac);
+    taginfo->setPendingCount(countQueueItem(pending->targetMac));
+    lock.unlock();
+#ifdef HAS_BLE_WRITER
+    BLE_queue_ready();
+#endif
     if (taginfo->pendingCount == 1) {
         Serial.printf("queue item added, first in line\r\n");
         // if (local) sendDataAvail(pending);
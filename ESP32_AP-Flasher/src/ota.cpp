@@ -7,8 +7,17 @@
 #include <MD5Builder.h>
 #include <Update.h>
 
+#include "bufferpool.h"
+#ifdef HAS_BLE_WRITER
+#include "ble_writer.h"
+#endif
+#include "contentfetch.h"
+#include "contentmanager.h"
 #include "flasher.h"
 #include "espflasher.h"
+#include "fontcache.h"
+#include "httpcache.h"
+#include "imagediff.h"
 #include "leds.h"
 #include "serialap.h"
 #include "storage.h"
@@ -64,6 +73,116 @@ void handleSysinfoRequest(AsyncWebServerRequest* request) {
 #else
     doc["hasFlasher"] = 0;
 #endif
+
+    const bufferpool::Stats poolStats = bufferpool::getStats();
+    JsonObject pool = doc["bufferpool"].to<JsonObject>();
+    pool["buffers"] = poolStats.buffers;
+    pool["bytes"] = poolStats.bytes;
+    pool["cached"] = poolStats.cachedBytes;
+    pool["hits"] = poolStats.hits;
+    pool["misses"] = poolStats.misses;
+    pool["evictions"] = poolStats.evictions;
+
+    const RenderCacheStats renderStats = getRenderCacheStats();
+    JsonObject render = doc["rendercache"].to<JsonObject>();
+    render["entries"] = renderStats.entries;
+    render["hits"] = renderStats.hits;
+    render["misses"] = renderStats.misses;
+
+    const fontcache::Stats fontStats = fontcache::getStats();
+    JsonObject fonts = doc["fontcache"].to<JsonObject>();
+    fonts["fonts"] = fontStats.fonts;
+    fonts["databytes"] = fontStats.dataBytes;
+    fonts["hits"] = fontStats.hits;
+    fonts["misses"] = fontStats.misses;
+    fonts["glyphs"] = fontStats.glyphs;
+    fonts["glyphbytes"] = fontStats.glyphBytes;
+    fonts["glyphhits"] = fontStats.glyphHits;
+    fonts["glyphmisses"] = fontStats.glyphMisses;
+
+    const TagTypeCacheStats tagTypeStats = getTagTypeCacheStats();
+    JsonObject tagTypes = doc["tagtypecache"].to<JsonObject>();
+    tagTypes["types"] = tagTypeStats.types;
+    tagTypes["templates"] = tagTypeStats.templates;
+    tagTypes["templatebytes"] = tagTypeStats.templateBytes;
+    tagTypes["hits"] = tagTypeStats.hits;
+    tagTypes["misses"] = tagTypeStats.misses;
+    tagTypes["flushes"] = tagTypeStats.flushes;
+
+    const imagediff::Stats diffStats = imagediff::getStats();
+    JsonObject diff = doc["imagediff"].to<JsonObject>();
+    diff["deltas"] = diffStats.deltas;
+    diff["fallbacks"] = diffStats.fallbacks;
+    diff["fullbytes"] = diffStats.fullBytes;
+    diff["deltabytes"] = diffStats.deltaBytes;
+
+    const contentfetch::Stats fetchStats = contentfetch::getStats();
+    JsonObject fetch = doc["contentfetch"].to<JsonObject>();
+    fetch["queued"] = fetchStats.queued;
+    fetch["inflight"] = fetchStats.inFlight;
+    fetch["staged"] = fetchStats.staged;
+    fetch["stagedbytes"] = fetchStats.stagedBytes;
+    fetch["fetches"] = fetchStats.fetches;
+    fetch["failures"] = fetchStats.failures;
+    fetch["prefetched"] = fetchStats.prefetched;
+    fetch["waits"] = fetchStats.waits;
+    fetch["expired"] = fetchStats.expired;
+
+    const httpcache::Stats cacheStats = httpcache::getStats();
+    JsonObject cache = doc["httpcache"].to<JsonObject>();
+    cache["entries"] = cacheStats.entries;
+    cache["bytes"] = cacheStats.bytes;
+    cache["hits"] = cacheStats.hits;
+    cache["misses"] = cacheStats.misses;
+    cache["hitrate"] = (cacheStats.hits + cacheStats.misses) ? cacheStats.hits * 100 / (cacheStats.hits + cacheStats.misses) : 0;
+    cache["revalidated"] = cacheStats.revalidated;
+    cache["bytessaved"] = cacheStats.bytesSaved;
+
+#ifdef HAS_BLE_WRITER
+    const BLEWriterStats bleStats = getBLEWriterStats();
+    JsonObject ble = doc["blewriter"].to<JsonObject>();
+    ble["uploads"] = bleStats.uploads;
+    ble["failures"] = bleStats.failures;
+    ble["connectfailures"] = bleStats.connectFailures;
+    ble["bytes"] = bleStats.bytes;
+    ble["resends"] = bleStats.resends;
+    ble["connectionms"] = bleStats.connectionMs;
+    ble["lastbytes"] = bleStats.lastBytes;
+    ble["lastuploadms"] = bleStats.lastUploadMs;
+    ble["lastbytespersecond"] = bleStats.lastBytesPerSecond;
+    ble["lastconnectionms"] = bleStats.lastConnectionMs;
+    ble["mtu"] = bleStats.mtu;
+#endif
+
+    const WebsocketStats wsStats = getWebsocketStats();
+    JsonObject websocket = doc["websocket"].to<JsonObject>();
+    websocket["messages"] = wsStats.messages;
+    websocket["tagupdates"] = wsStats.tagUpdates;
+    websocket["loglines"] = wsStats.logLines;
+    websocket["droppedlines"] = wsStats.droppedLines;
+    websocket["skipped"] = wsStats.skipped;
+
+    const LogStats logStats = getLogStats();
+    JsonObject log = doc["log"].to<JsonObject>();
+    log["lines"] = logStats.lines;
+    log["dropped"] = logStats.dropped;
+    log["flushes"] = logStats.flushes;
+    log["bytes"] = logStats.bytes;
+    log["peak"] = logStats.peak;
+    log["buffer"] = LOG_BUFFER;
+
+    const SerialAPStats apStats = getSerialAPStats();
+    JsonObject serialap = doc["serialap"].to<JsonObject>();
+    serialap["framed"] = apStats.framed;
+    serialap["frames"] = apStats.frames;
+    serialap["batched"] = apStats.batched;
+    serialap["retransmits"] = apStats.retransmits;
+    serialap["naks"] = apStats.naks;
+    serialap["failed"] = apStats.failed;
+    serialap["crcerrors"] = apStats.crcErrors;
+    serialap["lost"] = apStats.lost;
+    serialap["inflightpeak"] = apStats.inFlightPeak;
+
     const size_t bufferSize = measureJson(doc) + 1;
     AsyncResponseStream* response = request->beginResponseStream("application/json", bufferSize);
     serializeJson(doc, *response);
@@ -161,6 +280,8 @@ void handleLittleFSUpload(AsyncWebServerRequest* request, String filename, size_
             }
         }
         if (final) {
+            fontcache::fileChanged(uploadfilename);
+            tagTypeFileChanged(uploadfilename);
             if (uploadInfo->bufferSize > 0) {
                 xSemaphoreTake(fsMutex, portMAX_DELAY);
                 File file = contentFS->open(uploadfilename, "a");
@@ -228,7 +349,7 @@ void updateFirmware(const char* url, const char* expectedMd5, const size_t size)
 
     config.runStatus = RUNSTATUS_STOP;
     vTaskDelay(3000 / portTICK_PERIOD_MS);
-    saveDB("/current/tagDB.json");
+    saveDBbin("/current/tagDB.bin");
     // destroyDB();
 
     HTTPClient httpClient;
@@ -75,6 +75,19 @@ struct rxCmd {
 #define ZBS_RX_WAIT_TYPE 17
 #define ZBS_RX_WAIT_TAG_RETURN_DATA 18
 #define ZBS_RX_WAIT_SUBCHANNEL 19
+#define ZBS_RX_WAIT_BLOCKCACHE 20
+#define ZBS_RX_WAIT_FRAMING 21
+
+// blocks pushed into the AP's block cache. The AP replaces its entries in the order they were filled, so this mirrors its contents
+#define MAX_PUSHED_BLOCKS 16
+#define BLOCK_PREFETCH_DEPTH 2
+struct pushedBlock {
+    bool valid;
+    uint64_t ver;
+    uint8_t blockId;
+};
+struct pushedBlock pushedBlocks[MAX_PUSHED_BLOCKS];
+uint8_t pushedBlocksNext = 0;
 
 bool txStart() {
     while (1) {
@@ -122,6 +135,344 @@ bool waitCmdReply() {
     return false;
 }
 
+// Framed serial protocol, see espFrameHeader in oepl-esp-ap-proto.h
+#define FRAME_BATCH_DELAY 5    // ms an SDA or CXD waits for others to share its frame
+#define FRAME_RETRY_DELAY 100  // ms before an unanswered frame is sent again, on top of its time on the wire
+#define FRAME_MAX_RETRIES 5
+#define FRAME_RX_SIZE 300  // largest frame from the AP, encoded
+
+struct frameSlot {
+    bool used;
+    uint8_t seq;
+    uint8_t count;  // commands in the frame
+    uint8_t retries;
+    uint32_t sentAt;
+    uint8_t* encoded;  // with delimiters, ready to be sent again
+    uint16_t encodedLen;
+};
+
+volatile bool framedSerial = false;
+SemaphoreHandle_t frameMutex;  // guards the slots and the batch
+struct frameSlot frameSlots[FRAME_WINDOW];
+volatile uint8_t frameReplies[256];  // CMD_REPLY_* by sequence number, FRAME_STATUS_* has the same values
+uint8_t frameNextSeq = 0;
+uint32_t frameWindowBytes = 0;
+uint8_t frameBatchType = 0;
+uint8_t frameBatchCount = 0;
+uint32_t frameBatchStarted = 0;
+struct pendingData frameBatch[FRAME_MAX_BATCH];
+uint8_t frameRxSeq = 0;  // next sequence number expected from the AP
+bool frameRxSynced = false;
+struct SerialAPStats serialAPStats = {0};
+
+void addRXQueue(uint8_t* data, uint8_t len, uint8_t type);
+
+// CRC-16/CCITT-FALSE, continued from crc. Start with 0xFFFF
+static uint16_t crc16(uint16_t crc, const void* data, uint32_t len) {
+    static const uint16_t table[16] = {0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+                                       0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF};
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (uint32_t c = 0; c < len; c++) {
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (bytes[c] >> 4)];
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (bytes[c] & 0x0F)];
+    }
+    return crc;
+}
+
+// COBS encoder taking its input in pieces. out needs room for len + len / 254 + 1 bytes
+class CobsEncoder {
+   public:
+    explicit CobsEncoder(uint8_t* out) : out(out) {}
+    void put(const void* data, uint32_t len) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        for (uint32_t c = 0; c < len; c++) {
+            if (bytes[c] != 0) {
+                out[pos++] = bytes[c];
+                code++;
+            }
+            if (bytes[c] == 0 || code == 0xFF) {
+                out[codePos] = code;
+                codePos = pos++;
+                code = 1;
+            }
+        }
+    }
+    uint32_t finish() {
+        out[codePos] = code;
+        return pos;
+    }
+
+   private:
+    uint8_t* out;
+    uint32_t pos = 1;
+    uint32_t codePos = 0;
+    uint8_t code = 1;
+};
+
+// decodes a COBS encoded frame in place, returns the decoded length or -1 if it isn't valid
+static int32_t cobsDecode(uint8_t* buf, uint32_t len) {
+    uint32_t in = 0;
+    uint32_t out = 0;
+    while (in < len) {
+        uint8_t code = buf[in++];
+        if (code == 0 || in + code - 1 > len) return -1;
+        for (uint8_t c = 1; c < code; c++) buf[out++] = buf[in++];
+        if (code != 0xFF && in < len) buf[out++] = 0;
+    }
+    return out;
+}
+
+void frameWrite(const uint8_t* data, const uint16_t len) {
+    txStart();
+    AP_SERIAL_PORT.write(data, len);
+    txEnd();
+}
+
+// oldest sequence number that may still be sent again
+uint8_t frameBaseLocked() {
+    uint8_t base = frameNextSeq;
+    for (uint8_t c = 0; c < FRAME_WINDOW; c++) {
+        if (frameSlots[c].used && (int8_t)(frameSlots[c].seq - base) < 0) base = frameSlots[c].seq;
+    }
+    return base;
+}
+
+void frameReleaseLocked(struct frameSlot* slot, const uint8_t reply) {
+    free(slot->encoded);
+    slot->encoded = nullptr;
+    slot->used = false;
+    frameWindowBytes -= slot->encodedLen;
+    frameReplies[slot->seq] = reply;
+}
+
+void frameResendLocked(struct frameSlot* slot) {
+    slot->retries++;
+    serialAPStats.retransmits++;
+    frameWrite(slot->encoded, slot->encodedLen);
+    slot->sentAt = millis();
+}
+
+// sends a frame and keeps it until the AP answers. Returns the sequence number, or -1 if there is no room in the window
+int16_t frameQueueLocked(const uint8_t type, const void* head, const uint16_t headLen, const void* data, const uint16_t dataLen, const uint8_t count) {
+    struct frameSlot* slot = &frameSlots[frameNextSeq % FRAME_WINDOW];
+    const uint32_t len = sizeof(struct espFrameHeader) + headLen + dataLen + 2;
+    const uint32_t maxEncodedLen = len + len / 254 + 3;
+    if (slot->used) return -1;
+    if (frameWindowBytes && (frameWindowBytes + maxEncodedLen > FRAME_WINDOW_BYTES)) return -1;
+    uint8_t* encoded = static_cast<uint8_t*>(malloc(maxEncodedLen));
+    if (encoded == nullptr) return -1;
+
+    struct espFrameHeader fh = {type, frameNextSeq, frameBaseLocked()};
+    uint16_t crc = crc16(0xFFFF, &fh, sizeof(fh));
+    crc = crc16(crc, head, headLen);
+    crc = crc16(crc, data, dataLen);
+    const uint8_t crcBytes[2] = {(uint8_t)(crc & 0xFF), (uint8_t)(crc >> 8)};
+    CobsEncoder encoder(encoded + 1);
+    encoder.put(&fh, sizeof(fh));
+    encoder.put(head, headLen);
+    encoder.put(data, dataLen);
+    encoder.put(crcBytes, 2);
+    encoded[0] = 0x00;
+    uint16_t encodedLen = encoder.finish() + 1;
+    encoded[encodedLen++] = 0x00;
+
+    slot->used = true;
+    slot->seq = frameNextSeq++;
+    slot->count = count;
+    slot->retries = 0;
+    slot->encoded = encoded;
+    slot->encodedLen = encodedLen;
+    frameWindowBytes += encodedLen;
+    frameReplies[slot->seq] = CMD_REPLY_WAIT;
+    serialAPStats.frames += count;
+    uint8_t inFlight = 0;
+    for (uint8_t c = 0; c < FRAME_WINDOW; c++) {
+        if (frameSlots[c].used) inFlight++;
+    }
+    if (inFlight > serialAPStats.inFlightPeak) serialAPStats.inFlightPeak = inFlight;
+    frameWrite(encoded, encodedLen);
+    slot->sentAt = millis();
+    return slot->seq;
+}
+
+bool frameBatchFlushLocked() {
+    if (frameBatchCount == 0) return true;
+    if (frameQueueLocked(frameBatchType, frameBatch, frameBatchCount * sizeof(struct pendingData), nullptr, 0, frameBatchCount) < 0) return false;
+    if (frameBatchCount > 1) serialAPStats.batched += frameBatchCount;
+    frameBatchCount = 0;
+    return true;
+}
+
+// sends a frame after whatever was batched, waiting for room in the window. Returns the sequence number, or -1
+int16_t frameSend(const uint8_t type, const void* head, const uint16_t headLen, const void* data = nullptr, const uint16_t dataLen = 0) {
+    const uint32_t start = millis();
+    while (framedSerial) {
+        int16_t seq = -1;
+        xSemaphoreTake(frameMutex, portMAX_DELAY);
+        if (frameBatchFlushLocked()) seq = frameQueueLocked(type, head, headLen, data, dataLen, 1);
+        xSemaphoreGive(frameMutex);
+        if (seq >= 0) return seq;
+        if (millis() - start > 2000) break;
+        vTaskDelay(1 / portTICK_PERIOD_MS);
+    }
+    return -1;
+}
+
+// adds an SDA or CXD to the batch, it goes out when the batch is full or FRAME_BATCH_DELAY later
+bool frameBatchAdd(const uint8_t type, const struct pendingData* pending) {
+    const uint32_t start = millis();
+    while (framedSerial) {
+        bool added = false;
+        xSemaphoreTake(frameMutex, portMAX_DELAY);
+        if (frameBatchCount && (frameBatchType != type || frameBatchCount == FRAME_MAX_BATCH)) frameBatchFlushLocked();
+        if (frameBatchCount == 0) {
+            frameBatchType = type;
+            frameBatchStarted = millis();
+        }
+        if (frameBatchType == type && frameBatchCount < FRAME_MAX_BATCH) {
+            frameBatch[frameBatchCount++] = *pending;
+            if (frameBatchCount == FRAME_MAX_BATCH) frameBatchFlushLocked();
+            added = true;
+        }
+        xSemaphoreGive(frameMutex);
+        if (added) return true;
+        if (millis() - start > 2000) break;
+        vTaskDelay(1 / portTICK_PERIOD_MS);
+    }
+    return false;
+}
+
+// waits for the AP to answer a frame, returns the CMD_REPLY_*
+uint8_t frameWait(const int16_t seq) {
+    if (seq < 0) return CMD_REPLY_NOK;
+    const uint32_t start = millis();
+    while (frameReplies[seq] == CMD_REPLY_WAIT && millis() - start < 5000) {
+        vTaskDelay(1 / portTICK_PERIOD_MS);
+    }
+    if (frameReplies[seq] == CMD_REPLY_ACK && apInfo.isOnline == false) setAPstate(true, AP_STATE_ONLINE);
+    return frameReplies[seq];
+}
+
+// drops everything in flight, for when either side starts over
+void frameReset() {
+    xSemaphoreTake(frameMutex, portMAX_DELAY);
+    for (uint8_t c = 0; c < FRAME_WINDOW; c++) {
+        if (frameSlots[c].used) frameReleaseLocked(&frameSlots[c], CMD_REPLY_NOK);
+    }
+    frameBatchCount = 0;
+    frameNextSeq = 0;
+    frameRxSynced = false;
+    xSemaphoreGive(frameMutex);
+}
+
+// sends frames that weren't answered in time again, and the batch when it has waited long enough
+void frameHousekeeping() {
+    uint8_t failed = 0;
+    xSemaphoreTake(frameMutex, portMAX_DELAY);
+    for (uint8_t c = 0; c < FRAME_WINDOW; c++) {
+        struct frameSlot* slot = &frameSlots[c];
+        if (!slot->used || (millis() - slot->sentAt < (uint32_t)(FRAME_RETRY_DELAY + slot->encodedLen / 8))) continue;
+        if (slot->retries < FRAME_MAX_RETRIES) {
+            frameResendLocked(slot);
+        } else {
+            // the AP skips it when it sees the base of the next frame
+            failed += slot->count;
+            frameReleaseLocked(slot, CMD_REPLY_NOK);
+        }
+    }
+    if (frameBatchCount && (millis() - frameBatchStarted >= FRAME_BATCH_DELAY)) frameBatchFlushLocked();
+    serialAPStats.failed += failed;
+    xSemaphoreGive(frameMutex);
+    if (failed) Serial.printf("AP didn't answer %d commands\r\n", failed);
+}
+
+void frameResult(const uint8_t* payload, const uint16_t len) {
+    if (len < 2) return;
+    const struct espFrameResult* fr = (const struct espFrameResult*)payload;
+    uint8_t refused = 0;
+    xSemaphoreTake(frameMutex, portMAX_DELAY);
+    struct frameSlot* slot = &frameSlots[fr->seq % FRAME_WINDOW];
+    if (slot->used && slot->seq == fr->seq) {
+        uint8_t reply = CMD_REPLY_ACK;
+        for (uint16_t c = 0; c < len - 1; c++) {
+            if (fr->status[c] == FRAME_STATUS_NOQ) refused++;
+            if (fr->status[c] != FRAME_STATUS_ACK) reply = fr->status[c];
+        }
+        frameReleaseLocked(slot, reply);
+    }
+    xSemaphoreGive(frameMutex);
+    lastAPActivity = millis();
+    if (refused) Serial.printf("AP has no room for %d of %d pending entries\r\n", refused, len - 1);
+}
+
+void frameNak(const uint8_t seq) {
+    serialAPStats.naks++;
+    xSemaphoreTake(frameMutex, portMAX_DELAY);
+    struct frameSlot* slot = &frameSlots[seq % FRAME_WINDOW];
+    // it may have been sent again already, while the AP was asking
+    if (slot->used && slot->seq == seq && millis() - slot->sentAt > 10) frameResendLocked(slot);
+    xSemaphoreGive(frameMutex);
+}
+
+void frameEvent(const uint8_t* payload, const uint16_t len, const uint16_t expected, const uint8_t type) {
+    if (len != expected) return;
+    uint8_t* packetp = (uint8_t*)calloc(len + 8, 1);
+    if (packetp == nullptr) return;
+    memcpy(packetp, payload, len);
+    lastAPActivity = millis();
+    addRXQueue(packetp, len, type);
+}
+
+void frameReceived(uint8_t* buffer, const uint16_t encodedLen) {
+    // frame types aren't printable, so this is debug output from the AP
+    bool printable = true;
+    for (uint16_t c = 0; c < encodedLen; c++) {
+        if ((buffer[c] < 0x20 || buffer[c] > 0x7E) && buffer[c] != '\r' && buffer[c] != '\n') printable = false;
+    }
+    if (printable) {
+        Serial.write(buffer, encodedLen);
+        return;
+    }
+    int32_t len = cobsDecode(buffer, encodedLen);
+    if (len < (int32_t)(sizeof(struct espFrameHeader) + 2) || crc16(0xFFFF, buffer, len - 2) != (buffer[len - 2] | (buffer[len - 1] << 8))) {
+        serialAPStats.crcErrors++;
+        return;
+    }
+    len -= sizeof(struct espFrameHeader) + 2;
+    const struct espFrameHeader* fh = (const struct espFrameHeader*)buffer;
+    const uint8_t* payload = buffer + sizeof(struct espFrameHeader);
+    if (frameRxSynced) serialAPStats.lost += (uint8_t)(fh->seq - frameRxSeq);
+    frameRxSeq = fh->seq + 1;
+    frameRxSynced = true;
+    switch (fh->type) {
+        case FRAME_RESULT:
+            frameResult(payload, len);
+            break;
+        case FRAME_NAK:
+            if (len == 1) frameNak(payload[0]);
+            break;
+        case FRAME_RQB:
+            frameEvent(payload, len, sizeof(struct espBlockRequest), RX_CMD_RQB);
+            break;
+        case FRAME_ADR:
+            frameEvent(payload, len, sizeof(struct espAvailDataReq), RX_CMD_ADR);
+            break;
+        case FRAME_XFC:
+            frameEvent(payload, len, sizeof(struct espXferComplete), RX_CMD_XFC);
+            break;
+        case FRAME_XTO:
+            frameEvent(payload, len, sizeof(struct espXferComplete), RX_CMD_XTO);
+            break;
+        case FRAME_TRD:
+            if (len > 10) frameEvent(payload, len, payload[9] + 10, RX_CMD_TRD);
+            break;
+    }
+}
+
+SerialAPStats getSerialAPStats() {
+    return serialAPStats;
+}
+
 #if (AP_PROCESS_PORT == FLASHER_AP_PORT)
 int8_t APpowerPins[] = FLASHER_AP_POWER;
 #define AP_RESET_PIN FLASHER_AP_RESET
@@ -204,33 +555,22 @@ void APTagReset() {
     vTaskDelay(100 / portTICK_PERIOD_MS);
 }
 
-// Send data to the AP
-uint16_t sendBlock(const void* data, const uint16_t len) {
-    time_t timeCanary = millis();
-    if (apInfo.state == AP_STATE_NORADIO) return true;
-    if (!apInfo.isOnline) return false;
-    if (!txStart()) return 0;
-    // don't retry now, as it collides with communication from the tag
-    for (uint8_t attempt = 0; attempt < 1; attempt++) {
-        cmdReplyValue = CMD_REPLY_WAIT;
-        AP_SERIAL_PORT.print(">D>");
-        if (waitCmdReply()) goto blksend;
-        Serial.printf("block send failed in try %d\r\n", attempt);
+uint16_t blockChecksum(const void* data, const uint16_t len) {
+    uint16_t checksum = 0;
+    const uint8_t* dataBytes = reinterpret_cast<const uint8_t*>(data);
+    for (uint16_t c = 0; c < len; c++) {
+        checksum += dataBytes[c];
     }
-    Serial.print("Failed sending block...\r\n");
-    txEnd();
-    return 0;
-blksend:
+    return checksum;
+}
+
+// Write a block of data to the AP, after it acknowledged a block transfer
+uint16_t writeBlockData(const void* data, const uint16_t len) {
     uint8_t blockbuffer[sizeof(struct blockData)];
     struct blockData* bd = (struct blockData*)blockbuffer;
     bd->size = len;
-    bd->checksum = 0;
-
-    // calculate checksum
-    const uint8_t* dataBytes = reinterpret_cast<const uint8_t*>(data);
-    for (uint16_t c = 0; c < len; c++) {
-        bd->checksum += dataBytes[c];
-    }
+    bd->checksum = blockChecksum(data, len);
+    const uint8_t* dataBytes;
 
     // send blockData header
     dataBytes = reinterpret_cast<const uint8_t*>(&blockbuffer);
@@ -269,17 +609,120 @@ blksend:
     memset(dummyBuffer, 0xF5, 32);
     AP_SERIAL_PORT.write(dummyBuffer, 32);
 
+    return bd->checksum;
+}
+
+// Send data to the AP, as the answer to the block request for ver and blockId
+uint16_t sendBlock(const void* data, const uint16_t len, const uint64_t ver, const uint8_t blockId) {
+    time_t timeCanary = millis();
+    if (apInfo.state == AP_STATE_NORADIO) return true;
+    if (!apInfo.isOnline) return false;
+    if (framedSerial) {
+        // named, so the AP can drop the answer to a request it already gave up on
+        uint8_t head[sizeof(struct espBlockPush) + sizeof(struct blockData)];
+        struct espBlockPush* bp = (struct espBlockPush*)head;
+        struct blockData* bd = (struct blockData*)(head + sizeof(struct espBlockPush));
+        bp->ver = ver;
+        bp->blockId = blockId;
+        addCRC(bp, sizeof(struct espBlockPush));
+        bd->size = len;
+        bd->checksum = blockChecksum(data, len);
+        if (frameSend(FRAME_BLOCK, head, sizeof(head), data, len) < 0) return 0;
+        Serial.println("Sendblock queued, " + String(millis() - timeCanary) + "ms");
+        return bd->checksum;
+    }
+    if (!txStart()) return 0;
+    // don't retry now, as it collides with communication from the tag
+    for (uint8_t attempt = 0; attempt < 1; attempt++) {
+        cmdReplyValue = CMD_REPLY_WAIT;
+        AP_SERIAL_PORT.print(">D>");
+        if (waitCmdReply()) goto blksend;
+        Serial.printf("block send failed in try %d\r\n", attempt);
+    }
+    Serial.print("Failed sending block...\r\n");
+    txEnd();
+    return 0;
+blksend:
+    uint16_t checksum = writeBlockData(data, len);
     if (apInfo.type != ESP32_C6) delay(10);
     txEnd();
     Serial.println("Sendblock complete, " + String(millis() - timeCanary) + "ms");
-    return bd->checksum;
+    return checksum;
+}
+
+bool isBlockPushed(const uint64_t ver, const uint8_t blockId) {
+    for (uint8_t c = 0; c < MAX_PUSHED_BLOCKS; c++) {
+        if (pushedBlocks[c].valid && pushedBlocks[c].ver == ver && pushedBlocks[c].blockId == blockId) return true;
+    }
+    return false;
+}
+
+void clearPushedBlocks() {
+    memset(pushedBlocks, 0, sizeof(pushedBlocks));
+    pushedBlocksNext = 0;
+}
+
+// Push a block into the AP's block cache, before a tag asks for it
+bool sendBlockPush(const uint64_t ver, const uint8_t blockId, const void* data, const uint16_t len) {
+    if (!apInfo.isOnline || apInfo.blockCache == 0) return false;
+    struct espBlockPush bp = {0};
+    bp.ver = ver;
+    bp.blockId = blockId;
+    addCRC(&bp, sizeof(struct espBlockPush));
+    if (framedSerial) {
+        uint8_t head[sizeof(struct espBlockPush) + sizeof(struct blockData)];
+        struct blockData* bd = (struct blockData*)(head + sizeof(struct espBlockPush));
+        memcpy(head, &bp, sizeof(struct espBlockPush));
+        bd->size = len;
+        bd->checksum = blockChecksum(data, len);
+        if (frameSend(FRAME_BKP, head, sizeof(head), data, len) < 0) return false;
+    } else {
+        if (!txStart()) return false;
+        cmdReplyValue = CMD_REPLY_WAIT;
+        AP_SERIAL_PORT.print("BKP>");
+        AP_SERIAL_PORT.write((uint8_t*)&bp, sizeof(struct espBlockPush));
+        if (!waitCmdReply()) {
+            Serial.print("Block push refused\r\n");
+            txEnd();
+            return false;
+        }
+        writeBlockData(data, len);
+        txEnd();
+    }
+
+    uint8_t capacity = min(apInfo.blockCache, (uint8_t)MAX_PUSHED_BLOCKS);
+    pushedBlocksNext %= capacity;
+    pushedBlocks[pushedBlocksNext].valid = true;
+    pushedBlocks[pushedBlocksNext].ver = ver;
+    pushedBlocks[pushedBlocksNext].blockId = blockId;
+    pushedBlocksNext = (pushedBlocksNext + 1) % capacity;
+    return true;
+}
+
+// Push the blocks following blockId into the AP's cache, as long as there are no other requests waiting
+void prefetchBlocks(const uint8_t* data, const uint32_t datalen, const uint64_t ver, const uint8_t blockId) {
+    if (apInfo.blockCache == 0) return;
+    uint8_t totalblocks = (datalen / BLOCK_DATA_SIZE);
+    if (datalen % BLOCK_DATA_SIZE) totalblocks++;
+    // leave room in the cache for transfers to other tags
+    uint8_t depth = min((uint8_t)BLOCK_PREFETCH_DEPTH, (uint8_t)max(1, apInfo.blockCache / 2));
+
+    for (uint8_t next = blockId + 1; (next < totalblocks) && (next <= blockId + depth); next++) {
+        if (uxQueueMessagesWaiting(rxCmdQueue) > 0) return;
+        if (isBlockPushed(ver, next)) continue;
+        uint32_t len = datalen - (BLOCK_DATA_SIZE * next);
+        if (len > BLOCK_DATA_SIZE) len = BLOCK_DATA_SIZE;
+        if (!sendBlockPush(ver, next, data + (next * BLOCK_DATA_SIZE), len)) return;
+        Serial.printf("<BKP block %d, len %d\r\n", next, len);
+    }
 }
 
 bool sendDataAvail(struct pendingData* pending) {
     if (apInfo.state == AP_STATE_NORADIO) return true;
     if (!apInfo.isOnline) return false;
-    if (!txStart()) return false;
     addCRC(pending, sizeof(struct pendingData));
+    if (framedSerial) return frameBatchAdd(FRAME_SDA, pending);
+    if (!txStart()) return false;
     for (uint8_t attempt = 0; attempt < 5; attempt++) {
         cmdReplyValue = CMD_REPLY_WAIT;
         AP_SERIAL_PORT.print("SDA>");
@@ -300,8 +743,9 @@ bool sendDataAvail(struct pendingData* pending) {
 bool sendCancelPending(struct pendingData* pending) {
     if (apInfo.state == AP_STATE_NORADIO) return true;
     if (!apInfo.isOnline) return false;
-    if (!txStart()) return false;
     addCRC(pending, sizeof(struct pendingData));
+    if (framedSerial) return frameBatchAdd(FRAME_CXD, pending);
+    if (!txStart()) return false;
     for (uint8_t attempt = 0; attempt < 5; attempt++) {
         cmdReplyValue = CMD_REPLY_WAIT;
         AP_SERIAL_PORT.print("CXD>");
@@ -321,8 +765,17 @@ bool sendCancelPending(struct pendingData* pending) {
 bool sendChannelPower(struct espSetChannelPower* scp) {
     if (apInfo.state == AP_STATE_NORADIO) return true;
     if ((apInfo.state != AP_STATE_ONLINE) && (apInfo.state != AP_STATE_COMING_ONLINE)) return false;
-    if (!txStart()) return false;
     addCRC(scp, sizeof(struct espSetChannelPower));
+    if (framedSerial) {
+        if (frameWait(frameSend(FRAME_SCP, scp, sizeof(struct espSetChannelPower))) != CMD_REPLY_ACK) {
+            Serial.print("SCP failed to send...\r\n");
+            return false;
+        }
+        apInfo.channel = scp->channel;
+        apInfo.power = scp->power;
+        return true;
+    }
+    if (!txStart()) return false;
     for (uint8_t attempt = 0; attempt < 5; attempt++) {
         cmdReplyValue = CMD_REPLY_WAIT;
         AP_SERIAL_PORT.print("SCP>");
@@ -346,6 +799,11 @@ bool sendPing() {
     if (apInfo.state == AP_STATE_FLASHING) return false;
     Serial.print("ping");
     int t = millis();
+    if (framedSerial) {
+        const bool reply = (frameWait(frameSend(FRAME_PING, nullptr, 0)) == CMD_REPLY_ACK);
+        Serial.printf(reply ? " ok, %dms\r\n" : " failed\r\n", millis() - t);
+        return reply;
+    }
     if (!txStart()) return false;
     for (uint8_t attempt = 0; attempt < 3; attempt++) {
         cmdReplyValue = CMD_REPLY_WAIT;
@@ -363,6 +821,10 @@ bool sendPing() {
 bool sendGetInfo() {
     if (apInfo.state == AP_STATE_NORADIO) return true;
     if (!txStart()) return false;
+    // only reported by APs that accept block pushes
+    apInfo.blockCache = 0;
+    apInfo.framing = 0;
+    clearPushedBlocks();
     for (uint8_t attempt = 0; attempt < 5; attempt++) {
         cmdReplyValue = CMD_REPLY_WAIT;
         AP_SERIAL_PORT.print("NFO?");
@@ -389,6 +851,25 @@ bool sendHighspeed() {
     return false;
 }
 
+// switch to the framed protocol, the AP acknowledges in text and expects frames after that
+bool sendFraming() {
+    if (apInfo.state == AP_STATE_NORADIO) return false;
+    frameReset();
+    if (!txStart()) return false;
+    for (uint8_t attempt = 0; attempt < 5; attempt++) {
+        cmdReplyValue = CMD_REPLY_WAIT;
+        AP_SERIAL_PORT.print("FRM!");
+        if (waitCmdReply()) {
+            framedSerial = true;
+            serialAPStats.framed = true;
+            txEnd();
+            return true;
+        }
+    }
+    txEnd();
+    return false;
+}
+
 // add RX'd request from the AP to the processor queue
 void addRXQueue(uint8_t* data, uint8_t len, uint8_t type) {
     struct rxCmd* rxcmd = new struct rxCmd;
@@ -407,6 +888,7 @@ void rxCmdProcessor(void* parameter) {
     rxCmdQueue = xQueueCreate(30, sizeof(struct rxCmd*));
     txActive = xSemaphoreCreateBinary();
     xSemaphoreGive(txActive);
+    frameMutex = xSemaphoreCreateMutex();
     while (1) {
         if (apInfo.isOnline) {
             struct rxCmd* rxcmd = nullptr;
@@ -438,6 +920,7 @@ void rxCmdProcessor(void* parameter) {
                         break;
                     case RX_CMD_RSET:
                         Serial.println("AP did reset, resending pending\r\n");
+                        clearPushedBlocks();
                         refreshAllPending();
                         sendChannelPower(&curChannel);
                         break;
@@ -461,12 +944,24 @@ void rxSerialTask(void* parameter) {
     static uint8_t RXState = ZBS_RX_WAIT_HEADER;
     static char lastchar = 0;
     static uint8_t charindex = 0;
+    static uint8_t frameRx[FRAME_RX_SIZE];
+    static uint16_t frameRxLen = 0;
 
     gSerialTaskState = SERIAL_STATE_RUNNING;
     LOG("rxSerialTask starting\n");
     while (gSerialTaskState == SERIAL_STATE_RUNNING) {
         while (AP_SERIAL_PORT.available()) {
             lastchar = AP_SERIAL_PORT.read();
+            if (framedSerial) {
+                if (lastchar == 0x00) {
+                    if (frameRxLen > 0 && frameRxLen <= FRAME_RX_SIZE) frameReceived(frameRx, frameRxLen);
+                    frameRxLen = 0;
+                } else {
+                    if (frameRxLen < FRAME_RX_SIZE) frameRx[frameRxLen] = lastchar;
+                    if (frameRxLen <= FRAME_RX_SIZE) frameRxLen++;
+                }
+                continue;
+            }
             switch (RXState) {
                 case ZBS_RX_WAIT_HEADER:
 
@@ -520,6 +1015,16 @@ void rxSerialTask(void* parameter) {
                         charindex = 0;
                         memset(cmdbuffer, 0x00, 4);
                     }
+                    if ((strncmp(cmdbuffer, "BKC>", 4) == 0)) {
+                        RXState = ZBS_RX_WAIT_BLOCKCACHE;
+                        charindex = 0;
+                        memset(cmdbuffer, 0x00, 4);
+                    }
+                    if ((strncmp(cmdbuffer, "FRM>", 4) == 0)) {
+                        RXState = ZBS_RX_WAIT_FRAMING;
+                        charindex = 0;
+                        memset(cmdbuffer, 0x00, 4);
+                    }
                     if ((strncmp(cmdbuffer, "TYP>", 4) == 0)) {
                         RXState = ZBS_RX_WAIT_TYPE;
                         charindex = 0;
@@ -681,6 +1186,22 @@ void rxSerialTask(void* parameter) {
                         apInfo.nop = (uint8_t)strtoul(cmdbuffer, NULL, 16);
                     }
                     break;
+                case ZBS_RX_WAIT_BLOCKCACHE:
+                    cmdbuffer[charindex] = lastchar;
+                    charindex++;
+                    if (charindex == 2) {
+                        RXState = ZBS_RX_WAIT_HEADER;
+                        apInfo.blockCache = (uint8_t)strtoul(cmdbuffer, NULL, 16);
+                    }
+                    break;
+                case ZBS_RX_WAIT_FRAMING:
+                    cmdbuffer[charindex] = lastchar;
+                    charindex++;
+                    if (charindex == 2) {
+                        RXState = ZBS_RX_WAIT_HEADER;
+                        apInfo.framing = (uint8_t)strtoul(cmdbuffer, NULL, 16);
+                    }
+                    break;
                 case ZBS_RX_WAIT_TYPE:
                     cmdbuffer[charindex] = lastchar;
                     charindex++;
@@ -691,6 +1212,7 @@ void rxSerialTask(void* parameter) {
                     break;
             }
         }
+        if (framedSerial) frameHousekeeping();
         vTaskDelay(1 / portTICK_PERIOD_MS);
     }  // end of while(1)
 
@@ -843,10 +1365,16 @@ bool bringAPOnline(uint8_t newState) {
     }
     if (gSerialTaskState != SERIAL_STATE_RUNNING) {
         gSerialTaskState = SERIAL_STATE_STARTING;
-        xTaskCreate(rxSerialTask, "rxSerialTask", 1750, NULL, 11, NULL);
+        xTaskCreate(rxSerialTask, "rxSerialTask", 3000, NULL, 11, NULL);
         vTaskDelay(500 / portTICK_PERIOD_MS);
     }
     setAPstate(false, AP_STATE_OFFLINE);
+    // start over in text, an AP in framed mode falls back when it sees RDY?
+    if (framedSerial) {
+        framedSerial = false;
+        serialAPStats.framed = false;
+        frameReset();
+    }
     // try without rebooting
     AP_SERIAL_PORT.updateBaudRate(115200);
     uint32_t bootTimeout = millis();
@@ -880,6 +1408,9 @@ bool bringAPOnline(uint8_t newState) {
                 Serial.println("switched to 2000000 baud");
             }
         }
+        if (apInfo.framing == FRAME_PROTOCOL_VERSION && sendFraming()) {
+            Serial.println("switched to framed serial");
+        }
 
         vTaskDelay(200 / portTICK_PERIOD_MS);
         setAPstate(newState == AP_STATE_ONLINE ? true : false, newState);
@@ -5,8 +5,12 @@
 #include <Preferences.h>
 #include <esp_sntp.h>
 
+#include <atomic>
+#include <mutex>
+
 #include "storage.h"
 #include "tag_db.h"
+#include "web.h"
 #include "wifimanager.h"
 
 void timeSyncCallback(struct timeval* tv) {
@@ -37,6 +41,54 @@ void initTime(void* parameter) {
     vTaskDelete(NULL);
 }
 
+// Log lines go into a ring of records, one word header, seconds since epoch, then the text.
+// Producers reserve space by moving logHead with a compare and swap, and publish a record by
+// writing its header last. The log task is the only consumer, it zeroes what it has read
+// before moving logTail past it, so a header of 0 means not written yet.
+static_assert((LOG_BUFFER & (LOG_BUFFER - 1)) == 0 && LOG_BUFFER <= 32768, "LOG_BUFFER must be a power of two, up to 32768");
+static uint8_t* logBuffer = nullptr;
+static std::atomic<uint32_t> logHead(0);
+static std::atomic<uint32_t> logTail(0);
+static std::atomic<uint32_t> logDropped(0);
+static std::atomic<uint32_t> logPeak(0);
+static std::mutex logFlushMutex;
+static TaskHandle_t logTaskHandle = nullptr;
+static LogStats logStats = {0};
+
+static void logPublish(uint8_t* record, const uint32_t size, const uint32_t textLen) {
+    __atomic_store_n(reinterpret_cast<uint32_t*>(record), size | (textLen << 16), __ATOMIC_RELEASE);
+}
+
+static String logTime(const time_t time) {
+    struct tm timeinfo;
+    localtime_r(&time, &timeinfo);
+    char timeStr[24];
+    const char* format = (time < (time_t)1672531200) ? "           %H:%M:%S " : "%Y-%m-%d %H:%M:%S ";
+    strftime(timeStr, sizeof(timeStr), format, &timeinfo);
+    return String(timeStr);
+}
+
+// Appends to /log.txt, rotating it into /logold.txt at LOG_ROTATE_SIZE
+static size_t logAppend(const String& batch) {
+    // without the ring, lines also come from code that holds fsMutex already, like loadDBbin and saveDBbin
+    const bool holding = xSemaphoreGetMutexHolder(fsMutex) == xTaskGetCurrentTaskHandle();
+    if (!holding) xSemaphoreTake(fsMutex, portMAX_DELAY);
+    File logFile = contentFS->open("/log.txt", "a");
+    if (logFile && logFile.size() >= LOG_ROTATE_SIZE) {
+        logFile.close();
+        contentFS->remove("/logold.txt");
+        contentFS->rename("/log.txt", "/logold.txt");
+        logFile = contentFS->open("/log.txt", "a");
+    }
+    size_t written = 0;
+    if (logFile) {
+        written = logFile.print(batch);
+        logFile.close();
+    }
+    if (!holding) xSemaphoreGive(fsMutex);
+    return written;
+}
+
 void logLine(const char* buffer) {
     logLine(String(buffer));
 }
@@ -44,30 +96,110 @@ void logLine(const char* buffer) {
 void logLine(const String& text) {
     time_t now;
     time(&now);
+    if (logBuffer == nullptr) {
+        // before initLog() or when the ring couldn't be allocated, append the line right away
+        if (fsMutex == nullptr) {
+            logDropped++;
+            return;
+        }
+        const size_t written = logAppend(logTime(now) + text + "\r\n");
+        std::lock_guard<std::mutex> lock(logFlushMutex);
+        logStats.lines++;
+        logStats.bytes += written;
+        return;
+    }
+    const uint32_t seconds = now;
+    const uint32_t textLen = std::min<uint32_t>(text.length(), LOG_BUFFER / 4);
+    const uint32_t size = (8 + textLen + 3) & ~3;
 
-    char timeStr[24];
-    const char* format = (now < (time_t)1672531200) ? "           %H:%M:%S " : "%Y-%m-%d %H:%M:%S ";
-    strftime(timeStr, sizeof(timeStr), format, localtime(&now));
+    uint32_t head = logHead.load(std::memory_order_relaxed);
+    uint32_t pad;
+    uint32_t used;
+    do {
+        // records don't wrap, the rest of the ring is skipped instead
+        const uint32_t offset = head & (LOG_BUFFER - 1);
+        pad = (offset + size > LOG_BUFFER) ? LOG_BUFFER - offset : 0;
+        used = head + pad + size - logTail.load(std::memory_order_acquire);
+        if (used > LOG_BUFFER) {
+            logDropped++;
+            return;
+        }
+    } while (!logHead.compare_exchange_weak(head, head + pad + size, std::memory_order_acq_rel, std::memory_order_relaxed));
 
-    xSemaphoreTake(fsMutex, portMAX_DELAY);
-    File logFile = contentFS->open("/log.txt", "a");
-    if (logFile) {
-        if (logFile.size() >= 10 * 1024) {
-            logFile.close();
-            contentFS->remove("/logold.txt");
-            contentFS->rename("/log.txt", "/logold.txt");
-            logFile = contentFS->open("/log.txt", "a");
-            if (!logFile) {
-                xSemaphoreGive(fsMutex);
-                return;
-            }
+    if (pad) logPublish(logBuffer + (head & (LOG_BUFFER - 1)), pad, 0);
+    uint8_t* record = logBuffer + ((head + pad) & (LOG_BUFFER - 1));
+    memcpy(record + 4, &seconds, sizeof(seconds));
+    memcpy(record + 8, text.c_str(), textLen);
+    logPublish(record, size, textLen);
+
+    uint32_t peak = logPeak.load(std::memory_order_relaxed);
+    while (used > peak && !logPeak.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+    }
+    if (used > LOG_BUFFER / 2 && logTaskHandle) xTaskNotifyGive(logTaskHandle);
+}
+
+/// @brief Write the lines in the buffer to /log.txt and the web UI
+void logFlush() {
+    std::lock_guard<std::mutex> lock(logFlushMutex);
+    if (logBuffer == nullptr) return;
+
+    String batch;
+    uint32_t tail = logTail.load(std::memory_order_relaxed);
+    const uint32_t head = logHead.load(std::memory_order_acquire);
+    while (tail != head) {
+        uint8_t* record = logBuffer + (tail & (LOG_BUFFER - 1));
+        const uint32_t header = __atomic_load_n(reinterpret_cast<uint32_t*>(record), __ATOMIC_ACQUIRE);
+        if (header == 0) break;  // reserved, but still being written
+        const uint32_t size = header & 0xFFFF;
+        const uint32_t textLen = header >> 16;
+        if (textLen) {
+            uint32_t seconds;
+            memcpy(&seconds, record + 4, sizeof(seconds));
+            String text;
+            text.concat(reinterpret_cast<const char*>(record + 8), textLen);
+            batch += logTime(seconds) + text + "\r\n";
+            wsSysLog(text);
+            logStats.lines++;
         }
+        memset(record, 0, size);
+        tail += size;
+        logTail.store(tail, std::memory_order_release);
+    }
+    const uint32_t dropped = logDropped.exchange(0);
+    if (dropped) {
+        time_t now;
+        time(&now);
+        batch += logTime(now) + String(dropped) + " log lines dropped\r\n";
+        logStats.dropped += dropped;
+    }
+    logStats.peak = logPeak.load(std::memory_order_relaxed);
+    if (batch.isEmpty()) return;
 
-        logFile.print(timeStr);
-        logFile.println(text);
-        logFile.close();
+    logStats.bytes += logAppend(batch);
+    logStats.flushes++;
+}
+
+static void logTask(void* parameter) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, LOG_FLUSH_INTERVAL / portTICK_PERIOD_MS);
+        logFlush();
     }
-    xSemaphoreGive(fsMutex);
+}
+
+void initLog() {
+    if (logBuffer) return;
+#ifdef BOARD_HAS_PSRAM
+    logBuffer = static_cast<uint8_t*>(ps_calloc(1, LOG_BUFFER));
+#else
+    logBuffer = static_cast<uint8_t*>(calloc(1, LOG_BUFFER));
+#endif
+    if (logBuffer == nullptr) return;
+    xTaskCreate(logTask, "logger", 5000, NULL, 1, &logTaskHandle);
+}
+
+LogStats getLogStats() {
+    std::lock_guard<std::mutex> lock(logFlushMutex);
+    return logStats;
 }
 
 void logStartUp() {
@@ -4,45 +4,100 @@
 #include <ArduinoJson.h>
 #include <FS.h>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
+#include "bufferpool.h"
 #include "language.h"
 #include "storage.h"
+#include "tagindex.h"
 #include "util.h"
 
 #define STR_IMPL(x) #x
 #define STR(x) STR_IMPL(x)
 
 std::vector<tagRecord*> tagDB;
+std::recursive_mutex tagDBMutex;
 std::unordered_map<std::string, varStruct> varDB;
 std::unordered_map<int, HwType> hwdata = {};
 
+// parsed tag types. getHwType() and getHwTemplate() fill them on first use,
+// writes to /tagtypes set tagTypesChanged to drop them on the next use
+static std::mutex tagTypeMutex;
+static std::map<uint16_t, std::string> hwTemplates;  // hwtype << 8 | content id, msgpack. empty if the tag type has none
+static std::atomic<bool> tagTypesChanged(false);
+static TagTypeCacheStats tagTypeStats = {0};
+
 Config config;
 
+static TagIndex tagIndex;
+static uint32_t pushedRecords = 0;
+// /get_db responses being written, see TagDBJsonWriter::onErase
+static std::vector<TagDBJsonWriter*> tagDBWriters;
+
+static inline uint64_t macKey(const uint8_t mac[8]) {
+    uint64_t key;
+    memcpy(&key, mac, sizeof(key));
+    return key;
+}
+
 tagRecord* tagRecord::findByMAC(const uint8_t mac[8]) {
-    for (tagRecord* tag : tagDB) {
-        if (memcmp(tag->mac, mac, 8) == 0 && tag->version == 0) {
-            return tag;
-        }
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    const uint32_t pos = tagIndex.find(macKey(mac));
+    return pos == TagIndex::EMPTY ? nullptr : tagDB[pos];
+}
+
+tagRecord* addRecord(const uint8_t mac[8]) {
+    tagRecord* tag = new tagRecord;
+    memcpy(tag->mac, mac, sizeof(tag->mac));
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    tagIndex.set(macKey(mac), tagDB.size());
+    tagDB.push_back(tag);
+    return tag;
+}
+
+// removes tagDB[pos] by moving the last record into its place
+static void eraseRecordAt(const uint32_t pos) {
+    const uint32_t last = tagDB.size() - 1;
+    if (!tagDBWriters.empty()) TagDBJsonWriter::onErase(pos, last);
+    tagRecord* tag = tagDB[pos];
+    if (tag->version == 0) {
+        tagIndex.erase(macKey(tag->mac));
+    } else {
+        pushedRecords--;
     }
-    return nullptr;
+    bufferpool::release(tag->data);
+    tag->data = nullptr;
+    delete tag;
+
+    if (pos != last) {
+        tagDB[pos] = tagDB[last];
+        if (tagDB[pos]->version == 0) tagIndex.set(macKey(tagDB[pos]->mac), pos);
+    }
+    tagDB.pop_back();
 }
 
 bool deleteRecord(const uint8_t mac[8], bool allVersions) {
-    for (uint32_t c = 0; c < tagDB.size(); c++) {
-        tagRecord* tag = tagDB.at(c);
-        if (memcmp(tag->mac, mac, 8) == 0 && (allVersions || tag->version == 0)) {
-            if (tag->data != nullptr) {
-                free(tag->data);
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    bool deleted = false;
+    const uint32_t pos = tagIndex.find(macKey(mac));
+    if (pos != TagIndex::EMPTY) {
+        eraseRecordAt(pos);
+        deleted = true;
+    }
+    if (allVersions && pushedRecords > 0) {
+        for (int32_t c = tagDB.size() - 1; c >= 0; --c) {
+            if (tagDB[c]->version != 0 && memcmp(tagDB[c]->mac, mac, 8) == 0) {
+                eraseRecordAt(c);
+                deleted = true;
             }
-            tag->data = nullptr;
-            delete tagDB[c];
-            tagDB.erase(tagDB.begin() + c);
-            return true;
         }
     }
-    return false;
+    return deleted;
 }
 
 void mac2hex(const uint8_t* mac, char* hexBuffer) {
@@ -66,62 +121,163 @@ bool hex2mac(const String& hexString, uint8_t* mac) {
     }
 }
 
-String tagDBtoJson(const uint8_t mac[8], uint8_t startPos) {
-    JsonDocument doc;
-    JsonArray tags = doc["tags"].to<JsonArray>();
+static bool isTimedOut(const tagRecord* taginfo, const time_t now) {
+    const int32_t timeout = now - taginfo->lastseen;
+    if (taginfo->expectedNextCheckin < 3600) {
+        // not initialised, timeout if not seen last 5 minutes
+        return timeout > config.maxsleep * 60 + 300;
+    } else if (now - static_cast<time_t>(taginfo->expectedNextCheckin) > 600) {
+        // expected checkin is behind, timeout if not seen last 5 minutes
+        return timeout > config.maxsleep * 60 + 300;
+    }
+    return false;
+}
 
-    for (uint32_t c = startPos; c < tagDB.size(); ++c) {
-        const tagRecord* taginfo = tagDB.at(c);
+static bool isLowBattery(const tagRecord* taginfo) {
+    return taginfo->batteryMv < 2400 && taginfo->batteryMv != 0 && taginfo->batteryMv != 1337;
+}
 
-        const bool select = !mac || memcmp(taginfo->mac, mac, 8) == 0;
-        if (select && taginfo->version == 0) {
-            JsonObject tag = tags.add<JsonObject>();
-            fillNode(tag, taginfo);
-            if (measureJson(doc) > 5000) {
-                doc["continu"] = c + 1;
-                break;
-            }
-            if (mac) {
-                break;
+static bool matches(const TagFilter& filter, const tagRecord* taginfo, const time_t now) {
+    if (filter.byMac && memcmp(taginfo->mac, filter.mac, 8) != 0) return false;
+    if (taginfo->lastChange < filter.changedSince) return false;
+    if (filter.hwType >= 0 && taginfo->hwType != filter.hwType) return false;
+    if (filter.contentMode >= 0 && taginfo->contentMode != filter.contentMode) return false;
+    if (filter.timedOut && !isTimedOut(taginfo, now)) return false;
+    if (filter.lowBattery && !isLowBattery(taginfo)) return false;
+    return true;
+}
+
+TagDBJsonWriter::TagDBJsonWriter(const TagFilter& filter, const uint32_t startPos) : filter(filter) {
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    if (filter.byMac) {
+        // nothing to walk, the one tag is looked up at the end
+        pos = UINT32_MAX;
+        moved.push_back(macKey(filter.mac));
+        return;
+    }
+    pos = std::min(startPos, (uint32_t)tagDB.size());
+    tagDBWriters.push_back(this);
+}
+
+TagDBJsonWriter::~TagDBJsonWriter() {
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    tagDBWriters.erase(std::remove(tagDBWriters.begin(), tagDBWriters.end(), this), tagDBWriters.end());
+}
+
+void TagDBJsonWriter::onErase(const uint32_t erased, const uint32_t last) {
+    const tagRecord* gone = tagDB[erased];
+    for (TagDBJsonWriter* writer : tagDBWriters) {
+        if (gone->version == 0) {
+            writer->moved.erase(std::remove(writer->moved.begin(), writer->moved.end(), macKey(gone->mac)), writer->moved.end());
+        }
+        if (erased < writer->pos && last >= writer->pos) {
+            if (tagDB[last]->version == 0) writer->moved.push_back(macKey(tagDB[last]->mac));
+        } else if (writer->pos > last) {
+            // the tags past the end are all written, one added later goes at the new end
+            writer->pos = last;
+        }
+    }
+}
+
+const tagRecord* TagDBJsonWriter::nextRecord() {
+    while (pos < tagDB.size()) {
+        const tagRecord* taginfo = tagDB[pos++];
+        if (taginfo->version == 0) return taginfo;
+    }
+    while (!moved.empty()) {
+        const uint64_t key = moved.back();
+        moved.pop_back();
+        const tagRecord* taginfo = tagRecord::findByMAC(reinterpret_cast<const uint8_t*>(&key));
+        if (taginfo != nullptr) return taginfo;
+    }
+    return nullptr;
+}
+
+void TagDBJsonWriter::next() {
+    pending = "";
+    pendingPos = 0;
+    switch (state) {
+        case State::Start:
+            pending = "{\"tags\":[";
+            state = State::Tags;
+            return;
+        case State::Tags: {
+            time_t now;
+            time(&now);
+            while (true) {
+                JsonDocument doc;
+                {
+                    // runs on the web server task, records may be added, changed or deleted between pieces
+                    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+                    const tagRecord* taginfo = nextRecord();
+                    if (taginfo == nullptr) break;
+                    if (!matches(filter, taginfo, now)) continue;
+                    JsonObject tag = doc.to<JsonObject>();
+                    fillNode(tag, taginfo);
+                }
+                if (count++) pending = ",";
+                pending += doc.as<String>();
+                return;
             }
+            pending = "]}";
+            state = State::Done;
+            return;
         }
+        case State::Done:
+            return;
     }
+}
 
-    return doc.as<String>();
+size_t TagDBJsonWriter::read(uint8_t* buffer, const size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (pendingPos == pending.length()) {
+            if (state == State::Done) break;
+            next();
+            continue;
+        }
+        const size_t len = std::min(maxLen - written, pending.length() - pendingPos);
+        memcpy(buffer + written, pending.c_str() + pendingPos, len);
+        pendingPos += len;
+        written += len;
+    }
+    return written;
 }
 
-void fillNode(JsonObject& tag, const tagRecord* taginfo) {
+void fillNode(JsonObject& tag, const tagRecord* taginfo, const uint32_t fields) {
     char hexmac[17];
     mac2hex(taginfo->mac, hexmac);
     tag["mac"] = String(hexmac);
-    char hex[33];
-    for (uint8_t i = 0; i < 16; i++) {
-        sprintf(hex + (i * 2), "%02x", taginfo->md5[i]);
+    if (fields & TAGFIELD_HASH) {
+        char hex[33];
+        for (uint8_t i = 0; i < 16; i++) {
+            sprintf(hex + (i * 2), "%02x", taginfo->md5[i]);
+        }
+        tag["hash"] = (String)hex;
     }
-    tag["hash"] = (String)hex;
-    tag["lastseen"] = taginfo->lastseen;
-    tag["nextupdate"] = taginfo->nextupdate;
-    tag["nextcheckin"] = taginfo->expectedNextCheckin;
-    tag["pending"] = taginfo->pendingCount;
-    tag["alias"] = taginfo->alias;
-    tag["contentMode"] = taginfo->contentMode;
-    tag["LQI"] = taginfo->LQI;
-    tag["RSSI"] = taginfo->RSSI;
-    tag["temperature"] = taginfo->temperature;
-    tag["batteryMv"] = taginfo->batteryMv;
-    tag["hwType"] = taginfo->hwType;
-    tag["wakeupReason"] = taginfo->wakeupReason;
-    tag["capabilities"] = taginfo->capabilities;
-    tag["modecfgjson"] = taginfo->modeConfigJson;
-    tag["isexternal"] = taginfo->isExternal;
-    tag["apip"] = taginfo->apIp.toString();
-    tag["rotate"] = taginfo->rotate;
-    tag["lut"] = taginfo->lut;
-    tag["invert"] = taginfo->invert;
-    tag["updatecount"] = taginfo->updateCount;
-    tag["updatelast"] = taginfo->updateLast;
-    tag["ch"] = taginfo->currentChannel;
-    tag["ver"] = taginfo->tagSoftwareVersion;
+    if (fields & TAGFIELD_LASTSEEN) tag["lastseen"] = taginfo->lastseen;
+    if (fields & TAGFIELD_NEXTUPDATE) tag["nextupdate"] = taginfo->nextupdate;
+    if (fields & TAGFIELD_NEXTCHECKIN) tag["nextcheckin"] = taginfo->expectedNextCheckin;
+    if (fields & TAGFIELD_PENDING) tag["pending"] = taginfo->pendingCount;
+    if (fields & TAGFIELD_ALIAS) tag["alias"] = taginfo->alias;
+    if (fields & TAGFIELD_CONTENTMODE) tag["contentMode"] = taginfo->contentMode;
+    if (fields & TAGFIELD_LQI) tag["LQI"] = taginfo->LQI;
+    if (fields & TAGFIELD_RSSI) tag["RSSI"] = taginfo->RSSI;
+    if (fields & TAGFIELD_TEMPERATURE) tag["temperature"] = taginfo->temperature;
+    if (fields & TAGFIELD_BATTERY) tag["batteryMv"] = taginfo->batteryMv;
+    if (fields & TAGFIELD_HWTYPE) tag["hwType"] = taginfo->hwType;
+    if (fields & TAGFIELD_WAKEUPREASON) tag["wakeupReason"] = taginfo->wakeupReason;
+    if (fields & TAGFIELD_CAPABILITIES) tag["capabilities"] = taginfo->capabilities;
+    if (fields & TAGFIELD_MODECFG) tag["modecfgjson"] = taginfo->modeConfigJson;
+    if (fields & TAGFIELD_ISEXTERNAL) tag["isexternal"] = taginfo->isExternal;
+    if (fields & TAGFIELD_APIP) tag["apip"] = taginfo->apIp.toString();
+    if (fields & TAGFIELD_ROTATE) tag["rotate"] = taginfo->rotate;
+    if (fields & TAGFIELD_LUT) tag["lut"] = taginfo->lut;
+    if (fields & TAGFIELD_INVERT) tag["invert"] = taginfo->invert;
+    if (fields & TAGFIELD_UPDATECOUNT) tag["updatecount"] = taginfo->updateCount;
+    if (fields & TAGFIELD_UPDATELAST) tag["updatelast"] = taginfo->updateLast;
+    if (fields & TAGFIELD_CHANNEL) tag["ch"] = taginfo->currentChannel;
+    if (fields & TAGFIELD_SWVERSION) tag["ver"] = taginfo->tagSoftwareVersion;
 }
 
 void saveDB(const String& filename) {
@@ -197,9 +353,7 @@ bool loadDB(const String& filename) {
                 if (hex2mac(dst, mac)) {
                     tagRecord* taginfo = tagRecord::findByMAC(mac);
                     if (taginfo == nullptr) {
-                        taginfo = new tagRecord;
-                        memcpy(taginfo->mac, mac, sizeof(taginfo->mac));
-                        tagDB.push_back(taginfo);
+                        taginfo = addRecord(mac);
                     }
                     String md5 = tag["hash"].as<String>();
                     if (md5.length() >= 32) {
@@ -233,6 +387,7 @@ bool loadDB(const String& filename) {
                     taginfo->updateLast = tag["updatelast"] | 0;
                     taginfo->currentChannel = tag["ch"] | 0;
                     taginfo->tagSoftwareVersion = tag["ver"] | 0;
+                    taginfo->markDirty(TAGFIELD_ALL);
                 }
             } else {
                 Serial.print(F("deserializeJson() failed: "));
@@ -256,14 +411,18 @@ bool loadDB(const String& filename) {
 void destroyDB() {
     Serial.println("destroying DB");
     util::printHeap();
+    std::unique_lock<std::recursive_mutex> lock(tagDBMutex);
+    // responses in progress end with the tags written so far
+    for (int32_t c = tagDB.size() - 1; c >= 0 && !tagDBWriters.empty(); c--) TagDBJsonWriter::onErase(c, c);
     for (tagRecord*& tag : tagDB) {
-        if (tag->data != nullptr) {
-            free(tag->data);
-        }
+        bufferpool::release(tag->data);
         tag->data = nullptr;
         delete tag;
     }
     tagDB.clear();
+    tagIndex.clear();
+    pushedRecords = 0;
+    lock.unlock();
     util::printHeap();
 }
 
@@ -278,34 +437,16 @@ uint32_t getTagCount(uint32_t& timeoutcount, uint32_t& lowbattcount) {
     time(&now);
     for (const tagRecord* taginfo : tagDB) {
         if (!taginfo->isExternal) tagcount++;
-        const int32_t timeout = now - taginfo->lastseen;
-        if (taginfo->expectedNextCheckin < 3600) {
-            // not initialised, timeout if not seen last 5 minutes
-            if (timeout > config.maxsleep * 60 + 300) timeoutcount++;
-        } else if (now - static_cast<time_t>(taginfo->expectedNextCheckin) > 600) {
-            // expected checkin is behind, timeout if not seen last 5 minutes
-            if (timeout > config.maxsleep * 60 + 300) timeoutcount++;
-        }
-        if (taginfo->batteryMv < 2400 && taginfo->batteryMv != 0 && taginfo->batteryMv != 1337) lowbattcount++;
+        if (isTimedOut(taginfo, now)) timeoutcount++;
+        if (isLowBattery(taginfo)) lowbattcount++;
     }
     return tagcount;
 }
 
 void clearPending(tagRecord* taginfo) {
     taginfo->filename = String();
-    if (taginfo->data != nullptr) {
-        // check if this is the last copy of the buffer
-        int datacount = 0;
-        for (const tagRecord* tag : tagDB) {
-            if (tag->data == taginfo->data) {
-                datacount++;
-            }
-        }
-        if (datacount == 1) {
-            free(taginfo->data);
-        }
-        taginfo->data = nullptr;
-    }
+    bufferpool::release(taginfo->data);
+    taginfo->data = nullptr;
 }
 
 void initAPconfig() {
@@ -380,11 +521,23 @@ void saveAPconfig() {
     xSemaphoreGive(fsMutex);
 }
 
+static void checkTagTypesChanged() {
+    if (!tagTypesChanged.exchange(false)) return;
+    hwdata.clear();
+    hwTemplates.clear();
+    tagTypeStats.templateBytes = 0;
+    tagTypeStats.flushes++;
+}
+
 HwType getHwType(const uint8_t id) {
+    std::lock_guard<std::mutex> lock(tagTypeMutex);
+    checkTagTypesChanged();
     auto it = hwdata.find(id);
     if (it != hwdata.end()) {
+        tagTypeStats.hits++;
         return it->second;
     } else {
+        tagTypeStats.misses++;
         char filename[20];
         snprintf(filename, sizeof(filename), "/tagtypes/%02X.json", id);
         Serial.printf("read %s\r\n", filename);
@@ -399,6 +552,7 @@ HwType getHwType(const uint8_t id) {
             filter["shortlut"] = true;
             filter["zlib_compression"] = true;
             filter["g5_compression"] = true;
+            filter["diff_compression"] = true;
             filter["highlight_color"] = true;
             filter["colortable"] = true;
             JsonDocument doc;
@@ -425,6 +579,11 @@ HwType getHwType(const uint8_t id) {
                 } else {
                     hwType.g5 = 0;
                 }
+                if (doc["diff_compression"].is<const char*>()) {
+                    hwType.diff = strtol(doc["diff_compression"], nullptr, 16);
+                } else {
+                    hwType.diff = 0;
+                }
                 hwType.highlightColor = doc["highlight_color"].is<uint16_t>() ? doc["highlight_color"].as<uint16_t>() : 2;
                 JsonObject colorTable = doc["colortable"];
                 for (auto kv : colorTable) {
@@ -442,6 +601,70 @@ HwType getHwType(const uint8_t id) {
     }
 }
 
+static const std::string& loadHwTemplate(const uint8_t hwtype, const uint8_t id, const uint8_t depth) {
+    const uint16_t key = hwtype << 8 | id;
+    auto it = hwTemplates.find(key);
+    if (it != hwTemplates.end()) {
+        tagTypeStats.hits++;
+        return it->second;
+    }
+    tagTypeStats.misses++;
+    std::string& packed = hwTemplates[key];
+
+    const String idstr = String(id);
+    constexpr const char* templateKey = "template";
+
+    char filename[20];
+    snprintf(filename, sizeof(filename), "/tagtypes/%02X.json", hwtype);
+    File jsonFile = contentFS->open(filename, "r");
+
+    if (jsonFile) {
+        JsonDocument filter;
+        JsonDocument doc;
+        filter[templateKey][idstr] = true;
+        filter["usetemplate"] = true;
+        const DeserializationError error = deserializeJson(doc, jsonFile, DeserializationOption::Filter(filter));
+        jsonFile.close();
+        if (!error && doc[templateKey].is<JsonVariant>() && doc[templateKey][idstr].is<JsonVariant>()) {
+            packed.resize(measureMsgPack(doc[templateKey][idstr]));
+            serializeMsgPack(doc[templateKey][idstr], &packed[0], packed.size());
+            tagTypeStats.templateBytes += packed.size();
+            return packed;
+        }
+        if (!error && doc["usetemplate"].is<uint8_t>() && depth < 8) {
+            // std::map references stay valid while inserting
+            packed = loadHwTemplate(doc["usetemplate"], id, depth + 1);
+            tagTypeStats.templateBytes += packed.size();
+            return packed;
+        }
+        Serial.println("json error in " + String(filename));
+        Serial.println(error.c_str());
+    } else {
+        Serial.println("Failed to open " + String(filename));
+    }
+    return packed;
+}
+
+bool getHwTemplate(JsonDocument& json, const uint8_t id, const uint8_t hwtype) {
+    std::lock_guard<std::mutex> lock(tagTypeMutex);
+    checkTagTypesChanged();
+    const std::string& packed = loadHwTemplate(hwtype, id, 0);
+    if (packed.empty()) return false;
+    return !deserializeMsgPack(json, packed.data(), packed.size());
+}
+
+void tagTypeFileChanged(const String& path) {
+    if (path.startsWith("/tagtypes/") || path.startsWith("tagtypes/")) tagTypesChanged = true;
+}
+
+TagTypeCacheStats getTagTypeCacheStats() {
+    std::lock_guard<std::mutex> lock(tagTypeMutex);
+    TagTypeCacheStats stats = tagTypeStats;
+    stats.types = hwdata.size();
+    stats.templates = hwTemplates.size();
+    return stats;
+}
+
 bool setVarDB(const std::string& key, const String& value, const bool notify) {
     auto it = varDB.find(key);
     if (it == varDB.end()) {
@@ -476,13 +699,7 @@ void cleanupCurrent() {
         String filename = file.name();
         uint8_t mac[8];
         if (hex2mac(getBaseName(filename), mac)) {
-            bool found = false;
-            for (tagRecord* record : tagDB) {
-                if (memcmp(record->mac, mac, 8) == 0) {
-                    found = true;
-                    break;
-                }
-            }
+            const bool found = tagRecord::findByMAC(mac) != nullptr;
             if (!found || filename.endsWith(".pending")) {
                 filename = file.path();
                 file.close();
@@ -507,16 +724,30 @@ void cleanupCurrent() {
 }
 
 void pushTagInfo(tagRecord* taginfo) {
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
     tagRecord* taginfo2 = new tagRecord(*taginfo);
+    bufferpool::retain(taginfo2->data);
     taginfo2->version = 1;
     tagDB.push_back(taginfo2);
+    pushedRecords++;
 }
 
 void popTagInfo(const uint8_t mac[8]) {
-    for (tagRecord* tag : tagDB) {
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    if (pushedRecords == 0) return;
+    for (uint32_t c = 0; c < tagDB.size(); c++) {
+        tagRecord* tag = tagDB[c];
         if (memcmp(tag->mac, mac, 8) == 0 && tag->version == 1) {
             deleteRecord(mac, false);
+            // deleteRecord may have moved the pushed copy, look it up again
+            if (c >= tagDB.size() || tagDB[c] != tag) {
+                c = std::find(tagDB.begin(), tagDB.end(), tag) - tagDB.begin();
+            }
             tag->version = 0;
+            tag->markDirty(TAGFIELD_ALL);
+            pushedRecords--;
+            tagIndex.set(macKey(mac), c);
+            return;
         }
     }
 }
@@ -0,0 +1,629 @@
+#include <Arduino.h>
+#include <FS.h>
+#include <rom/crc.h>
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "storage.h"
+#include "system.h"
+#include "tag_db.h"
+#include "web.h"
+
+// Binary tagDB store. The file is an array of fixed-size units: unit 0 is the
+// header, the others are slots. A tag record occupies one or more consecutive
+// slots (an extent), starting with a head slot. Only records that changed since
+// the last save are written, in place when they still fit their extent. Writes
+// go through a journal first, so a crash halfway leaves either the old or the
+// new version of every record.
+
+#define DB_MAGIC 0x4244454F       // "OEDB"
+#define JOURNAL_MAGIC 0x4E4A454F  // "OEJN"
+#define DB_VERSION 1
+#define DB_SLOT_SIZE 128
+#define DB_JOURNAL_BATCH 32  // units per journal transaction, bounds the memory used while saving
+
+#define SLOT_FREE 0x00
+#define SLOT_HEAD 0xA5
+#define SLOT_CONT 0x5A
+
+struct dbHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slotSize;
+    uint32_t slotCount;
+    uint32_t reserved;
+    uint32_t crc;
+} __attribute__((packed));
+
+struct slotHead {
+    uint8_t kind;
+    uint8_t slots;
+    uint16_t len;
+    uint32_t crc;
+} __attribute__((packed));
+
+#define HEAD_PAYLOAD (DB_SLOT_SIZE - sizeof(struct slotHead))
+#define CONT_PAYLOAD (DB_SLOT_SIZE - 1)
+#define DB_MAX_RECORD (HEAD_PAYLOAD + 254 * CONT_PAYLOAD)
+
+struct Extent {
+    uint32_t first;
+    uint8_t slots;
+    uint32_t crc;
+    uint32_t seen;
+};
+
+struct Unit {
+    uint32_t index;
+    uint8_t data[DB_SLOT_SIZE];
+};
+
+static String storeFile;
+static std::unordered_map<uint64_t, Extent> extents;
+static std::vector<bool> slotUsed;
+static uint32_t saveGeneration = 0;
+static String damagedFile;  // a damaged store that couldn't be moved aside, kept for inspection
+
+static inline uint64_t macKey(const uint8_t mac[8]) {
+    uint64_t key;
+    memcpy(&key, mac, 8);
+    return key;
+}
+
+static inline uint32_t recordCrc(const uint8_t* data, const size_t len) {
+    return crc32_le(0, data, len);
+}
+
+static uint8_t slotsFor(const size_t len) {
+    if (len <= HEAD_PAYLOAD) return 1;
+    return 1 + (len - HEAD_PAYLOAD + CONT_PAYLOAD - 1) / CONT_PAYLOAD;
+}
+
+// record serialization, same fields as the json export
+
+class RecordWriter {
+   public:
+    std::vector<uint8_t> buf;
+
+    template <typename T>
+    void put(const T& value) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+        buf.insert(buf.end(), p, p + sizeof(T));
+    }
+    void putBytes(const uint8_t* p, const size_t len) {
+        buf.insert(buf.end(), p, p + len);
+    }
+    void putString(const String& value) {
+        const uint16_t len = value.length();
+        put(len);
+        putBytes(reinterpret_cast<const uint8_t*>(value.c_str()), len);
+    }
+};
+
+class RecordReader {
+   public:
+    RecordReader(const uint8_t* data, const size_t len) : data(data), len(len) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (pos + sizeof(T) > len) return false;
+        memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+    bool getBytes(uint8_t* p, const size_t n) {
+        if (pos + n > len) return false;
+        memcpy(p, data + pos, n);
+        pos += n;
+        return true;
+    }
+    bool getString(String& value) {
+        uint16_t n;
+        if (!get(n) || pos + n > len) return false;
+        value = String();
+        value.concat(reinterpret_cast<const char*>(data + pos), n);
+        pos += n;
+        return true;
+    }
+
+   private:
+    const uint8_t* data;
+    size_t len;
+    size_t pos = 0;
+};
+
+static void serializeRecord(const tagRecord* taginfo, RecordWriter& w) {
+    w.putBytes(taginfo->mac, 8);
+    w.putBytes(taginfo->md5, 16);
+    w.put(taginfo->lastseen);
+    w.put(taginfo->nextupdate);
+    w.put(taginfo->expectedNextCheckin);
+    w.put(taginfo->contentMode);
+    w.put(taginfo->LQI);
+    w.put(taginfo->RSSI);
+    w.put(taginfo->temperature);
+    w.put(taginfo->batteryMv);
+    w.put(taginfo->hwType);
+    w.put(taginfo->wakeupReason);
+    w.put(taginfo->capabilities);
+    w.put(taginfo->isExternal);
+    const uint32_t apIp = taginfo->apIp;
+    w.put(apIp);
+    w.put(taginfo->rotate);
+    w.put(taginfo->lut);
+    w.put(taginfo->invert);
+    w.put(taginfo->updateCount);
+    w.put(taginfo->updateLast);
+    w.put(taginfo->currentChannel);
+    w.put(taginfo->tagSoftwareVersion);
+    w.putString(taginfo->alias);
+    w.putString(taginfo->modeConfigJson);
+}
+
+// reads a record into taginfo, the mac included
+static bool deserializeRecord(RecordReader& r, tagRecord* taginfo) {
+    uint32_t apIp = 0;
+    bool ok = r.getBytes(taginfo->mac, 8) &&
+              r.getBytes(taginfo->md5, 16) &&
+              r.get(taginfo->lastseen) &&
+              r.get(taginfo->nextupdate) &&
+              r.get(taginfo->expectedNextCheckin) &&
+              r.get(taginfo->contentMode) &&
+              r.get(taginfo->LQI) &&
+              r.get(taginfo->RSSI) &&
+              r.get(taginfo->temperature) &&
+              r.get(taginfo->batteryMv) &&
+              r.get(taginfo->hwType) &&
+              r.get(taginfo->wakeupReason) &&
+              r.get(taginfo->capabilities) &&
+              r.get(taginfo->isExternal) &&
+              r.get(apIp) &&
+              r.get(taginfo->rotate) &&
+              r.get(taginfo->lut) &&
+              r.get(taginfo->invert) &&
+              r.get(taginfo->updateCount) &&
+              r.get(taginfo->updateLast) &&
+              r.get(taginfo->currentChannel) &&
+              r.get(taginfo->tagSoftwareVersion) &&
+              r.getString(taginfo->alias) &&
+              r.getString(taginfo->modeConfigJson);
+    taginfo->apIp = IPAddress(apIp);
+    return ok;
+}
+
+// journal
+
+static bool writeUnits(fs::File& file, const std::vector<Unit>& units) {
+    for (const Unit& unit : units) {
+        if (!file.seek(unit.index * DB_SLOT_SIZE)) return false;
+        if (file.write(unit.data, DB_SLOT_SIZE) != DB_SLOT_SIZE) return false;
+    }
+    return true;
+}
+
+static bool commitUnits(const String& filename, const std::vector<Unit>& units) {
+    if (units.empty()) return true;
+    const String journalFile = filename + ".jnl";
+
+    uint32_t header[2] = {JOURNAL_MAGIC, (uint32_t)units.size()};
+    uint32_t crc = crc32_le(0, reinterpret_cast<const uint8_t*>(header), sizeof(header));
+    crc = crc32_le(crc, reinterpret_cast<const uint8_t*>(units.data()), units.size() * sizeof(Unit));
+
+    fs::File journal = contentFS->open(journalFile, "w");
+    if (!journal) return false;
+    journal.write(reinterpret_cast<const uint8_t*>(header), sizeof(header));
+    journal.write(reinterpret_cast<const uint8_t*>(units.data()), units.size() * sizeof(Unit));
+    journal.write(reinterpret_cast<const uint8_t*>(&crc), sizeof(crc));
+    journal.close();
+
+    fs::File file = contentFS->open(filename, "r+");
+    if (!file) return false;
+    const bool ok = writeUnits(file, units);
+    file.close();
+    if (ok) contentFS->remove(journalFile);
+    return ok;
+}
+
+// apply a journal that was completely written, but possibly not applied
+static void replayJournal(const String& filename) {
+    const String journalFile = filename + ".jnl";
+    fs::File journal = contentFS->open(journalFile, "r");
+    if (!journal) return;
+
+    uint32_t header[2] = {0, 0};
+    std::vector<Unit> units;
+    uint32_t crc = 0;
+    bool valid = journal.read(reinterpret_cast<uint8_t*>(header), sizeof(header)) == sizeof(header) &&
+                 header[0] == JOURNAL_MAGIC && journal.size() == sizeof(header) + header[1] * sizeof(Unit) + sizeof(crc);
+    if (valid) {
+        units.resize(header[1]);
+        journal.read(reinterpret_cast<uint8_t*>(units.data()), units.size() * sizeof(Unit));
+        journal.read(reinterpret_cast<uint8_t*>(&crc), sizeof(crc));
+        uint32_t check = crc32_le(0, reinterpret_cast<const uint8_t*>(header), sizeof(header));
+        check = crc32_le(check, reinterpret_cast<const uint8_t*>(units.data()), units.size() * sizeof(Unit));
+        valid = (check == crc);
+    }
+    journal.close();
+
+    if (valid) {
+        fs::File file = contentFS->open(filename, "r+");
+        if (file) {
+            writeUnits(file, units);
+            file.close();
+            logLine("tagDB: replayed journal, " + String(units.size()) + " slots");
+        }
+    }
+    contentFS->remove(journalFile);
+}
+
+// slot allocation
+
+static uint32_t allocateSlots(const uint8_t count) {
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < slotUsed.size(); i++) {
+        run = slotUsed[i] ? 0 : run + 1;
+        if (run == count) return i + 1 - count;
+    }
+    // extend the file, reusing a free run at the end
+    const uint32_t first = slotUsed.size() - run;
+    slotUsed.resize(first + count, false);
+    return first;
+}
+
+static void markSlots(const uint32_t first, const uint8_t count, const bool used) {
+    for (uint32_t i = first; i < first + count; i++) slotUsed[i] = used;
+}
+
+static void headerUnit(Unit& unit) {
+    memset(&unit, 0, sizeof(Unit));
+    struct dbHeader* header = reinterpret_cast<struct dbHeader*>(unit.data);
+    header->magic = DB_MAGIC;
+    header->version = DB_VERSION;
+    header->slotSize = DB_SLOT_SIZE;
+    header->slotCount = slotUsed.size();
+    header->crc = recordCrc(unit.data, offsetof(struct dbHeader, crc));
+}
+
+static void resetStore(const String& filename) {
+    storeFile = filename;
+    extents.clear();
+    slotUsed.clear();
+}
+
+static bool createStore(const String& filename) {
+    resetStore(filename);
+    contentFS->remove(filename + ".jnl");
+    fs::File file = contentFS->open(filename, "w");
+    if (!file) return false;
+    Unit unit;
+    headerUnit(unit);
+    file.write(unit.data, DB_SLOT_SIZE);
+    file.close();
+    return true;
+}
+
+void saveDBbin(const String& filename) {
+    const long t = millis();
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+
+    if (filename == damagedFile && contentFS->exists(filename)) {
+        xSemaphoreGive(fsMutex);
+        Serial.println("saveDBbin: not overwriting damaged " + filename);
+        return;
+    }
+    if (storeFile != filename || !contentFS->exists(filename)) {
+        if (!createStore(filename)) {
+            xSemaphoreGive(fsMutex);
+            Serial.println("saveDBbin: Failed to open file for writing");
+            return;
+        }
+    }
+
+    saveGeneration++;
+    uint32_t headerSlotCount = slotUsed.size();
+    std::vector<Unit> batch;
+    uint32_t written = 0;
+    bool ok = true;
+
+    // units in a batch are applied in order, and the batch as a whole through the journal
+    auto flush = [&]() {
+        if (slotUsed.size() != headerSlotCount) {
+            batch.emplace_back();
+            headerUnit(batch.back());
+            batch.back().index = 0;
+            headerSlotCount = slotUsed.size();
+        }
+        ok = ok && commitUnits(filename, batch);
+        batch.clear();
+    };
+
+    // the changed records, serialized in one pass. The radio, udp and web tasks add and delete
+    // records meanwhile, the file work below only touches these copies
+    struct Changed {
+        uint64_t key;
+        std::vector<uint8_t> buf;
+    };
+    std::vector<Changed> changed;
+    {
+        std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+        for (tagRecord* taginfo : tagDB) {
+            if (taginfo->version != 0) continue;
+            const uint64_t key = macKey(taginfo->mac);
+            auto it = extents.find(key);
+            if (it != extents.end()) {
+                it->second.seen = saveGeneration;
+                if ((taginfo->dirtyStore & TAGFIELD_STORED) == 0) continue;
+            }
+            // a change made after this is left dirty for the next save
+            taginfo->dirtyStore = 0;
+            RecordWriter w;
+            serializeRecord(taginfo, w);
+            changed.push_back({key, std::move(w.buf)});
+        }
+    }
+
+    for (const Changed& record : changed) {
+        const std::vector<uint8_t>& buf = record.buf;
+        auto it = extents.find(record.key);
+        if (buf.size() > DB_MAX_RECORD) {
+            logLine("tagDB: record too large, not saved");
+            continue;
+        }
+        const uint32_t crc = recordCrc(buf.data(), buf.size());
+        const uint8_t count = slotsFor(buf.size());
+
+        if (it != extents.end() && it->second.crc == crc) continue;
+
+        // keep a record's slots in one journal transaction
+        if (batch.size() + count + 2 > DB_JOURNAL_BATCH) flush();
+
+        Extent extent;
+        if (it != extents.end() && it->second.slots >= count) {
+            // rewrite in place, trailing slots become orphans and are free
+            extent = it->second;
+            markSlots(extent.first + count, extent.slots - count, false);
+        } else {
+            if (it != extents.end()) {
+                // free the old extent. This goes before the new one, which may overlap it
+                Unit unit;
+                memset(&unit, 0, sizeof(Unit));
+                unit.index = it->second.first + 1;
+                batch.push_back(unit);
+                markSlots(it->second.first, it->second.slots, false);
+            }
+            extent.first = allocateSlots(count);
+        }
+        extent.slots = count;
+        extent.crc = crc;
+        extent.seen = saveGeneration;
+        markSlots(extent.first, count, true);
+
+        size_t pos = 0;
+        for (uint8_t s = 0; s < count; s++) {
+            Unit unit;
+            memset(&unit, 0, sizeof(Unit));
+            unit.index = extent.first + s + 1;
+            size_t n;
+            if (s == 0) {
+                struct slotHead* head = reinterpret_cast<struct slotHead*>(unit.data);
+                head->kind = SLOT_HEAD;
+                head->slots = count;
+                head->len = buf.size();
+                head->crc = crc;
+                n = min(buf.size() - pos, (size_t)HEAD_PAYLOAD);
+                memcpy(unit.data + sizeof(struct slotHead), buf.data() + pos, n);
+            } else {
+                unit.data[0] = SLOT_CONT;
+                n = min(buf.size() - pos, (size_t)CONT_PAYLOAD);
+                memcpy(unit.data + 1, buf.data() + pos, n);
+            }
+            pos += n;
+            batch.push_back(unit);
+        }
+        extents[record.key] = extent;
+        written++;
+    }
+
+    // free the records of tags that were deleted
+    for (auto it = extents.begin(); it != extents.end();) {
+        if (it->second.seen != saveGeneration) {
+            if (batch.size() + 2 > DB_JOURNAL_BATCH) flush();
+            Unit unit;
+            memset(&unit, 0, sizeof(Unit));
+            unit.index = it->second.first + 1;
+            batch.push_back(unit);
+            markSlots(it->second.first, it->second.slots, false);
+            it = extents.erase(it);
+            written++;
+        } else {
+            ++it;
+        }
+    }
+    flush();
+
+    if (!ok) {
+        // state doesn't match the file anymore, start over on the next save
+        resetStore(String());
+        logLine("error writing tagDB");
+    }
+    xSemaphoreGive(fsMutex);
+    Serial.println("DB saved " + String(millis() - t) + "ms, " + String(written) + " records written");
+}
+
+// Walks the records of a store and hands every one to onRecord. Journaled writes
+// always leave a consistent file, so anything that doesn't check out (header,
+// truncated slots, a head slot with a bad extent or crc) means the file is
+// damaged and false is returned.
+template <typename F>
+static bool scanStore(fs::File& file, F onRecord) {
+    Unit unit;
+    const struct dbHeader* header = reinterpret_cast<const struct dbHeader*>(unit.data);
+    if (!file.seek(0) || file.read(unit.data, DB_SLOT_SIZE) != DB_SLOT_SIZE || header->magic != DB_MAGIC ||
+        header->version != DB_VERSION || header->slotSize != DB_SLOT_SIZE ||
+        header->crc != recordCrc(unit.data, offsetof(struct dbHeader, crc))) {
+        Serial.println("loadDBbin: invalid header");
+        return false;
+    }
+    const uint32_t slotCount = header->slotCount;
+    if (slotCount > file.size() / DB_SLOT_SIZE - 1) {
+        Serial.println("loadDBbin: file truncated");
+        return false;
+    }
+    slotUsed.assign(slotCount, false);
+
+    std::vector<uint8_t> record;
+    uint32_t slot = 0;
+    while (slot < slotCount) {
+        if (file.read(unit.data, DB_SLOT_SIZE) != DB_SLOT_SIZE) return false;
+        const struct slotHead* head = reinterpret_cast<const struct slotHead*>(unit.data);
+        if (head->kind != SLOT_HEAD) {
+            // free, or the orphaned tail of a record that shrunk
+            slot++;
+            continue;
+        }
+
+        const uint32_t first = slot;
+        const uint8_t count = head->slots;
+        const uint16_t len = head->len;
+        const uint32_t crc = head->crc;
+        if (count == 0 || first + count > slotCount || len < 8 || len > HEAD_PAYLOAD + (count - 1) * CONT_PAYLOAD) {
+            Serial.println("loadDBbin: bad record at slot " + String(first));
+            return false;
+        }
+        record.resize(count * DB_SLOT_SIZE);
+        size_t pos = min((size_t)len, (size_t)HEAD_PAYLOAD);
+        memcpy(record.data(), unit.data + sizeof(struct slotHead), pos);
+        for (uint8_t s = 1; s < count; s++) {
+            if (file.read(unit.data, DB_SLOT_SIZE) != DB_SLOT_SIZE || unit.data[0] != SLOT_CONT) {
+                Serial.println("loadDBbin: incomplete record at slot " + String(first));
+                return false;
+            }
+            const size_t n = min((size_t)len - pos, (size_t)CONT_PAYLOAD);
+            memcpy(record.data() + pos, unit.data + 1, n);
+            pos += n;
+        }
+        if (recordCrc(record.data(), len) != crc) {
+            Serial.println("loadDBbin: crc error at slot " + String(first));
+            return false;
+        }
+        if (!onRecord(first, count, crc, record.data(), len)) return false;
+        slot = first + count;
+    }
+    return true;
+}
+
+// the whole file is checked before tagDB is touched, so a damaged file loads nothing
+static DBBinLoad loadStore(const String& filename, uint32_t& loaded) {
+    fs::File file = contentFS->open(filename, "r");
+    if (!file) return DBBIN_MISSING;
+
+    tagRecord scratch;
+    const bool intact = scanStore(file, [&scratch](uint32_t, uint8_t, uint32_t, const uint8_t* record, uint16_t len) {
+        RecordReader r(record, len);
+        return deserializeRecord(r, &scratch);
+    });
+    if (!intact) {
+        file.close();
+        return DBBIN_DAMAGED;
+    }
+
+    time_t now;
+    time(&now);
+    std::vector<Unit> duplicates;
+    scanStore(file, [&](uint32_t first, uint8_t count, uint32_t crc, const uint8_t* record, uint16_t len) {
+        const uint64_t key = macKey(record);
+        if (extents.find(key) != extents.end()) {
+            // only the first copy of a mac counts, the others are freed below
+            Unit unit;
+            memset(&unit, 0, sizeof(Unit));
+            unit.index = first + 1;
+            duplicates.push_back(unit);
+            return true;
+        }
+        tagRecord* taginfo = tagRecord::findByMAC(record);
+        if (taginfo == nullptr) {
+            taginfo = addRecord(record);
+        }
+        RecordReader r(record, len);
+        deserializeRecord(r, taginfo);
+        // this is what the file holds, only the adjustments below make it dirty again
+        taginfo->markClean();
+        if (taginfo->expectedNextCheckin < now) {
+            taginfo->setExpectedNextCheckin(now + 60);
+        }
+        taginfo->setPendingCount(0);
+        extents[key] = {first, count, crc, 0};
+        markSlots(first, count, true);
+        loaded++;
+        return true;
+    });
+    file.close();
+
+    for (size_t i = 0; i < duplicates.size(); i += DB_JOURNAL_BATCH) {
+        const std::vector<Unit> batch(duplicates.begin() + i, duplicates.begin() + min(i + DB_JOURNAL_BATCH, duplicates.size()));
+        if (!commitUnits(filename, batch)) {
+            // the next save starts a new store
+            resetStore(String());
+            logLine("tagDB: error freeing duplicate records");
+            return DBBIN_LOADED;
+        }
+    }
+    if (!duplicates.empty()) logLine("tagDB: freed " + String(duplicates.size()) + " duplicate records");
+    storeFile = filename;
+    return DBBIN_LOADED;
+}
+
+static bool copyStore(const String& from, const String& to) {
+    fs::File in = contentFS->open(from, "r");
+    if (!in) return false;
+    fs::File out = contentFS->open(to, "w");
+    if (!out) {
+        in.close();
+        return false;
+    }
+    copyFile(in, out);
+    const bool ok = out.size() == in.size();
+    in.close();
+    out.close();
+    return ok;
+}
+
+// Loads the store after applying a pending journal. A good file is copied to
+// .bak, a damaged one is renamed to .damaged, never overwritten, and the .bak
+// is loaded in its place.
+DBBinLoad loadDBbin(const String& filename) {
+    Serial.println("reading DB from " + String(filename));
+    const long t = millis();
+    const String backupFile = filename + ".bak";
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+
+    replayJournal(filename);
+    resetStore(String());
+
+    uint32_t loaded = 0;
+    DBBinLoad result = loadStore(filename, loaded);
+    if (result == DBBIN_LOADED) {
+        if (!copyStore(filename, backupFile)) logLine("tagDB: unable to write " + backupFile);
+    } else if (result == DBBIN_DAMAGED) {
+        resetStore(String());
+        const String movedFile = filename + ".damaged";
+        contentFS->remove(movedFile);
+        if (!contentFS->rename(filename.c_str(), movedFile.c_str())) {
+            // leave it in place, saveDBbin won't write over it
+            damagedFile = filename;
+            logLine("error: " + filename + " is damaged and can't be moved aside");
+        } else if (contentFS->exists(backupFile) && copyStore(backupFile, filename) &&
+                   loadStore(filename, loaded) == DBBIN_LOADED) {
+            logLine("error: " + filename + " is damaged, moved to " + movedFile + ", restored the last good copy");
+        } else {
+            resetStore(String());
+            contentFS->remove(filename);
+            logLine("error: " + filename + " is damaged, moved to " + movedFile + ", no good copy to restore");
+        }
+    }
+    xSemaphoreGive(fsMutex);
+    Serial.println("loadDBbin took " + String(millis() - t) + "ms, " + String(loaded) + " records");
+    return result;
+}
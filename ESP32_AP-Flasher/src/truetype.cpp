@@ -9,7 +9,10 @@ void truetypeClass::end() {
     file.close();
     freePointsAll();
     freeGlyph();
+    freeGlyphCache();
+    freeEdges();
     if (table != nullptr) free(table);
+    table = nullptr;
 }
 
 uint8_t truetypeClass::setTtfFile(File _file, uint8_t _checkCheckSum) {
@@ -45,6 +48,11 @@ void truetypeClass::setTtfDrawPixel(TTF_DRAWPIXEL *p) {
     pfnDrawPixel = p;
 }
 
+/* with supersampling, get called with the coverage (0-255) of every pixel touched, instead of drawing pixels covered for at least half */
+void truetypeClass::setTtfDrawCoverage(TTF_DRAWCOVERAGE *p) {
+    pfnDrawCoverage = p;
+}
+
 uint8_t truetypeClass::setTtfPointer(uint8_t *p, uint32_t u32Size, uint8_t _checkCheckSum, bool bF) {
     pTTF = p;
     u32TTFSize = u32Size;
@@ -69,6 +77,7 @@ uint8_t truetypeClass::setTtfPointer(uint8_t *p, uint32_t u32Size, uint8_t _chec
     readKern();
 #endif
     readHeadTable();
+    readHhea();
     return 1;
 
 } 
@@ -148,20 +157,30 @@ void truetypeClass::setFramebuffer(uint16_t _framebufferWidth, uint16_t _framebu
     displayHeight = _framebufferHeight;
     framebufferBit = _framebuffer_bit;
     userFrameBuffer = _framebuffer;
+    setFramebufferWindow(0, 0, displayWidth, displayHeight);
+
+    return;
+}
+
+void truetypeClass::setFramebufferWindow(int16_t _x, int16_t _y, uint16_t _width, uint16_t _height) {
+    frameX = _x;
+    frameY = _y;
+    frameWidth = _width;
+    frameHeight = _height;
 
     switch (framebufferBit) {
         case 16:  // 16bit horizontal
-            displayWidthFrame = displayWidth * 2;
+            displayWidthFrame = frameWidth * 2;
             break;
         case 8:  // 8bit Horizontal
-            displayWidthFrame = displayWidth;
+            displayWidthFrame = frameWidth;
             break;
         case 4:  // 4bit Horizontal
-            displayWidthFrame = (displayWidth + 1) / 2;
+            displayWidthFrame = (frameWidth + 1) / 2;
             break;
         case 1:  // 1bit Horizontal
         default:
-            displayWidthFrame = (displayWidth + 7) / 8;
+            displayWidthFrame = (frameWidth + 7) / 8;
             break;
     }
 
@@ -209,6 +228,29 @@ void truetypeClass::setTextRotation(uint16_t _rotation) {
     stringRotation = _rotation;
 }
 
+/* 1 samples every pixel once, 2 or 4 take 2x2 or 4x4 samples per pixel */
+void truetypeClass::setSupersampling(uint8_t _samples) {
+    if (_samples != 2 && _samples != 4) {
+        _samples = 1;
+    }
+    if (_samples != supersampling) {
+        // cached glyphs were rasterised with the old setting
+        freeGlyphCache();
+    }
+    supersampling = _samples;
+}
+
+void truetypeClass::setGlyphCacheSize(uint32_t _bytes) {
+    glyphCacheSize = _bytes;
+    if (glyphCacheSize == 0) {
+        freeGlyphCache();
+    }
+}
+
+ttGlyphCacheStats_t truetypeClass::getGlyphCacheStats() {
+    return glyphCacheStats;
+}
+
 /* ----------------private---------------- */
 /* calculate checksum */
 uint32_t truetypeClass::calculateCheckSum(uint32_t offset, uint32_t length) {
@@ -818,86 +860,351 @@ void truetypeClass::addLine(float _x0, float _y0, float _x1, float _y1) {
     */
 }
 
+static inline int32_t ceilDiv(int32_t _a, int32_t _b) {
+    return (_a >= 0) ? (_a + _b - 1) / _b : -((-_a) / _b);
+}
+
+static int compareEdges(const void *_a, const void *_b) {
+    return ((const ttEdge_t *)_a)->yTop - ((const ttEdge_t *)_b)->yTop;
+}
+
+/* fill the outline with an active edge list, nonzero winding rule.
+   Samples are taken at whole pixel coordinates, or on a grid of supersampling^2 positions centered on them.
+   Coordinates are scaled to sample units (1 / (2 * supersampling) pixel), so all math is exact integer math */
 void truetypeClass::fillGlyph(int16_t _x_min, int16_t _y_min, uint16_t characterSize) {
-    for (int16_t y = round((float)(ascender - glyph.yMax) * (float)characterSize / (float)headTable.unitsPerEm + _y_min);
-         y < round((float)(ascender - glyph.yMin) * (float)characterSize / (float)headTable.unitsPerEm + _y_min);
-         y++) {
-        ttCoordinate_t point1, point2;
-        ttCoordinate_t point;
-        point.y = (float)y;
-
-        uint16_t intersectPointsNum = 0;
-        uint16_t bpCounter = 0;
-        uint16_t epCounter = 0;
-        uint16_t p2Num = 0;
-
-        for (uint16_t i = 0; i < numPoints; i++) {
-            point1 = points[i];
-            // Wrap?
-            if (i == endPoints[epCounter]) {
-                p2Num = beginPoints[bpCounter];
-                epCounter++;
-                bpCounter++;
-            } else {
-                p2Num = i + 1;
+    const int16_t yStart = round((float)(ascender - glyph.yMax) * (float)characterSize / (float)headTable.unitsPerEm + _y_min);
+    const int16_t yEnd = round((float)(ascender - glyph.yMin) * (float)characterSize / (float)headTable.unitsPerEm + _y_min);
+    const int16_t xStart = _x_min + round((float)glyph.xMin * (float)characterSize / (float)headTable.unitsPerEm);
+    const int16_t xEnd = _x_min + round((float)glyph.xMax * (float)characterSize / (float)headTable.unitsPerEm);
+    if ((yStart >= yEnd) || (xStart >= xEnd)) {
+        return;
+    }
+
+    const int32_t scale = 2 * supersampling;
+    const int32_t offset = 1 - supersampling;
+    const uint16_t numEdges = buildEdges(yStart, scale, offset);
+    if (numEdges == 0) {
+        return;
+    }
+
+    const uint16_t width = xEnd - xStart;
+    if (supersampling > 1 && coverageSize < width) {
+        uint8_t *newCoverage = (uint8_t *)realloc(coverage, width);
+        if (newCoverage == nullptr) {
+            return;
+        }
+        coverage = newCoverage;
+        coverageSize = width;
+    }
+    const uint16_t samples = supersampling * supersampling;
+
+    uint16_t nextEdge = 0;
+    uint16_t numActive = 0;
+    for (int16_t y = yStart; y < yEnd; y++) {
+        if (supersampling > 1) {
+            memset(coverage, 0, width);
+        }
+        for (uint8_t subY = 0; subY < supersampling; subY++) {
+            const int32_t sampleY = y * scale + offset + 2 * subY;
+
+            // drop edges that ended, add the ones starting on this row
+            uint16_t kept = 0;
+            for (uint16_t i = 0; i < numActive; i++) {
+                if (edges[activeEdges[i]].yBottom > sampleY) {
+                    activeEdges[kept++] = activeEdges[i];
+                }
+            }
+            numActive = kept;
+            while ((nextEdge < numEdges) && (edges[nextEdge].yTop <= sampleY)) {
+                activeEdges[numActive++] = nextEdge++;
+            }
+            if (numActive == 0) {
+                continue;
             }
-            point2 = points[p2Num];
-
-            if (point1.y <= (float)y) {
-                if (point2.y > (float)y) {
-                    // Have a valid up intersect
-                    intersectPointsNum++;
-                    pointsToFill = (ttWindIntersect_t *)realloc(pointsToFill, sizeof(ttWindIntersect_t) * intersectPointsNum);
-                    pointsToFill[intersectPointsNum - 1].p1 = i;
-                    pointsToFill[intersectPointsNum - 1].p2 = p2Num;
-                    pointsToFill[intersectPointsNum - 1].up = 1;
+
+            // sort by crossing. the order hardly changes between rows, so insertion sort
+            for (uint16_t i = 1; i < numActive; i++) {
+                const uint16_t edge = activeEdges[i];
+                uint16_t j = i;
+                while ((j > 0) && (edges[activeEdges[j - 1]].x > edges[edge].x)) {
+                    activeEdges[j] = activeEdges[j - 1];
+                    j--;
                 }
-            } else {
-                // start y > point.y (no test needed)
-                if (point2.y <= (float)y) {
-                    // Have a valid down intersect
-                    intersectPointsNum++;
-                    pointsToFill = (ttWindIntersect_t *)realloc(pointsToFill, sizeof(ttWindIntersect_t) * intersectPointsNum);
-                    pointsToFill[intersectPointsNum - 1].p1 = i;
-                    pointsToFill[intersectPointsNum - 1].p2 = p2Num;
-                    pointsToFill[intersectPointsNum - 1].up = 0;
+                activeEdges[j] = edge;
+            }
+
+            // a sample is inside an edge's winding left of the crossing
+            int16_t windingNumber = 0;
+            for (uint16_t i = 0; i < numActive; i++) {
+                windingNumber += edges[activeEdges[i]].dir;
+            }
+            int32_t spanStart = INT32_MIN;
+            for (uint16_t i = 0; i < numActive; i++) {
+                ttEdge_t *edge = &edges[activeEdges[i]];
+                if (windingNumber != 0) {
+                    fillSpan(spanStart, edge->x, y, xStart, xEnd, scale, offset);
                 }
+                windingNumber -= edge->dir;
+                spanStart = edge->x;
+
+                // step to the next sample row
+                edge->x += edge->stepX;
+                edge->err -= edge->stepErr;
+                if (edge->err < 0) {
+                    edge->x++;
+                    edge->err += edge->dy;
+                }
+            }
+            if (windingNumber != 0) {
+                fillSpan(spanStart, INT32_MAX, y, xStart, xEnd, scale, offset);
             }
         }
 
-        for (int16_t x = _x_min + round((float)glyph.xMin * (float)characterSize / (float)headTable.unitsPerEm);
-             x < _x_min + round((float)glyph.xMax * (float)characterSize / (float)headTable.unitsPerEm);
-             x++) {
-            int16_t windingNumber = 0;
-            point.x = (float)x;
+        if (supersampling > 1) {
+            for (uint16_t i = 0; i < width; i++) {
+                if (coverage[i] == 0) {
+                    continue;
+                }
+                if (pfnDrawCoverage) {
+                    (*pfnDrawCoverage)(xStart + i, y, coverage[i] * 255 / samples);
+                } else if (coverage[i] * 2 >= samples) {
+                    addPixel(xStart + i, y, colorInside);
+                }
+            }
+        }
+    }
+}
 
-            for (uint16_t i = 0; i < intersectPointsNum; i++) {
-                point1 = points[pointsToFill[i].p1];
-                point2 = points[pointsToFill[i].p2];
+/* build the edge list for the current outline, sorted by first sample row */
+uint16_t truetypeClass::buildEdges(int16_t _y_start, int32_t _scale, int32_t _offset) {
+    if (edgesSize < numPoints) {
+        ttEdge_t *newEdges = (ttEdge_t *)realloc(edges, sizeof(ttEdge_t) * numPoints);
+        if (newEdges == nullptr) {
+            return 0;
+        }
+        edges = newEdges;
+        uint16_t *newActive = (uint16_t *)realloc(activeEdges, sizeof(uint16_t) * numPoints);
+        if (newActive == nullptr) {
+            return 0;
+        }
+        activeEdges = newActive;
+        edgesSize = numPoints;
+    }
 
-                if (pointsToFill[i].up == 1) {
-                    if (isLeft(&point1, &point2, &point) > 0) {
-                        windingNumber++;
-                    }
-                } else {
-                    if (isLeft(&point1, &point2, &point) < 0) {
-                        windingNumber--;
-                    }
-                }
+    const int32_t firstRow = _y_start * _scale + _offset;
+    uint16_t numEdges = 0;
+    uint16_t bpCounter = 0;
+    uint16_t epCounter = 0;
+    uint16_t p2Num = 0;
+
+    for (uint16_t i = 0; i < numPoints; i++) {
+        // Wrap?
+        if (i == endPoints[epCounter]) {
+            p2Num = beginPoints[bpCounter];
+            epCounter++;
+            bpCounter++;
+        } else {
+            p2Num = i + 1;
+        }
+
+        int32_t x0 = (int32_t)points[i].x * _scale;
+        int32_t y0 = (int32_t)points[i].y * _scale;
+        int32_t x1 = (int32_t)points[p2Num].x * _scale;
+        int32_t y1 = (int32_t)points[p2Num].y * _scale;
+        if (y0 == y1) {
+            continue;
+        }
+        ttEdge_t *edge = &edges[numEdges];
+        edge->dir = (y0 < y1) ? 1 : -1;
+        if (y0 > y1) {
+            int32_t tmp = x0;
+            x0 = x1;
+            x1 = tmp;
+            tmp = y0;
+            y0 = y1;
+            y1 = tmp;
+        }
+
+        // sample rows are every 2 units, starting at firstRow. rows y0 <= row < y1 cross the edge
+        int32_t top = firstRow;
+        if (top < y0) {
+            top += (y0 - top + 1) & ~1;
+        }
+        if (top >= y1) {
+            continue;
+        }
+        const int32_t dx = x1 - x0;
+        const int32_t dy = y1 - y0;
+        const int32_t num = dx * (top - y0);
+        edge->yTop = top;
+        edge->yBottom = y1;
+        edge->dy = dy;
+        edge->x = x0 + ceilDiv(num, dy);
+        edge->err = (edge->x - x0) * dy - num;
+        edge->stepX = -ceilDiv(-2 * dx, dy);
+        edge->stepErr = 2 * dx - edge->stepX * dy;
+        numEdges++;
+    }
+
+    qsort(edges, numEdges, sizeof(ttEdge_t), compareEdges);
+    return numEdges;
+}
+
+/* fill the samples of row _y with _x0 <= x < _x1 */
+void truetypeClass::fillSpan(int32_t _x0, int32_t _x1, int16_t _y, int16_t _x_start, int16_t _x_end, int32_t _scale, int32_t _offset) {
+    const int32_t first = _x_start * _scale + _offset;
+    const int32_t last = _x_end * _scale;
+    if (_x0 < first) _x0 = first;
+    if (_x1 > last) _x1 = last;
+    if (_x0 >= _x1) {
+        return;
+    }
+
+    if (supersampling == 1) {
+        for (int32_t x = ceilDiv(_x0, 2); x < ceilDiv(_x1, 2); x++) {
+            addPixel(x, _y, colorInside);
+        }
+        return;
+    }
+    for (uint8_t subX = 0; subX < supersampling; subX++) {
+        const int32_t sampleOffset = _offset + 2 * subX;
+        const int32_t x1 = min(ceilDiv(_x1 - sampleOffset, _scale), (int32_t)_x_end);
+        for (int32_t x = max(ceilDiv(_x0 - sampleOffset, _scale), (int32_t)_x_start); x < x1; x++) {
+            coverage[x - _x_start]++;
+        }
+    }
+}
+
+void truetypeClass::freeEdges() {
+    free(edges);
+    edges = nullptr;
+    free(activeEdges);
+    activeEdges = nullptr;
+    edgesSize = 0;
+    free(coverage);
+    coverage = nullptr;
+    coverageSize = 0;
+}
+
+/* glyph cache */
+/* get the rasterised glyph for a character code at the current size, rasterising it on a miss */
+ttGlyphBitmap_t *truetypeClass::getGlyphBitmap(uint16_t _code) {
+    const uint32_t key = ((uint32_t)characterSize << 16) | _code;
+    auto it = glyphCache.find(key);
+    if (it != glyphCache.end()) {
+        ttGlyphBitmap_t *bitmap = it->second;
+        if (bitmap != glyphCacheHead) {
+            // move to the front of the lru list
+            bitmap->prev->next = bitmap->next;
+            if (bitmap->next) {
+                bitmap->next->prev = bitmap->prev;
+            } else {
+                glyphCacheTail = bitmap->prev;
             }
+            bitmap->prev = nullptr;
+            bitmap->next = glyphCacheHead;
+            glyphCacheHead->prev = bitmap;
+            glyphCacheHead = bitmap;
+        }
+        glyphCacheStats.hits++;
+        return bitmap;
+    }
+    glyphCacheStats.misses++;
+
+    const uint16_t glyphId = codeToGlyphId(_code);
+    const uint16_t measureWidth = getHMetric(glyphId).advanceWidth;
+    charCode = glyphId;
+    readGlyph(charCode);
+
+    // same bounds as fillGlyph uses, with the pen at the origin
+    int16_t x0 = round((float)glyph.xMin * (float)characterSize / (float)headTable.unitsPerEm);
+    int16_t x1 = round((float)glyph.xMax * (float)characterSize / (float)headTable.unitsPerEm);
+    int16_t y0 = round((float)(ascender - glyph.yMax) * (float)characterSize / (float)headTable.unitsPerEm);
+    int16_t y1 = round((float)(ascender - glyph.yMin) * (float)characterSize / (float)headTable.unitsPerEm);
+    if (glyph.numberOfContours < 0 || x1 <= x0 || y1 <= y0) {
+        x1 = x0;
+        y1 = y0;
+    }
+    const uint32_t bitmapBytes = ((x1 - x0 + 7) / 8) * (y1 - y0);
+    const uint32_t size = sizeof(ttGlyphBitmap_t) + bitmapBytes;
 
-            if (windingNumber != 0) {
-                addPixel(x, y, colorInside);
+    ttGlyphBitmap_t *bitmap = (ttGlyphBitmap_t *)malloc(size);
+    if (bitmap == nullptr) {
+        freePointsAll();
+        freeGlyph();
+        return nullptr;
+    }
+    bitmap->key = key;
+    bitmap->size = size;
+    bitmap->glyphId = glyphId;
+    bitmap->metricId = charCode;
+    bitmap->advanceWidth = getHMetric(charCode).advanceWidth;
+    bitmap->measureWidth = measureWidth;
+    bitmap->x = x0;
+    bitmap->y = y0;
+    bitmap->width = x1 - x0;
+    bitmap->height = y1 - y0;
+    memset(bitmap + 1, 0, bitmapBytes);
+
+    if (bitmapBytes) {
+        rasterTarget = bitmap;
+        generateOutline(0, 0, characterSize);
+        fillGlyph(0, 0, characterSize);
+        rasterTarget = nullptr;
+    }
+    freePointsAll();
+    freeGlyph();
+
+    glyphCache[key] = bitmap;
+    bitmap->prev = nullptr;
+    bitmap->next = glyphCacheHead;
+    if (glyphCacheHead) glyphCacheHead->prev = bitmap;
+    glyphCacheHead = bitmap;
+    if (glyphCacheTail == nullptr) glyphCacheTail = bitmap;
+    glyphCacheStats.glyphs++;
+    glyphCacheStats.bytes += size;
+
+    // evict, but keep the glyph we're about to draw
+    while (glyphCacheStats.bytes > glyphCacheSize && glyphCacheTail != bitmap) {
+        freeGlyphBitmap(glyphCacheTail);
+    }
+    return bitmap;
+}
+
+void truetypeClass::drawGlyphBitmap(ttGlyphBitmap_t *_bitmap, int16_t _x, int16_t _y) {
+    const uint8_t *bits = (const uint8_t *)(_bitmap + 1);
+    const uint16_t stride = (_bitmap->width + 7) / 8;
+    for (uint16_t y = 0; y < _bitmap->height; y++) {
+        const uint8_t *row = bits + y * stride;
+        for (uint16_t x = 0; x < _bitmap->width; x++) {
+            if (row[x / 8] & (0b10000000 >> (x % 8))) {
+                addPixel(_x + _bitmap->x + x, _y + _bitmap->y + y, colorInside);
             }
         }
+    }
+}
 
-        if (pointsToFill != nullptr) free(pointsToFill);
-        pointsToFill = nullptr;
+void truetypeClass::freeGlyphBitmap(ttGlyphBitmap_t *_bitmap) {
+    if (_bitmap->prev) {
+        _bitmap->prev->next = _bitmap->next;
+    } else {
+        glyphCacheHead = _bitmap->next;
     }
+    if (_bitmap->next) {
+        _bitmap->next->prev = _bitmap->prev;
+    } else {
+        glyphCacheTail = _bitmap->prev;
+    }
+    glyphCache.erase(_bitmap->key);
+    glyphCacheStats.glyphs--;
+    glyphCacheStats.bytes -= _bitmap->size;
+    free(_bitmap);
 }
 
-float truetypeClass::isLeft(ttCoordinate_t *_p0, ttCoordinate_t *_p1, ttCoordinate_t *_point) {
-    return ((_p1->x - _p0->x) * (_point->y - _p0->y) - (_point->x - _p0->x) * (_p1->y - _p0->y));
+void truetypeClass::freeGlyphCache() {
+    while (glyphCacheTail) {
+        freeGlyphBitmap(glyphCacheTail);
+    }
 }
 
 void truetypeClass::textDraw(int16_t _x, int16_t _y, const wchar_t _character[]) {
@@ -913,10 +1220,16 @@ void truetypeClass::textDraw(int16_t _x, int16_t _y, const wchar_t _character[])
             continue;
         }
 
-        charCode = codeToGlyphId(_character[c]);
+        // coverage output can't be cached as a bitmap
+        ttGlyphBitmap_t *bitmap = (glyphCacheSize && !(supersampling > 1 && pfnDrawCoverage)) ? getGlyphBitmap(_character[c]) : nullptr;
+        if (bitmap) {
+            charCode = bitmap->metricId;
+        } else {
+            charCode = codeToGlyphId(_character[c]);
 
-        //Serial.printf("code:%4d\n", charCode);
-        readGlyph(charCode);
+            //Serial.printf("code:%4d\n", charCode);
+            readGlyph(charCode);
+        }
 
         _x += characterSpace;
 #ifdef ENABLEKERNING
@@ -927,7 +1240,12 @@ void truetypeClass::textDraw(int16_t _x, int16_t _y, const wchar_t _character[])
 #endif
         prev_code = charCode;
 
-        ttHMetric_t hMetric = getHMetric(charCode);
+        ttHMetric_t hMetric;
+        if (bitmap) {
+            hMetric.advanceWidth = bitmap->advanceWidth;
+        } else {
+            hMetric = getHMetric(charCode);
+        }
 
         // Line breaks when reaching the edge of the display
         if (c > 0 && (hMetric.advanceWidth + _x) > end_x) {
@@ -948,12 +1266,16 @@ void truetypeClass::textDraw(int16_t _x, int16_t _y, const wchar_t _character[])
             continue;
         }
 
-        if (glyph.numberOfContours >= 0) {
-            generateOutline(_x, _y, characterSize);
-            fillGlyph(_x, _y, characterSize);
+        if (bitmap) {
+            drawGlyphBitmap(bitmap, _x, _y);
+        } else {
+            if (glyph.numberOfContours >= 0) {
+                generateOutline(_x, _y, characterSize);
+                fillGlyph(_x, _y, characterSize);
+            }
+            freePointsAll();
+            freeGlyph();
         }
-        freePointsAll();
-        freeGlyph();
 
         _x += hMetric.advanceWidth;
         c++;
@@ -986,6 +1308,16 @@ void truetypeClass::textDraw(int16_t _x, int16_t _y, const String _string) {
 void truetypeClass::addPixel(int16_t _x, int16_t _y, uint16_t _colorCode) {
     uint8_t *buf_ptr;
 
+    if (rasterTarget) {  // rasterising a glyph for the glyph cache
+        _x -= rasterTarget->x;
+        _y -= rasterTarget->y;
+        if ((_x >= 0) && ((uint16_t)_x < rasterTarget->width) && (_y >= 0) && ((uint16_t)_y < rasterTarget->height)) {
+            buf_ptr = (uint8_t *)(rasterTarget + 1) + (uint16_t)_y * ((rasterTarget->width + 7) / 8) + (uint16_t)_x / 8;
+            *buf_ptr |= 0b10000000 >> ((uint16_t)_x % 8);
+        }
+        return;
+    }
+
     if (pfnDrawPixel) {  // user-supplied pixel function
         (*pfnDrawPixel)(_x, _y, _colorCode);
         return;
@@ -1020,6 +1352,13 @@ void truetypeClass::addPixel(int16_t _x, int16_t _y, uint16_t _colorCode) {
         return;
     }
 
+    // outside the part of the display the framebuffer holds
+    _x -= frameX;
+    _y -= frameY;
+    if ((_x < 0) || ((uint16_t)_x >= frameWidth) || ((uint16_t)_y >= frameHeight) || (_y < 0)) {
+        return;
+    }
+
     switch (framebufferBit) {
         case 16:  // 16bit horizontal
         {
@@ -1066,8 +1405,14 @@ uint16_t truetypeClass::getStringWidth(const wchar_t _character[]) {
             c++;
             continue;
         }
-        uint16_t code = codeToGlyphId(_character[c]);
-        readGlyph(code, 1);
+        ttGlyphBitmap_t *bitmap = (glyphCacheSize) ? getGlyphBitmap(_character[c]) : nullptr;
+        uint16_t code;
+        if (bitmap) {
+            code = bitmap->glyphId;
+        } else {
+            code = codeToGlyphId(_character[c]);
+            readGlyph(code, 1);
+        }
 
         output += characterSpace;
 #ifdef ENABLEKERNING
@@ -1078,8 +1423,12 @@ uint16_t truetypeClass::getStringWidth(const wchar_t _character[]) {
 #endif
         prev_code = code;
 
-        ttHMetric_t hMetric = getHMetric(code);
-        output += hMetric.advanceWidth;
+        if (bitmap) {
+            output += bitmap->measureWidth;
+        } else {
+            ttHMetric_t hMetric = getHMetric(code);
+            output += hMetric.advanceWidth;
+        }
         c++;
     }
 
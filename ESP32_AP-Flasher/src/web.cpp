@@ -10,10 +10,14 @@
 #include <WiFi.h>
 
 #include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #include "AsyncJson.h"
 #include "LittleFS.h"
 #include "SPIFFSEditor.h"
+#include "bufferpool.h"
 #include "commstructs.h"
 #include "language.h"
 #include "leds.h"
@@ -38,20 +42,66 @@ WifiManager wm;
 SemaphoreHandle_t wsMutex;
 uint32_t lastssidscan = 0;
 
+// what is waiting for the next wsFlush()
+struct wsLine {
+    String text;
+    bool isErr;
+    bool isSys;      // from logLine(), as written to /log.txt
+    uint16_t count;  // merged lines
+};
+static std::mutex wsBatchMutex;
+static std::vector<uint64_t> wsDirtyTags;
+static std::vector<wsLine> wsLines;
+static uint32_t wsDroppedLines = 0;
+// per client that was behind, the tag fields it missed
+static std::map<uint32_t, std::map<uint64_t, uint32_t>> wsBehind;
+// with the TAGFIELD_ bits of a tag that was deleted, it goes out as contentMode 255
+#define WS_TAG_DELETED (1UL << 31)
+static WebsocketStats wsStats = {0};
+
+// lines that start with the mac of a tag
+static bool isTagLine(const String &text) {
+    if (text.length() < 16) return false;
+    for (uint8_t i = 0; i < 16; i++) {
+        if (!isxdigit(text[i])) return false;
+    }
+    return true;
+}
+
+static void wsQueueLine(const String &text, const bool isErr, const bool isSys) {
+    std::lock_guard<std::mutex> lock(wsBatchMutex);
+    // a burst of the same kind of line from the same tag (block requests) becomes one
+    if (!wsLines.empty()) {
+        wsLine &last = wsLines.back();
+        if (last.isErr == isErr && last.isSys == isSys && isTagLine(text) && text.length() >= 30 && last.text.startsWith(text.substring(0, 30))) {
+            last.text = text;
+            last.count++;
+            return;
+        }
+    }
+    if (wsLines.size() >= WS_LOG_LINES) {
+        auto victim = std::find_if(wsLines.begin(), wsLines.end(), [](const wsLine &line) { return !line.isErr; });
+        if (victim == wsLines.end()) victim = wsLines.begin();
+        wsDroppedLines += victim->count;
+        wsLines.erase(victim);
+    }
+    wsLines.push_back({text, isErr, isSys, 1});
+}
+
 void wsLog(const String &text) {
-    JsonDocument doc;
-    doc["logMsg"] = text;
-    if (wsMutex) xSemaphoreTake(wsMutex, portMAX_DELAY);
-    ws.textAll(doc.as<String>());
-    if (wsMutex) xSemaphoreGive(wsMutex);
+    wsQueueLine(text, false, false);
 }
 
 void wsErr(const String &text) {
-    JsonDocument doc;
-    doc["errMsg"] = text;
-    if (wsMutex) xSemaphoreTake(wsMutex, portMAX_DELAY);
-    ws.textAll(doc.as<String>());
-    if (wsMutex) xSemaphoreGive(wsMutex);
+    wsQueueLine(text, true, false);
+}
+
+void wsSysLog(const String &text) {
+    wsQueueLine(text, false, true);
+}
+
+static const char *wsLineKey(const wsLine &line) {
+    return line.isSys ? "sysMsg" : (line.isErr ? "errMsg" : "logMsg");
 }
 
 size_t dbSize() {
@@ -128,12 +178,14 @@ void wsSendSysteminfo() {
     // reboot once at night
     if (timeinfo.tm_hour == 3 && timeinfo.tm_min == 56 && millis() > 2 * 3600 * 1000 && config.nightlyreboot == 1) {
         logLine("Nightly reboot");
+        logFlush();
         wsErr("REBOOTING");
+        wsFlush();
         config.runStatus = RUNSTATUS_STOP;
         ws.enable(false);
         vTaskDelay(5000 / portTICK_PERIOD_MS);
         refreshAllPending();
-        saveDB("/current/tagDB.json");
+        saveDBbin("/current/tagDB.bin");
         ws.closeAll();
         delay(100);
         ESP.restart();
@@ -168,41 +220,158 @@ void wsSendSysteminfo() {
 }
 
 void wsSendTaginfo(const uint8_t *mac, uint8_t syncMode) {
-    if (syncMode != SYNC_DELETE) {
-        String json = "";
-        json = tagDBtoJson(mac);
-        xSemaphoreTake(wsMutex, portMAX_DELAY);
-        ws.textAll(json);
-        xSemaphoreGive(wsMutex);
+    struct TagInfo taginfoitem;
+    {
+        std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+        tagRecord *taginfo = tagRecord::findByMAC(mac);
+        if (taginfo == nullptr) return;
+
+        if (syncMode == SYNC_DELETE || (taginfo->dirtyWeb & TAGFIELD_WEB)) {
+            // sent with the next flush, together with everything else that changed. Deleted
+            // records are gone by then, the flush tells the clients to drop them
+            uint64_t key;
+            memcpy(&key, taginfo->mac, sizeof(key));
+            std::lock_guard<std::mutex> lock(wsBatchMutex);
+            if (std::find(wsDirtyTags.begin(), wsDirtyTags.end(), key) == wsDirtyTags.end()) wsDirtyTags.push_back(key);
+        }
+        if (syncMode <= SYNC_NOSYNC) return;
+        const uint32_t syncFields = (syncMode == SYNC_TAGSTATUS) ? TAGFIELD_SYNC_TAGSTATUS : TAGFIELD_SYNC_USERCFG;
+        // a delete or a config change is always sent, tag status only when it changed
+        if (syncMode == SYNC_TAGSTATUS && (taginfo->dirtySync & syncFields) == 0) return;
+        taginfo->dirtySync &= ~syncFields;
+        if (taginfo->contentMode == 12 && syncMode != SYNC_DELETE) return;
+
+        memcpy(taginfoitem.mac, taginfo->mac, sizeof(taginfoitem.mac));
+        taginfoitem.syncMode = syncMode;
+        taginfoitem.contentMode = taginfo->contentMode;
+        if (syncMode == SYNC_USERCFG) {
+            strncpy(taginfoitem.alias, taginfo->alias.c_str(), sizeof(taginfoitem.alias) - 1);
+            taginfoitem.alias[sizeof(taginfoitem.alias) - 1] = '\0';
+            taginfoitem.nextupdate = taginfo->nextupdate;
+        }
+        if (syncMode == SYNC_TAGSTATUS) {
+            taginfoitem.lastseen = taginfo->lastseen;
+            taginfoitem.nextupdate = taginfo->nextupdate;
+            taginfoitem.pendingCount = taginfo->pendingCount;
+            taginfoitem.expectedNextCheckin = taginfo->expectedNextCheckin;
+            taginfoitem.hwType = taginfo->hwType;
+            taginfoitem.wakeupReason = taginfo->wakeupReason;
+            taginfoitem.capabilities = taginfo->capabilities;
+            taginfoitem.pendingIdle = taginfo->pendingIdle;
+        }
     }
-    if (syncMode > SYNC_NOSYNC) {
-        const tagRecord *taginfo = tagRecord::findByMAC(mac);
-        if (taginfo != nullptr) {
-            if (taginfo->contentMode != 12 || syncMode == SYNC_DELETE) {
-                UDPcomm udpsync;
-                struct TagInfo taginfoitem;
-                memcpy(taginfoitem.mac, taginfo->mac, sizeof(taginfoitem.mac));
-                taginfoitem.syncMode = syncMode;
-                taginfoitem.contentMode = taginfo->contentMode;
-                if (syncMode == SYNC_USERCFG) {
-                    strncpy(taginfoitem.alias, taginfo->alias.c_str(), sizeof(taginfoitem.alias) - 1);
-                    taginfoitem.alias[sizeof(taginfoitem.alias) - 1] = '\0';
-                    taginfoitem.nextupdate = taginfo->nextupdate;
-                }
-                if (syncMode == SYNC_TAGSTATUS) {
-                    taginfoitem.lastseen = taginfo->lastseen;
-                    taginfoitem.nextupdate = taginfo->nextupdate;
-                    taginfoitem.pendingCount = taginfo->pendingCount;
-                    taginfoitem.expectedNextCheckin = taginfo->expectedNextCheckin;
-                    taginfoitem.hwType = taginfo->hwType;
-                    taginfoitem.wakeupReason = taginfo->wakeupReason;
-                    taginfoitem.capabilities = taginfo->capabilities;
-                    taginfoitem.pendingIdle = taginfo->pendingIdle;
-                }
-                udpsync.netTaginfo(&taginfoitem);
+    UDPcomm udpsync;
+    udpsync.netTaginfo(&taginfoitem);
+}
+
+static String wsBatchMessage(const std::map<uint64_t, uint32_t> &changes, const std::vector<wsLine> &lines, const uint32_t dropped) {
+    JsonDocument doc;
+    if (!changes.empty()) {
+        // only the fields that changed since the last update, the web UI merges them
+        JsonArray tags = doc["tags"].to<JsonArray>();
+        std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+        for (const auto &change : changes) {
+            const tagRecord *taginfo = tagRecord::findByMAC(reinterpret_cast<const uint8_t *>(&change.first));
+            if (taginfo == nullptr) {
+                if ((change.second & WS_TAG_DELETED) == 0) continue;
+                char hexmac[17];
+                mac2hex(reinterpret_cast<const uint8_t *>(&change.first), hexmac);
+                JsonObject tag = tags.add<JsonObject>();
+                tag["mac"] = String(hexmac);
+                tag["contentMode"] = 255;
+                continue;
             }
+            JsonObject tag = tags.add<JsonObject>();
+            fillNode(tag, taginfo, change.second & TAGFIELD_WEB);
+        }
+    }
+    if (lines.size() == 1 && lines[0].count == 1 && dropped == 0) {
+        doc[wsLineKey(lines[0])] = lines[0].text;
+    } else if (!lines.empty() || dropped) {
+        JsonArray logs = doc["logs"].to<JsonArray>();
+        if (dropped) logs.add<JsonObject>()["errMsg"] = String(dropped) + " log lines dropped";
+        for (const wsLine &line : lines) {
+            String text = line.text;
+            if (line.count > 1) text += " (" + String(line.count) + "x)";
+            logs.add<JsonObject>()[wsLineKey(line)] = text;
         }
     }
+    return doc.isNull() ? String() : doc.as<String>();
+}
+
+/// @brief Send the collected tag updates and log lines, one message per client
+void wsFlush() {
+    std::vector<uint64_t> dirtyTags;
+    std::vector<wsLine> lines;
+    uint32_t dropped;
+    {
+        std::lock_guard<std::mutex> lock(wsBatchMutex);
+        dirtyTags.swap(wsDirtyTags);
+        lines.swap(wsLines);
+        dropped = wsDroppedLines;
+        wsDroppedLines = 0;
+    }
+
+    // runs on its own task, records may be changed or deleted by the radio, udp and web tasks meanwhile
+    std::map<uint64_t, uint32_t> changes;
+    std::unique_lock<std::recursive_mutex> tagLock(tagDBMutex);
+    for (const uint64_t key : dirtyTags) {
+        tagRecord *taginfo = tagRecord::findByMAC(reinterpret_cast<const uint8_t *>(&key));
+        if (taginfo == nullptr) {
+            changes[key] = WS_TAG_DELETED;
+            continue;
+        }
+        const uint32_t fields = taginfo->dirtyWeb & TAGFIELD_WEB;
+        taginfo->dirtyWeb &= ~fields;
+        if (fields) changes[key] = fields;
+    }
+    tagLock.unlock();
+    if (changes.empty() && lines.empty() && dropped == 0 && wsBehind.empty()) return;
+
+    xSemaphoreTake(wsMutex, portMAX_DELAY);
+    std::map<uint32_t, std::map<uint64_t, uint32_t>> behind;
+    String message;
+    for (AsyncWebSocketClient &client : ws.getClients()) {
+        if (client.status() != WS_CONNECTED) continue;
+        auto missed = wsBehind.find(client.id());
+        if (client.queueLen() >= WS_CLIENT_QUEUE) {
+            // keep what it misses, log lines excepted
+            std::map<uint64_t, uint32_t> &pending = behind[client.id()];
+            if (missed != wsBehind.end()) pending = missed->second;
+            for (const auto &change : changes) pending[change.first] |= change.second;
+            wsStats.skipped++;
+            continue;
+        }
+        if (missed != wsBehind.end()) {
+            std::map<uint64_t, uint32_t> pending = missed->second;
+            for (const auto &change : changes) pending[change.first] |= change.second;
+            const String catchup = wsBatchMessage(pending, lines, dropped);
+            if (!catchup.isEmpty()) client.text(catchup);
+            wsStats.tagUpdates += pending.size();
+        } else {
+            if (message.isEmpty()) message = wsBatchMessage(changes, lines, dropped);
+            if (message.isEmpty()) continue;
+            client.text(message);
+            wsStats.tagUpdates += changes.size();
+        }
+        wsStats.messages++;
+    }
+    // clients that are gone are dropped here as well
+    wsBehind.swap(behind);
+    wsStats.logLines += lines.size();
+    wsStats.droppedLines += dropped;
+    xSemaphoreGive(wsMutex);
+}
+
+WebsocketStats getWebsocketStats() {
+    return wsStats;
+}
+
+static void wsFlushTask(void *parameter) {
+    while (true) {
+        vTaskDelay(WS_FLUSH_INTERVAL / portTICK_PERIOD_MS);
+        wsFlush();
+    }
 }
 
 void wsSendAPitem(struct APlist *apitem) {
@@ -241,8 +410,31 @@ uint8_t wsClientCount() {
     return ws.count();
 }
 
+static size_t logFileSize(const char *path) {
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    File file = contentFS->open(path, "r");
+    const size_t size = file ? file.size() : 0;
+    if (file) file.close();
+    xSemaphoreGive(fsMutex);
+    return size;
+}
+
+// The web server sends a response after the handler returns. The buffer may be dequeued or
+// replaced meanwhile, the response holds a reference to it until it is done or the client is gone
+static void sendBuffer(AsyncWebServerRequest *request, uint8_t *data, const size_t len) {
+    bufferpool::retain(data);
+    std::shared_ptr<uint8_t> ref(data, bufferpool::release);
+    AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", len, [ref, len](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        const size_t n = std::min(maxLen, len - index);
+        memcpy(buffer, ref.get() + index, n);
+        return n;
+    });
+    request->send(response);
+}
+
 void init_web() {
     wsMutex = xSemaphoreCreateMutex();
+    xTaskCreate(wsFlushTask, "wsflush", 6000, NULL, 2, NULL);
     WiFi.mode(WIFI_STA);
     WiFi.setTxPower(static_cast<wifi_power_t>(config.wifiPower));
 
@@ -255,11 +447,13 @@ void init_web() {
     server.on("/reboot", HTTP_POST, [](AsyncWebServerRequest *request) {
         request->send(200, "text/plain", "OK Reboot");
         logLine("Reboot request by user");
+        logFlush();
         wsErr("REBOOTING");
+        wsFlush();
         delay(100);
         ws.enable(false);
         refreshAllPending();
-        saveDB("/current/tagDB.json");
+        saveDBbin("/current/tagDB.bin");
         ws.closeAll();
         delay(100);
         ESP.restart();
@@ -276,23 +470,28 @@ void init_web() {
     server.on("/jsonupload", HTTP_POST, doJsonUpload);
 
     server.on("/get_db", HTTP_GET, [](AsyncWebServerRequest *request) {
-        String json = "";
+        TagFilter filter;
+        uint32_t startPos = 0;
         if (request->hasParam("mac")) {
-            String dst = request->getParam("mac")->value();
-            uint8_t mac[8];
-            if (hex2mac(dst, mac)) {
-                json = tagDBtoJson(mac);
-            } else {
-                json = "{\"error\": \"malformatted parameter\"}";
-            }
-        } else {
-            uint8_t startPos = 0;
-            if (request->hasParam("pos")) {
-                startPos = atoi(request->getParam("pos")->value().c_str());
+            if (!hex2mac(request->getParam("mac")->value(), filter.mac)) {
+                request->send(200, "application/json", "{\"error\": \"malformatted parameter\"}");
+                return;
             }
-            json = tagDBtoJson(nullptr, startPos);
+            filter.byMac = true;
         }
-        request->send(200, "application/json", json);
+        if (request->hasParam("pos")) startPos = request->getParam("pos")->value().toInt();
+        if (request->hasParam("changed")) filter.changedSince = request->getParam("changed")->value().toInt();
+        if (request->hasParam("hwtype")) filter.hwType = request->getParam("hwtype")->value().toInt();
+        if (request->hasParam("contentmode")) filter.contentMode = request->getParam("contentmode")->value().toInt();
+        if (request->hasParam("timeout")) filter.timedOut = request->getParam("timeout")->value() == "1";
+        if (request->hasParam("lowbatt")) filter.lowBattery = request->getParam("lowbatt")->value() == "1";
+
+        // written as the client takes it, one tag at a time
+        auto writer = std::make_shared<TagDBJsonWriter>(filter, startPos);
+        AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [writer](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return writer->read(buffer, maxLen);
+        });
+        request->send(response);
     });
 
     server.on("/getdata", HTTP_GET, [](AsyncWebServerRequest *request) {
@@ -305,38 +504,42 @@ void init_web() {
                     if (request->hasParam("md5")) {
                         uint8_t md5[8];
                         if (hex2mac(request->getParam("md5")->value(), md5)) {
+                            std::lock_guard<std::recursive_mutex> lock(queueMutex);
                             PendingItem *queueItem = getQueueItem(mac, *reinterpret_cast<uint64_t *>(md5));
                             if (queueItem == nullptr) {
                                 Serial.println("getQueueItem: no queue item");
                                 request->send(404, "text/plain", "File not found");
                                 return;
                             }
-                            if (queueItem->data == nullptr) {
-                                fs::File file = contentFS->open(queueItem->filename);
-                                if (file) {
-                                    queueItem->data = getDataForFile(file);
-                                    Serial.println("Reading file " + String(queueItem->filename));
-                                    file.close();
-                                } else {
-                                    request->send(404, "text/plain", "File not found");
-                                    return;
-                                }
+                            if (loadQueueItemData(queueItem) == nullptr) {
+                                request->send(404, "text/plain", "File not found");
+                                return;
                             }
-                            request->send(200, "application/octet-stream", queueItem->data, queueItem->len);
+                            sendBuffer(request, queueItem->data, queueItem->len);
                             return;
                         }
                     } else {
                         // older version without queue
+                        std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+                        taginfo = tagRecord::findByMAC(mac);
+                        if (taginfo == nullptr) {
+                            request->send(404, "text/plain", "File not found");
+                            return;
+                        }
                         if (taginfo->data == nullptr) {
                             fs::File file = contentFS->open(taginfo->filename);
                             if (!file) {
                                 request->send(404, "text/plain", "File not found");
                                 return;
                             }
-                            taginfo->data = getDataForFile(file);
+                            taginfo->data = bufferpool::readFile(file, 0);
                             file.close();
+                            if (taginfo->data == nullptr) {
+                                request->send(404, "text/plain", "File not found");
+                                return;
+                            }
                         }
-                        request->send(200, "application/octet-stream", taginfo->data, taginfo->len);
+                        sendBuffer(request, taginfo->data, taginfo->len);
                         return;
                     }
                 }
@@ -358,23 +561,23 @@ void init_web() {
                             // temporary content, restore after sending
                             pushTagInfo(taginfo);
                         }
-                        taginfo->contentMode = newContentMode;
+                        taginfo->setContentMode(newContentMode);
                     }
                     if (request->hasParam("alias", true)) {
-                        taginfo->alias = request->getParam("alias", true)->value();
+                        taginfo->setAlias(request->getParam("alias", true)->value());
                     }
                     if (request->hasParam("modecfgjson", true)) {
-                        taginfo->modeConfigJson = request->getParam("modecfgjson", true)->value();
+                        taginfo->setModeConfigJson(request->getParam("modecfgjson", true)->value());
                     }
-                    taginfo->nextupdate = 0;
+                    taginfo->setNextupdate(0);
                     if (request->hasParam("rotate", true)) {
-                        taginfo->rotate = atoi(request->getParam("rotate", true)->value().c_str());
+                        taginfo->setRotate(atoi(request->getParam("rotate", true)->value().c_str()));
                     }
                     if (request->hasParam("lut", true)) {
-                        taginfo->lut = atoi(request->getParam("lut", true)->value().c_str());
+                        taginfo->setLut(atoi(request->getParam("lut", true)->value().c_str()));
                     }
                     if (request->hasParam("invert", true)) {
-                        taginfo->invert = atoi(request->getParam("invert", true)->value().c_str());
+                        taginfo->setInvert(atoi(request->getParam("invert", true)->value().c_str()));
                     }
                     wsSendTaginfo(mac, SYNC_USERCFG);
                     // saveDB("/current/tagDB.json");
@@ -402,6 +605,8 @@ void init_web() {
                         time_t now;
                         time(&now);
                         for (int c = tagDB.size() - 1; c >= 0; --c) {
+                            // deleteRecord can remove more than one record
+                            if (c >= tagDB.size()) continue;
                             tagRecord *tag = tagDB.at(c);
                             if (tag->expectedNextCheckin == 3216153600 || tag->lastseen < now - 24 * 3600 || now > tag->expectedNextCheckin + 600) {
                                 wsSendTaginfo(tag->mac, SYNC_DELETE);
@@ -413,7 +618,7 @@ void init_web() {
                         clearPending(taginfo);
                         while (dequeueItem(mac)) {
                         };
-                        taginfo->pendingCount = countQueueItem(mac);
+                        taginfo->setPendingCount(countQueueItem(mac));
                         wsSendTaginfo(mac, SYNC_TAGSTATUS);
                     }
                     if (strcmp(cmdValue, "refresh") == 0) {
@@ -430,7 +635,7 @@ void init_web() {
                     }
                     if (strcmp(cmdValue, "deepsleep") == 0) {
                         sendTagCommand(mac, CMD_DO_DEEPSLEEP, !taginfo->isExternal);
-                        taginfo->pendingIdle = 9999;
+                        taginfo->setPendingIdle(9999);
                         wsSendTaginfo(mac, SYNC_TAGSTATUS);
                     }
                     if (strcmp(cmdValue, "ledflash") == 0) {
@@ -762,6 +967,8 @@ void init_web() {
             contentFS->remove("/logold.txt");
             contentFS->remove("/current/tagDB.json");
             contentFS->remove("/current/tagDB.json.bak");
+            contentFS->remove("/current/tagDB.bin");
+            contentFS->remove("/current/tagDB.bin.jnl");
             contentFS->remove("/current/tagDBrestored.json");
             contentFS->remove("/current/apconfig.json");
             delay(100);
@@ -769,7 +976,7 @@ void init_web() {
             ESP.restart();
         } else {
             refreshAllPending();
-            saveDB("/current/tagDB.json");
+            saveDBbin("/current/tagDB.bin");
         }
 
         ws.closeAll();
@@ -792,6 +999,29 @@ void init_web() {
 
     // OTA related calls
 
+    server.on("/log", HTTP_GET, [](AsyncWebServerRequest *request) {
+        // lines still in RAM are written out first, then /logold.txt and /log.txt are streamed, oldest first
+        logFlush();
+        const size_t oldSize = logFileSize("/logold.txt");
+        const size_t size = oldSize + logFileSize("/log.txt");
+        AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain", [oldSize, size](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            if (index >= size) return 0;
+            const bool old = index < oldSize;
+            const size_t len = std::min(maxLen, (old ? oldSize : size) - index);
+            xSemaphoreTake(fsMutex, portMAX_DELAY);
+            File file = contentFS->open(old ? "/logold.txt" : "/log.txt", "r");
+            size_t read = 0;
+            if (file) {
+                // rotated in the meantime: the response ends short
+                if (file.seek(old ? index : index - oldSize)) read = file.read(buffer, len);
+                file.close();
+            }
+            xSemaphoreGive(fsMutex);
+            return read;
+        });
+        request->send(response);
+    });
+
     server.on("/sysinfo", HTTP_GET, handleSysinfoRequest);
     server.on("/check_file", HTTP_GET, handleCheckFile);
     server.on("/rollback", HTTP_POST, handleRollback);
@@ -915,16 +1145,16 @@ void doImageUpload(AsyncWebServerRequest *request, String filename, size_t index
                             dither = request->getParam("dither", true)->value().toInt();
                         }
                         if (request->hasParam("alias", true)) {
-                            taginfo->alias = request->getParam("alias", true)->value();
+                            taginfo->setAlias(request->getParam("alias", true)->value());
                         }
                         if (request->hasParam("rotate", true)) {
-                            taginfo->rotate = atoi(request->getParam("rotate", true)->value().c_str());
+                            taginfo->setRotate(atoi(request->getParam("rotate", true)->value().c_str()));
                         }
                         if (request->hasParam("lut", true)) {
-                            taginfo->lut = atoi(request->getParam("lut", true)->value().c_str());
+                            taginfo->setLut(atoi(request->getParam("lut", true)->value().c_str()));
                         }
                         if (request->hasParam("invert", true)) {
-                            taginfo->invert = atoi(request->getParam("invert", true)->value().c_str());
+                            taginfo->setInvert(atoi(request->getParam("invert", true)->value().c_str()));
                         }
                         uint32_t ttl = 0;
                         if (request->hasParam("ttl", true)) {
@@ -940,14 +1170,14 @@ void doImageUpload(AsyncWebServerRequest *request, String filename, size_t index
                                 preloadlut = request->getParam("preloadlut", true)->value().toInt();
                             }
                         }
-                        taginfo->modeConfigJson = "{\"filename\":\"/temp/" + uploadfilename + "\",\"timetolive\":\"" + String(ttl) + "\",\"dither\":\"" + String(dither) + "\",\"delete\":\"1\", \"preload\":\"" + String(preload) + "\", \"preload_lut\":\"" + String(preloadlut) + "\", \"preload_type\":\"" + String(preloadtype) + "\"}";
+                        taginfo->setModeConfigJson("{\"filename\":\"/temp/" + uploadfilename + "\",\"timetolive\":\"" + String(ttl) + "\",\"dither\":\"" + String(dither) + "\",\"delete\":\"1\", \"preload\":\"" + String(preload) + "\", \"preload_lut\":\"" + String(preloadlut) + "\", \"preload_type\":\"" + String(preloadtype) + "\"}");
                         if (request->hasParam("contentmode", true)) {
-                            taginfo->contentMode = request->getParam("contentmode", true)->value().toInt();
+                            taginfo->setContentMode(request->getParam("contentmode", true)->value().toInt());
                         } else {
-                            taginfo->contentMode = 24;
+                            taginfo->setContentMode(24);
                         }
                         Serial.println("upload finished " + uploadfilename);
-                        taginfo->nextupdate = 0;
+                        taginfo->setNextupdate(0);
                         wsSendTaginfo(mac, SYNC_USERCFG);
                         request->send(200, "text/plain", "Ok, saved");
                     } else {
@@ -984,9 +1214,9 @@ void doJsonUpload(AsyncWebServerRequest *request) {
                 if (request->hasParam("ttl", true)) {
                     ttl = request->getParam("ttl", true)->value().toInt();
                 }
-                taginfo->modeConfigJson = "{\"filename\":\"/current/" + dst + ".json\",\"interval\":\"" + String(ttl) + "\"}";
-                taginfo->contentMode = 19;
-                taginfo->nextupdate = 0;
+                taginfo->setModeConfigJson("{\"filename\":\"/current/" + dst + ".json\",\"interval\":\"" + String(ttl) + "\"}");
+                taginfo->setContentMode(19);
+                taginfo->setNextupdate(0);
                 wsSendTaginfo(mac, SYNC_USERCFG);
                 request->send(200, "text/plain", "Ok, saved");
             } else {
@@ -1012,6 +1242,7 @@ void dotagDBUpload(AsyncWebServerRequest *request, String filename, size_t index
         xSemaphoreGive(fsMutex);
         destroyDB();
         loadDB("/current/tagDBrestored.json");
+        saveDBbin("/current/tagDB.bin");
         request->send(200, "text/plain", "Ok, restored.");
     }
 }
@@ -467,7 +467,7 @@ bool onCommandCallback(improv::ImprovCommand cmd) {
 
             ws.enable(false);
             refreshAllPending();
-            saveDB("/current/tagDB.json");
+            saveDBbin("/current/tagDB.bin");
             ws.closeAll();
             delay(100);
             if (wm.connectToWifi(String(cmd.ssid.c_str()), String(cmd.password.c_str()), true)) {
@@ -0,0 +1,225 @@
+// Peak heap of rendering content with drawBanded in makeimage.cpp, against a full 16 bit sprite and
+// spr2buffer as before, per tag type and output format. This is built without BOARD_HAS_PSRAM, the
+// boards banding is for, so the full sprite path always writes raw planes. The heap is counted for
+// every allocation, by replacing malloc and free, from before the sprite is created until the file
+// is written.
+//
+// Every banded image is decoded the way a tag would and has to give the same planes as the full
+// sprite, for all dither modes and the rotations drawBanded takes, the others have to fall back to
+// the full sprite. Bands are sized from the largest free block, written raw the peak heap has to
+// stay under half of it for every tag type. Compressed output adds the compressor or the encoder.
+//
+//   banded_heap_bench
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include <malloc.h>
+
+#include <atomic>
+#include <vector>
+
+#include "makeimage.h"
+#include "miniz-oepl.h"
+#include "storage.h"
+#include "tag_db.h"
+#include "../../src/g5/g5dec.inl"
+
+// what the rest of the AP would provide
+fs::FS* contentFS = &fs::hostFS;
+SemaphoreHandle_t fsMutex = xSemaphoreCreateMutex();
+Config config;
+
+void wsErr(const String&) {}
+namespace util {
+void printLargestFreeBlock() {}
+}  // namespace util
+
+// heap in use and its high-water mark, for everything allocated through malloc
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+static std::atomic<long> heapUsed(0);
+static std::atomic<long> heapPeak(0);
+
+static void heapAdd(void* ptr) {
+    if (ptr == nullptr) return;
+    const long used = heapUsed += malloc_usable_size(ptr);
+    long peak = heapPeak.load();
+    while (used > peak && !heapPeak.compare_exchange_weak(peak, used)) {
+    }
+}
+
+extern "C" void* malloc(size_t size) {
+    void* ptr = __libc_malloc(size);
+    heapAdd(ptr);
+    return ptr;
+}
+extern "C" void* calloc(size_t count, size_t size) {
+    void* ptr = __libc_calloc(count, size);
+    heapAdd(ptr);
+    return ptr;
+}
+extern "C" void* realloc(void* ptr, size_t size) {
+    if (ptr) heapUsed -= malloc_usable_size(ptr);
+    void* moved = __libc_realloc(ptr, size);
+    heapAdd(moved ? moved : (size ? ptr : nullptr));
+    return moved;
+}
+extern "C" void free(void* ptr) {
+    if (ptr) heapUsed -= malloc_usable_size(ptr);
+    __libc_free(ptr);
+}
+
+struct TagType {
+    const char* name;
+    uint16_t width, height;
+    uint8_t bpp, rotatebuffer;
+    std::vector<Color> colors;
+};
+
+enum Format { RAW, ZLIB, G5 };
+static const char* const formatName[] = {"raw", "zlib", "g5"};
+
+// boxes in all palette colors, a gradient and single pixels, the same on every call
+static void drawContent(TFT_eSprite& spr, int w, int h, uint32_t seed) {
+    auto rnd = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    };
+    static const uint16_t colors[] = {0x0000, 0xF800, 0xFFE0, 0x07E0, 0x001F, 0xBDF7, 0x7BEF, 0xFBE0};
+    for (int i = 0; i < 60; i++) {
+        const int x = rnd() % w - 20, y = rnd() % h - 20, bw = rnd() % (w / 3) + 1, bh = rnd() % (h / 3) + 1;
+        spr.fillRect(x, y, bw, bh, colors[rnd() % 8]);
+    }
+    for (int y = h / 2; y < h / 2 + 40 && y < h; y++) {
+        for (int x = 0; x < w; x++) spr.drawPixel(x, y, ((x * 31 / w) << 11) | ((y * 63 / h) << 5) | ((x + y) % 32));
+    }
+    for (int i = 0; i < 2000; i++) spr.drawPixel(rnd() % w, rnd() % h, colors[rnd() % 8]);
+}
+
+static std::vector<uint8_t> readFile(const char* path) {
+    fs::File file = contentFS->open(path, "r");
+    std::vector<uint8_t> data(file.size());
+    file.read(data.data(), data.size());
+    return data;
+}
+
+// the planes in a file written for a tag, as it would decode them
+static bool decode(const std::vector<uint8_t>& file, const imgParam& params, long bufw, long bufh, std::vector<uint8_t>& planes) {
+    if (!params.zlib && !params.g5) {
+        planes = file;
+        return true;
+    }
+    if (params.zlib) {
+        uint32_t total;
+        if (file.size() < 6) return false;
+        memcpy(&total, file.data(), 4);
+        std::vector<uint8_t> out(total);
+        Miniz::tinfl_decompressor* decomp = (Miniz::tinfl_decompressor*)malloc(sizeof(Miniz::tinfl_decompressor));
+        tinfl_init(decomp);
+        size_t inBytes = file.size() - 6, outBytes = total;
+        const Miniz::tinfl_status status = Miniz::tinfl_decompress(decomp, file.data() + 6, &inBytes, out.data(), out.data(), &outBytes, Miniz::TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+        free(decomp);
+        if (status != Miniz::TINFL_STATUS_DONE || outBytes != total || out[0] != 6) return false;
+        planes.assign(out.begin() + 6, out.end());
+        return true;
+    }
+    if (file.size() <= 6) return false;
+    const int count = file[5] == 2 ? 2 : 1;
+    std::vector<uint8_t> g5data(file.begin() + 6, file.end());
+    g5data.resize(g5data.size() + 4, 0);
+    planes.assign(bufw / 8 * bufh * count + 1, 0);
+    G5DECIMAGE g5dec;
+    int rc = g5_decode_init(&g5dec, bufw, bufh * count, g5data.data(), file.size() - 6);
+    for (long line = 0; line < bufh * count && rc == G5_SUCCESS; line++) rc = g5_decode_line(&g5dec, planes.data() + line * (bufw / 8));
+    planes.pop_back();
+    return rc == G5_DECODE_COMPLETE;
+}
+
+int main() {
+    const std::vector<Color> bw = {Color(255, 255, 255), Color(0, 0, 0)};
+    const std::vector<Color> bwr = {Color(255, 255, 255), Color(0, 0, 0), Color(255, 0, 0)};
+    const std::vector<Color> bwry = {Color(255, 255, 255), Color(0, 0, 0), Color(255, 0, 0), Color(255, 255, 0)};
+    const std::vector<Color> sixColor = {Color(255, 255, 255), Color(0, 0, 0), Color(255, 0, 0), Color(255, 255, 0), Color(0, 255, 0), Color(0, 0, 255)};
+    const std::vector<TagType> types = {
+        {"1.54\" bw", 152, 152, 1, 0, bw},
+        {"2.13\" bwr", 250, 122, 2, 1, bwr},
+        {"2.9\" bwr", 296, 128, 2, 1, bwr},
+        {"4.2\" bwr", 400, 300, 2, 0, bwr},
+        {"5.85\" bw", 792, 272, 1, 1, bw},
+        {"7.5\" bwr", 640, 384, 2, 0, bwr},
+        {"7.5\" bwry", 800, 480, 2, 1, bwry},
+        {"7.3\" 6 color", 800, 480, 3, 0, sixColor},
+    };
+
+    bool ok = true;
+    printf("%-13s %-9s %-5s %11s %11s\n", "tag type", "size", "out", "full sprite", "banded");
+    for (const TagType& type : types) {
+        for (Format format : {RAW, ZLIB, G5}) {
+            if (type.bpp > 2 && format != RAW) continue;
+            for (uint8_t rotate = 0; rotate < 4; rotate++) {
+                for (uint8_t dither = 0; dither < 3; dither++) {
+                    imgParam params;
+                    params.hwdata.colortable = type.colors;
+                    params.hasRed = false;
+                    params.dither = dither;
+                    params.rotate = rotate;
+                    params.rotatebuffer = type.rotatebuffer;
+                    params.width = type.rotatebuffer % 2 ? type.height : type.width;
+                    params.height = type.rotatebuffer % 2 ? type.width : type.height;
+                    params.bpp = type.bpp;
+                    params.invert = 0;
+                    params.zlib = format == ZLIB;
+                    params.g5 = format == G5;
+                    const uint32_t seed = rotate * 7 + dither + 1;
+                    auto draw = [&](TFT_eSprite& spr) { drawContent(spr, params.width, params.height, seed); };
+
+                    imgParam full = params;
+                    long base = heapUsed;
+                    heapPeak = base;
+                    {
+                        String file = "/full";
+                        TFT_eSprite spr(&tft);
+                        spr.setColorDepth(16);
+                        spr.createSprite(full.width, full.height);
+                        spr.fillSprite(TFT_WHITE);
+                        draw(spr);
+                        spr2buffer(spr, file, full);
+                    }
+                    const long fullPeak = heapPeak - base;
+
+                    imgParam banded = params;
+                    base = heapUsed;
+                    heapPeak = base;
+                    String file = "/banded";
+                    const bool drawn = drawBanded(file, banded, draw);
+                    const long bandedPeak = heapPeak - base;
+
+                    if (rotate == 0 && dither == 2) {
+                        printf("%-13s %3ux%-5u %-5s %11ld %11ld\n", type.name, type.width, type.height, formatName[format], fullPeak, bandedPeak);
+                    }
+
+                    // the band sprite has to be read straight, so the sprite may only be turned by 180 degrees
+                    const bool fits = rotate % 2 == 0 || type.width == type.height;
+                    const long bufw = type.width, bufh = type.height;
+                    std::vector<uint8_t> planes;
+                    if (drawn != fits) {
+                        printf("FAIL: %s %s, rotate %u, dither %u: drawBanded %s\n", type.name, formatName[format], rotate, dither, drawn ? "drew" : "failed");
+                        ok = false;
+                    } else if (drawn && (!decode(readFile("/banded"), banded, bufw, bufh, planes) || planes != readFile("/full") || banded.hasRed != full.hasRed)) {
+                        printf("FAIL: %s %s, rotate %u, dither %u: the banded image differs\n", type.name, formatName[format], rotate, dither);
+                        ok = false;
+                    }
+                    if (format == RAW && bandedPeak > (long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) / 2) {
+                        printf("FAIL: %s, rotate %u, dither %u: banded peak heap %ld\n", type.name, rotate, dither, bandedPeak);
+                        ok = false;
+                    }
+                }
+            }
+        }
+    }
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+// Renders per minute with slow and failing content sources, fetching inline the way drawNew used to
+// against fetching through the contentfetch workers. A stand-in HTTP server on the loopback interface
+// plays four hosts: a fast one, a slow one, one that answers 500 and one that never answers.
+//
+// 30 tags want new content every 10s. The renderer runs a pass every second like contentRunner, a
+// draw takes 40ms. Inline, every tag waits for the fetches of the tags before it in the pass. With
+// the workers a pass only draws tags whose content is staged and prefetches the ones due soon.
+//
+//   contentfetch_bench [seconds per run]
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "contentfetch.h"
+#include "storage.h"
+
+// what the rest of the AP would provide
+fs::FS* contentFS = &fs::hostFS;
+SemaphoreHandle_t fsMutex = xSemaphoreCreateMutex();
+DynStorage Storage;
+DynStorage::DynStorage() : isInited(true) {}
+uint64_t DynStorage::freeSpace() { return 16 * 1024 * 1024; }
+
+static const unsigned long INTERVAL = 10000;  // ms between a tag's updates
+static const unsigned long PASS = 1000;       // ms between renderer passes
+static const unsigned long DRAW = 40;         // ms a draw takes
+static const uint16_t TIMEOUT = 5000;         // ms, as contentRequests asks for
+
+struct Host {
+    const char* name;
+    int tags;
+    unsigned long delay;  // ms before answering, 0 for never
+    int code;
+    int listener = -1;
+    uint16_t port = 0;
+};
+
+static Host hosts[] = {
+    {"fast", 20, 150, 200},
+    {"slow", 5, 2500, 200},
+    {"error", 3, 200, 500},
+    {"hang", 2, 0, 200},
+};
+
+static std::atomic<bool> stopping{false};
+
+static void serveConnection(int fd, const Host* host) {
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) break;
+        request.append(buffer, n);
+    }
+    // sleep in slices so a hanging answer notices the client giving up
+    const unsigned long start = millis();
+    while (!stopping && (host->delay == 0 || millis() - start < host->delay)) {
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, 50) == 1 && recv(fd, buffer, sizeof(buffer), MSG_PEEK) == 0) break;
+    }
+    if (host->delay && !stopping) {
+        const std::string body = "{\"host\":\"" + std::string(host->name) + "\",\"pad\":\"" + std::string(2000, 'x') + "\"}";
+        const std::string response = "HTTP/1.0 " + std::to_string(host->code) + " X\r\nContent-Type: application/json\r\nContent-Length: " +
+                                     std::to_string(body.size()) + "\r\n\r\n" + body;
+        send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+    }
+    close(fd);
+}
+
+static void serveHost(Host* host) {
+    while (!stopping) {
+        const int fd = accept(host->listener, nullptr, nullptr);
+        if (fd >= 0) std::thread(serveConnection, fd, host).detach();
+    }
+}
+
+static void startServer() {
+    for (Host& host : hosts) {
+        host.listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (bind(host.listener, (sockaddr*)&addr, len) < 0 || listen(host.listener, 64) < 0 ||
+            getsockname(host.listener, (sockaddr*)&addr, &len) < 0) {
+            perror("stand-in server");
+            exit(1);
+        }
+        host.port = ntohs(addr.sin_port);
+        std::thread(serveHost, &host).detach();
+    }
+}
+
+struct Tag {
+    const Host* host;
+    contentfetch::Request req;
+    unsigned long due;
+    bool prefetched;
+};
+
+struct Result {
+    int renders = 0;
+    int rendersPerHost[4] = {0};
+    int failed = 0;  // rendered an error, the content source failed
+    unsigned long longestPass = 0;
+};
+
+static std::vector<Tag> makeTags(const unsigned long start) {
+    std::vector<Tag> tags;
+    for (const Host& host : hosts) {
+        for (int i = 0; i < host.tags; i++) {
+            Tag tag;
+            tag.host = &host;
+            tag.req.url = "http://127.0.0.1:" + String(host.port) + "/" + host.name + "?tag=" + String((int)tags.size());
+            tag.req.timeout = TIMEOUT;
+            // spread over the first interval, like tags that checked in at different times
+            tag.due = start + tags.size() * INTERVAL / 30;
+            tag.prefetched = false;
+            tags.push_back(tag);
+        }
+    }
+    return tags;
+}
+
+static void fetchInline(const contentfetch::Request& req, contentfetch::Response& response) {
+    HTTPClient http;
+    http.begin(req.url);
+    http.setConnectTimeout(req.timeout);
+    http.setTimeout(req.timeout);
+    response.httpCode = http.GET();
+    if (response.httpCode == 200) {
+        const String body = http.getString();
+        response.body = (uint8_t*)strdup(body.c_str());
+        response.len = body.length();
+    }
+    http.end();
+}
+
+static Result run(const bool workers, const unsigned long seconds) {
+    Result result;
+    const unsigned long start = millis();
+    const unsigned long end = start + seconds * 1000;
+    std::vector<Tag> tags = makeTags(start);
+    while (millis() < end) {
+        const unsigned long passStart = millis();
+        for (Tag& tag : tags) {
+            if (millis() >= end) break;
+            const unsigned long now = millis();
+            if (now >= tag.due) {
+                contentfetch::Response response;
+                if (workers) {
+                    if (!contentfetch::ready(tag.req)) continue;
+                    contentfetch::take(tag.req, response);
+                } else {
+                    fetchInline(tag.req, response);
+                }
+                delay(DRAW);
+                result.renders++;
+                result.rendersPerHost[tag.host - hosts]++;
+                if (response.httpCode != 200) result.failed++;
+                tag.due = millis() + INTERVAL;
+                tag.prefetched = false;
+            } else if (workers && !tag.prefetched && tag.due - now <= CONTENTFETCH_LEAD * 1000UL) {
+                contentfetch::prefetch(tag.req, time(nullptr) + (tag.due - now) / 1000);
+                tag.prefetched = true;
+            }
+        }
+        const unsigned long spent = millis() - passStart;
+        result.longestPass = std::max(result.longestPass, spent);
+        if (spent < PASS) delay(PASS - spent);
+    }
+    return result;
+}
+
+static void report(const char* name, const Result& result, const unsigned long seconds) {
+    printf("%-8s %6.1f renders/min (fast %.1f, slow %.1f, error %.1f, hang %.1f), %d with failed content, longest pass %lums\n", name,
+           result.renders * 60.0 / seconds, result.rendersPerHost[0] * 60.0 / seconds, result.rendersPerHost[1] * 60.0 / seconds,
+           result.rendersPerHost[2] * 60.0 / seconds, result.rendersPerHost[3] * 60.0 / seconds, result.failed, result.longestPass);
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    const unsigned long seconds = argc > 1 ? atoi(argv[1]) : 60;
+    startServer();
+    printf("30 tags every %lus, %lus per run, %d workers, %d request per host\n", INTERVAL / 1000, seconds, CONTENTFETCH_WORKERS, CONTENTFETCH_PER_HOST);
+
+    const Result inlined = run(false, seconds);
+    report("inline", inlined, seconds);
+    contentfetch::begin();
+    const Result pooled = run(true, seconds);
+    report("workers", pooled, seconds);
+    const contentfetch::Stats stats = contentfetch::getStats();
+    printf("contentfetch: %u fetches, %u failed, %u prefetched, %u waits\n", stats.fetches, stats.failures, stats.prefetched, stats.waits);
+
+    bool ok = true;
+    // a pass only draws, it never waits for a source
+    if (pooled.longestPass > 30 * DRAW + PASS / 2) {
+        printf("FAIL: a pass took %lums with the workers\n", pooled.longestPass);
+        ok = false;
+    }
+    // tags on the fast host keep their interval, whatever the other hosts do
+    const int expected = hosts[0].tags * (seconds * 1000 / (INTERVAL + PASS + 30 * DRAW));
+    if (pooled.rendersPerHost[0] < expected || pooled.rendersPerHost[0] < inlined.rendersPerHost[0]) {
+        printf("FAIL: %d renders of fast tags with the workers, expected at least %d\n", pooled.rendersPerHost[0], expected);
+        ok = false;
+    }
+    // failing and hanging sources still give their tags a turn
+    if (pooled.rendersPerHost[2] == 0 || pooled.rendersPerHost[3] == 0) {
+        printf("FAIL: tags with failing content were never drawn\n");
+        ok = false;
+    }
+    stopping = true;
+    printf("%s\n", ok ? "OK" : "FAILED");
+    fflush(stdout);
+    // the stand-in's threads are still blocked in accept and in hanging answers
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,163 @@
+// Benchmark of ttf text in drawString: fonts from fontcache.cpp, with their rasterised glyphs kept,
+// against setting up a new truetypeClass from the font file for every string as drawString did
+// before. A template of 25 strings, like a weather and date screen, is drawn with Signika-SB.ttf
+// and weathericons.ttf from data/fonts on a 640x384 8 bit framebuffer. Reported is the time per
+// render once the cache is warm, and the file opens and bytes read per render. fontcache_bench_psram
+// is the same built with BOARD_HAS_PSRAM, the font files in memory and a larger glyph budget.
+//
+// The cached fonts have to give the same framebuffer, open no files once warm, and load a font
+// again after fileChanged().
+//
+//   fontcache_bench [renders]
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#include <chrono>
+#include <vector>
+
+#include "fontcache.h"
+#include "storage.h"
+#include "truetype.h"
+
+// what the rest of the AP would provide
+fs::FS* contentFS = &fs::hostFS;
+SemaphoreHandle_t fsMutex = xSemaphoreCreateMutex();
+TFT_eSPI tft;
+
+static const uint16_t width = 640, height = 384;
+
+struct Line {
+    const char* font;
+    uint16_t size;
+    int16_t x, y;
+    const char* text;
+};
+
+static const char* const signika = "/fonts/Signika-SB.ttf";
+static const char* const icons = "/fonts/weathericons.ttf";
+
+static const Line lines[] = {
+    {signika, 40, 10, 10, "Saturday 18 October"},
+    {signika, 120, 10, 60, "14:35"},
+    {icons, 90, 420, 40, "\xef\x80\x8d"},
+    {signika, 60, 420, 150, "17.5\xc2\xb0"},
+    {signika, 24, 10, 200, "Feels like 16\xc2\xb0, wind 12 km/h NW"},
+    {signika, 24, 10, 230, "Humidity 68%, pressure 1014 hPa"},
+    {signika, 20, 10, 260, "Sunrise 07:52, sunset 18:41"},
+    {icons, 40, 10, 290, "\xef\x80\x82"},
+    {icons, 40, 130, 290, "\xef\x80\x86"},
+    {icons, 40, 250, 290, "\xef\x80\x99"},
+    {icons, 40, 370, 290, "\xef\x80\x8d"},
+    {icons, 40, 490, 290, "\xef\x80\x9b"},
+    {signika, 18, 10, 340, "Sun"},
+    {signika, 18, 130, 340, "Mon"},
+    {signika, 18, 250, 340, "Tue"},
+    {signika, 18, 370, 340, "Wed"},
+    {signika, 18, 490, 340, "Thu"},
+    {signika, 18, 60, 340, "18/9"},
+    {signika, 18, 180, 340, "16/8"},
+    {signika, 18, 300, 340, "14/6"},
+    {signika, 18, 420, 340, "15/7"},
+    {signika, 18, 540, 340, "17/9"},
+    {signika, 16, 10, 365, "Updated 14:30"},
+    {signika, 16, 300, 365, "Battery 2.9V"},
+    {signika, 16, 520, 365, "RSSI -64"},
+};
+
+static void drawLine(truetypeClass& truetype, uint8_t* framebuffer, const Line& line) {
+    truetype.setFramebuffer(width, height, 8, framebuffer);
+    truetype.setCharacterSize(line.size);
+    truetype.setCharacterSpacing(0);
+    truetype.setTextBoundary(line.x, width, height);
+    truetype.setTextColor(0x00, 0x00);
+    truetype.textDraw(line.x, line.y, line.text);
+}
+
+// as drawString did before, a new font from the file for every string
+static void renderBefore(uint8_t* framebuffer) {
+    memset(framebuffer, 0xFF, width * height);
+    for (const Line& line : lines) {
+        truetypeClass truetype = truetypeClass();
+        File fontFile = contentFS->open(line.font, "r");
+        if (!truetype.setTtfFile(fontFile)) continue;
+        drawLine(truetype, framebuffer, line);
+        truetype.end();
+    }
+}
+
+static void renderCached(uint8_t* framebuffer) {
+    memset(framebuffer, 0xFF, width * height);
+    for (const Line& line : lines) {
+        truetypeClass* truetype = fontcache::getTtf(line.font);
+        if (truetype) drawLine(*truetype, framebuffer, line);
+    }
+}
+
+static bool loadFont(const char* name) {
+    FILE* in = fopen((String(FONT_DIR "/") + name).c_str(), "rb");
+    if (in == nullptr) return false;
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(in);
+    File out = contentFS->open(String("/fonts/") + name, "w");
+    out.write(data.data(), data.size());
+    return true;
+}
+
+// ms per render, file opens and bytes read per render
+static double timed(void (*render)(uint8_t*), uint8_t* framebuffer, uint32_t renders, fs::HostFSStats& perRender) {
+    const fs::HostFSStats start = fs::hostFS.getStats();
+    const auto t = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < renders; i++) render(framebuffer);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count() / renders;
+    const fs::HostFSStats end = fs::hostFS.getStats();
+    perRender.opens = (end.opens - start.opens) / renders;
+    perRender.bytesRead = (end.bytesRead - start.bytesRead) / renders;
+    return ms;
+}
+
+int main(int argc, char** argv) {
+    const uint32_t renders = argc > 1 ? atoi(argv[1]) : 200;
+    if (!loadFont("Signika-SB.ttf") || !loadFont("weathericons.ttf")) {
+        printf("FAILED: fonts not found in " FONT_DIR "\n");
+        return 1;
+    }
+
+    bool ok = true;
+    std::vector<uint8_t> before(width * height), cached(width * height);
+    fs::HostFSStats stats;
+
+    renderBefore(before.data());
+    const double msBefore = timed(renderBefore, before.data(), renders, stats);
+    printf("before: %6.3f ms per render, %u file opens, %u bytes read\n", msBefore, stats.opens, stats.bytesRead);
+
+    renderCached(cached.data());
+    const double msCached = timed(renderCached, cached.data(), renders, stats);
+    const fontcache::Stats cache = fontcache::getStats();
+    printf("cached: %6.3f ms per render, %u file opens, %u bytes read, %u glyphs in %u bytes of %u per font\n", msCached, stats.opens, stats.bytesRead, cache.glyphs, cache.glyphBytes, FONTCACHE_GLYPH_BUDGET);
+    printf("%.1fx\n", msBefore / msCached);
+
+    if (cached != before) {
+        printf("FAIL: the cached fonts draw something else\n");
+        ok = false;
+    }
+    if (stats.opens != 0) {
+        printf("FAIL: %u file opens per render with the cache warm\n", stats.opens);
+        ok = false;
+    }
+
+    // a font written again has to be loaded again
+    const uint32_t misses = fontcache::getStats().misses;
+    loadFont("Signika-SB.ttf");
+    fontcache::fileChanged(signika);
+    renderCached(cached.data());
+    if (fontcache::getStats().misses == misses || cached != before) {
+        printf("FAIL: fonts not loaded again after fileChanged()\n");
+        ok = false;
+    }
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,345 @@
+// Round trip of the DATATYPE_IMG_DIFF deltas made by imagediff.cpp. No tag firmware decodes them
+// yet, so this is what holds the format to its description in oepl-definitions.h: every delta is
+// decoded here the way a tag would, xor'ed onto the image the tag shows, and must give the new
+// image bit for bit.
+//
+// The fixtures are labels drawn in buffer layout: a border, a dithered logo, lines of text, a
+// clock and a price, on a 4.2" black/white and a 2.9" black/white/red tag. Each update is sent
+// to a tag that takes zlib, one that takes G5 and one that takes neither, and the delta size is
+// reported against the full image in the same format.
+#include <Arduino.h>
+#include <FS.h>
+
+#include <random>
+#include <vector>
+
+#include "commstructs.h"
+#include "imagediff.h"
+#include "miniz-oepl.h"
+#include "storage.h"
+#include "tag_db.h"
+#include "../../src/g5/g5dec.inl"
+#include "../../src/g5/g5enc.inl"
+
+// what the rest of the AP would provide
+fs::FS* contentFS = &fs::hostFS;
+SemaphoreHandle_t fsMutex = xSemaphoreCreateMutex();
+
+void mac2hex(const uint8_t* mac, char* hexBuffer) {
+    sprintf(hexBuffer, "%02X%02X%02X%02X%02X%02X%02X%02X", mac[7], mac[6], mac[5], mac[4], mac[3], mac[2], mac[1], mac[0]);
+}
+
+static HwType currentType;
+HwType getHwType(const uint8_t) { return currentType; }
+
+// as in makeimage.cpp, which needs the display library
+uint8_t* g5Compress(uint16_t width, uint16_t height, uint8_t* buffer, uint16_t buffersize, uint16_t& outBufferSize) {
+    G5ENCIMAGE g5enc;
+    uint8_t* outbuffer = (uint8_t*)ps_malloc(buffersize + 16384);
+    if (outbuffer == NULL) return nullptr;
+    int rc = g5_encode_init(&g5enc, width, height, outbuffer, buffersize);
+    for (int y = 0; y < height && rc == G5_SUCCESS; y++) {
+        rc = g5_encode_encodeLine(&g5enc, buffer);
+        buffer += (width / 8);
+    }
+    if (rc != G5_ENCODE_COMPLETE) {
+        free(outbuffer);
+        return nullptr;
+    }
+    outBufferSize = g5_encode_getOutSize(&g5enc);
+    return outbuffer;
+}
+
+struct Image {
+    uint16_t bufw;
+    uint16_t bufh;
+    uint8_t count;
+    std::vector<uint8_t> planes;
+
+    Image(uint16_t w, uint16_t h, uint8_t c) : bufw(w), bufh(h), count(c), planes((size_t)w / 8 * h * c, 0) {}
+    size_t planeSize() const { return (size_t)bufw / 8 * bufh; }
+    void set(int x, int y, uint8_t plane, bool on = true) {
+        if (x < 0 || y < 0 || x >= bufw || y >= bufh) return;
+        uint8_t& b = planes[plane * planeSize() + (size_t)y * (bufw / 8) + x / 8];
+        const uint8_t bit = 0x80 >> (x % 8);
+        b = on ? (b | bit) : (b & ~bit);
+    }
+    void fill(int x, int y, int w, int h, uint8_t plane, bool on = true) {
+        for (int yy = y; yy < y + h; yy++) {
+            for (int xx = x; xx < x + w; xx++) set(xx, yy, plane, on);
+        }
+    }
+};
+
+// seven segment digits, '.' and ':' are narrow
+static int drawText(Image& img, int x, int y, const char* text, int size, uint8_t plane) {
+    static const uint8_t segments[10] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+    const int w = size, h = size * 2, t = std::max(2, size / 6);
+    for (const char* c = text; *c; c++) {
+        if (*c == '.' || *c == ':') {
+            if (*c == ':') img.fill(x, y + h / 3, t, t, plane);
+            img.fill(x, y + (*c == ':' ? 2 * h / 3 : h - t), t, t, plane);
+            x += 2 * t;
+            continue;
+        }
+        const uint8_t s = segments[*c - '0'];
+        if (s & 0x01) img.fill(x, y, w, t, plane);
+        if (s & 0x02) img.fill(x + w - t, y, t, h / 2, plane);
+        if (s & 0x04) img.fill(x + w - t, y + h / 2, t, h / 2, plane);
+        if (s & 0x08) img.fill(x, y + h - t, w, t, plane);
+        if (s & 0x10) img.fill(x, y + h / 2, t, h / 2, plane);
+        if (s & 0x20) img.fill(x, y, t, h / 2, plane);
+        if (s & 0x40) img.fill(x, y + h / 2 - t / 2, w, t, plane);
+        x += w + t * 2;
+    }
+    return x;
+}
+
+// lines of words of random length
+static void drawLines(Image& img, int x, int y, int w, int lines, int seed) {
+    std::mt19937 rng(seed);
+    for (int l = 0; l < lines; l++, y += 14) {
+        for (int xx = x; xx < x + w;) {
+            const int word = 12 + rng() % 40;
+            for (int c = 0; c < word && xx + c < x + w; c += 6) {
+                img.fill(xx + c, y + (rng() % 3), 4, 7 + rng() % 3, 0);
+            }
+            xx += word + 6;
+        }
+    }
+}
+
+struct Label {
+    const char* clock;
+    const char* price;
+    int seed;
+};
+
+static Image drawLabel(uint16_t bufw, uint16_t bufh, uint8_t count, const Label& label) {
+    Image img(bufw, bufh, count);
+    const uint8_t accent = count - 1;
+    img.fill(0, 0, bufw, 2, 0);
+    img.fill(0, bufh - 2, bufw, 2, 0);
+    img.fill(0, 0, 2, bufh, 0);
+    img.fill(bufw - 2, 0, 2, bufh, 0);
+    // dithered logo
+    std::mt19937 rng(label.seed);
+    for (int y = 6; y < 6 + bufh / 6; y++) {
+        for (int x = 6; x < 6 + bufw / 4; x++) img.set(x, y, 0, (rng() % 100) < (uint32_t)(20 + 60 * (x - 6) / (bufw / 4)));
+    }
+    drawText(img, bufw / 2, 8, label.clock, bufw / 40 + 4, 0);
+    drawLines(img, 8, bufh / 6 + 16, bufw - 16, bufh / 60 + 2, label.seed);
+    drawText(img, bufw / 6, bufh / 2, label.price, bufw / 12 + 4, accent);
+    drawLines(img, 8, bufh - bufh / 5, bufw - 16, 2, label.seed + 1);
+    return img;
+}
+
+enum Format { RAW, ZLIB, G5 };
+static const char* formatName[] = {"raw", "zlib", "g5"};
+
+// a full image file as makeimage.cpp writes it
+static std::vector<uint8_t> encodeFull(const Image& img, Format format, uint8_t& dataType) {
+    const uint8_t header[6] = {6, (uint8_t)(img.bufw & 0xFF), (uint8_t)(img.bufw >> 8), (uint8_t)(img.bufh & 0xFF), (uint8_t)(img.bufh >> 8), img.count};
+    std::vector<uint8_t> out;
+    if (format == RAW) {
+        dataType = img.count == 2 ? DATATYPE_IMG_RAW_2BPP : DATATYPE_IMG_RAW_1BPP;
+        return img.planes;
+    }
+    if (format == ZLIB) {
+        dataType = DATATYPE_IMG_ZLIB;
+        std::vector<uint8_t> in(header, header + sizeof(header));
+        in.insert(in.end(), img.planes.begin(), img.planes.end());
+        Miniz::tdefl_compressor* comp = (Miniz::tdefl_compressor*)malloc(sizeof(Miniz::tdefl_compressor));
+        Miniz::tdefl_initOEPL(comp, NULL, NULL, Miniz::TDEFL_WRITE_ZLIB_HEADER | 1500);
+        out.resize(4 + in.size() + in.size() / 8 + 64);
+        size_t inLen = in.size(), outLen = out.size() - 4;
+        Miniz::tdefl_compressOEPL(comp, in.data(), &inLen, out.data() + 4, &outLen, Miniz::TDEFL_FINISH);
+        free(comp);
+        out.resize(4 + outLen);
+        const uint32_t total = in.size();
+        memcpy(out.data(), &total, sizeof(total));
+        out[4] = 0x48;
+        out[5] = 0xC7;
+        return out;
+    }
+    dataType = DATATYPE_IMG_G5;
+    uint16_t g5Size = 0;
+    std::vector<uint8_t> planes(img.planes);
+    planes.push_back(0);
+    uint8_t* g5 = g5Compress(img.bufw, img.bufh * img.count, planes.data(), img.planes.size(), g5Size);
+    out.assign(header, header + sizeof(header));
+    out.insert(out.end(), g5, g5 + g5Size);
+    free(g5);
+    return out;
+}
+
+// what a tag does with a DATATYPE_IMG_DIFF file: unpack the rectangle and xor it onto its image
+static bool applyDelta(const std::vector<uint8_t>& delta, uint64_t expectedBase, Image& img) {
+    if (delta.size() < 19 || delta[0] < 19) return false;
+    uint64_t baseVer;
+    uint16_t x, y, w, h;
+    memcpy(&baseVer, &delta[1], 8);
+    memcpy(&x, &delta[9], 2);
+    memcpy(&y, &delta[11], 2);
+    memcpy(&w, &delta[13], 2);
+    memcpy(&h, &delta[15], 2);
+    const uint8_t count = delta[17], type = delta[18];
+    const uint8_t* payload = delta.data() + delta[0];
+    const size_t payloadLen = delta.size() - delta[0];
+    if (baseVer != expectedBase || count != img.count || x % 8 || w % 8 || x + w > img.bufw || y + h > img.bufh) return false;
+
+    const size_t rectSize = (size_t)w / 8 * h * count;
+    std::vector<uint8_t> rect(rectSize + 1);
+    if (type == DATATYPE_IMG_RAW_1BPP || type == DATATYPE_IMG_RAW_2BPP) {
+        if (payloadLen != rectSize) return false;
+        memcpy(rect.data(), payload, rectSize);
+    } else if (type == DATATYPE_IMG_ZLIB) {
+        uint32_t total;
+        memcpy(&total, payload, 4);
+        if (total != rectSize + 6) return false;
+        std::vector<uint8_t> out(total);
+        Miniz::tinfl_decompressor* decomp = (Miniz::tinfl_decompressor*)malloc(sizeof(Miniz::tinfl_decompressor));
+        tinfl_init(decomp);
+        size_t inBytes = payloadLen - 6, outBytes = total;
+        const Miniz::tinfl_status status = Miniz::tinfl_decompress(decomp, payload + 6, &inBytes, out.data(), out.data(), &outBytes, Miniz::TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+        free(decomp);
+        if (status != Miniz::TINFL_STATUS_DONE || outBytes != total || out[0] != 6) return false;
+        if ((out[1] | out[2] << 8) != w || (out[3] | out[4] << 8) != h || (out[5] & 0x0F) != count) return false;
+        memcpy(rect.data(), out.data() + 6, rectSize);
+    } else if (type == DATATYPE_IMG_G5) {
+        if (payloadLen <= 6 || (payload[1] | payload[2] << 8) != w || (payload[3] | payload[4] << 8) != h) return false;
+        std::vector<uint8_t> g5data(payload + 6, payload + payloadLen);
+        g5data.resize(g5data.size() + 4, 0);
+        G5DECIMAGE g5dec;
+        int rc = g5_decode_init(&g5dec, w, h * count, g5data.data(), payloadLen - 6);
+        for (size_t line = 0; line < (size_t)h * count && rc == G5_SUCCESS; line++) rc = g5_decode_line(&g5dec, rect.data() + line * (w / 8));
+        if (rc != G5_DECODE_COMPLETE) return false;
+    } else {
+        return false;
+    }
+
+    for (uint8_t p = 0; p < count; p++) {
+        for (uint16_t r = 0; r < h; r++) {
+            for (uint16_t bx = 0; bx < w / 8; bx++) {
+                img.planes[p * img.planeSize() + (size_t)(y + r) * (img.bufw / 8) + x / 8 + bx] ^= rect[((size_t)p * h + r) * (w / 8) + bx];
+            }
+        }
+    }
+    return true;
+}
+
+static void writeFile(const String& path, const std::vector<uint8_t>& data) {
+    File file = contentFS->open(path, "w");
+    file.write(data.data(), data.size());
+}
+
+static std::vector<uint8_t> readFile(const String& path) {
+    File file = contentFS->open(path, "r");
+    std::vector<uint8_t> data(file.size());
+    file.read(data.data(), data.size());
+    return data;
+}
+
+struct Display {
+    const char* name;
+    uint16_t width;
+    uint16_t height;
+    uint8_t rotatebuffer;
+    uint8_t count;
+};
+
+struct Update {
+    const char* name;
+    Label label;
+    bool small;  // must go out as a delta
+};
+
+static int failures = 0;
+static uint32_t version = 0;
+
+static void runCase(const Display& display, Format format, const Label& from, const Update& update) {
+    currentType = HwType();
+    currentType.width = display.width;
+    currentType.height = display.height;
+    currentType.rotatebuffer = display.rotatebuffer;
+    currentType.bpp = display.count;
+    currentType.diff = 1;
+    currentType.zlib = format == ZLIB ? 1 : 0;
+    currentType.g5 = format == G5 ? 1 : 0;
+
+    tagRecord tag;
+    tag.mac[0] = 0x42;
+    tag.tagSoftwareVersion = 1;
+    char hexmac[17];
+    mac2hex(tag.mac, hexmac);
+    const String prefix = "/current/" + String(hexmac) + "_";
+    const uint16_t bufw = display.rotatebuffer % 2 ? display.height : display.width;
+    const uint16_t bufh = display.rotatebuffer % 2 ? display.width : display.height;
+
+    // the image the tag shows
+    Image base = drawLabel(bufw, bufh, display.count, from);
+    uint8_t dataType;
+    const uint64_t baseVer = ++version;
+    writeFile(prefix + "1.pending", encodeFull(base, format, dataType));
+    uint32_t deltaSize = 0;
+    imagediff::prepare(&tag, prefix + "1.pending", dataType, baseVer, deltaSize);
+    imagediff::xferComplete(tag.mac, prefix + "1.pending");
+    memcpy(tag.md5, &baseVer, sizeof(baseVer));
+
+    // and the update
+    const Image next = drawLabel(bufw, bufh, display.count, update.label);
+    const std::vector<uint8_t> full = encodeFull(next, format, dataType);
+    writeFile(prefix + "2.pending", full);
+    const String deltaFile = imagediff::prepare(&tag, prefix + "2.pending", dataType, ++version, deltaSize);
+
+    if (deltaFile.isEmpty()) {
+        printf("  %-6s %-5s %-13s full %6zu bytes, sent in full\n", display.name, formatName[format], update.name, full.size());
+        if (update.small) {
+            printf("FAIL: %s %s %s wasn't sent as a delta\n", display.name, formatName[format], update.name);
+            failures++;
+        }
+    } else {
+        const std::vector<uint8_t> delta = readFile(deltaFile);
+        const bool applied = applyDelta(delta, baseVer, base);
+        printf("  %-6s %-5s %-13s full %6zu bytes, delta %6zu bytes, %5.1f%%\n", display.name, formatName[format], update.name,
+               full.size(), delta.size(), 100.0 * delta.size() / full.size());
+        if (!applied || base.planes != next.planes) {
+            printf("FAIL: %s %s %s delta doesn't give the new image\n", display.name, formatName[format], update.name);
+            failures++;
+        }
+        if (delta.size() != deltaSize) {
+            printf("FAIL: %s %s %s delta is %zu bytes, prepare said %u\n", display.name, formatName[format], update.name, delta.size(), deltaSize);
+            failures++;
+        }
+    }
+    imagediff::xferComplete(tag.mac, deltaFile.isEmpty() ? prefix + "2.pending" : deltaFile);
+    contentFS->remove(prefix + "1.pending");
+    contentFS->remove(prefix + "2.pending");
+    contentFS->remove("/current/" + String(hexmac) + ".base");
+}
+
+int main() {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    const Display displays[] = {
+        {"4.2\"", 400, 300, 0, 1},
+        {"2.9\"", 296, 128, 1, 2},
+    };
+    const Label from = {"12:34", "4.99", 1};
+    const Update updates[] = {
+        {"clock", {"12:35", "4.99", 1}, true},
+        {"price", {"12:34", "3.49", 1}, true},
+        {"clock+price", {"12:35", "3.49", 1}, true},
+        {"new content", {"08:10", "17.25", 7}, false},
+    };
+
+    for (const Display& display : displays) {
+        for (const Format format : {ZLIB, G5, RAW}) {
+            for (const Update& update : updates) runCase(display, format, from, update);
+        }
+    }
+    const imagediff::Stats stats = imagediff::getStats();
+    printf("%u deltas, %.1f%% of the full images they replaced\n", stats.deltas,
+           stats.fullBytes ? 100.0 * stats.deltaBytes / stats.fullBytes : 0.0);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+// Stress test for the pending queue in newproto.cpp: producer threads queue new images with
+// prepareDataAvail while radio threads answer block requests and transfer completes for the same
+// tags. Every block sent must hold the content of the version that was asked for, the queue
+// bookkeeping must add up afterwards and no buffer may stay referenced once the queues are empty.
+//
+// A probe thread measures how long a queue lookup waits for queueMutex, the file system is slowed
+// down to flash speed so file work done under the lock shows up there.
+//
+//   newproto_stress [tags] [images per producer] [fs delay us]
+#include <Arduino.h>
+#include <FS.h>
+#include <MD5Builder.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bufferpool.h"
+#include "imagediff.h"
+#include "newproto.h"
+#include "serialap.h"
+#include "storage.h"
+#include "system.h"
+#include "tag_db.h"
+#include "udp.h"
+#include "web.h"
+
+static const int PRODUCERS = 2;
+static const int RADIOS = 3;
+
+extern uint32_t pendingQueueSize;
+
+// what the rest of the AP would provide
+Config config;
+std::vector<tagRecord*> tagDB;
+std::recursive_mutex tagDBMutex;
+fs::FS* contentFS = &fs::hostFS;
+SemaphoreHandle_t fsMutex = xSemaphoreCreateMutex();
+UDPcomm udpsync;
+
+struct espSetChannelPower curChannel;
+struct APInfoS apInfo;
+
+UDPcomm::UDPcomm() {}
+UDPcomm::~UDPcomm() {}
+void UDPcomm::getAPList() {}
+void UDPcomm::netProcessDataReq(struct espAvailDataReq*) {}
+void UDPcomm::netSendDataAvail(struct pendingData*) {}
+void UDPcomm::netProcessXferComplete(struct espXferComplete*) {}
+void UDPcomm::netProcessXferTimeout(struct espXferComplete*) {}
+
+tagRecord* tagRecord::findByMAC(const uint8_t mac[8]) {
+    // the tag list doesn't change during the test
+    for (tagRecord* tag : tagDB) {
+        if (memcmp(tag->mac, mac, 8) == 0) return tag;
+    }
+    return nullptr;
+}
+
+void clearPending(tagRecord* taginfo) {
+    // unlike the real one this leaves the filename alone: the producer of a tag is the only one
+    // writing it here, a radio thread clearing it at the same time would race on the String
+    bufferpool::release(taginfo->data);
+    taginfo->data = nullptr;
+}
+
+tagRecord* addRecord(const uint8_t mac[8]) { return nullptr; }
+bool deleteRecord(const uint8_t mac[8], bool allVersions) { return false; }
+void popTagInfo(const uint8_t*) {}
+bool hex2mac(const String&, uint8_t*) { return false; }
+void mac2hex(const uint8_t* mac, char* hexBuffer) {
+    sprintf(hexBuffer, "%02X%02X%02X%02X%02X%02X%02X%02X", mac[7], mac[6], mac[5], mac[4], mac[3], mac[2], mac[1], mac[0]);
+}
+void wsLog(const String&) {}
+void wsErr(const String&) {}
+void wsSendTaginfo(const uint8_t*, uint8_t) {}
+uint8_t wsClientCount() { return 0; }
+void logLine(const String&) {}
+void logLine(const char*) {}
+
+namespace TagData {
+void parse(const uint8_t src[8], const size_t id, const uint8_t* data, const uint8_t len) {}
+}  // namespace TagData
+
+namespace imagediff {
+String prepare(const tagRecord*, const String&, uint8_t, uint64_t, uint32_t&) { return String(); }
+String xferComplete(const uint8_t*, const String& filename) { return filename; }
+}  // namespace imagediff
+
+static std::atomic<uint32_t> dataAvails{0};
+static std::atomic<uint32_t> cancels{0};
+static std::atomic<uint32_t> blocks{0};
+static std::atomic<uint32_t> badBlocks{0};
+
+bool sendDataAvail(struct pendingData*) {
+    dataAvails++;
+    return true;
+}
+bool sendChannelPower(struct espSetChannelPower*) { return true; }
+bool sendCancelPending(struct pendingData*) {
+    cancels++;
+    return true;
+}
+void prefetchBlocks(const uint8_t*, const uint32_t, const uint64_t, const uint8_t) {}
+
+// every image is one 64 bit word repeated, the radio thread sets the word it expects before asking for a block
+static thread_local uint64_t expectedWord;
+
+uint16_t sendBlock(const void* data, const uint16_t len, const uint64_t, const uint8_t) {
+    blocks++;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (uint16_t i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        if (word != expectedWord) {
+            badBlocks++;
+            break;
+        }
+    }
+    return 0;
+}
+
+static std::mutex wordsMutex;
+static std::map<uint64_t, uint64_t> wordOfVersion;
+
+static std::atomic<bool> producing{true};
+
+static void producer(const int index, const uint32_t images) {
+    std::mt19937 rng(index);
+    std::vector<tagRecord*> mine;
+    for (size_t i = index; i < tagDB.size(); i += PRODUCERS) mine.push_back(tagDB[i]);
+    std::vector<uint32_t> lastUpload(mine.size(), 0);
+
+    for (uint32_t n = 0; n < images; n++) {
+        const size_t t = n % mine.size();
+        // the pending file name has millisecond resolution
+        while (millis() - lastUpload[t] < 2) std::this_thread::sleep_for(std::chrono::microseconds(200));
+        lastUpload[t] = millis();
+
+        const uint64_t word = ((uint64_t)index << 48) | ((uint64_t)n << 16) | 0xA5A5;
+        std::vector<uint8_t> content((1 + rng() % 8) * BLOCK_DATA_SIZE / sizeof(uint64_t) * sizeof(uint64_t));
+        for (size_t i = 0; i < content.size(); i += sizeof(word)) memcpy(&content[i], &word, sizeof(word));
+
+        uint8_t md5bytes[16];
+        MD5Builder md5;
+        md5.begin();
+        md5.add(content.data(), content.size());
+        md5.getBytes(md5bytes);
+        uint64_t dataVer;
+        memcpy(&dataVer, md5bytes, sizeof(dataVer));
+        {
+            std::lock_guard<std::mutex> lock(wordsMutex);
+            wordOfVersion[dataVer] = word;
+        }
+
+        String filename = "/upload_" + String(index) + "_" + String(n) + ".raw";
+        File file = contentFS->open(filename, "w");
+        file.write(content.data(), content.size());
+        file.close();
+        // now and then a preload, those stay queued next to the image
+        const uint8_t dataTypeArgument = (rng() % 4 == 0) ? 0x10 : 0x00;
+        prepareDataAvail(filename, DATATYPE_IMG_RAW_1BPP, dataTypeArgument, mine[t]->mac, 0);
+    }
+}
+
+static void radio(const int index) {
+    std::mt19937 rng(100 + index);
+    while (producing) {
+        tagRecord* tag = tagDB[rng() % tagDB.size()];
+        uint64_t ver = 0;
+        uint32_t len = 0;
+        {
+            std::lock_guard<std::recursive_mutex> lock(queueMutex);
+            PendingItem* item = getQueueItem(tag->mac);
+            if (item != nullptr) {
+                ver = item->pendingdata.availdatainfo.dataVer;
+                len = item->pendingdata.availdatainfo.dataSize;
+            }
+        }
+        if (ver == 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wordsMutex);
+            expectedWord = wordOfVersion[ver];
+        }
+        if (rng() % 4) {
+            struct espBlockRequest br = {0};
+            memcpy(br.src, tag->mac, 8);
+            br.ver = ver;
+            br.blockId = rng() % ((len + BLOCK_DATA_SIZE - 1) / BLOCK_DATA_SIZE);
+            addCRC(&br, sizeof(br));
+            processBlockRequest(&br);
+        } else {
+            struct espXferComplete xfc = {0};
+            memcpy(xfc.src, tag->mac, 8);
+            processXferComplete(&xfc, true);
+        }
+    }
+}
+
+struct ProbeResult {
+    uint32_t samples;
+    uint64_t totalUs;
+    uint64_t maxUs;
+};
+
+static ProbeResult probe() {
+    ProbeResult result = {0, 0, 0};
+    while (producing) {
+        const auto start = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::recursive_mutex> lock(queueMutex);
+        }
+        const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        result.samples++;
+        result.totalUs += us;
+        result.maxUs = std::max(result.maxUs, us);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    const uint32_t tags = argc > 1 ? atoi(argv[1]) : 32;
+    const uint32_t images = argc > 2 ? atoi(argv[2]) : 500;
+    const uint32_t fsDelayUs = argc > 3 ? atoi(argv[3]) : 200;
+
+    config.runStatus = RUNSTATUS_RUN;
+    config.maxsleep = 10;
+    config.preview = 1;
+    contentFS->setOpDelayUs(fsDelayUs);
+    for (uint32_t i = 0; i < tags; i++) {
+        tagRecord* tag = new tagRecord;
+        tag->mac[0] = i;
+        tag->mac[1] = i >> 8;
+        tag->mac[7] = 0x42;
+        tagDB.push_back(tag);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (int i = 0; i < PRODUCERS; i++) producers.emplace_back(producer, i, images);
+    std::vector<std::thread> radios;
+    for (int i = 0; i < RADIOS; i++) radios.emplace_back(radio, i);
+    ProbeResult waits;
+    std::thread prober([&waits] { waits = probe(); });
+
+    for (auto& thread : producers) thread.join();
+    producing = false;
+    for (auto& thread : radios) thread.join();
+    prober.join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int failures = 0;
+    uint32_t queued = 0;
+    for (tagRecord* tag : tagDB) queued += countQueueItem(tag->mac);
+    if (queued != pendingQueueSize) {
+        printf("FAIL: %u items in the tag queues, pendingQueueSize says %u\n", queued, pendingQueueSize);
+        failures++;
+    }
+    if (badBlocks) {
+        printf("FAIL: %u blocks didn't hold the requested version\n", badBlocks.load());
+        failures++;
+    }
+
+    for (tagRecord* tag : tagDB) {
+        while (dequeueItem(tag->mac)) {
+        };
+        clearPending(tag);
+    }
+    const bufferpool::Stats pool = bufferpool::getStats();
+    if (pendingQueueSize != 0 || pool.bytes != pool.cachedBytes) {
+        printf("FAIL: after emptying the queues %u items remain, %u of %u buffered bytes still referenced\n",
+               pendingQueueSize, pool.bytes - pool.cachedBytes, pool.bytes);
+        failures++;
+    }
+
+    printf("%u tags, %d producers x %u images, %d radio threads, fs delay %u us: %.1f s\n",
+           tags, PRODUCERS, images, RADIOS, fsDelayUs, seconds);
+    printf("  %u data avails, %u blocks sent, %u cancels, %u items left queued\n",
+           dataAvails.load(), blocks.load(), cancels.load(), queued);
+    printf("  queueMutex wait: avg %.1f us, max %lu us over %u probes\n",
+           waits.samples ? (double)waits.totalUs / waits.samples : 0.0, (unsigned long)waits.maxUs, waits.samples);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
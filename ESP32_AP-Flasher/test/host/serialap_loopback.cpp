@@ -0,0 +1,264 @@
+// The serial link between serialap.cpp and the C6/H2 AP over a pty pair, both sides running their
+// real code: serialap.cpp here, main.c of the C6 AP in pty_ap, a child process. Both sides pace
+// their writes at the baud rate. bringAPOnline negotiates the framed protocol; the ESP32 then drops
+// back to text the way it does after a reboot, and the text runs come first.
+//
+// Reported for text and framed:
+//  - SDA throughput in commands per second, until the AP has answered the last one
+//  - ping round trips
+//  - block push latency, until the AP confirms the block is in its cache
+// Then SDAs in frames with a share of the writes in both directions damaged.
+//
+// Every other mac gets a second SDA with no attempts left, which clears its entry. When the AP
+// runs the commands in order, exactly half the macs are pending once the pty closes, and the AP's
+// count is checked against that. The AP holds CONFIG_OEPL_PENDING_SLOTS entries, 3.5 per mac.
+//
+//   serialap_loopback <pty_ap> [macs] [damage rate]
+#include <Arduino.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <random>
+#include <vector>
+
+#include "commstructs.h"
+#include "contentmanager.h"
+#include "leds.h"
+#include "newproto.h"
+#include "powermgt.h"
+#include "serialap.h"
+#include "settings.h"
+#include "web.h"
+#include "wifimanager.h"
+
+// what the rest of the AP would provide. No tag checks in, so none of the requests ever come
+WifiManager::WifiManager() {}
+IPAddress WifiManager::localIP() { return IPAddress(); }
+WifiManager wm;
+
+void addCRC(void* p, uint8_t len) {
+    uint8_t total = 0;
+    for (uint8_t c = 1; c < len; c++) total += ((uint8_t*)p)[c];
+    ((uint8_t*)p)[0] = total;
+}
+void processBlockRequest(struct espBlockRequest*) {}
+void processDataReq(struct espAvailDataReq*, bool, IPAddress) {}
+void processXferComplete(struct espXferComplete*, bool) {}
+void processXferTimeout(struct espXferComplete*, bool) {}
+void processTagReturnData(struct espTagReturnData*, uint8_t, bool) {}
+void refreshAllPending() {}
+void powerControl(bool, uint8_t*, uint8_t) {}
+void quickBlink(uint8_t) {}
+void wsSendSysteminfo() {}
+bool sendAPSegmentedData(const uint8_t*, String, uint16_t, bool, bool) { return false; }
+bool showAPSegmentedInfo(const uint8_t*, bool) { return false; }
+void updateContent(const uint8_t*) {}
+
+// serialap.cpp, besides what serialap.h declares
+extern volatile bool framedSerial;
+void rxCmdProcessor(void* parameter);
+bool sendGetInfo();
+bool sendFraming();
+void frameReset();
+bool sendBlockPush(const uint64_t ver, const uint8_t blockId, const void* data, const uint16_t len);
+
+struct APProcess {
+    pid_t pid = -1;
+    int master = -1;
+    int slave = -1;
+    FILE* report = nullptr;
+};
+
+static APProcess startAP(const char* path, const double damage) {
+    APProcess ap;
+    char name[64];
+    int out[2];
+    if (openpty(&ap.master, &ap.slave, name, nullptr, nullptr) < 0 || pipe(out) < 0) {
+        perror("pty");
+        exit(2);
+    }
+    termios tio;
+    tcgetattr(ap.slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(ap.slave, TCSANOW, &tio);
+    const String rate(damage, 3);
+    ap.pid = fork();
+    if (ap.pid == 0) {
+        dup2(out[1], STDOUT_FILENO);
+        close(out[0]);
+        close(ap.master);
+        execl(path, path, name, rate.c_str(), (char*)nullptr);
+        perror(path);
+        _exit(2);
+    }
+    close(out[1]);
+    ap.report = fdopen(out[0], "r");
+    Serial1.damage = 0;
+    Serial1.attach(ap.master);
+    return ap;
+}
+
+// closes the link, the AP reports its pending entries and exits
+static int stopAP(APProcess& ap) {
+    Serial1.attach(-1);
+    close(ap.master);
+    close(ap.slave);
+    unsigned pending = 0, noUpdate = 0, overflow = 0;
+    const bool reported = fscanf(ap.report, "pending %u noupdate %u overflow %u", &pending, &noUpdate, &overflow) == 3;
+    fclose(ap.report);
+    waitpid(ap.pid, nullptr, 0);
+    if (!reported) return -1;
+    if (overflow) printf("AP rx buffer overflowed %u times\n", overflow);
+    return pending;
+}
+
+static struct pendingData pendingFor(const uint32_t mac, const uint16_t attemptsLeft) {
+    struct pendingData pending = {};
+    pending.availdatainfo.dataType = DATATYPE_IMG_RAW_1BPP;
+    pending.availdatainfo.dataVer = 0x5EED000000000000ULL | mac;
+    pending.availdatainfo.dataSize = 4736;
+    pending.availdatainfo.nextCheckIn = 1;
+    pending.attemptsLeft = attemptsLeft;
+    memcpy(pending.targetMac, &mac, 4);
+    pending.targetMac[6] = 0x11;
+    pending.targetMac[7] = 0x22;
+    return pending;
+}
+
+struct Run {
+    double commandsPerSecond = 0;
+    double pingMs = 0;
+    double pushMedianMs = 0;
+    double pushMaxMs = 0;
+    uint32_t refused = 0;  // commands that weren't sent or answered
+};
+
+static double msSince(const unsigned long startUs) {
+    return (micros() - startUs) / 1000.0;
+}
+
+// SDAs for macs first to first + count, the odd ones cleared again right after
+static void sendPending(const uint32_t first, const uint32_t count, Run& run) {
+    const unsigned long start = micros();
+    uint32_t commands = 0;
+    for (uint32_t mac = first; mac < first + count; mac++) {
+        struct pendingData pending = pendingFor(mac, 200);
+        run.refused += !sendDataAvail(&pending);
+        commands++;
+        if (mac % 2) {
+            pending = pendingFor(mac, 0);
+            run.refused += !sendDataAvail(&pending);
+            commands++;
+        }
+    }
+    // the AP answers in order, the ping is answered after the last SDA
+    run.refused += !sendPing();
+    run.commandsPerSecond = commands * 1000.0 / msSince(start);
+}
+
+static void measure(const uint32_t first, const uint32_t count, Run& run) {
+    sendPending(first, count, run);
+
+    const int pings = 50;
+    const unsigned long start = micros();
+    for (int c = 0; c < pings; c++) run.refused += !sendPing();
+    run.pingMs = msSince(start) / pings;
+
+    std::mt19937 rng(first);
+    std::vector<uint8_t> block(BLOCK_DATA_SIZE);
+    std::vector<double> latencies;
+    for (int c = 0; c < 40; c++) {
+        for (uint8_t& b : block) b = rng();
+        const unsigned long pushStart = micros();
+        run.refused += !sendBlockPush(0xB10C000000000000ULL | first, c, block.data(), block.size());
+        run.refused += !sendPing();
+        latencies.push_back(msSince(pushStart));
+    }
+    std::sort(latencies.begin(), latencies.end());
+    run.pushMedianMs = latencies[latencies.size() / 2];
+    run.pushMaxMs = latencies.back();
+}
+
+static void report(const char* name, const Run& run) {
+    printf("%-7s %7.0f SDA/s, ping %5.2fms, block push median %5.1fms max %5.1fms\n", name, run.commandsPerSecond, run.pingMs, run.pushMedianMs,
+           run.pushMaxMs);
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    if (argc < 2) {
+        fprintf(stderr, "usage: serialap_loopback <pty_ap> [macs] [damage rate]\n");
+        return 2;
+    }
+    const char* apPath = argv[1];
+    const uint32_t macs = (argc > 2) ? atoi(argv[2]) & ~1 : 400;
+    const double damage = (argc > 3) ? atof(argv[3]) : 0.02;
+    signal(SIGPIPE, SIG_IGN);
+    bool ok = true;
+
+    xTaskCreate(rxCmdProcessor, "rxCmdProcessor", 6000, NULL, 15, NULL);
+    delay(100);
+
+    APProcess ap = startAP(apPath, 0);
+    if (!bringAPOnline() || !framedSerial || apInfo.blockCache == 0) {
+        printf("FAIL: the AP didn't come online with the framed protocol\n");
+        stopAP(ap);
+        return 1;
+    }
+    printf("AP type %02X, %d block cache entries, framed protocol %d, %u macs per run\n", apInfo.type, apInfo.blockCache, apInfo.framing, macs);
+
+    // NFO? drops the AP back to text, as when the ESP32 starts over
+    framedSerial = false;
+    frameReset();
+    Run text;
+    if (!sendGetInfo()) {
+        printf("FAIL: the AP didn't fall back to text\n");
+        ok = false;
+    }
+    measure(0, macs, text);
+    report("text", text);
+
+    Run framed;
+    if (!sendFraming()) {
+        printf("FAIL: the AP didn't switch to frames again\n");
+        ok = false;
+    }
+    measure(macs, macs, framed);
+    report("framed", framed);
+
+    // then with a share of the writes damaged on both sides, for macs of their own
+    const SerialAPStats before = getSerialAPStats();
+    Serial1.damage = damage;
+    kill(ap.pid, SIGUSR1);
+    Run damaged;
+    const uint32_t damagedMacs = macs * 5;
+    sendPending(2 * macs, damagedMacs, damaged);
+    Serial1.damage = 0;
+    const SerialAPStats after = getSerialAPStats();
+    printf("damaged %6.0f SDA/s, %.0f%% of the writes damaged: %u retransmits, %u naks, %u crc errors, %u failed, in flight peak %d\n",
+           damaged.commandsPerSecond, damage * 100, after.retransmits - before.retransmits, after.naks - before.naks, after.crcErrors - before.crcErrors,
+           after.failed - before.failed, after.inFlightPeak);
+
+    const int pending = stopAP(ap);
+    const int expected = macs + damagedMacs / 2;
+    printf("%d entries pending on the AP, expected %d\n", pending, expected);
+    if (pending != expected || after.failed != before.failed) {
+        printf("FAIL: commands got lost or ran out of order\n");
+        ok = false;
+    }
+    if (text.refused || framed.refused) {
+        printf("FAIL: %u text and %u framed commands failed\n", text.refused, framed.refused);
+        ok = false;
+    }
+    if (framed.commandsPerSecond < 2 * text.commandsPerSecond) {
+        printf("FAIL: the framed protocol isn't faster\n");
+        ok = false;
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,411 @@
+// Benchmark of spr2color in makeimage.cpp, the conversion of a rendered sprite to the planes sent to a
+// tag, against the per-pixel version it replaced, which is kept below. Sample images are a gradient,
+// a photo-like image with noise, black text and blocks of color, drawn in 16, 8 and 1 bit sprites.
+// Reported is the time per conversion of the photo in a 16 bit sprite, per palette and dither mode.
+//
+// Checked against the old conversion for every image, palette, rotation and plane: the same bits for
+// dither 0 and 2, and for dither 1, the error diffusion now done in integers, averages over 8x8 blocks
+// within 3 of 255 of each other. A single pixel that comes out different changes the pixels after it.
+//
+//   spr2color_bench [width height]
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include "makeimage.h"
+#include "storage.h"
+#include "tag_db.h"
+
+// what the rest of the AP would provide
+fs::FS* contentFS = &fs::hostFS;
+SemaphoreHandle_t fsMutex = xSemaphoreCreateMutex();
+Config config;
+
+void wsErr(const String&) {}
+namespace util {
+void printLargestFreeBlock() {}
+}  // namespace util
+
+void spr2color(TFT_eSprite& spr, imgParam& imageParams, uint8_t* buffer, size_t buffer_size, bool is_red);
+
+// spr2color as it was, one readPixel and one palette search per pixel
+namespace before {
+
+struct Error {
+    int32_t r;
+    int32_t g;
+    int32_t b;
+};
+
+uint32_t colorDistance(const Color& c1, const Color& c2, const Error& e1) {
+    int32_t r_diff = c1.r + e1.r - c2.r;
+    int32_t g_diff = c1.g + e1.g - c2.g;
+    int32_t b_diff = c1.b + e1.b - c2.b;
+    if (abs(c1.r - c1.g) < 20 && abs(c1.b - c1.g) < 20) {
+        if (abs(c2.r - c2.g) > 20 || abs(c2.b - c2.g) > 20) return 4294967295;  // don't select color pixels on black and white
+    }
+    return 3 * r_diff * r_diff + 5.47 * g_diff * g_diff + 1.53 * b_diff * b_diff;
+}
+
+std::tuple<int, int, float, float> findClosestColors(const Color& pixel, const std::vector<Color>& palette) {
+    int closestIndex = -1, secondClosestIndex = -1;
+    float closestDist = std::numeric_limits<float>::max();
+    float secondClosestDist = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < palette.size(); ++i) {
+        float dist = colorDistance(pixel, palette[i], (Error){0, 0, 0});
+        if (dist < closestDist) {
+            secondClosestIndex = closestIndex;
+            secondClosestDist = closestDist;
+            closestIndex = i;
+            closestDist = dist;
+        } else if (dist < secondClosestDist) {
+            secondClosestIndex = i;
+            secondClosestDist = dist;
+        }
+    }
+    if (closestIndex != -1 && secondClosestIndex != -1) {
+        auto rgbValue = [](const Color& color) {
+            return (color.r << 16) | (color.g << 8) | color.b;
+        };
+
+        if (rgbValue(palette[secondClosestIndex]) > rgbValue(palette[closestIndex])) {
+            std::swap(closestIndex, secondClosestIndex);
+            std::swap(closestDist, secondClosestDist);
+        }
+    }
+    return {closestIndex, secondClosestIndex, closestDist, secondClosestDist};
+}
+
+void spr2color(TFT_eSprite& spr, imgParam& imageParams, uint8_t* buffer, size_t buffer_size, bool is_red) {
+    uint8_t rotate = imageParams.rotate;
+    long bufw = spr.width(), bufh = spr.height();
+
+    if (imageParams.rotatebuffer % 2) {
+        // turn the image 90 or 270
+        rotate = (rotate + 3) % 4;
+        rotate = (rotate + (imageParams.rotatebuffer - 1)) % 4;
+        bufw = spr.height();
+        bufh = spr.width();
+    } else {
+        // rotate 180
+        rotate = (rotate + (imageParams.rotatebuffer)) % 4;
+    }
+
+    memset(buffer, 0, buffer_size);
+
+    std::vector<Color> palette = imageParams.hwdata.colortable;
+    if (imageParams.invert == 1) {
+        std::swap(palette[0], palette[1]);
+    }
+    Color color;
+    int num_colors = palette.size();
+    if (imageParams.bufferbpp == 1) num_colors = 2;
+    Error* error_bufferold = new Error[bufw + 4];
+    Error* error_buffernew = new Error[bufw + 4];
+
+    size_t bitOffset = 0;
+
+    memset(error_bufferold, 0, bufw * sizeof(Error));
+    for (uint16_t y = 0; y < bufh; y++) {
+        memset(error_buffernew, 0, bufw * sizeof(Error));
+        for (uint16_t x = 0; x < bufw; x++) {
+            switch (rotate) {
+                case 0:
+                    color = Color(spr.readPixel(x, y));
+                    break;
+                case 1:
+                    color = Color(spr.readPixel(y, bufw - 1 - x));
+                    break;
+                case 2:
+                    color = Color(spr.readPixel(bufw - 1 - x, bufh - 1 - y));
+                    break;
+                case 3:
+                    color = Color(spr.readPixel(bufh - 1 - y, x));
+                    break;
+            }
+
+            int best_color_index = 0;
+            if (imageParams.dither == 2) {
+                // special ordered dithering
+                auto [c1Index, c2Index, distC1, distC2] = findClosestColors(color, palette);
+                float weight = distC1 / (distC1 + distC2);
+                if (weight <= 0.03) {
+                    best_color_index = c1Index;
+                } else if (weight < 0.30) {
+                    best_color_index = ((y % 2 && ((y / 2 + x) % 2)) ? c2Index : c1Index);
+                } else if (weight < 0.70) {
+                    best_color_index = ((x + y) % 2 ? c2Index : c1Index);
+                } else if (weight < 0.97) {
+                    best_color_index = ((y % 2 && ((y / 2 + x) % 2)) % 2 ? c1Index : c2Index);
+                } else {
+                    best_color_index = c2Index;
+                }
+            }
+
+            if (imageParams.dither == 1 || imageParams.dither == 0) {
+                uint32_t best_color_distance = colorDistance(color, palette[0], error_bufferold[x]);
+
+                for (int i = 1; i < num_colors; i++) {
+                    if (best_color_distance == 0) break;
+                    uint32_t distance = colorDistance(color, palette[i], error_bufferold[x]);
+                    if (distance < best_color_distance) {
+                        best_color_distance = distance;
+                        best_color_index = i;
+                    }
+                }
+            }
+
+            if (imageParams.bpp == 3 || imageParams.bpp == 4) {
+                size_t byteIndex = bitOffset / 8;
+                uint8_t bitIndex = bitOffset % 8;
+
+                if (bitIndex + imageParams.bpp <= 8) {
+                    buffer[byteIndex] |= best_color_index << (8 - bitIndex - imageParams.bpp);
+                } else {
+                    uint8_t highPart = best_color_index >> (bitIndex + imageParams.bpp - 8);
+                    uint8_t lowPart = best_color_index & ((1 << (bitIndex + imageParams.bpp - 8)) - 1);
+                    buffer[byteIndex] |= highPart;
+                    buffer[byteIndex + 1] |= lowPart << (8 - (bitIndex + imageParams.bpp - 8));
+                }
+                bitOffset += imageParams.bpp;
+            } else {
+                uint8_t bitIndex = 7 - (x % 8);
+                uint32_t byteIndex = (y * bufw + x) / 8;
+
+                switch (best_color_index) {
+                    case 1:
+                        if (!is_red)
+                            buffer[byteIndex] |= (1 << bitIndex);
+                        break;
+                    case 2:
+                        imageParams.hasRed = true;
+                        if (is_red)
+                            buffer[byteIndex] |= (1 << bitIndex);
+                        break;
+                    case 3:
+                        imageParams.hasRed = true;
+                        buffer[byteIndex] |= (1 << bitIndex);
+                        break;
+                }
+            }
+
+            if (imageParams.dither == 1) {
+                // Burkes Dithering
+                Error error = {
+                    color.r + error_bufferold[x].r - palette[best_color_index].r,
+                    color.g + error_bufferold[x].g - palette[best_color_index].g,
+                    color.b + error_bufferold[x].b - palette[best_color_index].b};
+
+                float scaling_factor = 255.0f / std::max(std::abs(error.r), std::max(std::abs(error.g), std::abs(error.b)));
+                if (scaling_factor < 1.0f) {
+                    error.r *= scaling_factor;
+                    error.g *= scaling_factor;
+                    error.b *= scaling_factor;
+                }
+
+                error_buffernew[x].r += error.r / 4;
+                error_buffernew[x].g += error.g / 4;
+                error_buffernew[x].b += error.b / 4;
+                if (x > 0) {
+                    error_buffernew[x - 1].r += error.r / 8;
+                    error_buffernew[x - 1].g += error.g / 8;
+                    error_buffernew[x - 1].b += error.b / 8;
+                }
+                if (x > 1) {
+                    error_buffernew[x - 2].r += error.r / 16;
+                    error_buffernew[x - 2].g += error.g / 16;
+                    error_buffernew[x - 2].b += error.b / 16;
+                }
+                error_buffernew[x + 1].r += error.r / 8;
+                error_buffernew[x + 1].g += error.g / 8;
+                error_buffernew[x + 1].b += error.b / 8;
+                error_bufferold[x + 1].r += error.r / 4;
+                error_bufferold[x + 1].g += error.g / 4;
+                error_bufferold[x + 1].b += error.b / 4;
+                error_buffernew[x + 2].r += error.r / 16;
+                error_buffernew[x + 2].g += error.g / 16;
+                error_buffernew[x + 2].b += error.b / 16;
+                error_bufferold[x + 2].r += error.r / 8;
+                error_bufferold[x + 2].g += error.g / 8;
+                error_bufferold[x + 2].b += error.b / 8;
+            }
+        }
+        memcpy(error_bufferold, error_buffernew, bufw * sizeof(Error));
+    }
+
+    delete[] error_buffernew;
+    delete[] error_bufferold;
+}
+
+}  // namespace before
+
+struct Palette {
+    const char* name;
+    std::vector<Color> colors;
+    uint8_t bpp;
+};
+
+static const char* const kinds[] = {"gradient", "photo", "text", "blocks"};
+
+static uint16_t rgb565(int r, int g, int b) {
+    r = std::clamp(r, 0, 255);
+    g = std::clamp(g, 0, 255);
+    b = std::clamp(b, 0, 255);
+    return (r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3;
+}
+
+static void drawSample(TFT_eSprite& spr, int kind, int w, int h) {
+    uint32_t seed = kind + 7;
+    auto noise = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return (int)((seed >> 8) % 40) - 20;
+    };
+    static const uint16_t blocks[] = {TFT_RED, TFT_YELLOW, TFT_BLACK, TFT_WHITE, 0x7BEF};
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint16_t color;
+            switch (kind) {
+                case 0:
+                    color = rgb565(x * 255 / w, y * 255 / h, (x + y) * 255 / (w + h));
+                    break;
+                case 1: {
+                    const int v = 128 + 100 * sin(x * 0.05) * cos(y * 0.07);
+                    color = rgb565(v + noise(), v * 0.8 + noise(), v * 0.6 + noise());
+                } break;
+                case 2:
+                    color = ((x / 3 + y / 5) % 7 == 0 || (x % 40) < 2) ? TFT_BLACK : TFT_WHITE;
+                    break;
+                default:
+                    color = blocks[(x / 50 + y / 50) % 5];
+                    break;
+            }
+            spr.drawPixel(x, y, color);
+        }
+    }
+}
+
+// mean and largest difference of 8x8 block averages, in gray levels of 255
+static void blockDifference(const Palette& pal, const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, long bufw, long bufh, double& mean, double& worst) {
+    auto value = [&](const std::vector<uint8_t>& buf, long x, long y) -> double {
+        const size_t px = (size_t)y * bufw + x;
+        if (pal.bpp >= 3) {
+            const size_t bit = px * pal.bpp;
+            const unsigned v = ((buf[bit / 8] << 8 | buf[bit / 8 + 1]) >> (16 - pal.bpp - bit % 8)) & ((1 << pal.bpp) - 1);
+            const Color& c = pal.colors[v % pal.colors.size()];
+            return 0.3 * c.r + 0.59 * c.g + 0.11 * c.b;
+        }
+        return (buf[px / 8] >> (7 - x % 8) & 1) * 255.0;
+    };
+    double sum = 0;
+    long count = 0;
+    worst = 0;
+    for (long by = 0; by + 8 <= bufh; by += 8) {
+        for (long bx = 0; bx + 8 <= bufw; bx += 8) {
+            double va = 0, vb = 0;
+            for (int j = 0; j < 8; j++) {
+                for (int i = 0; i < 8; i++) {
+                    va += value(a, bx + i, by + j);
+                    vb += value(b, bx + i, by + j);
+                }
+            }
+            const double d = fabs(va - vb) / 64;
+            sum += d;
+            worst = std::max(worst, d);
+            count++;
+        }
+    }
+    mean = count ? sum / count : 0;
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    const int width = argc > 2 ? atoi(argv[1]) : 800;
+    const int height = argc > 2 ? atoi(argv[2]) : 480;
+    if (width < 8 || height < 8 || width % 8 || height % 8) {
+        printf("width and height are multiples of 8\n");
+        return 1;
+    }
+
+    std::vector<Palette> palettes = {
+        {"bw", {Color(255, 255, 255), Color(0, 0, 0)}, 1},
+        {"bwr", {Color(255, 255, 255), Color(0, 0, 0), Color(255, 0, 0)}, 2},
+        {"bwry", {Color(255, 255, 255), Color(0, 0, 0), Color(255, 0, 0), Color(255, 255, 0)}, 2},
+        {"6 color", {Color(255, 255, 255), Color(0, 0, 0), Color(255, 0, 0), Color(255, 255, 0), Color(0, 255, 0), Color(0, 0, 255)}, 3},
+        {"16 gray", {}, 4},
+    };
+    for (int i = 0; i < 16; i++) palettes[4].colors.push_back(Color(255 - i * 17, 255 - i * 17, 255 - i * 17));
+
+    bool ok = true;
+    double worstMean = 0, worstBlock = 0;
+    printf("%dx%d photo, 16 bit sprite, ms per conversion\n", width, height);
+    for (int depth : {16, 8, 1}) {
+        for (int kind = 0; kind < 4; kind++) {
+            TFT_eSprite spr(&tft);
+            spr.setColorDepth(depth);
+            if (depth == 1) spr.setBitmapColor(TFT_WHITE, TFT_BLACK);
+            spr.createSprite(width, height);
+            drawSample(spr, kind, width, height);
+
+            for (const Palette& pal : palettes) {
+                for (uint8_t dither = 0; dither < 3; dither++) {
+                    const bool timed = depth == 16 && kind == 1;
+                    for (uint8_t rotate = 0; rotate < 4; rotate++) {
+                        for (uint8_t rotatebuffer = 0; rotatebuffer < 2; rotatebuffer++) {
+                            for (int red = 0; red < (pal.bpp == 2 ? 2 : 1); red++) {
+                                imgParam params;
+                                params.hwdata.colortable = pal.colors;
+                                params.hasRed = false;
+                                params.dither = dither;
+                                params.bufferbpp = depth == 1 ? 1 : 8;
+                                params.rotate = rotate;
+                                params.rotatebuffer = rotatebuffer;
+                                params.bpp = pal.bpp;
+                                params.invert = rotate == 3;
+                                imgParam paramsBefore = params;
+
+                                const size_t size = (size_t)width * height / 8 * (pal.bpp >= 3 ? pal.bpp : 1);
+                                std::vector<uint8_t> after(size + 1), old(size + 1);
+                                auto start = std::chrono::steady_clock::now();
+                                before::spr2color(spr, paramsBefore, old.data(), size, red);
+                                const double msBefore = msSince(start);
+                                start = std::chrono::steady_clock::now();
+                                spr2color(spr, params, after.data(), size, red);
+                                const double msAfter = msSince(start);
+                                if (timed && rotate == 0 && rotatebuffer == 0 && !red) {
+                                    printf("%-8s dither %u: before %7.2f, after %6.2f, %5.1fx\n", pal.name, dither, msBefore, msAfter, msBefore / msAfter);
+                                }
+
+                                size_t bits = 0;
+                                for (size_t i = 0; i < size; i++) bits += __builtin_popcount(old[i] ^ after[i]);
+                                double mean = 0, worst = 0;
+                                if (dither == 1) {
+                                    const long bufw = rotatebuffer % 2 ? height : width, bufh = rotatebuffer % 2 ? width : height;
+                                    blockDifference(pal, old, after, bufw, bufh, mean, worst);
+                                    worstMean = std::max(worstMean, mean);
+                                    worstBlock = std::max(worstBlock, worst);
+                                }
+                                if ((dither != 1 && bits) || mean > 3.0 || params.hasRed != paramsBefore.hasRed) {
+                                    printf("FAIL: %d bit %s, %s, dither %u, rotate %u, rotatebuffer %u, %s plane: %zu bits differ, block mean %.2f, hasRed %d/%d\n",
+                                           depth, kinds[kind], pal.name, dither, rotate, rotatebuffer, red ? "red" : "black", bits, mean, paramsBefore.hasRed, params.hasRed);
+                                    ok = false;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    printf("dither 1 against before: mean block difference %.2f, largest %.1f\n", worstMean, worstBlock);
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
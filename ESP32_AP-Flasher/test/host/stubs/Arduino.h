@@ -0,0 +1,315 @@
+// Host stand-in for the Arduino core, just enough to build AP sources for the harnesses in test/host.
+// Serial output is dropped unless a harness attaches a pty, timing comes from the host clock.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <ctime>
+#include <math.h>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+#ifndef __GLIBC_PREREQ
+#define __GLIBC_PREREQ(a, b) 0
+#endif
+#if !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+    const size_t len = strlen(src);
+    if (size) {
+        const size_t n = std::min(len, size - 1);
+        memcpy(dst, src, n);
+        dst[n] = 0;
+    }
+    return len;
+}
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+struct __FlashStringHelper;
+#define F(x) x
+#define PROGMEM
+#define memcpy_P memcpy
+#define __packed __attribute__((packed))
+
+class String {
+   public:
+    std::string s;
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const std::string& c) : s(c) {}
+    String(char c) : s(1, c) {}
+    template <class T, class = typename std::enable_if<std::is_integral<T>::value>::type>
+    explicit String(T v, int base = 10) {
+        if (base == 10) {
+            s = std::to_string(v);
+            return;
+        }
+        char buf[72];
+        unsigned long long u = (unsigned long long)v;
+        int i = sizeof(buf);
+        buf[--i] = 0;
+        do {
+            buf[--i] = "0123456789abcdefghijklmnopqrstuvwxyz"[u % base];
+            u /= base;
+        } while (u);
+        s = buf + i;
+    }
+    explicit String(double v, int decimals = 2) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        s = buf;
+    }
+    const char* c_str() const { return s.c_str(); }
+    size_t length() const { return s.size(); }
+    bool isEmpty() const { return s.empty(); }
+    String substring(size_t a, size_t b = std::string::npos) const { return a >= s.size() ? String() : String(s.substr(a, b == std::string::npos ? b : b - a)); }
+    int indexOf(const String& x, int from = 0) const { return (int)s.find(x.s, from); }
+    int indexOf(char x, int from = 0) const { return (int)s.find(x, from); }
+    int lastIndexOf(char x) const { return (int)s.rfind(x); }
+    bool startsWith(const String& x) const { return s.rfind(x.s, 0) == 0; }
+    bool endsWith(const String& x) const { return s.size() >= x.s.size() && s.compare(s.size() - x.s.size(), x.s.size(), x.s) == 0; }
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+    void replace(const String& from, const String& to) {
+        if (from.s.empty()) return;
+        for (size_t pos = 0; (pos = s.find(from.s, pos)) != std::string::npos; pos += to.s.size()) s.replace(pos, from.s.size(), to.s);
+    }
+    void trim() {
+        s.erase(0, s.find_first_not_of(" \t\r\n"));
+        s.erase(s.find_last_not_of(" \t\r\n") + 1);
+    }
+    void toLowerCase() {
+        for (auto& c : s) c = tolower(c);
+    }
+    void toUpperCase() {
+        for (auto& c : s) c = toupper(c);
+    }
+    void remove(unsigned int index, unsigned int count = UINT_MAX) {
+        if (index < s.size()) s.erase(index, count);
+    }
+    bool reserve(size_t n) {
+        s.reserve(n);
+        return true;
+    }
+    char charAt(size_t i) const { return s[i]; }
+    char operator[](size_t i) const { return s[i]; }
+    void toCharArray(char* b, size_t n) const {
+        strncpy(b, s.c_str(), n);
+        if (n) b[n - 1] = 0;
+    }
+    void getBytes(uint8_t* b, size_t n) const { memcpy(b, s.c_str(), std::min(n, s.size() + 1)); }
+    bool equals(const String& o) const { return s == o.s; }
+    bool equalsIgnoreCase(const String& o) const { return strcasecmp(s.c_str(), o.s.c_str()) == 0; }
+    int compareTo(const String& o) const { return s.compare(o.s); }
+    String& operator+=(const String& o) {
+        s += o.s;
+        return *this;
+    }
+    String& operator+=(const char* o) {
+        s += o;
+        return *this;
+    }
+    String& operator+=(char o) {
+        s += o;
+        return *this;
+    }
+    template <class T, class = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    String& operator+=(T o) {
+        s += String(o).s;
+        return *this;
+    }
+    bool concat(const String& o) {
+        s += o.s;
+        return true;
+    }
+    bool concat(const char* c, unsigned int n) {
+        s.append(c, n);
+        return true;
+    }
+    bool operator==(const String& o) const { return s == o.s; }
+    bool operator==(const char* o) const { return s == o; }
+    bool operator!=(const String& o) const { return s != o.s; }
+    bool operator<(const String& o) const { return s < o.s; }
+    friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+    friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.s); }
+    friend String operator+(const String& a, char b) { return String(a.s + b); }
+};
+
+class Print {
+   public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t* b, size_t n) {
+        size_t written = 0;
+        while (n--) written += write(*b++);
+        return written;
+    }
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t write(const char* b, size_t n) { return write((const uint8_t*)b, n); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buf[512];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if (len < 0) return 0;
+        return write((const uint8_t*)buf, std::min((size_t)len, sizeof(buf) - 1));
+    }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    template <class T, class = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    size_t print(T v, int base = 10) { return print(String(v, base)); }
+    template <class T>
+    size_t println(T v) { return print(v) + println(); }
+    size_t println() { return write("\r\n"); }
+    virtual void flush() {}
+};
+
+class Stream : public Print {
+   public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual size_t readBytes(char* b, size_t n) {
+        size_t got = 0;
+        for (int c; got < n && (c = read()) >= 0; got++) b[got] = c;
+        return got;
+    }
+    size_t readBytes(uint8_t* b, size_t n) { return readBytes((char*)b, n); }
+    bool find(const char* target) {
+        const size_t len = strlen(target);
+        size_t matched = 0;
+        for (int c; (c = read()) >= 0;) {
+            if (c == target[matched]) {
+                if (++matched == len) return true;
+            } else {
+                matched = (c == target[0]) ? 1 : 0;
+            }
+        }
+        return false;
+    }
+    String readStringUntil(char end) {
+        String ret;
+        for (int c; (c = read()) >= 0 && c != end;) ret += (char)c;
+        return ret;
+    }
+    String readString() { return readStringUntil(0); }
+    void setTimeout(unsigned long) {}
+};
+
+// Output is dropped, unless a harness attaches a file descriptor, a pty for instance. Writes to it
+// are paced at the baud rate, they return once the rest fits in the transmit fifo
+class HardwareSerial : public Stream {
+   public:
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* data, size_t n) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    void attach(int fd);
+    void begin(unsigned long baud, ...) { updateBaudRate(baud); }
+    void updateBaudRate(unsigned long baud) { byteNs = 10 * 1000000000ULL / baud; }
+    void end() {}
+    void setTxTimeoutMs(int) {}
+    void setRxBufferSize(int) {}
+    void setDebugOutput(bool) {}
+    operator bool() { return true; }
+    double damage = 0;  // share of the writes to the fd that get a byte flipped
+
+   private:
+    std::atomic<int> fd{-1};
+    std::atomic<uint32_t> byteNs{10 * 1000000000ULL / 115200};
+    uint64_t busyUntil = 0;  // us on the micros() clock
+    uint8_t rx[256];
+    size_t rxHead = 0;
+    size_t rxLen = 0;
+};
+extern HardwareSerial Serial, Serial1, Serial2;
+
+class IPAddress {
+   public:
+    IPAddress() : addr(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t a) : addr(a) {}
+    String toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buf);
+    }
+    bool fromString(const String& s) {
+        unsigned a, b, c, d;
+        if (sscanf(s.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) != 4) return false;
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    operator uint32_t() const { return addr; }
+    uint8_t operator[](int i) const { return addr >> (8 * i); }
+    bool operator==(const IPAddress& o) const { return addr == o.addr; }
+
+   private:
+    uint32_t addr;
+};
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int digitalRead(int) { return 0; }
+inline long random(long max) { return max > 0 ? rand() % max : 0; }
+inline long random(long min, long max) { return max > min ? min + rand() % (max - min) : min; }
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+#define INPUT_PULLUP 2
+#define INPUT_PULLDOWN 3
+#define SERIAL_8N1 0x800001c
+using std::max;
+using std::min;
+#define constrain(x, a, b) ((x) < (a) ? (a) : ((x) > (b) ? (b) : (x)))
+
+#include "freertos_stub.h"
+
+struct EspClass {
+    uint32_t getFreeHeap() { return 200000; }
+    uint32_t getMaxAllocHeap() { return 100000; }
+    uint32_t getFreePsram() { return 0; }
+    uint32_t getPsramSize() { return 0; }
+    uint32_t getHeapSize() { return 300000; }
+    uint32_t getMinFreeHeap() { return 150000; }
+    uint32_t getFlashChipSize() { return 4 * 1024 * 1024; }
+    void restart() { exit(0); }
+};
+extern EspClass ESP;
+inline void* ps_malloc(size_t n) { return malloc(n); }
+inline void* ps_calloc(size_t n, size_t s) { return calloc(n, s); }
+inline void* ps_realloc(void* p, size_t n) { return realloc(p, n); }
+inline bool psramFound() { return false; }
+#define MALLOC_CAP_SPIRAM 1
+#define MALLOC_CAP_8BIT 2
+#define MALLOC_CAP_INTERNAL 4
+#define MALLOC_CAP_DEFAULT 8
+inline void* heap_caps_malloc(size_t n, uint32_t) { return malloc(n); }
+inline void* heap_caps_calloc(size_t n, size_t s, uint32_t) { return calloc(n, s); }
+inline size_t heap_caps_get_free_size(uint32_t) { return 200000; }
+inline size_t heap_caps_get_largest_free_block(uint32_t) { return 100000; }
+int64_t esp_timer_get_time();
+inline bool getLocalTime(struct tm* info, uint32_t = 5000) {
+    time_t now = time(nullptr);
+    localtime_r(&now, info);
+    return true;
+}
+
+#include "WiFi.h"
@@ -0,0 +1,887 @@
+// Host stand-in for ArduinoJson 7, the part of the API the AP sources use. Documents are a tree of
+// shared nodes, serializeJson/serializeJsonPretty produce the same text as the real library and
+// deserializeJson reads a Stream one character at a time, stopping right after the value like the
+// real one does. Filters and nesting limits are accepted and ignored.
+// MessagePack isn't implemented, the MsgPack calls store json text: only tag_db's template cache
+// uses them, and it reads back what it wrote itself. Timings don't stand for ArduinoJson's.
+#pragma once
+#include <Arduino.h>
+
+#include <cerrno>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class JsonVariant;
+class JsonObject;
+class JsonArray;
+class JsonDocument;
+
+namespace hostjson {
+
+struct Node;
+typedef std::shared_ptr<Node> NodePtr;
+
+struct Node {
+    enum Type : uint8_t { Null, Bool, Int, UInt, Float, Str, Array, Object };
+    Type type = Null;
+    bool b = false;
+    int64_t i = 0;
+    uint64_t u = 0;
+    double f = 0;
+    std::string s;
+    std::vector<NodePtr> items;
+    std::vector<std::pair<std::string, NodePtr>> members;
+
+    void reset(Type t) {
+        type = t;
+        s.clear();
+        items.clear();
+        members.clear();
+    }
+    NodePtr member(const std::string& key) const {
+        for (const auto& m : members) {
+            if (m.first == key) return m.second;
+        }
+        return nullptr;
+    }
+    void copyFrom(const Node& o) {
+        if (&o == this) return;
+        reset(o.type);
+        b = o.b;
+        i = o.i;
+        u = o.u;
+        f = o.f;
+        s = o.s;
+        for (const auto& item : o.items) {
+            items.push_back(std::make_shared<Node>());
+            items.back()->copyFrom(*item);
+        }
+        for (const auto& m : o.members) {
+            members.emplace_back(m.first, std::make_shared<Node>());
+            members.back().second->copyFrom(*m.second);
+        }
+    }
+};
+
+template <class T>
+struct IsStringLike : std::integral_constant<bool, std::is_same<typename std::decay<T>::type, String>::value ||
+                                                       std::is_same<typename std::decay<T>::type, std::string>::value ||
+                                                       std::is_same<typename std::decay<T>::type, const char*>::value ||
+                                                       std::is_same<typename std::decay<T>::type, char*>::value> {};
+
+inline std::string toStd(const String& v) { return v.s; }
+inline std::string toStd(const std::string& v) { return v; }
+inline std::string toStd(const char* v) { return v ? v : ""; }
+
+inline void write(std::string& out, const Node* node, int indent);
+
+inline std::string toJson(const Node* node, const int indent) {
+    std::string out;
+    write(out, node, indent);
+    return out;
+}
+
+}  // namespace hostjson
+
+struct JsonString {
+    std::string s;
+    const char* c_str() const { return s.c_str(); }
+    operator String() const { return String(s); }
+    bool operator==(const char* o) const { return s == o; }
+    bool operator==(const String& o) const { return s == o.s; }
+};
+
+class JsonVariant {
+   public:
+    JsonVariant() {}
+    explicit JsonVariant(hostjson::NodePtr node) : node(node) {}
+    JsonVariant(const JsonVariant&) = default;
+
+    // writes copy the value, like a member proxy in ArduinoJson
+    JsonVariant& operator=(const JsonVariant& o) {
+        set(o);
+        return *this;
+    }
+    template <class T>
+    JsonVariant& operator=(const T& value) {
+        set(value);
+        return *this;
+    }
+
+    template <class T>
+    bool set(const T& value) {
+        hostjson::NodePtr n = ensure();
+        if (!n) return false;
+        assign(*n, value);
+        return true;
+    }
+
+    template <class K>
+    JsonVariant operator[](const K& key) const {
+        JsonVariant child;
+        const hostjson::NodePtr n = node;
+        if constexpr (std::is_integral<K>::value) {
+            if (n && n->type == hostjson::Node::Array && (size_t)key < n->items.size()) child.node = n->items[key];
+            child.index = key;
+        } else {
+            child.key = keyOf(key);
+            if (n && n->type == hostjson::Node::Object) child.node = n->member(child.key);
+            child.byKey = true;
+        }
+        if (!child.node) child.parent = std::make_shared<JsonVariant>(*this);
+        return child;
+    }
+
+    template <class T>
+    T as() const;
+    template <class T>
+    bool is() const;
+    template <class T, class = typename std::enable_if<std::is_arithmetic<T>::value || std::is_same<T, String>::value ||
+                                                        std::is_same<T, std::string>::value || std::is_same<T, const char*>::value ||
+                                                        std::is_same<T, JsonObject>::value || std::is_same<T, JsonArray>::value ||
+                                                        std::is_same<T, JsonString>::value>::type>
+    operator T() const { return as<T>(); }
+
+    template <class T>
+    typename std::enable_if<!hostjson::IsStringLike<T>::value && !std::is_array<T>::value, T>::type operator|(const T& fallback) const {
+        if (!isCompatible<T>()) return fallback;
+        return as<T>();
+    }
+    const char* operator|(const char* fallback) const {
+        return (node && node->type == hostjson::Node::Str) ? node->s.c_str() : fallback;
+    }
+    String operator|(const String& fallback) const {
+        return (node && node->type == hostjson::Node::Str) ? String(node->s) : fallback;
+    }
+
+    template <class T>
+    bool operator==(const T& value) const {
+        if constexpr (hostjson::IsStringLike<T>::value || std::is_array<T>::value) {
+            return node && node->type == hostjson::Node::Str && node->s == hostjson::toStd(value);
+        } else if constexpr (std::is_base_of<JsonVariant, T>::value) {
+            return hostjson::toJson(node.get(), -1) == hostjson::toJson(value.node.get(), -1);
+        } else {
+            return isCompatible<T>() && as<T>() == value;
+        }
+    }
+    template <class T>
+    bool operator!=(const T& value) const { return !(*this == value); }
+
+    bool isNull() const { return !node || node->type == hostjson::Node::Null; }
+    size_t size() const {
+        if (!node) return 0;
+        return node->type == hostjson::Node::Array ? node->items.size() : (node->type == hostjson::Node::Object ? node->members.size() : 0);
+    }
+    void clear() {
+        if (node) node->reset(hostjson::Node::Null);
+    }
+    template <class K>
+    bool containsKey(const K& key) const {
+        return node && node->type == hostjson::Node::Object && node->member(keyOf(key)) != nullptr;
+    }
+    template <class K>
+    void remove(const K& key) {
+        if (!node) return;
+        if constexpr (std::is_integral<K>::value) {
+            if (node->type == hostjson::Node::Array && (size_t)key < node->items.size()) node->items.erase(node->items.begin() + key);
+        } else {
+            if (node->type != hostjson::Node::Object) return;
+            const std::string k = keyOf(key);
+            for (auto it = node->members.begin(); it != node->members.end(); ++it) {
+                if (it->first == k) {
+                    node->members.erase(it);
+                    return;
+                }
+            }
+        }
+    }
+
+    template <class T>
+    T add();
+    template <class T>
+    bool add(const T& value) {
+        hostjson::NodePtr n = ensureArray();
+        if (!n) return false;
+        n->items.push_back(std::make_shared<hostjson::Node>());
+        assign(*n->items.back(), value);
+        return true;
+    }
+    template <class T>
+    T to();
+
+    JsonObject createNestedObject();
+    template <class K>
+    JsonObject createNestedObject(const K& key);
+    JsonArray createNestedArray();
+    template <class K>
+    JsonArray createNestedArray(const K& key);
+
+    mutable hostjson::NodePtr node;  // null when the variant refers to a member that doesn't exist yet
+
+   protected:
+    // creates the member this variant refers to, and its parents, on the first write
+    hostjson::NodePtr ensure() const {
+        if (node || !parent) return node;
+        hostjson::NodePtr p = parent->ensure();
+        if (!p) return nullptr;
+        if (byKey) {
+            if (p->type == hostjson::Node::Null) p->reset(hostjson::Node::Object);
+            if (p->type != hostjson::Node::Object) return nullptr;
+            node = p->member(key);
+            if (!node) {
+                node = std::make_shared<hostjson::Node>();
+                p->members.emplace_back(key, node);
+            }
+        } else {
+            if (p->type == hostjson::Node::Null) p->reset(hostjson::Node::Array);
+            if (p->type != hostjson::Node::Array) return nullptr;
+            while (p->items.size() <= index) p->items.push_back(std::make_shared<hostjson::Node>());
+            node = p->items[index];
+        }
+        parent.reset();
+        return node;
+    }
+    hostjson::NodePtr ensureArray() const {
+        hostjson::NodePtr n = ensure();
+        if (n && n->type == hostjson::Node::Null) n->reset(hostjson::Node::Array);
+        return (n && n->type == hostjson::Node::Array) ? n : nullptr;
+    }
+
+    template <class K>
+    static std::string keyOf(const K& key) {
+        if constexpr (std::is_same<typename std::decay<K>::type, JsonString>::value) {
+            return key.s;
+        } else {
+            return hostjson::toStd(key);
+        }
+    }
+
+    template <class T>
+    bool isCompatible() const {
+        if (!node) return false;
+        if constexpr (std::is_same<T, bool>::value) {
+            return node->type == hostjson::Node::Bool;
+        } else if constexpr (std::is_arithmetic<T>::value) {
+            return node->type == hostjson::Node::Int || node->type == hostjson::Node::UInt || node->type == hostjson::Node::Float;
+        } else {
+            return is<T>();
+        }
+    }
+
+    template <class T>
+    static void assign(hostjson::Node& n, const T& value) {
+        using D = typename std::decay<T>::type;
+        if constexpr (std::is_base_of<JsonVariant, D>::value) {
+            if (value.node) {
+                n.copyFrom(*value.node);
+            } else {
+                n.reset(hostjson::Node::Null);
+            }
+        } else if constexpr (std::is_same<D, bool>::value) {
+            n.reset(hostjson::Node::Bool);
+            n.b = value;
+        } else if constexpr (std::is_integral<D>::value && std::is_signed<D>::value) {
+            n.reset(hostjson::Node::Int);
+            n.i = value;
+        } else if constexpr (std::is_integral<D>::value) {
+            n.reset(hostjson::Node::UInt);
+            n.u = value;
+        } else if constexpr (std::is_floating_point<D>::value) {
+            n.reset(hostjson::Node::Float);
+            n.f = value;
+        } else if constexpr (std::is_same<D, std::nullptr_t>::value) {
+            n.reset(hostjson::Node::Null);
+        } else {
+            n.reset(hostjson::Node::Str);
+            n.s = hostjson::toStd(value);
+        }
+    }
+
+    mutable std::shared_ptr<JsonVariant> parent;
+    std::string key;
+    size_t index = 0;
+    bool byKey = false;
+
+    friend class JsonDocument;
+};
+
+struct JsonPair {
+    JsonString k;
+    JsonVariant v;
+    JsonString key() const { return k; }
+    JsonVariant value() const { return v; }
+};
+
+class JsonObject : public JsonVariant {
+   public:
+    JsonObject() {}
+    JsonObject(const JsonVariant& v) : JsonVariant(v) {}
+    using JsonVariant::operator=;
+
+    class iterator {
+       public:
+        iterator(hostjson::NodePtr node, size_t pos) : node(node), pos(pos) {}
+        JsonPair operator*() const { return JsonPair{JsonString{node->members[pos].first}, JsonVariant(node->members[pos].second)}; }
+        iterator& operator++() {
+            pos++;
+            return *this;
+        }
+        bool operator!=(const iterator& o) const { return pos != o.pos; }
+
+       private:
+        hostjson::NodePtr node;
+        size_t pos;
+    };
+    iterator begin() const { return iterator(node, 0); }
+    iterator end() const { return iterator(node, node && node->type == hostjson::Node::Object ? node->members.size() : 0); }
+};
+
+class JsonArray : public JsonVariant {
+   public:
+    JsonArray() {}
+    JsonArray(const JsonVariant& v) : JsonVariant(v) {}
+    using JsonVariant::operator=;
+
+    class iterator {
+       public:
+        iterator(hostjson::NodePtr node, size_t pos) : node(node), pos(pos) {}
+        JsonVariant operator*() const { return JsonVariant(node->items[pos]); }
+        iterator& operator++() {
+            pos++;
+            return *this;
+        }
+        bool operator!=(const iterator& o) const { return pos != o.pos; }
+
+       private:
+        hostjson::NodePtr node;
+        size_t pos;
+    };
+    iterator begin() const { return iterator(node, 0); }
+    iterator end() const { return iterator(node, node && node->type == hostjson::Node::Array ? node->items.size() : 0); }
+};
+
+typedef JsonVariant JsonVariantConst;
+typedef JsonObject JsonObjectConst;
+typedef JsonArray JsonArrayConst;
+
+class JsonDocument : public JsonVariant {
+   public:
+    JsonDocument() : JsonVariant(std::make_shared<hostjson::Node>()) {}
+    template <class A>
+    JsonDocument(A*) : JsonDocument() {}
+    JsonDocument(const JsonDocument& o) : JsonDocument() { node->copyFrom(*o.node); }
+    JsonDocument& operator=(const JsonDocument& o) {
+        node->copyFrom(*o.node);
+        return *this;
+    }
+    using JsonVariant::operator=;
+
+    size_t memoryUsage() const { return 0; }
+    bool overflowed() const { return false; }
+    void shrinkToFit() {}
+};
+
+template <class T>
+T JsonVariant::as() const {
+    using hostjson::Node;
+    const Node* n = node.get();
+    if constexpr (std::is_same<T, bool>::value) {
+        if (!n) return false;
+        if (n->type == Node::Bool) return n->b;
+        if (n->type == Node::Int) return n->i != 0;
+        if (n->type == Node::UInt) return n->u != 0;
+        if (n->type == Node::Float) return n->f != 0;
+        return false;
+    } else if constexpr (std::is_arithmetic<T>::value) {
+        if (!n) return T();
+        if (n->type == Node::Int) return (T)n->i;
+        if (n->type == Node::UInt) return (T)n->u;
+        if (n->type == Node::Float) return (T)n->f;
+        if (n->type == Node::Bool) return (T)n->b;
+        return T();
+    } else if constexpr (std::is_same<T, String>::value || std::is_same<T, std::string>::value) {
+        if (n && n->type == Node::Str) return T(n->s);
+        return T(hostjson::toJson(n, -1));
+    } else if constexpr (std::is_same<T, const char*>::value) {
+        return (n && n->type == Node::Str) ? n->s.c_str() : nullptr;
+    } else if constexpr (std::is_same<T, JsonObject>::value) {
+        return (n && n->type == Node::Object) ? JsonObject(JsonVariant(node)) : JsonObject();
+    } else if constexpr (std::is_same<T, JsonArray>::value) {
+        return (n && n->type == Node::Array) ? JsonArray(JsonVariant(node)) : JsonArray();
+    } else if constexpr (std::is_same<T, JsonVariant>::value) {
+        return *this;
+    } else if constexpr (std::is_same<T, JsonString>::value) {
+        return JsonString{(n && n->type == Node::Str) ? n->s : std::string()};
+    } else {
+        static_assert(sizeof(T) == 0, "conversion not supported by the host ArduinoJson");
+    }
+}
+
+template <class T>
+bool JsonVariant::is() const {
+    using hostjson::Node;
+    if (!node) return false;
+    const Node::Type t = node->type;
+    if constexpr (std::is_same<T, JsonVariant>::value) {
+        return t != Node::Null;
+    } else if constexpr (std::is_same<T, JsonObject>::value) {
+        return t == Node::Object;
+    } else if constexpr (std::is_same<T, JsonArray>::value) {
+        return t == Node::Array;
+    } else if constexpr (hostjson::IsStringLike<T>::value || std::is_same<T, JsonString>::value) {
+        return t == Node::Str;
+    } else if constexpr (std::is_same<T, bool>::value) {
+        return t == Node::Bool;
+    } else if constexpr (std::is_integral<T>::value) {
+        return t == Node::Int || t == Node::UInt;
+    } else if constexpr (std::is_floating_point<T>::value) {
+        return t == Node::Int || t == Node::UInt || t == Node::Float;
+    } else {
+        return false;
+    }
+}
+
+template <class T>
+T JsonVariant::add() {
+    hostjson::NodePtr n = ensureArray();
+    if (!n) return T();
+    n->items.push_back(std::make_shared<hostjson::Node>());
+    n->items.back()->reset(std::is_same<T, JsonObject>::value ? hostjson::Node::Object
+                                                              : (std::is_same<T, JsonArray>::value ? hostjson::Node::Array : hostjson::Node::Null));
+    return T(JsonVariant(n->items.back()));
+}
+
+template <class T>
+T JsonVariant::to() {
+    hostjson::NodePtr n = ensure();
+    if (!n) return T();
+    n->reset(std::is_same<T, JsonObject>::value ? hostjson::Node::Object
+                                                : (std::is_same<T, JsonArray>::value ? hostjson::Node::Array : hostjson::Node::Null));
+    return T(JsonVariant(n));
+}
+
+inline JsonObject JsonVariant::createNestedObject() { return add<JsonObject>(); }
+template <class K>
+JsonObject JsonVariant::createNestedObject(const K& key) { return (*this)[key].template to<JsonObject>(); }
+inline JsonArray JsonVariant::createNestedArray() { return add<JsonArray>(); }
+template <class K>
+JsonArray JsonVariant::createNestedArray(const K& key) { return (*this)[key].template to<JsonArray>(); }
+
+// serialization
+
+namespace hostjson {
+
+inline void writeString(std::string& out, const std::string& s) {
+    out += '"';
+    for (const unsigned char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += (char)c;
+                }
+        }
+    }
+    out += '"';
+}
+
+// indent < 0 is compact, otherwise the depth of a pretty print with two spaces per level
+inline void write(std::string& out, const Node* node, const int indent) {
+    const bool pretty = indent >= 0;
+    auto newline = [&](const int depth) {
+        if (!pretty) return;
+        out += "\r\n";
+        out.append(depth * 2, ' ');
+    };
+    char buf[32];
+    switch (node ? node->type : Node::Null) {
+        case Node::Null: out += "null"; break;
+        case Node::Bool: out += node->b ? "true" : "false"; break;
+        case Node::Int:
+            snprintf(buf, sizeof(buf), "%lld", (long long)node->i);
+            out += buf;
+            break;
+        case Node::UInt:
+            snprintf(buf, sizeof(buf), "%llu", (unsigned long long)node->u);
+            out += buf;
+            break;
+        case Node::Float:
+            if (std::isnan(node->f) || std::isinf(node->f)) {
+                out += "null";
+            } else {
+                snprintf(buf, sizeof(buf), "%.9g", node->f);
+                out += buf;
+            }
+            break;
+        case Node::Str: writeString(out, node->s); break;
+        case Node::Array:
+            out += '[';
+            for (size_t i = 0; i < node->items.size(); i++) {
+                if (i) out += ',';
+                newline(indent + 1);
+                write(out, node->items[i].get(), pretty ? indent + 1 : -1);
+            }
+            if (!node->items.empty()) newline(indent);
+            out += ']';
+            break;
+        case Node::Object:
+            out += '{';
+            for (size_t i = 0; i < node->members.size(); i++) {
+                if (i) out += ',';
+                newline(indent + 1);
+                writeString(out, node->members[i].first);
+                out += pretty ? ": " : ":";
+                write(out, node->members[i].second.get(), pretty ? indent + 1 : -1);
+            }
+            if (!node->members.empty()) newline(indent);
+            out += '}';
+            break;
+    }
+}
+
+}  // namespace hostjson
+
+inline size_t serializeJson(const JsonVariant& v, String& out) {
+    out.s = hostjson::toJson(v.node.get(), -1);
+    return out.length();
+}
+inline size_t serializeJson(const JsonVariant& v, std::string& out) {
+    out = hostjson::toJson(v.node.get(), -1);
+    return out.size();
+}
+inline size_t serializeJson(const JsonVariant& v, Print& out) {
+    const std::string s = hostjson::toJson(v.node.get(), -1);
+    return out.write((const uint8_t*)s.data(), s.size());
+}
+inline size_t serializeJson(const JsonVariant& v, char* buffer, size_t size) {
+    const std::string s = hostjson::toJson(v.node.get(), -1);
+    if (size == 0) return 0;
+    const size_t n = std::min(s.size(), size - 1);
+    memcpy(buffer, s.data(), n);
+    buffer[n] = 0;
+    return n;
+}
+inline size_t serializeJsonPretty(const JsonVariant& v, String& out) {
+    out.s = hostjson::toJson(v.node.get(), 0);
+    return out.length();
+}
+inline size_t serializeJsonPretty(const JsonVariant& v, Print& out) {
+    const std::string s = hostjson::toJson(v.node.get(), 0);
+    return out.write((const uint8_t*)s.data(), s.size());
+}
+inline size_t measureJson(const JsonVariant& v) { return hostjson::toJson(v.node.get(), -1).size(); }
+inline size_t measureJsonPretty(const JsonVariant& v) { return hostjson::toJson(v.node.get(), 0).size(); }
+
+// deserialization
+
+class DeserializationError {
+   public:
+    enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+    DeserializationError(Code code = Ok) : value(code) {}
+    explicit operator bool() const { return value != Ok; }
+    const char* c_str() const {
+        static const char* names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"};
+        return names[value];
+    }
+    Code code() const { return value; }
+    bool operator==(Code c) const { return value == c; }
+    bool operator!=(Code c) const { return value != c; }
+
+   private:
+    Code value;
+};
+
+namespace DeserializationOption {
+struct Filter {
+    Filter() {}
+    Filter(const JsonVariant&) {}
+};
+struct NestingLimit {
+    NestingLimit(int = 10) {}
+};
+}  // namespace DeserializationOption
+
+namespace hostjson {
+
+struct MemoryReader {
+    const char* p;
+    const char* end;
+    int peek() { return p < end ? (unsigned char)*p : -1; }
+    int read() { return p < end ? (unsigned char)*p++ : -1; }
+};
+
+struct StreamReader {
+    Stream& stream;
+    int peek() { return stream.peek(); }
+    int read() { return stream.read(); }
+};
+
+template <class R>
+class Parser {
+   public:
+    explicit Parser(R& reader) : in(reader) {}
+
+    DeserializationError parse(Node& node) {
+        skipSpace();
+        if (in.peek() < 0) return DeserializationError::EmptyInput;
+        return value(node, 0);
+    }
+
+   private:
+    R& in;
+
+    void skipSpace() {
+        for (int c = in.peek(); c == ' ' || c == '\t' || c == '\r' || c == '\n'; c = in.peek()) in.read();
+    }
+
+    DeserializationError value(Node& node, const int depth) {
+        if (depth > 64) return DeserializationError::TooDeep;
+        skipSpace();
+        const int c = in.peek();
+        if (c < 0) return DeserializationError::IncompleteInput;
+        if (c == '{') return object(node, depth);
+        if (c == '[') return array(node, depth);
+        if (c == '"' || c == '\'') {
+            node.reset(Node::Str);
+            return string(node.s);
+        }
+        if (c == 't') return literal("true", node, Node::Bool, true);
+        if (c == 'f') return literal("false", node, Node::Bool, false);
+        if (c == 'n') return literal("null", node, Node::Null, false);
+        if (c == '-' || (c >= '0' && c <= '9')) return number(node);
+        return DeserializationError::InvalidInput;
+    }
+
+    DeserializationError literal(const char* word, Node& node, const Node::Type type, const bool b) {
+        for (const char* w = word; *w; w++) {
+            const int c = in.read();
+            if (c < 0) return DeserializationError::IncompleteInput;
+            if (c != *w) return DeserializationError::InvalidInput;
+        }
+        node.reset(type);
+        node.b = b;
+        return DeserializationError::Ok;
+    }
+
+    DeserializationError number(Node& node) {
+        std::string text;
+        for (int c = in.peek(); c >= 0 && (isdigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'); c = in.peek()) {
+            text += (char)in.read();
+        }
+        char* end;
+        if (text.find_first_of(".eE") == std::string::npos) {
+            errno = 0;
+            if (text[0] == '-') {
+                const long long v = strtoll(text.c_str(), &end, 10);
+                if (*end == 0 && errno == 0) {
+                    node.reset(Node::Int);
+                    node.i = v;
+                    return DeserializationError::Ok;
+                }
+            } else {
+                const unsigned long long v = strtoull(text.c_str(), &end, 10);
+                if (*end == 0 && errno == 0) {
+                    node.reset(Node::UInt);
+                    node.u = v;
+                    return DeserializationError::Ok;
+                }
+            }
+        }
+        const double v = strtod(text.c_str(), &end);
+        if (*end != 0) return DeserializationError::InvalidInput;
+        node.reset(Node::Float);
+        node.f = v;
+        return DeserializationError::Ok;
+    }
+
+    static void appendUtf8(std::string& s, const uint32_t cp) {
+        if (cp < 0x80) {
+            s += (char)cp;
+        } else if (cp < 0x800) {
+            s += (char)(0xC0 | (cp >> 6));
+            s += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            s += (char)(0xE0 | (cp >> 12));
+            s += (char)(0x80 | ((cp >> 6) & 0x3F));
+            s += (char)(0x80 | (cp & 0x3F));
+        } else {
+            s += (char)(0xF0 | (cp >> 18));
+            s += (char)(0x80 | ((cp >> 12) & 0x3F));
+            s += (char)(0x80 | ((cp >> 6) & 0x3F));
+            s += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool hex4(uint32_t& cp) {
+        cp = 0;
+        for (int n = 0; n < 4; n++) {
+            const int c = in.read();
+            if (!isxdigit(c)) return false;
+            cp = cp * 16 + (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+        }
+        return true;
+    }
+
+    DeserializationError string(std::string& s) {
+        const int quote = in.read();
+        for (;;) {
+            int c = in.read();
+            if (c < 0) return DeserializationError::IncompleteInput;
+            if (c == quote) return DeserializationError::Ok;
+            if (c != '\\') {
+                s += (char)c;
+                continue;
+            }
+            c = in.read();
+            switch (c) {
+                case -1: return DeserializationError::IncompleteInput;
+                case 'b': s += '\b'; break;
+                case 'f': s += '\f'; break;
+                case 'n': s += '\n'; break;
+                case 'r': s += '\r'; break;
+                case 't': s += '\t'; break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!hex4(cp)) return DeserializationError::InvalidInput;
+                    if (cp >= 0xD800 && cp < 0xDC00 && in.peek() == '\\') {
+                        in.read();
+                        uint32_t low;
+                        if (in.read() != 'u' || !hex4(low)) return DeserializationError::InvalidInput;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(s, cp);
+                    break;
+                }
+                default: s += (char)c;
+            }
+        }
+    }
+
+    DeserializationError array(Node& node, const int depth) {
+        in.read();
+        node.reset(Node::Array);
+        skipSpace();
+        if (in.peek() == ']') {
+            in.read();
+            return DeserializationError::Ok;
+        }
+        for (;;) {
+            node.items.push_back(std::make_shared<Node>());
+            const DeserializationError err = value(*node.items.back(), depth + 1);
+            if (err) return err;
+            skipSpace();
+            const int c = in.read();
+            if (c == ']') return DeserializationError::Ok;
+            if (c < 0) return DeserializationError::IncompleteInput;
+            if (c != ',') return DeserializationError::InvalidInput;
+        }
+    }
+
+    DeserializationError object(Node& node, const int depth) {
+        in.read();
+        node.reset(Node::Object);
+        skipSpace();
+        if (in.peek() == '}') {
+            in.read();
+            return DeserializationError::Ok;
+        }
+        for (;;) {
+            skipSpace();
+            const int q = in.peek();
+            if (q < 0) return DeserializationError::IncompleteInput;
+            if (q != '"' && q != '\'') return DeserializationError::InvalidInput;
+            std::string key;
+            DeserializationError err = string(key);
+            if (err) return err;
+            skipSpace();
+            const int colon = in.read();
+            if (colon < 0) return DeserializationError::IncompleteInput;
+            if (colon != ':') return DeserializationError::InvalidInput;
+            NodePtr child = std::make_shared<Node>();
+            err = value(*child, depth + 1);
+            if (err) return err;
+            // a repeated key keeps the last value, as in ArduinoJson
+            NodePtr existing = node.member(key);
+            if (existing) {
+                existing->copyFrom(*child);
+            } else {
+                node.members.emplace_back(std::move(key), child);
+            }
+            skipSpace();
+            const int c = in.read();
+            if (c == '}') return DeserializationError::Ok;
+            if (c < 0) return DeserializationError::IncompleteInput;
+            if (c != ',') return DeserializationError::InvalidInput;
+        }
+    }
+};
+
+template <class R>
+DeserializationError parseInto(JsonDocument& doc, R& reader) {
+    doc.clear();
+    Parser<R> parser(reader);
+    const DeserializationError err = parser.parse(*doc.node);
+    if (err) doc.clear();
+    return err;
+}
+
+template <class T>
+struct IsOption : std::integral_constant<bool, std::is_same<T, DeserializationOption::Filter>::value ||
+                                                   std::is_same<T, DeserializationOption::NestingLimit>::value> {};
+template <class... O>
+struct AreOptions : std::true_type {};
+template <class O, class... Rest>
+struct AreOptions<O, Rest...> : std::integral_constant<bool, IsOption<O>::value && AreOptions<Rest...>::value> {};
+
+}  // namespace hostjson
+
+template <class... O, class = typename std::enable_if<hostjson::AreOptions<O...>::value>::type>
+DeserializationError deserializeJson(JsonDocument& doc, const char* input, O...) {
+    hostjson::MemoryReader reader{input, input ? input + strlen(input) : input};
+    return hostjson::parseInto(doc, reader);
+}
+template <class... O, class = typename std::enable_if<hostjson::AreOptions<O...>::value>::type>
+DeserializationError deserializeJson(JsonDocument& doc, const String& input, O...) {
+    return deserializeJson(doc, input.c_str());
+}
+template <class... O, class = typename std::enable_if<hostjson::AreOptions<O...>::value>::type>
+DeserializationError deserializeJson(JsonDocument& doc, const std::string& input, O...) {
+    hostjson::MemoryReader reader{input.data(), input.data() + input.size()};
+    return hostjson::parseInto(doc, reader);
+}
+template <class C, class... O, class = typename std::enable_if<sizeof(C) == 1 && hostjson::AreOptions<O...>::value>::type>
+DeserializationError deserializeJson(JsonDocument& doc, const C* input, size_t len, O...) {
+    hostjson::MemoryReader reader{(const char*)input, (const char*)input + len};
+    return hostjson::parseInto(doc, reader);
+}
+template <class... O, class = typename std::enable_if<hostjson::AreOptions<O...>::value>::type>
+DeserializationError deserializeJson(JsonDocument& doc, Stream& input, O...) {
+    hostjson::StreamReader reader{input};
+    return hostjson::parseInto(doc, reader);
+}
+
+// MessagePack, stored as json text, see the top of this file
+inline size_t measureMsgPack(const JsonVariant& v) { return measureJson(v); }
+inline size_t serializeMsgPack(const JsonVariant& v, char* buffer, size_t size) {
+    const std::string s = hostjson::toJson(v.node.get(), -1);
+    const size_t n = std::min(s.size(), size);
+    memcpy(buffer, s.data(), n);
+    return n;
+}
+template <class C>
+DeserializationError deserializeMsgPack(JsonDocument& doc, const C* input, size_t len) {
+    return deserializeJson(doc, input, len);
+}
@@ -0,0 +1,2 @@
+// Declarations only, enough for the AP headers that mention the web server.
+#pragma once
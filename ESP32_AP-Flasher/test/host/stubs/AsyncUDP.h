@@ -0,0 +1,5 @@
+// Declarations only, enough for udp.h.
+#pragma once
+#include <Arduino.h>
+class AsyncUDPPacket { public: uint8_t* data(); size_t length(); IPAddress remoteIP(); };
+class AsyncUDP { public: bool listenMulticast(IPAddress, uint16_t); void onPacket(std::function<void(AsyncUDPPacket)>); size_t writeTo(const uint8_t*, size_t, IPAddress, uint16_t); size_t broadcastTo(uint8_t*, size_t, uint16_t); };
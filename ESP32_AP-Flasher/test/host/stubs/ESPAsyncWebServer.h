@@ -0,0 +1,67 @@
+// Declarations only, enough for the AP headers that mention the web server.
+#pragma once
+#include <list>
+#include <Arduino.h>
+#include <FS.h>
+#include <functional>
+enum WebRequestMethod { HTTP_GET = 1, HTTP_POST = 2, HTTP_PUT = 4, HTTP_ANY = 255 };
+struct AsyncWebParameter { const String& value() const; const String& name() const; };
+typedef AsyncWebParameter AsyncWebHeader;
+class AsyncWebServerResponse { public: void addHeader(const String&, const String&); void setCode(int); };
+class AsyncResponseStream : public AsyncWebServerResponse, public Print { public: size_t write(uint8_t) override { return 1; } size_t write(const uint8_t* b, size_t n) override { return n; } using Print::write; };
+typedef std::function<size_t(uint8_t*, size_t, size_t)> AwsResponseFiller;
+class AsyncWebServerRequest {
+  public:
+    bool hasParam(const String&, bool post = false, bool file = false) const;
+    const AsyncWebParameter* getParam(const String&, bool post = false, bool file = false) const;
+    size_t params() const;
+    const AsyncWebParameter* getParam(size_t) const;
+    void send(int, const String& = String(), const String& = String());
+    void send(int, const String&, const uint8_t*, size_t);
+    void send(fs::FS&, const String&, const String& = String(), bool = false);
+    void send(AsyncWebServerResponse*);
+    AsyncResponseStream* beginResponseStream(const String&, size_t = 1460);
+    AsyncWebServerResponse* beginChunkedResponse(const String&, AwsResponseFiller);
+    AsyncWebServerResponse* beginResponse(int, const String&, const String& = String());
+    AsyncWebServerResponse* beginResponse(fs::FS&, const String&, const String& = String(), bool = false);
+    bool hasHeader(const String&) const;
+    const AsyncWebHeader* getHeader(const String&) const;
+    void onDisconnect(std::function<void()>);
+    String url() const;
+    WebRequestMethod method() const;
+    void* _tempObject;
+    fs::File _tempFile;
+};
+typedef std::function<void(AsyncWebServerRequest*)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, String, size_t, uint8_t*, size_t, bool)> ArUploadHandlerFunction;
+struct AsyncStaticWebHandler { AsyncStaticWebHandler& setCacheControl(const char*); AsyncStaticWebHandler& setDefaultFile(const char*); };
+class AsyncWebHandler {};
+enum AwsClientStatus { WS_DISCONNECTED, WS_CONNECTED, WS_DISCONNECTING };
+class AsyncWebSocketClient { public: AwsClientStatus status() const; uint32_t id(); bool canSend(); void text(const String&); size_t queueLen() const; bool queueIsFull() const; };
+enum AwsEventType { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA };
+class AsyncWebSocket : public AsyncWebHandler {
+  public:
+    AsyncWebSocket(const String&);
+    void textAll(const String&);
+    void textAll(const char*, size_t);
+    void text(uint32_t, const String&);
+    size_t count() const;
+    void cleanupClients(uint16_t = 8);
+    void enable(bool);
+    void closeAll();
+    bool availableForWriteAll();
+    bool availableForWrite(uint32_t);
+    std::list<AsyncWebSocketClient>& getClients();
+    void onEvent(std::function<void(AsyncWebSocket*, AsyncWebSocketClient*, AwsEventType, void*, uint8_t*, size_t)>);
+};
+class AsyncWebServer {
+  public:
+    AsyncWebServer(int);
+    void on(const char*, int, ArRequestHandlerFunction);
+    void on(const char*, int, ArRequestHandlerFunction, ArUploadHandlerFunction);
+    void addHandler(AsyncWebHandler*);
+    AsyncStaticWebHandler& serveStatic(const char*, fs::FS&, const char*);
+    void onNotFound(ArRequestHandlerFunction);
+    void begin();
+};
+struct DefaultHeaders { static DefaultHeaders& Instance(); void addHeader(const char*, const char*); };
@@ -0,0 +1,186 @@
+// In-memory file system for the host harnesses. Open files keep their content alive like
+// an unlinked file would, and every call can be slowed down to stand in for flash.
+#pragma once
+#include <Arduino.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+// glibc's own allocator, see FlashAllocator
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void __libc_free(void* ptr);
+
+namespace fs {
+
+// File contents stand in for flash, they are allocated past malloc so they don't count for
+// harnesses that measure the heap by replacing malloc or operator new.
+template <class T>
+struct FlashAllocator {
+    typedef T value_type;
+    FlashAllocator() {}
+    template <class U>
+    FlashAllocator(const FlashAllocator<U>&) {}
+    T* allocate(size_t n) {
+        T* ptr = (T*)__libc_malloc(n * sizeof(T));
+        if (ptr == nullptr) throw std::bad_alloc();
+        return ptr;
+    }
+    void deallocate(T* ptr, size_t) { __libc_free(ptr); }
+    bool operator==(const FlashAllocator&) const { return true; }
+    bool operator!=(const FlashAllocator&) const { return false; }
+};
+typedef std::vector<uint8_t, FlashAllocator<uint8_t>> Content;
+
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+
+struct HostFSStats {
+    uint32_t opens;
+    uint32_t bytesRead;
+    uint32_t bytesWritten;
+};
+
+class File : public Stream {
+   public:
+    File() {}
+    File(std::shared_ptr<Content> content, const String& path, bool writable)
+        : content(content), filePath(path), writable(writable) {}
+
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t* b, size_t n) override;
+    using Print::write;
+    size_t read(uint8_t* b, size_t n) { return readBytes((char*)b, n); }
+    int read() override {
+        uint8_t b;
+        return readBytes((char*)&b, 1) == 1 ? b : -1;
+    }
+    int peek() override { return content && pos < content->size() ? (*content)[pos] : -1; }
+    int available() override { return content ? content->size() - pos : 0; }
+    size_t readBytes(char* b, size_t n) override;
+    bool seek(uint32_t offset, SeekMode mode = SeekSet) {
+        if (!content) return false;
+        const size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? pos : content->size());
+        if (base + offset > content->size()) return false;
+        pos = base + offset;
+        return true;
+    }
+    size_t position() const { return pos; }
+    size_t size() const { return content ? content->size() : 0; }
+    void close() { content.reset(); }
+    operator bool() const { return content != nullptr; }
+    const char* name() const {
+        const int slash = filePath.lastIndexOf('/');
+        return filePath.c_str() + slash + 1;
+    }
+    const char* path() const { return filePath.c_str(); }
+    bool isDirectory() { return false; }
+    File openNextFile() { return File(); }
+    time_t getLastWrite() { return 0; }
+
+   private:
+    std::shared_ptr<Content> content;
+    String filePath;
+    bool writable = false;
+    size_t pos = 0;
+};
+
+class FS {
+   public:
+    File open(const char* path, const char* mode = "r", bool create = false) {
+        opDelay();
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.opens++;
+        auto it = files.find(path);
+        if (mode[0] == 'w' || (mode[0] == 'a' && it == files.end())) {
+            // like LittleFS, a reader that has the old file open keeps the old content
+            auto content = std::make_shared<Content>();
+            files[path] = content;
+            return File(content, path, true);
+        }
+        if (it == files.end()) return File();
+        File file(it->second, path, mode[0] == 'a' || strchr(mode, '+') != nullptr);
+        if (mode[0] == 'a') file.seek(0, SeekEnd);
+        return file;
+    }
+    File open(const String& path, const char* mode = "r", bool create = false) { return open(path.c_str(), mode, create); }
+    bool exists(const char* path) {
+        opDelay();
+        std::lock_guard<std::mutex> lock(mutex);
+        return files.count(path) != 0;
+    }
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path) {
+        opDelay();
+        std::lock_guard<std::mutex> lock(mutex);
+        return files.erase(path) != 0;
+    }
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to) {
+        opDelay();
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = files.find(from);
+        if (it == files.end()) return false;
+        auto content = it->second;
+        files.erase(it);
+        files[to] = content;
+        return true;
+    }
+    bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+    bool mkdir(const char*) { return true; }
+    bool mkdir(const String&) { return true; }
+
+    /// @brief Make every call take at least this long, 0 to run at memory speed
+    void setOpDelayUs(const uint32_t us) { delayUs = us; }
+    size_t fileCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return files.size();
+    }
+    HostFSStats getStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+   private:
+    friend class File;
+    void opDelay() const {
+        if (delayUs) std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+    }
+
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<Content>> files;
+    uint32_t delayUs = 0;
+    HostFSStats stats = {0};
+};
+
+// the one file system the harnesses use, File counts its traffic there
+extern FS hostFS;
+
+inline size_t File::write(const uint8_t* b, size_t n) {
+    if (!content || !writable) return 0;
+    if (pos + n > content->size()) content->resize(pos + n);
+    memcpy(content->data() + pos, b, n);
+    pos += n;
+    std::lock_guard<std::mutex> lock(hostFS.mutex);
+    hostFS.stats.bytesWritten += n;
+    return n;
+}
+
+inline size_t File::readBytes(char* b, size_t n) {
+    if (!content) return 0;
+    hostFS.opDelay();
+    n = std::min(n, content->size() - pos);
+    memcpy(b, content->data() + pos, n);
+    pos += n;
+    std::lock_guard<std::mutex> lock(hostFS.mutex);
+    hostFS.stats.bytesRead += n;
+    return n;
+}
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
@@ -0,0 +1,117 @@
+// Definitions behind HTTPClient.h.
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool HTTPClient::begin(const String& url) {
+    end();
+    requestHeaders.clear();
+    std::string rest = url.c_str();
+    const size_t scheme = rest.find("://");
+    if (scheme != std::string::npos) rest = rest.substr(scheme + 3);
+    const size_t slash = rest.find('/');
+    path = (slash == std::string::npos) ? "/" : rest.substr(slash);
+    host = rest.substr(0, slash);
+    const size_t colon = host.find(':');
+    if (colon != std::string::npos) {
+        port = atoi(host.c_str() + colon + 1);
+        host.resize(colon);
+    }
+    const size_t fragment = path.find('#');
+    if (fragment != std::string::npos) path.resize(fragment);
+    return true;
+}
+
+static bool waitFor(int fd, short events, int ms) {
+    pollfd p = {fd, events, 0};
+    return poll(&p, 1, ms) == 1;
+}
+
+int HTTPClient::GET() {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) return HTTPC_ERROR_CONNECTION_REFUSED;
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return HTTPC_ERROR_CONNECTION_REFUSED;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) return HTTPC_ERROR_CONNECTION_REFUSED;
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (!waitFor(fd, POLLOUT, connectTimeout) || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    const std::string request = "GET " + path + " HTTP/1.0\r\nHost: " + host + "\r\n" + requestHeaders + "\r\n";
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) return HTTPC_ERROR_SEND_HEADER_FAILED;
+
+    char buffer[1024];
+    size_t end;
+    while ((end = responseHeaders.find("\r\n\r\n")) == std::string::npos) {
+        if (!waitFor(fd, POLLIN, timeout)) return HTTPC_ERROR_READ_TIMEOUT;
+        const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return HTTPC_ERROR_CONNECTION_LOST;
+        responseHeaders.append(buffer, n);
+    }
+    bodyStart = responseHeaders.substr(end + 4);
+    responseHeaders.resize(end + 2);
+    const String length = header("Content-Length");
+    if (!length.isEmpty()) contentLength = atoi(length.c_str());
+    return atoi(responseHeaders.c_str() + responseHeaders.find(' ') + 1);
+}
+
+int HTTPClient::writeToStream(Stream* stream) {
+    if (fd < 0) return HTTPC_ERROR_CONNECTION_LOST;
+    int total = 0;
+    std::string chunk;
+    chunk.swap(bodyStart);
+    while (true) {
+        if (!chunk.empty()) {
+            if (stream->write((const uint8_t*)chunk.data(), chunk.size()) != chunk.size()) return HTTPC_ERROR_STREAM_WRITE;
+            total += chunk.size();
+        }
+        if (contentLength >= 0 && total >= contentLength) return total;
+        if (!waitFor(fd, POLLIN, timeout)) return HTTPC_ERROR_READ_TIMEOUT;
+        char buffer[4096];
+        const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n == 0 && contentLength < 0) return total;
+        if (n <= 0) return HTTPC_ERROR_CONNECTION_LOST;
+        chunk.assign(buffer, n);
+    }
+}
+
+String HTTPClient::getString() {
+    struct Collect : Stream {
+        std::string body;
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t* data, size_t len) override {
+            body.append((const char*)data, len);
+            return len;
+        }
+    } collect;
+    return writeToStream(&collect) < 0 ? String() : String(collect.body);
+}
+
+String HTTPClient::header(const char* name) {
+    const std::string key = std::string("\r\n") + name + ":";
+    for (size_t pos = responseHeaders.find("\r\n"); pos != std::string::npos; pos = responseHeaders.find("\r\n", pos + 2)) {
+        if (strncasecmp(responseHeaders.c_str() + pos, key.c_str(), key.size()) != 0) continue;
+        size_t start = pos + key.size();
+        while (responseHeaders[start] == ' ') start++;
+        return String(responseHeaders.substr(start, responseHeaders.find("\r\n", start) - start));
+    }
+    return String();
+}
+
+void HTTPClient::end() {
+    if (fd >= 0) close(fd);
+    fd = -1;
+    responseHeaders.clear();
+    bodyStart.clear();
+    contentLength = -1;
+}
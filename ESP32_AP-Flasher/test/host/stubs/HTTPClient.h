@@ -0,0 +1,49 @@
+// Plain HTTP/1.0 GET over a socket, for harnesses that run a stand-in server on the loopback
+// interface. Only literal IPv4 hosts connect, any other url fails like an unreachable server.
+#pragma once
+#include <WiFi.h>
+
+#include <string>
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_NOT_MODIFIED 304
+#define HTTPC_STRICT_FOLLOW_REDIRECTS 1
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+class HTTPClient {
+   public:
+    ~HTTPClient() { end(); }
+    bool begin(const String& url);
+    bool begin(WiFiClient&, const String& url) { return begin(url); }
+    int GET();
+    int POST(const String&) { return HTTPC_ERROR_CONNECTION_REFUSED; }
+    void end();
+    int getSize() { return contentLength; }
+    String getString();
+    WiFiClient* getStreamPtr() { return nullptr; }
+    int writeToStream(Stream* stream);
+    void addHeader(const String& name, const String& value) { requestHeaders += std::string(name.c_str()) + ": " + value.c_str() + "\r\n"; }
+    void setTimeout(int ms) { timeout = ms; }
+    void setConnectTimeout(int ms) { connectTimeout = ms; }
+    void setFollowRedirects(int) {}
+    void collectHeaders(const char**, size_t) {}
+    String header(const char* name);
+    bool hasHeader(const char* name) { return !header(name).isEmpty(); }
+    void setReuse(bool) {}
+    bool connected() { return fd >= 0; }
+
+   private:
+    std::string host;
+    std::string path;
+    int port = 80;
+    int fd = -1;
+    int timeout = 5000;
+    int connectTimeout = 5000;
+    std::string requestHeaders;
+    std::string responseHeaders;
+    std::string bodyStart;  // body bytes read along with the headers
+    int contentLength = -1;
+};
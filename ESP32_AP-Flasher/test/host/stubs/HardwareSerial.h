@@ -0,0 +1,3 @@
+// HardwareSerial lives in Arduino.h, see there.
+#pragma once
+#include <Arduino.h>
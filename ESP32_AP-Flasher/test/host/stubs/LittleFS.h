@@ -0,0 +1,3 @@
+// Declarations only, the harnesses use the in-memory file system in FS.h.
+#pragma once
+#include <FS.h>
@@ -0,0 +1,43 @@
+// Not md5: two FNV-1a passes fill the 16 bytes. The harnesses only need a digest that tells
+// contents apart, the AP uses the first 8 bytes as the data version.
+#pragma once
+#include <Arduino.h>
+
+class MD5Builder {
+   public:
+    void begin() {
+        h1 = 0xcbf29ce484222325ULL;
+        h2 = 0x84222325cbf29ce4ULL;
+    }
+    void add(const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            h1 = (h1 ^ data[i]) * 0x100000001b3ULL;
+            h2 = (h2 ^ data[i] ^ 0x5a) * 0x100000001b3ULL;
+        }
+    }
+    void add(const String& s) { add((const uint8_t*)s.c_str(), s.length()); }
+    void addStream(Stream& stream, size_t len) {
+        uint8_t buf[512];
+        while (len) {
+            const size_t got = stream.readBytes((char*)buf, std::min(len, sizeof(buf)));
+            if (got == 0) break;
+            add(buf, got);
+            len -= got;
+        }
+    }
+    void calculate() {}
+    void getBytes(uint8_t* out) const {
+        memcpy(out, &h1, sizeof(h1));
+        memcpy(out + sizeof(h1), &h2, sizeof(h2));
+    }
+    String toString() const {
+        uint8_t bytes[16];
+        getBytes(bytes);
+        char hex[33];
+        for (int i = 0; i < 16; i++) sprintf(hex + i * 2, "%02x", bytes[i]);
+        return String(hex);
+    }
+
+   private:
+    uint64_t h1 = 0, h2 = 0;
+};
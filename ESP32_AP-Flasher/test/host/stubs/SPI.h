@@ -0,0 +1,5 @@
+// Declarations only, enough for the flasher headers.
+#pragma once
+#include <Arduino.h>
+class SPIClass;
+class SPISettings {};
@@ -0,0 +1,195 @@
+// Host stand-in for TFT_eSPI, the sprite part only: pixel storage, viewports and readPixel with the
+// conversions of the library, so makeimage.cpp reads sprites here the way it does on the AP.
+// Text isn't drawn, and vlw fonts aren't loaded, the members are there for fontcache.cpp.
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+
+#define TFT_BLACK 0x0000
+#define TFT_WHITE 0xFFFF
+#define TFT_RED 0xF800
+#define TFT_YELLOW 0xFFE0
+#define TL_DATUM 0
+
+class TFT_eSPI : public Print {
+   public:
+    size_t write(uint8_t) override { return 1; }
+};
+
+class TFT_eSprite : public TFT_eSPI {
+   public:
+    explicit TFT_eSprite(TFT_eSPI *) {}
+    ~TFT_eSprite() { deleteSprite(); }
+
+    void setColorDepth(int8_t b) { bpp = (b == 16 || b == 8 || b == 1) ? b : 16; }
+    int8_t getColorDepth() { return bpp; }
+    void setBitmapColor(uint16_t fg, uint16_t bg) {
+        bitmapFg = fg;
+        bitmapBg = bg;
+    }
+
+    void *createSprite(int16_t w, int16_t h, uint8_t frames = 1) {
+        if (img) return img;
+        const size_t size = bpp == 16 ? (size_t)w * h * 2 : bpp == 8 ? (size_t)w * h : (size_t)((w + 7) & ~7) / 8 * h;
+        img = (uint8_t *)calloc(size, 1);
+        if (!img) return nullptr;
+        iwidth = w;
+        iheight = h;
+        bitwidth = (w + 7) & ~7;
+        resetViewport();
+        return img;
+    }
+    void deleteSprite() {
+        free(img);
+        img = nullptr;
+        iwidth = iheight = 0;
+    }
+    void *getPointer() { return img; }
+    bool created() { return img != nullptr; }
+
+    // as in TFT_eSPI, with datum the drawing coordinates start at (x, y) and may lie outside the sprite
+    void setViewport(int32_t x, int32_t y, int32_t w, int32_t h, bool vpDatum = true) {
+        xDatum = x;
+        yDatum = y;
+        xWidth = w;
+        yHeight = h;
+        vpX = vpY = 0;
+        vpW = iwidth;
+        vpH = iheight;
+        this->vpDatum = false;
+        vpOoB = false;
+        if (x < 0) {
+            w += x;
+            x = 0;
+        }
+        if (y < 0) {
+            h += y;
+            y = 0;
+        }
+        if (x + w > iwidth) w = iwidth - x;
+        if (y + h > iheight) h = iheight - y;
+        if (w < 1 || h < 1) {
+            xDatum = yDatum = 0;
+            xWidth = iwidth;
+            yHeight = iheight;
+            vpOoB = true;
+            return;
+        }
+        if (!vpDatum) {
+            xDatum = yDatum = 0;
+            xWidth = iwidth;
+            yHeight = iheight;
+        }
+        vpX = x;
+        vpY = y;
+        vpW = x + w;
+        vpH = y + h;
+        this->vpDatum = vpDatum;
+    }
+    void resetViewport() {
+        xDatum = yDatum = 0;
+        xWidth = vpW = iwidth;
+        yHeight = vpH = iheight;
+        vpX = vpY = 0;
+        vpDatum = vpOoB = false;
+    }
+    int16_t width() { return vpDatum ? xWidth : iwidth; }
+    int16_t height() { return vpDatum ? yHeight : iheight; }
+
+    void drawPixel(int32_t x, int32_t y, uint32_t color) {
+        if (!img || vpOoB) return;
+        x += xDatum;
+        y += yDatum;
+        if (x < vpX || y < vpY || x >= vpW || y >= vpH) return;
+        if (bpp == 16) {
+            ((uint16_t *)img)[x + y * iwidth] = (uint16_t)(color >> 8 | color << 8);
+        } else if (bpp == 8) {
+            img[x + y * iwidth] = (uint8_t)((color & 0xE000) >> 8 | (color & 0x0700) >> 6 | (color & 0x0018) >> 3);
+        } else if (color) {
+            img[(x + y * bitwidth) >> 3] |= 0x80 >> (x & 7);
+        } else {
+            img[(x + y * bitwidth) >> 3] &= ~(0x80 >> (x & 7));
+        }
+    }
+    uint16_t readPixel(int32_t x, int32_t y) {
+        if (!img || vpOoB) return 0xFFFF;
+        x += xDatum;
+        y += yDatum;
+        if (x < vpX || y < vpY || x >= vpW || y >= vpH) return 0xFFFF;
+        if (bpp == 16) {
+            const uint16_t color = ((uint16_t *)img)[x + y * iwidth];
+            return color >> 8 | color << 8;
+        }
+        if (bpp == 8) {
+            uint16_t color = img[x + y * iwidth];
+            if (color != 0) {
+                static const uint8_t blue[] = {0, 11, 21, 31};
+                color = (color & 0xE0) << 8 | (color & 0xC0) << 5 | (color & 0x1C) << 6 | (color & 0x1C) << 3 | blue[color & 0x03];
+            }
+            return color;
+        }
+        return (img[(x + y * bitwidth) >> 3] & (0x80 >> (x & 7))) ? bitmapFg : bitmapBg;
+    }
+    void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+        for (int32_t j = y; j < y + h; j++) {
+            for (int32_t i = x; i < x + w; i++) drawPixel(i, j, color);
+        }
+    }
+    void fillSprite(uint32_t color) {
+        if (!vpOoB) fillRect(vpX - xDatum, vpY - yDatum, vpW - vpX, vpH - vpY, color);
+    }
+    void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+        fillRect(x, y, w, 1, color);
+        fillRect(x, y + h - 1, w, 1, color);
+        fillRect(x, y, 1, h, color);
+        fillRect(x + w - 1, y, 1, h, color);
+    }
+    void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data) {
+        for (int32_t j = 0; j < h; j++) {
+            for (int32_t i = 0; i < w; i++) {
+                const uint16_t color = data[i + j * w];
+                drawPixel(x + i, y + j, swapBytes ? (uint16_t)(color >> 8 | color << 8) : color);
+            }
+        }
+    }
+    void setSwapBytes(bool swap) { swapBytes = swap; }
+    void pushSprite(int32_t, int32_t) {}
+
+    void setTextColor(uint16_t, uint16_t, bool = false) {}
+    void setTextDatum(uint8_t) {}
+    void setCursor(int16_t, int16_t, uint8_t = 1) {}
+    void loadFont(const String &, fs::FS &) {}
+    void unloadFont() { fontLoaded = false; }
+
+    struct fontMetrics {
+        const uint8_t *gArray;
+        uint16_t gCount;
+        uint16_t yAdvance;
+        uint16_t spaceWidth;
+        int16_t ascent;
+        int16_t descent;
+        uint16_t maxAscent;
+        uint16_t maxDescent;
+    };
+    fontMetrics gFont = {0};
+    uint16_t *gUnicode = nullptr;
+    uint8_t *gHeight = nullptr;
+    uint8_t *gWidth = nullptr;
+    uint8_t *gxAdvance = nullptr;
+    int16_t *gdY = nullptr;
+    int8_t *gdX = nullptr;
+    uint32_t *gBitmap = nullptr;
+    bool fontLoaded = false;
+    fs::File fontFile;
+    bool fs_font = true;
+
+   private:
+    uint8_t *img = nullptr;
+    int8_t bpp = 16;
+    int32_t iwidth = 0, iheight = 0, bitwidth = 0;
+    int32_t xDatum = 0, yDatum = 0, xWidth = 0, yHeight = 0;
+    int32_t vpX = 0, vpY = 0, vpW = 0, vpH = 0;
+    bool vpDatum = false, vpOoB = false;
+    uint16_t bitmapFg = TFT_WHITE, bitmapBg = TFT_BLACK;
+    bool swapBytes = false;
+};
@@ -0,0 +1,20 @@
+// Host stand-in for TJpg_Decoder. Nothing is decoded, every jpg reads as invalid.
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+
+typedef bool (*SketchCallback)(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *data);
+
+class TJpg_Decoder {
+   public:
+    void setSwapBytes(bool) {}
+    void setJpgScale(uint8_t) {}
+    void setCallback(SketchCallback) {}
+    uint8_t getFsJpgSize(uint16_t *w, uint16_t *h, const String &, fs::FS &) {
+        *w = *h = 0;
+        return 1;
+    }
+    uint8_t drawFsJpg(int32_t, int32_t, const String &, fs::FS &) { return 1; }
+};
+
+inline TJpg_Decoder TJpgDec;
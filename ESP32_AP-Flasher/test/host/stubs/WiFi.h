@@ -0,0 +1,10 @@
+// Declarations only, the harnesses have no network.
+#pragma once
+struct WiFiClass { int status(); String SSID(); int RSSI(); void macAddress(uint8_t*); String macAddress(); IPAddress localIP(); };
+extern WiFiClass WiFi;
+#define WL_CONNECTED 3
+typedef int WiFiEvent_t;
+enum esp_mac_type_t { ESP_MAC_WIFI_STA, ESP_MAC_WIFI_SOFTAP, ESP_MAC_BT, ESP_MAC_ETH };
+class WiFiClient : public Stream { public: size_t write(uint8_t) override {return 1;} using Print::write; int connected(); void stop(); };
+class WiFiClientSecure : public WiFiClient { public: void setInsecure(); };
+class WiFiUDP : public Stream {public: size_t write(uint8_t) override {return 1;} using Print::write;};
@@ -0,0 +1,44 @@
+// FreeRTOS calls used by the AP sources, backed by std::thread and a counting semaphore in host_arduino.cpp.
+#pragma once
+#include <cstdint>
+typedef void* SemaphoreHandle_t;
+typedef void* QueueHandle_t;
+typedef void* TaskHandle_t;
+typedef void* TimerHandle_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+#define portTICK_RATE_MS 1
+#define pdMS_TO_TICKS(x) (x)
+#define configMAX_PRIORITIES 25
+#define tskIDLE_PRIORITY 0
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateCounting(int, int);
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t);
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t, BaseType_t*);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t, BaseType_t*);
+QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t);
+BaseType_t xQueueSend(QueueHandle_t, const void*, TickType_t);
+BaseType_t xQueueReceive(QueueHandle_t, void*, TickType_t);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t);
+BaseType_t xTaskCreate(void (*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*);
+BaseType_t xTaskCreatePinnedToCore(void (*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*, int);
+void vTaskDelay(TickType_t);
+void vTaskDelete(TaskHandle_t);
+TickType_t xTaskGetTickCount();
+BaseType_t xTaskNotifyGive(TaskHandle_t);
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+bool xPortInIsrContext();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t);
+const char* pcTaskGetName(TaskHandle_t);
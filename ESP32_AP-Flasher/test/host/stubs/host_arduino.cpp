@@ -0,0 +1,236 @@
+// Definitions behind the host stand-ins in this directory.
+#include <Arduino.h>
+#include <FS.h>
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial, Serial1, Serial2;
+EspClass ESP;
+WiFiClass WiFi;
+fs::FS fs::hostFS;
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+int64_t esp_timer_get_time() {
+    return micros();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+// the fifo of an ESP32 uart, HardwareSerial has no transmit buffer of its own by default
+static const size_t UART_TX_FIFO = 128;
+
+void HardwareSerial::attach(int fd) {
+    rxHead = rxLen = 0;
+    busyUntil = 0;
+    this->fd = fd;
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t n) {
+    if (fd < 0) return n;
+    static thread_local std::mt19937 rng(std::random_device{}());
+    std::vector<uint8_t> bytes(data, data + n);
+    if (damage > 0 && n > 2 && std::uniform_real_distribution<double>(0, 1)(rng) < damage) bytes[1 + rng() % (n - 2)] ^= 0x5A;
+    for (size_t off = 0; off < n;) {
+        const ssize_t written = ::write(fd, bytes.data() + off, n - off);
+        if (written > 0) off += written;
+        if (written < 0 && errno != EINTR && errno != EAGAIN) break;
+    }
+    const uint64_t now = micros();
+    busyUntil = std::max(busyUntil, now) + n * byteNs / 1000;
+    const uint64_t fifoUs = UART_TX_FIFO * byteNs / 1000;
+    if (busyUntil > now + fifoUs) std::this_thread::sleep_for(std::chrono::microseconds(busyUntil - fifoUs - now));
+    return n;
+}
+
+int HardwareSerial::available() {
+    if (fd < 0) return 0;
+    int pending = 0;
+    if (ioctl(fd, FIONREAD, &pending) < 0) pending = 0;
+    return rxLen - rxHead + pending;
+}
+
+int HardwareSerial::read() {
+    if (fd < 0) return -1;
+    if (rxHead == rxLen) {
+        const int pending = available();
+        if (pending <= 0) return -1;
+        const ssize_t got = ::read(fd, rx, std::min(sizeof(rx), (size_t)pending));
+        if (got <= 0) return -1;
+        rxHead = 0;
+        rxLen = got;
+    }
+    return rx[rxHead++];
+}
+
+// mutexes are semaphores with one token, good enough as long as nobody relies on priority inheritance
+namespace {
+struct Semaphore {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int count;
+    int max;
+    std::thread::id owner;
+    int depth = 0;
+};
+}  // namespace
+
+static Semaphore* newSemaphore(int max, int initial) {
+    Semaphore* sem = new Semaphore;
+    sem->max = max;
+    sem->count = initial;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return newSemaphore(1, 1); }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return newSemaphore(1, 1); }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return newSemaphore(1, 0); }
+SemaphoreHandle_t xSemaphoreCreateCounting(int max, int initial) { return newSemaphore(max, initial); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks) {
+    Semaphore* sem = static_cast<Semaphore*>(handle);
+    std::unique_lock<std::mutex> lock(sem->mutex);
+    auto ready = [sem] { return sem->count > 0; };
+    if (ticks == portMAX_DELAY) {
+        sem->cv.wait(lock, ready);
+    } else if (!sem->cv.wait_for(lock, std::chrono::milliseconds(ticks), ready)) {
+        return pdFALSE;
+    }
+    sem->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+    Semaphore* sem = static_cast<Semaphore*>(handle);
+    {
+        std::lock_guard<std::mutex> lock(sem->mutex);
+        if (sem->count >= sem->max) return pdFALSE;
+        sem->count++;
+    }
+    sem->cv.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t handle, TickType_t ticks) {
+    Semaphore* sem = static_cast<Semaphore*>(handle);
+    {
+        std::lock_guard<std::mutex> lock(sem->mutex);
+        if (sem->depth && sem->owner == std::this_thread::get_id()) {
+            sem->depth++;
+            return pdTRUE;
+        }
+    }
+    if (xSemaphoreTake(handle, ticks) != pdTRUE) return pdFALSE;
+    std::lock_guard<std::mutex> lock(sem->mutex);
+    sem->owner = std::this_thread::get_id();
+    sem->depth = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t handle) {
+    Semaphore* sem = static_cast<Semaphore*>(handle);
+    {
+        std::lock_guard<std::mutex> lock(sem->mutex);
+        if (sem->depth == 0 || sem->owner != std::this_thread::get_id()) return pdFALSE;
+        if (--sem->depth) return pdTRUE;
+        sem->owner = std::thread::id();
+    }
+    return xSemaphoreGive(handle);
+}
+
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t handle, BaseType_t*) { return xSemaphoreTake(handle, 0); }
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t handle, BaseType_t*) { return xSemaphoreGive(handle); }
+
+namespace {
+struct Queue {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> items;
+    size_t length;
+    size_t itemSize;
+};
+}  // namespace
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    Queue* queue = new Queue;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t ticks) {
+    Queue* queue = static_cast<Queue*>(handle);
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto room = [queue] { return queue->items.size() < queue->length; };
+    if (ticks == portMAX_DELAY) {
+        queue->cv.wait(lock, room);
+    } else if (!queue->cv.wait_for(lock, std::chrono::milliseconds(ticks), room)) {
+        return pdFALSE;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(item);
+    queue->items.emplace_back(bytes, bytes + queue->itemSize);
+    queue->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void* item, TickType_t ticks) {
+    Queue* queue = static_cast<Queue*>(handle);
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto ready = [queue] { return !queue->items.empty(); };
+    if (ticks == portMAX_DELAY) {
+        queue->cv.wait(lock, ready);
+    } else if (!queue->cv.wait_for(lock, std::chrono::milliseconds(ticks), ready)) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    queue->cv.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+    Queue* queue = static_cast<Queue*>(handle);
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->items.size();
+}
+
+BaseType_t xTaskCreate(void (*task)(void*), const char*, uint32_t, void* parameter, UBaseType_t, TaskHandle_t*) {
+    std::thread(task, parameter).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void*), const char* name, uint32_t stack, void* parameter, UBaseType_t priority, TaskHandle_t* handle, int) {
+    return xTaskCreate(task, name, stack, parameter, priority, handle);
+}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+void vTaskDelete(TaskHandle_t) {}
+TickType_t xTaskGetTickCount() { return millis(); }
+TaskHandle_t xTaskGetCurrentTaskHandle() { return nullptr; }
+bool xPortInIsrContext() { return false; }
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 4096; }
+const char* pcTaskGetName(TaskHandle_t) { return "host"; }
@@ -0,0 +1,13 @@
+// crc32_le as in the ESP32 ROM: the reflected CRC-32 of zlib, crc32_le(0, "123456789", 9) == 0xCBF43926.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+inline uint32_t crc32_le(uint32_t crc, const uint8_t* buf, size_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
@@ -0,0 +1,293 @@
+// Benchmark of /get_db: the streaming TagDBJsonWriter in tag_db.cpp against the tagDBtoJson it
+// replaced, which built a document of up to 5000 bytes per request and had the web UI come back
+// with the "continu" position. Reported are bytes per ms and the peak heap while serializing,
+// counted by replacing operator new. Both run on the host ArduinoJson stand-in, so the heap is
+// that of the stand-in's nodes and the times are not ArduinoJson's, the shape is what counts.
+//
+// Then the writer's guarantees: its peak heap doesn't grow with the number of tags, the filters
+// select the same tags as checking every tag by hand, and tags deleted and added halfway through
+// a response don't make it skip or repeat any of the others.
+//
+//   tagdb_json_bench [tags] [chunk size]
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <malloc.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "storage.h"
+#include "system.h"
+#include "tag_db.h"
+#include "web.h"
+
+// what the rest of the AP would provide
+fs::FS* contentFS = &fs::hostFS;
+SemaphoreHandle_t fsMutex = xSemaphoreCreateMutex();
+
+void logLine(const String&) {}
+void logLine(const char*) {}
+void wsErr(const String&) {}
+void wsLog(const String&) {}
+void wsSendTaginfo(const uint8_t*, uint8_t) {}
+namespace util {
+void printHeap() {}
+}  // namespace util
+
+// heap in use and its high-water mark, for everything allocated through operator new
+static std::atomic<size_t> heapUsed(0);
+static std::atomic<size_t> heapPeak(0);
+
+void* operator new(size_t size) {
+    void* ptr = malloc(size ? size : 1);
+    if (ptr == nullptr) throw std::bad_alloc();
+    const size_t used = heapUsed += malloc_usable_size(ptr);
+    size_t peak = heapPeak.load();
+    while (used > peak && !heapPeak.compare_exchange_weak(peak, used)) {
+    }
+    return ptr;
+}
+void operator delete(void* ptr) noexcept {
+    if (ptr == nullptr) return;
+    heapUsed -= malloc_usable_size(ptr);
+    free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+static void fillTags(const uint32_t count) {
+    std::mt19937 rng(1);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t mac[8] = {(uint8_t)i, (uint8_t)(i >> 8), 0x11, 0x22, 0x33, 0x44, 0x00, 0x00};
+        tagRecord* tag = addRecord(mac);
+        uint8_t md5[16];
+        for (uint8_t& b : md5) b = rng();
+        tag->setMd5(md5);
+        tag->setLastseen(1700000000 + rng() % 100000);
+        tag->setNextupdate(1700000000 + rng() % 100000);
+        tag->setExpectedNextCheckin(2000000000);
+        tag->setContentMode(rng() % 30);
+        tag->setLQI(rng());
+        tag->setRSSI(-(int8_t)(rng() % 90));
+        tag->setTemperature(rng() % 30);
+        tag->setBatteryMv(2200 + rng() % 900);
+        tag->setHwType(rng() % 0x40);
+        tag->setCapabilities(rng());
+        tag->setApIp(IPAddress(192, 168, 1, 2));
+        tag->setUpdateCount(rng() % 5000);
+        tag->setUpdateLast(1700000000 + rng() % 100000);
+        tag->setCurrentChannel(11 + rng() % 16);
+        tag->setTagSoftwareVersion(0x19 + rng() % 8);
+        if (i % 5) tag->setAlias("Shelf " + String(i) + " label");
+        if (i % 7) tag->setModeConfigJson("{\"location\":\"Amsterdam\",\"units\":\"1\",\"interval\":\"" + String(rng() % 60) + "\"}");
+        tag->lastChange = 1700000000 + i;
+    }
+}
+
+// the /get_db of before, one request per 5000 bytes. startPos was a uint8_t, which kept the web UI
+// from getting past tag 255, it is widened here to compare whole databases
+static String tagDBtoJson(const uint8_t mac[8], uint32_t startPos) {
+    JsonDocument doc;
+    JsonArray tags = doc["tags"].to<JsonArray>();
+    for (uint32_t c = startPos; c < tagDB.size(); ++c) {
+        const tagRecord* taginfo = tagDB.at(c);
+        const bool select = !mac || memcmp(taginfo->mac, mac, 8) == 0;
+        if (select && taginfo->version == 0) {
+            JsonObject tag = tags.add<JsonObject>();
+            fillNode(tag, taginfo);
+            if (measureJson(doc) > 5000) {
+                doc["continu"] = c + 1;
+                break;
+            }
+            if (mac) break;
+        }
+    }
+    return doc.as<String>();
+}
+
+// the response as a client receives it, kept with malloc to stay out of the measured heap
+struct Body {
+    char* data = nullptr;
+    size_t len = 0;
+
+    Body() = default;
+    Body(const Body&) = delete;
+    Body& operator=(const Body&) = delete;
+    ~Body() { free(data); }
+    void append(const uint8_t* buffer, const size_t n) {
+        data = static_cast<char*>(realloc(data, len + n + 1));
+        memcpy(data + len, buffer, n);
+        len += n;
+        data[len] = 0;
+    }
+};
+
+struct Run {
+    double ms;
+    size_t bytes;
+    size_t peak;  // above what was in use before
+    uint32_t requests;
+};
+
+static Run streamed(const TagFilter& filter, const size_t chunk, Body& body, const std::function<void(uint32_t)>& between = nullptr) {
+    Run run = {0, 0, 0, 1};
+    std::vector<uint8_t> buffer(chunk);
+    const size_t base = heapUsed;
+    heapPeak = base;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        TagDBJsonWriter writer(filter, 0);
+        for (uint32_t n = 0;; n++) {
+            const size_t len = writer.read(buffer.data(), chunk);
+            if (len == 0) break;
+            run.bytes += len;
+            body.append(buffer.data(), len);
+            if (between) between(n);
+        }
+    }
+    run.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    run.peak = heapPeak - base;
+    return run;
+}
+
+static Run paged() {
+    Run run = {0, 0, 0, 0};
+    const size_t base = heapUsed;
+    heapPeak = base;
+    const auto start = std::chrono::steady_clock::now();
+    uint32_t pos = 0;
+    while (true) {
+        const String json = tagDBtoJson(nullptr, pos);
+        run.requests++;
+        run.bytes += json.length();
+        JsonDocument doc;
+        deserializeJson(doc, json);
+        if (doc["continu"].isNull()) break;
+        pos = doc["continu"].as<uint32_t>();
+    }
+    run.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    run.peak = heapPeak - base;
+    return run;
+}
+
+static std::vector<String> macsOf(const Body& body, bool& ok) {
+    JsonDocument doc;
+    ok = body.data && !deserializeJson(doc, (const char*)body.data);
+    std::vector<String> macs;
+    for (JsonObject tag : doc["tags"].as<JsonArray>()) macs.push_back(tag["mac"].as<String>());
+    return macs;
+}
+
+static String hexOf(const tagRecord* tag) {
+    char hex[17];
+    mac2hex(tag->mac, hex);
+    return String(hex);
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    const uint32_t tags = argc > 1 ? atoi(argv[1]) : 1000;
+    const size_t chunk = argc > 2 ? atoi(argv[2]) : 1436;
+    bool ok = true;
+    config.maxsleep = 10;
+
+    // the writer's peak heap is the same for a tenth of the tags
+    Body smallBody, body;
+    fillTags(tags / 10);
+    const Run small = streamed(TagFilter(), chunk, smallBody);
+    destroyDB();
+
+    fillTags(tags);
+    const Run stream = streamed(TagFilter(), chunk, body);
+    const Run old = paged();
+    printf("%u tags, %zu byte chunks\n", tags, chunk);
+    printf("streamed: %zu bytes in %.1fms, %.0f bytes/ms, peak heap %zu bytes, 1 request\n", stream.bytes, stream.ms, stream.bytes / stream.ms,
+           stream.peak);
+    printf("paged:    %zu bytes in %.1fms, %.0f bytes/ms, peak heap %zu bytes, %u requests\n", old.bytes, old.ms, old.bytes / old.ms, old.peak,
+           old.requests);
+    printf("streamed, %u tags: peak heap %zu bytes\n", tags / 10, small.peak);
+    if (stream.peak > small.peak + 1024) {
+        printf("FAIL: the peak heap grows with the number of tags\n");
+        ok = false;
+    }
+
+    bool parsed;
+    std::vector<String> macs = macsOf(body, parsed);
+    if (!parsed || macs.size() != tagDB.size()) {
+        printf("FAIL: %zu of %zu tags in the response\n", macs.size(), tagDB.size());
+        ok = false;
+    }
+
+    // filters against checking every tag
+    struct Case {
+        const char* name;
+        TagFilter filter;
+        std::function<bool(const tagRecord*)> select;
+    };
+    std::vector<Case> cases(5);
+    cases[0] = {"changed since", TagFilter(), [tags](const tagRecord* t) { return t->lastChange >= 1700000000 + tags / 2; }};
+    cases[0].filter.changedSince = 1700000000 + tags / 2;
+    cases[1] = {"hwType", TagFilter(), [](const tagRecord* t) { return t->hwType == 0x21; }};
+    cases[1].filter.hwType = 0x21;
+    cases[2] = {"contentMode", TagFilter(), [](const tagRecord* t) { return t->contentMode == 4; }};
+    cases[2].filter.contentMode = 4;
+    cases[3] = {"low battery", TagFilter(), [](const tagRecord* t) { return t->batteryMv < 2400; }};
+    cases[3].filter.lowBattery = true;
+    cases[4] = {"mac", TagFilter(), [](const tagRecord* t) { return t->mac[0] == 7 && t->mac[1] == 0; }};
+    cases[4].filter.byMac = true;
+    memcpy(cases[4].filter.mac, tagDB[7]->mac, 8);
+    for (const Case& c : cases) {
+        std::set<String> expected;
+        for (const tagRecord* tag : tagDB) {
+            if (c.select(tag)) expected.insert(hexOf(tag));
+        }
+        Body filtered;
+        streamed(c.filter, chunk, filtered);
+        macs = macsOf(filtered, parsed);
+        if (!parsed || std::set<String>(macs.begin(), macs.end()) != expected || macs.size() != expected.size()) {
+            printf("FAIL: filter %s gave %zu tags, expected %zu\n", c.name, macs.size(), expected.size());
+            ok = false;
+        }
+    }
+
+    // every other tag deleted after the first chunk, and new ones added after the second.
+    // deleteRecord moves the last tag into the gap, a writer going by position alone would skip
+    // the moved tags
+    std::set<String> kept;
+    std::vector<std::array<uint8_t, 8>> doomed;
+    for (uint32_t i = 0; i < tagDB.size(); i++) {
+        std::array<uint8_t, 8> mac;
+        memcpy(mac.data(), tagDB[i]->mac, 8);
+        if (i % 2) {
+            doomed.push_back(mac);
+        } else {
+            kept.insert(hexOf(tagDB[i]));
+        }
+    }
+    Body deleting;
+    streamed(TagFilter(), chunk, deleting, [&doomed, &kept](uint32_t n) {
+        if (n == 0) {
+            for (const auto& mac : doomed) deleteRecord(mac.data());
+        } else if (n == 1) {
+            for (uint8_t i = 0; i < 50; i++) {
+                const uint8_t mac[8] = {i, 0x99, 0x11, 0x22, 0x33, 0x44, 0x00, 0x00};
+                kept.insert(hexOf(addRecord(mac)));
+            }
+        }
+    });
+    macs = macsOf(deleting, parsed);
+    const std::set<String> written(macs.begin(), macs.end());
+    uint32_t missing = 0;
+    for (const String& mac : kept) missing += written.count(mac) == 0;
+    const uint32_t repeated = macs.size() - written.size();
+    if (!parsed || missing || repeated) {
+        printf("FAIL: changes during a response left out %u tags and repeated %u\n", missing, repeated);
+        ok = false;
+    }
+
+    destroyDB();
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
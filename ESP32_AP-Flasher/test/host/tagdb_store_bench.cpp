@@ -0,0 +1,268 @@
+// Benchmark of the binary tagDB store in tag_db_bin.cpp against the json database in tag_db.cpp:
+// time and bytes of a full save, of the periodic save after some tags changed, and of a load.
+// The json numbers come from the host ArduinoJson stand-in, its bytes are exact, its times are not
+// ArduinoJson's, and a json save includes the 100 ms saveDB waits before renaming the old file.
+// A binary load reads the file twice, once to check it and once to load it, and once more to
+// copy it to the .bak.
+//
+// Then the recovery paths: a record with a broken crc must not be loaded, the damaged file is
+// moved aside and the copy of the last good load restored; a second copy of a mac must neither
+// overwrite the first one nor survive on disk.
+//
+//   tagdb_store_bench [tags] [saves] [changed tags per save]
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <FS.h>
+#include <rom/crc.h>
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "storage.h"
+#include "system.h"
+#include "tag_db.h"
+#include "web.h"
+
+// what the rest of the AP would provide
+fs::FS* contentFS = &fs::hostFS;
+SemaphoreHandle_t fsMutex = xSemaphoreCreateMutex();
+
+void copyFile(File in, File out) {
+    uint8_t buf[64];
+    size_t n;
+    while ((n = in.read(buf, sizeof(buf))) > 0) out.write(buf, n);
+}
+void logLine(const String&) {}
+void logLine(const char*) {}
+void wsErr(const String&) {}
+void wsLog(const String&) {}
+void wsSendTaginfo(const uint8_t*, uint8_t) {}
+namespace util {
+void printHeap() {}
+}  // namespace util
+
+static const char* BIN_FILE = "/current/tagDB.bin";
+static const char* JSON_FILE = "/current/tagDB.json";
+
+// the same layout as tag_db_bin.cpp, for the file surgery below
+#define SLOT_SIZE 128
+#define SLOT_HEAD 0xA5
+struct slotHead {
+    uint8_t kind;
+    uint8_t slots;
+    uint16_t len;
+    uint32_t crc;
+} __attribute__((packed));
+
+static void fillTags(const uint32_t count) {
+    std::mt19937 rng(1);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t mac[8] = {(uint8_t)i, (uint8_t)(i >> 8), 0x11, 0x22, 0x33, 0x44, 0x00, 0x00};
+        tagRecord* tag = addRecord(mac);
+        uint8_t md5[16];
+        for (uint8_t& b : md5) b = rng();
+        tag->setMd5(md5);
+        tag->setLastseen(1700000000 + rng() % 100000);
+        tag->setNextupdate(1700000000 + rng() % 100000);
+        tag->setExpectedNextCheckin(2000000000);
+        tag->setContentMode(rng() % 30);
+        tag->setLQI(rng());
+        tag->setRSSI(-(int8_t)(rng() % 90));
+        tag->setTemperature(rng() % 30);
+        tag->setBatteryMv(2600 + rng() % 500);
+        tag->setHwType(rng() % 0x40);
+        tag->setCapabilities(rng());
+        tag->setApIp(IPAddress(192, 168, 1, 2));
+        tag->setUpdateCount(rng() % 5000);
+        tag->setUpdateLast(1700000000 + rng() % 100000);
+        tag->setCurrentChannel(11 + rng() % 16);
+        tag->setTagSoftwareVersion(0x19 + rng() % 8);
+        // most tags have an alias and a content configuration, some a long one
+        if (i % 5) tag->setAlias("Shelf " + String(i) + " label");
+        if (i % 7) {
+            String cfg = "{\"location\":\"Amsterdam\",\"units\":\"1\",\"interval\":\"" + String(rng() % 60) + "\"}";
+            if (i % 13 == 0) cfg = "{\"url\":\"https://example.com/calendar/feed/" + String(rng()) + ".ics\",\"title\":\"Meeting room " + String(i) + "\",\"interval\":\"15\"}";
+            tag->setModeConfigJson(cfg);
+        }
+    }
+}
+
+// what a tag checking in changes
+static void touchTags(const uint32_t count, std::mt19937& rng) {
+    for (uint32_t i = 0; i < count; i++) {
+        tagRecord* tag = tagDB[rng() % tagDB.size()];
+        tag->setLastseen(tag->lastseen + 60);
+        tag->setBatteryMv(2600 + rng() % 500);
+        tag->setLQI(rng());
+        tag->setRSSI(-(int8_t)(rng() % 90));
+    }
+}
+
+// every tag as json in mac order, the binary store loads them in slot order
+static String dumpTags() {
+    std::map<String, String> nodes;
+    for (const tagRecord* tag : tagDB) {
+        JsonDocument doc;
+        JsonObject node = doc.to<JsonObject>();
+        // pending and the next checkin are adjusted on load
+        fillNode(node, tag, TAGFIELD_STORED & ~(TAGFIELD_PENDING | TAGFIELD_NEXTCHECKIN));
+        nodes[node["mac"].as<String>()] = doc.as<String>();
+    }
+    String out;
+    for (const auto& node : nodes) out += node.second + "\n";
+    return out;
+}
+
+struct Measure {
+    double ms;
+    uint32_t written;
+    uint32_t read;
+};
+
+template <class F>
+static Measure measure(F work) {
+    const fs::HostFSStats before = fs::hostFS.getStats();
+    const auto start = std::chrono::steady_clock::now();
+    work();
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const fs::HostFSStats after = fs::hostFS.getStats();
+    return {ms, after.bytesWritten - before.bytesWritten, after.bytesRead - before.bytesRead};
+}
+
+static std::vector<uint8_t> readFile(const String& path) {
+    File file = contentFS->open(path, "r");
+    std::vector<uint8_t> data(file.size());
+    file.read(data.data(), data.size());
+    return data;
+}
+
+static void writeFile(const String& path, const std::vector<uint8_t>& data) {
+    File file = contentFS->open(path, "w");
+    file.write(data.data(), data.size());
+}
+
+static int failures = 0;
+
+static void check(const bool ok, const char* what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void testDamaged(const String& saved) {
+    // loadDBbin made the .bak of this file, flip a byte in the first record
+    std::vector<uint8_t> data = readFile(BIN_FILE);
+    size_t pos = SLOT_SIZE;
+    while (pos < data.size() && data[pos] != SLOT_HEAD) pos += SLOT_SIZE;
+    check(pos < data.size(), "no record for the damaged test");
+    if (pos >= data.size()) return;
+    data[pos + sizeof(slotHead) + 8] ^= 0xFF;
+    writeFile(BIN_FILE, data);
+
+    destroyDB();
+    check(loadDBbin(BIN_FILE) == DBBIN_DAMAGED, "a broken record doesn't report a damaged file");
+    check(contentFS->exists(String(BIN_FILE) + ".damaged") && readFile(String(BIN_FILE) + ".damaged") == data,
+          "the damaged file isn't kept as it was");
+    check(dumpTags() == saved, "tagDB doesn't hold the last good copy after a damaged load");
+
+    saveDBbin(BIN_FILE);
+    destroyDB();
+    check(loadDBbin(BIN_FILE) == DBBIN_LOADED && dumpTags() == saved, "the restored store doesn't load");
+}
+
+static void testDuplicate() {
+    // the first tag has a record that fits one slot, no alias or configuration
+    const uint8_t mac[8] = {0, 0, 0x11, 0x22, 0x33, 0x44, 0x00, 0x00};
+    const uint16_t battery = tagRecord::findByMAC(mac)->batteryMv;
+
+    std::vector<uint8_t> data = readFile(BIN_FILE);
+    size_t found = 0;
+    for (size_t pos = SLOT_SIZE; pos + SLOT_SIZE <= data.size(); pos += SLOT_SIZE) {
+        const slotHead* head = reinterpret_cast<const slotHead*>(&data[pos]);
+        if (head->kind == SLOT_HEAD && head->slots == 1 && memcmp(&data[pos + sizeof(slotHead)], mac, 8) == 0) found = pos;
+    }
+    check(found != 0, "no one slot record for the duplicate test");
+    if (!found) return;
+
+    // append a copy with another battery voltage, it sits after the original so it must lose
+    std::vector<uint8_t> copy(data.begin() + found, data.begin() + found + SLOT_SIZE);
+    slotHead* head = reinterpret_cast<slotHead*>(copy.data());
+    uint8_t* record = copy.data() + sizeof(slotHead);
+    // mac, md5, lastseen, nextupdate, expectedNextCheckin, contentMode, LQI, RSSI, temperature
+    const size_t batteryPos = 8 + 16 + 4 + 4 + 4 + 1 + 1 + 1 + 1;
+    const uint16_t other = battery ^ 0x5555;
+    memcpy(record + batteryPos, &other, 2);
+    head->crc = crc32_le(0, record, head->len);
+    data.insert(data.end(), copy.begin(), copy.end());
+    uint32_t slotCount;
+    memcpy(&slotCount, &data[8], 4);
+    slotCount++;
+    memcpy(&data[8], &slotCount, 4);
+    const uint32_t headerCrc = crc32_le(0, data.data(), 16);
+    memcpy(&data[16], &headerCrc, 4);
+    writeFile(BIN_FILE, data);
+
+    destroyDB();
+    check(loadDBbin(BIN_FILE) == DBBIN_LOADED, "a file with a duplicate mac doesn't load");
+    const tagRecord* loaded = tagRecord::findByMAC(mac);
+    check(loaded != nullptr && loaded->batteryMv == battery, "the second copy of a mac overwrote the first");
+    const std::vector<uint8_t> after = readFile(BIN_FILE);
+    check(after.size() == data.size() && after[data.size() - SLOT_SIZE] != SLOT_HEAD, "the second copy wasn't freed on disk");
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    const uint32_t tags = argc > 1 ? atoi(argv[1]) : 1000;
+    const uint32_t saves = argc > 2 ? atoi(argv[2]) : 20;
+    const uint32_t changed = argc > 3 ? atoi(argv[3]) : tags / 20;
+
+    config.maxsleep = 10;
+    fillTags(tags);
+    // the first tag is kept small for the duplicate test
+    tagDB[0]->setAlias("");
+    tagDB[0]->setModeConfigJson("");
+    const String original = dumpTags();
+
+    const Measure jsonSave = measure([] { saveDB(JSON_FILE); });
+    const Measure binSave = measure([] { saveDBbin(BIN_FILE); });
+
+    std::mt19937 rng(2);
+    Measure jsonPeriodic = {0, 0, 0};
+    Measure binPeriodic = {0, 0, 0};
+    for (uint32_t s = 0; s < saves; s++) {
+        touchTags(changed, rng);
+        const Measure b = measure([] { saveDBbin(BIN_FILE); });
+        const Measure j = measure([] { saveDB(JSON_FILE); });
+        binPeriodic = {binPeriodic.ms + b.ms, binPeriodic.written + b.written, 0};
+        jsonPeriodic = {jsonPeriodic.ms + j.ms, jsonPeriodic.written + j.written, 0};
+    }
+    const String saved = dumpTags();
+
+    destroyDB();
+    const Measure jsonLoad = measure([] { loadDB(JSON_FILE); });
+    check(dumpTags() == saved, "the json database doesn't load what was saved");
+    destroyDB();
+    const Measure binLoad = measure([] { check(loadDBbin(BIN_FILE) == DBBIN_LOADED, "the binary store doesn't load"); });
+    check(dumpTags() == saved, "the binary store doesn't load what was saved");
+    check(original != saved, "the periodic saves didn't change anything");
+
+    testDamaged(saved);
+    testDuplicate();
+
+    const size_t jsonBytes = contentFS->open(JSON_FILE, "r").size();
+    const size_t binBytes = contentFS->open(BIN_FILE, "r").size();
+    printf("%u tags, json %zu bytes, binary %zu bytes\n", tags, jsonBytes, binBytes);
+    printf("  full save:  json %8.2f ms %8u bytes written, binary %8.2f ms %8u bytes written\n",
+           jsonSave.ms, jsonSave.written, binSave.ms, binSave.written);
+    printf("  %u saves of %u changed tags, per save:\n", saves, changed);
+    printf("              json %8.2f ms %8u bytes written, binary %8.2f ms %8u bytes written\n",
+           jsonPeriodic.ms / saves, jsonPeriodic.written / saves, binPeriodic.ms / saves, binPeriodic.written / saves);
+    printf("  load:       json %8.2f ms %8u bytes read,    binary %8.2f ms %8u bytes read\n",
+           jsonLoad.ms, jsonLoad.read, binLoad.ms, binLoad.read);
+    destroyDB();
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
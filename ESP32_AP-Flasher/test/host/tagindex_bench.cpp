@@ -0,0 +1,144 @@
+// Lookup and insert/delete latency of the tagDB MAC index against the linear scan it replaced.
+//   tagindex_bench [tag counts...]   (default 100 1000 5000)
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "tagindex.h"
+
+struct Record {
+    uint8_t mac[8];
+};
+
+static uint64_t macKey(const uint8_t mac[8]) {
+    uint64_t key;
+    memcpy(&key, mac, sizeof(key));
+    return key;
+}
+
+// tagDB as before the index: push_back, scan with memcmp, erase in place
+struct LinearDB {
+    std::vector<Record*> records;
+
+    Record* find(const uint8_t mac[8]) {
+        for (Record* record : records) {
+            if (memcmp(record->mac, mac, 8) == 0) return record;
+        }
+        return nullptr;
+    }
+    void add(Record* record) { records.push_back(record); }
+    void erase(const uint8_t mac[8]) {
+        for (auto it = records.begin(); it != records.end(); ++it) {
+            if (memcmp((*it)->mac, mac, 8) == 0) {
+                records.erase(it);
+                return;
+            }
+        }
+    }
+};
+
+// tagDB as tag_db.cpp keeps it: index into the vector, swap with the last record on erase
+struct IndexedDB {
+    std::vector<Record*> records;
+    TagIndex index;
+
+    Record* find(const uint8_t mac[8]) {
+        const uint32_t pos = index.find(macKey(mac));
+        return pos == TagIndex::EMPTY ? nullptr : records[pos];
+    }
+    void add(Record* record) {
+        index.set(macKey(record->mac), records.size());
+        records.push_back(record);
+    }
+    void erase(const uint8_t mac[8]) {
+        const uint32_t pos = index.find(macKey(mac));
+        if (pos == TagIndex::EMPTY) return;
+        index.erase(macKey(mac));
+        const uint32_t last = records.size() - 1;
+        if (pos != last) {
+            records[pos] = records[last];
+            index.set(macKey(records[pos]->mac), pos);
+        }
+        records.pop_back();
+    }
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double nsPer(Clock::time_point start, size_t ops) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ops;
+}
+
+struct Result {
+    double hit, miss, churn;
+    size_t errors;
+};
+
+template <class DB>
+static Result run(std::vector<Record>& records, std::vector<Record>& absent, const size_t ops) {
+    DB db;
+    for (Record& record : records) db.add(&record);
+    Result result = {0, 0, 0, 0};
+    std::mt19937 rng(1);
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        Record& want = records[rng() % records.size()];
+        if (db.find(want.mac) != &want) result.errors++;
+    }
+    result.hit = nsPer(start, ops);
+
+    start = Clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        if (db.find(absent[i % absent.size()].mac) != nullptr) result.errors++;
+    }
+    result.miss = nsPer(start, ops);
+
+    // delete a tag and add it back, as deleteRecord and a new tag checking in do
+    start = Clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        Record& record = records[rng() % records.size()];
+        db.erase(record.mac);
+        db.add(&record);
+    }
+    result.churn = nsPer(start, ops);
+
+    for (Record& record : records) {
+        if (db.find(record.mac) != &record) result.errors++;
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; i++) counts.push_back(strtoul(argv[i], nullptr, 10));
+    if (counts.empty()) counts = {100, 1000, 5000};
+
+    printf("ns per operation\n");
+    printf("%6s  %22s  %22s  %22s\n", "tags", "lookup hit lin/idx", "lookup miss lin/idx", "delete+insert lin/idx");
+    size_t errors = 0;
+    for (const size_t count : counts) {
+        std::mt19937_64 rng(count);
+        std::vector<Record> records(count), absent(256);
+        // real MACs share their upper bytes, only the low ones differ
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t key = 0x0000021800000000ULL | (rng() & 0xffffffffULL);
+            memcpy(records[i].mac, &key, 8);
+        }
+        for (Record& record : absent) {
+            const uint64_t key = 0x0000031800000000ULL | (rng() & 0xffffffffULL);
+            memcpy(record.mac, &key, 8);
+        }
+        const size_t ops = std::max<size_t>(20000, 2000000 / count);
+        const Result linear = run<LinearDB>(records, absent, ops);
+        const Result indexed = run<IndexedDB>(records, absent, ops);
+        errors += linear.errors + indexed.errors;
+        printf("%6zu  %10.1f / %9.1f  %10.1f / %9.1f  %10.1f / %9.1f\n", count,
+               linear.hit, indexed.hit, linear.miss, indexed.miss, linear.churn, indexed.churn);
+    }
+    if (errors) printf("%zu lookups returned the wrong record\n", errors);
+    return errors ? 1 : 0;
+}
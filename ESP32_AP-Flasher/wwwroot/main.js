@@ -196,6 +196,16 @@ function connect() {
 		if (msg.errMsg) {
 			showMessage(msg.errMsg, true);
 		}
+		if (msg.sysMsg) {
+			showMessage(msg.sysMsg, false);
+		}
+		if (msg.logs) {
+			for (const line of msg.logs) {
+				if (line.logMsg) showMessage(line.logMsg, false);
+				if (line.errMsg) showMessage(line.errMsg, true);
+				if (line.sysMsg) showMessage(line.sysMsg, false);
+			}
+		}
 		if (msg.tags) {
 			processTags(msg.tags);
 		}
@@ -268,11 +278,23 @@ function convertSize(bytes) {
 }
 
 function processTags(tagArray) {
-	for (const element of tagArray) {
-		const tagmac = element.mac;
+	for (const update of tagArray) {
+		// websocket updates only carry the fields that changed
+		const tagmac = update.mac;
+		const element = Object.assign(tagDB[tagmac] || {}, update);
 		tagDB[tagmac] = element;
 
 		let div = $('#tag' + tagmac);
+		if (element.contentMode == 255) {
+			// deleted, here or on a remote AP
+			delete tagDB[tagmac];
+			if (div != null) {
+				div.remove();
+				showMessage(tagmac + " removed");
+			}
+			continue;
+		}
+
 		if (div == null) {
 			div = $('#tagtemplate').cloneNode(true);
 			div.setAttribute('id', 'tag' + tagmac);
@@ -283,12 +305,6 @@ function processTags(tagArray) {
 
 		div.style.display = 'block';
 
-		if (element.contentMode == 255) {
-			div.remove();
-			showMessage(tagmac + " removed by remote AP");
-			continue;
-		}
-
 		if (element.isexternal) {
 			$('#tag' + tagmac + ' .mac').innerHTML = tagmac + " via ext AP";
 		} else {
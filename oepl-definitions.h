@@ -115,7 +115,9 @@
 #define DATATYPE_NOUPDATE 0
 #define DATATYPE_IMG_BMP 2			// ** deprecated
 #define DATATYPE_FW_UPDATE 3
-#define DATATYPE_IMG_DIFF 0x10             // always 1BPP ** deprecated
+#define DATATYPE_IMG_DIFF 0x10             // changed rectangle of the previous image (dataVer baseVer), xor'ed with it
+                                                    // [uint8_t header length][uint64_t baseVer][uint16_t x][uint16_t y][uint16_t width][uint16_t height][uint8_t planes][uint8_t payload datatype][payload]
+                                                    // payload: the rectangle as DATATYPE_IMG_ZLIB, DATATYPE_IMG_G5 or DATATYPE_IMG_RAW_*
 #define DATATYPE_IMG_RAW_1BPP 0x20         // 2888 bytes for 1.54"  / 4736 2.9" / 15000 4.2"
 #define DATATYPE_IMG_RAW_2BPP 0x21         // 5776 bytes for 1.54"  / 9472 2.9" / 30000 4.2"
 #define DATATYPE_IMG_RAW_3BPP 0x22         // ACEP
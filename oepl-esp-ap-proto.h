@@ -9,6 +9,12 @@ struct espBlockRequest {
     uint8_t src[8];
 } __packed;
 
+struct espBlockPush {
+    uint8_t checksum;
+    uint64_t ver;
+    uint8_t blockId;
+} __packed;
+
 struct espXferComplete {
     uint8_t checksum;
     uint8_t src[8];
@@ -36,3 +42,48 @@ struct espTagReturnData {
     struct tagReturnData returnData;
 } __packed;
 
+
+// Framed serial protocol. An AP that supports it reports FRM> with the version in its NFO? reply;
+// after FRM! is acknowledged both sides switch from the text commands to frames. Every frame is
+// COBS encoded between two 0x00 delimiters, and carries an espFrameHeader, the payload and a
+// CRC-16/CCITT over both. Commands to the AP are numbered, up to FRAME_WINDOW of them can be in
+// flight, and each one is answered with a FRAME_RESULT. The AP carries them out in order, and
+// asks for a missing one with FRAME_NAK.
+#define FRAME_PROTOCOL_VERSION 2
+#define FRAME_WINDOW 8     // commands in flight
+#define FRAME_MAX_BATCH 8  // pendingData entries in one SDA or CXD frame
+
+// ESP32 to AP, answered by a FRAME_RESULT
+#define FRAME_SDA 0x01    // pendingData[]
+#define FRAME_CXD 0x02    // pendingData[]
+#define FRAME_SCP 0x03    // espSetChannelPower
+#define FRAME_BLOCK 0x04  // espBlockPush naming the requested block, followed by blockData
+#define FRAME_BKP 0x05    // espBlockPush followed by blockData
+#define FRAME_PING 0x06
+// AP to ESP32
+#define FRAME_RESULT 0x10  // espFrameResult
+#define FRAME_NAK 0x11     // sequence number of the command that didn't arrive
+#define FRAME_RQB 0x12     // espBlockRequest
+#define FRAME_ADR 0x13     // espAvailDataReq
+#define FRAME_XFC 0x14     // espXferComplete
+#define FRAME_XTO 0x15     // espXferComplete
+#define FRAME_TRD 0x16     // espTagReturnData
+
+#define FRAME_STATUS_ACK 0x01
+#define FRAME_STATUS_NOK 0x02
+#define FRAME_STATUS_NOQ 0x03  // no room in the AP's pending data
+
+#define FRAME_MAX_PAYLOAD (sizeof(struct espBlockPush) + sizeof(struct blockData) + BLOCK_DATA_SIZE)
+#define FRAME_MAX_SIZE (sizeof(struct espFrameHeader) + FRAME_MAX_PAYLOAD + 2)
+#define FRAME_MAX_ENCODED (FRAME_MAX_SIZE + FRAME_MAX_SIZE / 254 + 1)
+
+struct espFrameHeader {
+    uint8_t type;
+    uint8_t seq;
+    uint8_t base;  // oldest sequence number the sender may still send again
+} __packed;
+
+struct espFrameResult {
+    uint8_t seq;
+    uint8_t status[];  // one for every command in the frame
+} __packed;